@@ -1,7 +1,10 @@
 #include <stdbool.h>
+#include <string.h>
 
 #include <glib.h>
 
+#include "common/macro.h"
+#include "common/morestring.h"
 #include "ccargs.h"
 
 
@@ -24,3 +27,199 @@ bool CC_can_run_remotely (char **cc_argv[], char **cc_envp[]) {
   }
   return true;
 }
+
+
+/**
+ * @brief Tests if `arg` names a C or C++ source file.
+ */
+static bool CC__is_source (const char *arg) {
+  static const char *extensions[] = {
+    ".c", ".cc", ".cp", ".cxx", ".cpp", ".CPP", ".c++", ".C", ".i", ".ii",
+  };
+  const char *ext = strrchr(arg, '.');
+  return_if(ext == NULL) false;
+  for (unsigned int i = 0; i < G_N_ELEMENTS(extensions); i++) {
+    return_if(strcmp(ext, extensions[i]) == 0) true;
+  }
+  return false;
+}
+
+
+/**
+ * @brief Tests if `arg` is an option of dependency output which takes a
+ *        separate argument.
+ */
+static bool CC__is_dependency_option (const char *arg) {
+  static const char *options[] = {"-MF", "-MT", "-MQ"};
+  for (unsigned int i = 0; i < G_N_ELEMENTS(options); i++) {
+    return_if(strcmp(arg, options[i]) == 0) true;
+  }
+  return false;
+}
+
+
+/**
+ * @brief Gets the object file the compiler writes for `source` if no `-o` is
+ *        given, relative to its working directory.
+ *
+ * @param source the source file
+ * @return the object file [transfer-full]
+ */
+static char *CC__default_object (const char *source) {
+  char *basename = g_path_get_basename(source);
+  *strrchr(basename, '.') = '\0';
+  char *object = g_strconcat(basename, ".o", NULL);
+  g_free(basename);
+  return object;
+}
+
+
+/**
+ * @brief Finds the source and object file of `cc_argv`.
+ *
+ * @param cc_argv compiler's argument vector [array zero-terminated=1]
+ * @param[out] source the source file, as in `cc_argv`
+ * @param[out] object the object file, as in `cc_argv`, or `NULL` if not given
+ * @return `true` if `cc_argv` compiles exactly one source file into one object
+ *         file, without writing any other file than the dependency file
+ */
+static bool CC__parse (
+    char * const cc_argv[], const char **source, const char **object) {
+  // options followed by a separate argument
+  static const char *separate_options[] = {
+    "-x", "-D", "-U", "-I", "-iquote", "-isystem", "-idirafter", "-include",
+    "-imacros", "-Xpreprocessor", "-Xassembler", "-aux-info", "--param",
+  };
+  // options which produce other files, or read files not seen by the
+  // preprocessor
+  static const char *rejected_prefixes[] = {
+    "-E", "-S", "-save-temps", "--coverage", "-ftest-coverage",
+    "-fprofile-", "-fauto-profile", "-gsplit-dwarf", "-fdump-", "-Wl,",
+    "-Xlinker", "-fplugin", "-specs",
+  };
+  // options which output dependencies instead of the object file
+  static const char *rejected_options[] = {"-M", "-MM"};
+
+  bool compile_only = false;
+  *source = NULL;
+  *object = NULL;
+
+  for (int i = 1; cc_argv[i] != NULL; i++) {
+    const char *arg = cc_argv[i];
+
+    if (arg[0] != '-') {
+      // response files, linker inputs or several sources
+      return_if(arg[0] == '@' || !CC__is_source(arg) || *source != NULL) false;
+      *source = arg;
+      continue;
+    }
+
+    return_if(arg[1] == '\0') false;
+    if (strcmp(arg, "-c") == 0) {
+      compile_only = true;
+      continue;
+    }
+    if (strscmp(arg, "-o") == 0) {
+      *object = arg[2] != '\0' ? arg + 2 : cc_argv[++i];
+      return_if(*object == NULL) false;
+      continue;
+    }
+    for (unsigned int j = 0; j < G_N_ELEMENTS(rejected_prefixes); j++) {
+      return_if(strscmp(arg, rejected_prefixes[j]) == 0) false;
+    }
+    for (unsigned int j = 0; j < G_N_ELEMENTS(rejected_options); j++) {
+      return_if(strcmp(arg, rejected_options[j]) == 0) false;
+    }
+    if (CC__is_dependency_option(arg)) {
+      i++;
+      return_if(cc_argv[i] == NULL) false;
+      continue;
+    }
+    for (unsigned int j = 0; j < G_N_ELEMENTS(separate_options); j++) {
+      if (strcmp(arg, separate_options[j]) == 0) {
+        i++;
+        return_if(cc_argv[i] == NULL) false;
+        break;
+      }
+    }
+  }
+  return compile_only && *source != NULL;
+}
+
+
+bool CC_is_cacheable (
+    char * const cc_argv[], const char *working_directory, char **output) {
+  const char *source;
+  const char *object;
+  return_if_fail(CC__parse(cc_argv, &source, &object)) false;
+
+  if (object == NULL) {
+    char *filename = CC__default_object(source);
+    *output = g_build_filename(working_directory, filename, NULL);
+    g_free(filename);
+  } else {
+    *output = g_path_is_absolute(object) ?
+      g_strdup(object) : g_build_filename(working_directory, object, NULL);
+  }
+  return true;
+}
+
+
+char **CC_preprocess_argv (char * const cc_argv[], bool deps) {
+  GPtrArray *argv = g_ptr_array_new();
+  g_ptr_array_add(argv, g_strdup(cc_argv[0]));
+  bool has_deps = false;
+  bool has_file = false;
+  bool has_target = false;
+  for (int i = 1; cc_argv[i] != NULL; i++) {
+    const char *arg = cc_argv[i];
+    if (strcmp(arg, "-c") == 0) {
+      g_ptr_array_add(argv, g_strdup("-E"));
+    } else if (strcmp(arg, "-o") == 0) {
+      i++;
+    } else if (strscmp(arg, "-M") == 0) {
+      // dependency output does not change the object file
+      bool separate = CC__is_dependency_option(arg) && cc_argv[i + 1] != NULL;
+      if (deps) {
+        has_deps |= strcmp(arg, "-MD") == 0 || strcmp(arg, "-MMD") == 0;
+        has_file |= strscmp(arg, "-MF") == 0;
+        has_target |= strscmp(arg, "-MT") == 0 || strscmp(arg, "-MQ") == 0;
+        g_ptr_array_add(argv, g_strdup(arg));
+        if (separate) {
+          g_ptr_array_add(argv, g_strdup(cc_argv[i + 1]));
+        }
+      }
+      if (separate) {
+        i++;
+      }
+    } else if (strscmp(arg, "-o") != 0) {
+      g_ptr_array_add(argv, g_strdup(arg));
+    }
+  }
+
+  const char *source;
+  const char *object;
+  if (has_deps && (!has_file || !has_target) &&
+      CC__parse(cc_argv, &source, &object)) {
+    // `-o` is dropped, so name them after the object file as the compiler
+    // would
+    char *target =
+      object == NULL ? CC__default_object(source) : g_strdup(object);
+    if (!has_file) {
+      const char *dot = strrchr(target, '.');
+      const char *slash = strrchr(target, '/');
+      size_t len = dot != NULL && (slash == NULL || dot > slash) ?
+        (size_t) (dot - target) : strlen(target);
+      g_ptr_array_add(argv, g_strdup("-MF"));
+      g_ptr_array_add(argv, g_strdup_printf("%.*s.d", (int) len, target));
+    }
+    if (!has_target) {
+      g_ptr_array_add(argv, g_strdup("-MQ"));
+      g_ptr_array_add(argv, g_strdup(target));
+    }
+    g_free(target);
+  }
+
+  g_ptr_array_add(argv, NULL);
+  return (char **) g_ptr_array_free(argv, FALSE);
+}
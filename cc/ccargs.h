@@ -17,6 +17,31 @@
  * @return `true` if `cc_argv` is suitable for remote compilation
  */
 bool CC_can_run_remotely (char **cc_argv[], char **cc_envp[]);
+/**
+ * @brief Tests if `cc_argv` compiles exactly one source file into one object
+ *        file, without writing any other file than the dependency file, so
+ *        that its result can be cached.
+ *
+ * @param cc_argv compiler's argument vector [array zero-terminated=1]
+ * @param working_directory compiler's working directory
+ * @param[out] output absolute path to the object file [transfer-full]
+ * @return `true` if the result of `cc_argv` can be cached
+ */
+bool CC_is_cacheable (
+  char * const cc_argv[], const char *working_directory, char **output);
+/**
+ * @brief Makes an argument vector which preprocesses the source file of
+ *        `cc_argv` to stdout, for a `cc_argv` accepted by CC_is_cacheable().
+ *
+ * With `deps`, options of dependency output such as `-MD` are kept, with the
+ * dependency file and target made explicit, so that the preprocessor writes
+ * the same dependency file as the compiler would. Otherwise they are dropped.
+ *
+ * @param cc_argv compiler's argument vector [array zero-terminated=1]
+ * @param deps whether to keep dependency output
+ * @return the new argument vector [array zero-terminated=1][transfer-full]
+ */
+char **CC_preprocess_argv (char * const cc_argv[], bool deps);
 
 
 /**@}*/
@@ -0,0 +1,307 @@
+#include <stdbool.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "common/macro.h"
+#include "common/morestring.h"
+#include "common/wrapper/mappedfile.h"
+#include "includescan.h"
+
+
+/**
+ * @ingroup CC
+ * @brief Contains the state of an include scan.
+ */
+struct IncludeScanner {
+  /// Compiler's working directory.
+  const char *working_directory;
+  /// Directories searched for quoted includes only. [element-type filename]
+  GPtrArray *quote_dirs;
+  /// Directories searched for all includes. [element-type filename]
+  GPtrArray *dirs;
+  /// Found files. [element-type filename]
+  GHashTable *files;
+  /// Paths known not to exist. [element-type filename]
+  GHashTable *misses;
+  /// Found files yet to be scanned. [element-type filename]
+  GQueue pending;
+};
+
+
+/**
+ * @memberof IncludeScanner
+ * @brief Makes `path` absolute against the working directory.
+ *
+ * @return the absolute path [transfer-full]
+ */
+static char *IncludeScanner__absolute (
+    struct IncludeScanner *scanner, const char *path) {
+  return g_path_is_absolute(path) ?
+    g_strdup(path) :
+    g_build_filename(scanner->working_directory, path, NULL);
+}
+
+
+/**
+ * @memberof IncludeScanner
+ * @brief Records `path` if it exists.
+ *
+ * @param scanner an IncludeScanner
+ * @param path an absolute path [transfer-full]
+ * @return `true` if the file exists
+ */
+static bool IncludeScanner_add (
+    struct IncludeScanner *scanner, char *path) {
+  if (g_hash_table_contains(scanner->files, path)) {
+    g_free(path);
+    return true;
+  }
+  if (g_hash_table_contains(scanner->misses, path)) {
+    g_free(path);
+    return false;
+  }
+  should (g_file_test(path, G_FILE_TEST_IS_REGULAR)) otherwise {
+    g_hash_table_add(scanner->misses, path);
+    return false;
+  }
+  should (g_hash_table_size(scanner->files) <
+          CC_SCAN_INCLUDES_MAX_FILES) otherwise {
+    g_free(path);
+    return true;
+  }
+  g_hash_table_add(scanner->files, path);
+  g_queue_push_tail(&scanner->pending, path);
+  return true;
+}
+
+
+/**
+ * @memberof IncludeScanner
+ * @brief Searches for an included file.
+ *
+ * @param scanner an IncludeScanner
+ * @param name the name in the directive
+ * @param quote_dir directory of the including file if `name` is quoted,
+ *                  otherwise NULL
+ * @param self the including file if the directive is `#include_next`,
+ *             otherwise NULL
+ */
+static void IncludeScanner_resolve (
+    struct IncludeScanner *scanner, const char *name, const char *quote_dir,
+    const char *self) {
+  if (g_path_is_absolute(name)) {
+    IncludeScanner_add(scanner, g_strdup(name));
+    return;
+  }
+
+  if (quote_dir != NULL) {
+    return_if(IncludeScanner_add(
+      scanner, g_build_filename(quote_dir, name, NULL)));
+    for (guint i = 0; i < scanner->quote_dirs->len; i++) {
+      return_if(IncludeScanner_add(scanner, g_build_filename(
+        g_ptr_array_index(scanner->quote_dirs, i), name, NULL)));
+    }
+  }
+  for (guint i = 0; i < scanner->dirs->len; i++) {
+    char *path = g_build_filename(
+      g_ptr_array_index(scanner->dirs, i), name, NULL);
+    if (self != NULL && strcmp(path, self) == 0) {
+      g_free(path);
+      continue;
+    }
+    return_if(IncludeScanner_add(scanner, path));
+  }
+}
+
+
+/**
+ * @memberof IncludeScanner
+ * @brief Skips spaces and tabs.
+ */
+static inline const char *IncludeScanner__skip_blank (
+    const char *p, const char *end) {
+  while (p < end && (*p == ' ' || *p == '\t')) {
+    p++;
+  }
+  return p;
+}
+
+
+/**
+ * @memberof IncludeScanner
+ * @brief Scans a file for `#include` directives.
+ *
+ * @param scanner an IncludeScanner
+ * @param path an absolute path
+ */
+static void IncludeScanner_scan (
+    struct IncludeScanner *scanner, const char *path) {
+  struct MappedFile m;
+  return_if_fail(MappedFile_init(&m, path, NULL) == 0);
+  char *dir = g_path_get_dirname(path);
+
+  const char *end = m.content + m.length;
+  for (const char *line = m.content; line < end;) {
+    const char *eol = memchr(line, '\n', end - line);
+    if (eol == NULL) {
+      eol = end;
+    }
+
+    do_once {
+      const char *p = IncludeScanner__skip_blank(line, eol);
+      break_if_not(p < eol && *p == '#');
+      p = IncludeScanner__skip_blank(p + 1, eol);
+      break_if_not(eol - p > 7 && memcmp(p, "include", 7) == 0);
+      p += 7;
+      bool next = eol - p > 5 && memcmp(p, "_next", 5) == 0;
+      if (next) {
+        p += 5;
+      }
+      p = IncludeScanner__skip_blank(p, eol);
+      // computed includes are not supported
+      break_if_not(p < eol && (*p == '"' || *p == '<'));
+      bool quoted = *p == '"';
+      const char *name = p + 1;
+      const char *name_end = memchr(name, quoted ? '"' : '>', eol - name);
+      break_if_not(name_end != NULL && name_end > name);
+
+      char *s_name = g_strndup(name, name_end - name);
+      IncludeScanner_resolve(
+        scanner, s_name, quoted && !next ? dir : NULL, next ? path : NULL);
+      g_free(s_name);
+    }
+
+    line = eol + 1;
+  }
+
+  g_free(dir);
+  MappedFile_destroy(&m);
+}
+
+
+/**
+ * @memberof IncludeScanner
+ * @brief Tests if `arg` names a source file.
+ */
+static bool IncludeScanner__is_source (const char *arg) {
+  static const char *extensions[] = {
+    ".c", ".cc", ".cp", ".cxx", ".cpp", ".CPP", ".c++", ".C",
+    ".m", ".mm", ".M", ".S", ".sx",
+  };
+  const char *ext = strrchr(arg, '.');
+  return_if(ext == NULL) false;
+  for (unsigned int i = 0; i < G_N_ELEMENTS(extensions); i++) {
+    return_if(strcmp(ext, extensions[i]) == 0) true;
+  }
+  return false;
+}
+
+
+GHashTable *CC_scan_includes (
+    char * const cc_argv[], const char *working_directory) {
+  static const char *system_dirs[] = {"/usr/local/include", "/usr/include"};
+  // options followed by a separate argument which is not a path we need
+  static const char *skipped_options[] = {
+    "-o", "-x", "-D", "-U", "-MF", "-MT", "-MQ", "-Xlinker", "-Xassembler",
+    "-Xpreprocessor", "-L", "-l", "-T", "-u", "-aux-info", "-imacros",
+  };
+
+  struct IncludeScanner scanner = {
+    .working_directory = working_directory,
+    .quote_dirs = g_ptr_array_new_with_free_func(g_free),
+    .dirs = g_ptr_array_new_with_free_func(g_free),
+    .files = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL),
+    .misses = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL),
+  };
+  g_queue_init(&scanner.pending);
+
+  GPtrArray *system = g_ptr_array_new_with_free_func(g_free);
+  GPtrArray *after = g_ptr_array_new_with_free_func(g_free);
+  GPtrArray *forced = g_ptr_array_new_with_free_func(g_free);
+  GPtrArray *sources = g_ptr_array_new_with_free_func(g_free);
+  bool nostdinc = false;
+
+#define option_value(option) \
+  (strcmp(arg, option) == 0 ? cc_argv[++i] : arg + strlen(option))
+
+  for (int i = 1; cc_argv[i] != NULL; i++) {
+    const char *arg = cc_argv[i];
+    const char *value = NULL;
+    GPtrArray *target = NULL;
+
+    if (arg[0] != '-') {
+      if (IncludeScanner__is_source(arg)) {
+        g_ptr_array_add(sources, IncludeScanner__absolute(&scanner, arg));
+      }
+      continue;
+    }
+
+    if (strcmp(arg, "-nostdinc") == 0) {
+      nostdinc = true;
+    } else if (strscmp(arg, "-iquote") == 0) {
+      value = option_value("-iquote");
+      target = scanner.quote_dirs;
+    } else if (strscmp(arg, "-isystem") == 0) {
+      value = option_value("-isystem");
+      target = system;
+    } else if (strscmp(arg, "-idirafter") == 0) {
+      value = option_value("-idirafter");
+      target = after;
+    } else if (strcmp(arg, "-include") == 0) {
+      value = cc_argv[++i];
+      target = forced;
+    } else if (strscmp(arg, "-I") == 0) {
+      value = option_value("-I");
+      target = scanner.dirs;
+    } else {
+      for (unsigned int j = 0; j < G_N_ELEMENTS(skipped_options); j++) {
+        if (strcmp(arg, skipped_options[j]) == 0) {
+          i++;
+          break;
+        }
+      }
+    }
+
+    break_if(value == NULL && target != NULL);
+    if (target != NULL) {
+      g_ptr_array_add(target, IncludeScanner__absolute(&scanner, value));
+    }
+    break_if(cc_argv[i] == NULL);
+  }
+
+#undef option_value
+
+  // search order: -I, -isystem, system directories, -idirafter
+  for (guint i = 0; i < system->len; i++) {
+    g_ptr_array_add(scanner.dirs, g_strdup(g_ptr_array_index(system, i)));
+  }
+  if (!nostdinc) {
+    for (unsigned int i = 0; i < G_N_ELEMENTS(system_dirs); i++) {
+      g_ptr_array_add(scanner.dirs, g_strdup(system_dirs[i]));
+    }
+  }
+  for (guint i = 0; i < after->len; i++) {
+    g_ptr_array_add(scanner.dirs, g_strdup(g_ptr_array_index(after, i)));
+  }
+
+  for (guint i = 0; i < sources->len; i++) {
+    IncludeScanner_add(&scanner, g_strdup(g_ptr_array_index(sources, i)));
+  }
+  for (guint i = 0; i < forced->len; i++) {
+    IncludeScanner_add(&scanner, g_strdup(g_ptr_array_index(forced, i)));
+  }
+
+  for (const char *path; (path = g_queue_pop_head(&scanner.pending)) != NULL;) {
+    IncludeScanner_scan(&scanner, path);
+  }
+
+  g_ptr_array_free(system, TRUE);
+  g_ptr_array_free(after, TRUE);
+  g_ptr_array_free(forced, TRUE);
+  g_ptr_array_free(sources, TRUE);
+  g_ptr_array_free(scanner.quote_dirs, TRUE);
+  g_ptr_array_free(scanner.dirs, TRUE);
+  g_hash_table_destroy(scanner.misses);
+  return scanner.files;
+}
@@ -0,0 +1,37 @@
+#ifndef DFCC_CC_INCLUDESCAN_H
+#define DFCC_CC_INCLUDESCAN_H
+
+#include <gmodule.h>
+
+#include "common/cdecls.h"
+
+BEGIN_C_DECLS
+
+
+/// @ingroup CC
+/// Maximum number of files collected by CC_scan_includes().
+#define CC_SCAN_INCLUDES_MAX_FILES 8192
+
+
+/**
+ * @ingroup CC
+ * @brief Finds the files a compiler invocation may read, by scanning
+ *        `#include` directives of its source files.
+ *
+ * The scan is a best-effort approximation: conditional compilation is
+ * ignored, computed includes are skipped, and only the standard system
+ * include directories are searched besides those given in `cc_argv`.
+ * Paths are built the way the compiler would open them, without
+ * canonicalization.
+ *
+ * @param cc_argv compiler's argument vector [array zero-terminated=1]
+ * @param working_directory compiler's working directory
+ * @return a set of absolute paths of found files [transfer-full]
+ */
+GHashTable *CC_scan_includes (
+  char * const cc_argv[], const char *working_directory);
+
+
+END_C_DECLS
+
+#endif /* DFCC_CC_INCLUDESCAN_H */
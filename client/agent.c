@@ -0,0 +1,402 @@
+#include <signal.h>
+#include <stdbool.h>
+
+#include <gio/gio.h>
+#include <gio/gunixsocketaddress.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <libsoup/soup.h>
+
+#include "common/macro.h"
+#include "common/wrapper/file.h"
+#include "common/wrapper/gvariant.h"
+#include "config/config.h"
+#include "cc/resultinfo.h"
+#include "log.h"
+#include "race.h"
+#include "remote.h"
+#include "agent.h"
+
+
+/// Maximum length of a serialized request from a client.
+#define Agent_MAX_REQUEST_SIZE (16 * 1024 * 1024)
+/// Maximum length of a serialized response from the agent.
+#define Agent_MAX_RESPONSE_SIZE (64 * 1024)
+/// Maximum number of jobs run at the same time; later ones wait in a queue.
+#define Agent_MAX_THREADS 64
+/// Maximum number of connections kept open to a single server.
+#define Agent_MAX_CONNS_PER_HOST Agent_MAX_THREADS
+/// Seconds after which an idle keep-alive connection is closed.
+#define Agent_IDLE_TIMEOUT 600
+
+
+/**
+ * @brief Long-lived state shared by all jobs of the agent.
+ */
+struct Agent {
+  const struct Config *config;
+  /// Shared sessions to each server, which own the pools of keep-alive
+  /// connections.
+  SoupSession **sessions;
+  GSocketService *service;
+};
+
+
+static GMainLoop *agent_loop;
+
+
+/**
+ * @brief Callback when receives `SIGINT` or `SIGTERM` signal.
+ *
+ * Quit loop.
+ *
+ * @param sig signal
+ */
+static void Agent_quit (int sig) {
+  g_main_loop_quit(agent_loop);
+}
+
+
+/**
+ * @memberof Agent
+ * @private
+ * @brief Asks the client whether the job may write its outputs.
+ *
+ * @param race a Race
+ * @param id index of the contender
+ * @param userdata the GIOStream to the client
+ * @return `true` if the client has not taken another result
+ */
+static bool Agent__claim (struct Race *race, int id, void *userdata) {
+  GIOStream *connection = userdata;
+  GError *error = NULL;
+  GVariant *answer = NULL;
+  if (g_output_stream_write_variant(
+      g_io_stream_get_output_stream(connection),
+      g_variant_new("(i@a{sv})", DFCC_AGENT_STATUS_CLAIM,
+                    g_variant_new_array(G_VARIANT_TYPE("{sv}"), NULL, 0)),
+      NULL, &error)) {
+    answer = g_input_stream_read_variant(
+      g_io_stream_get_input_stream(connection), G_VARIANT_TYPE_BOOLEAN,
+      Agent_MAX_RESPONSE_SIZE, NULL, &error);
+  }
+  should (answer != NULL) otherwise {
+    g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_DEBUG,
+          "Client gone before claim: %s", error->message);
+    g_error_free(error);
+    return false;
+  }
+  bool claimed = g_variant_get_boolean(answer);
+  g_variant_unref(answer);
+  return claimed;
+}
+
+
+/**
+ * @memberof Agent
+ * @private
+ * @brief Callback when the client hangs up.
+ *
+ * @param socket a GSocket
+ * @param condition the condition
+ * @param user_data a GCancellable to cancel
+ * @return `G_SOURCE_REMOVE`
+ */
+static gboolean Agent__hangup (
+    GSocket *socket, GIOCondition condition, gpointer user_data) {
+  g_cancellable_cancel(G_CANCELLABLE(user_data));
+  return G_SOURCE_REMOVE;
+}
+
+
+/**
+ * @memberof Agent
+ * @private
+ * @brief Run the remote leg of a job the client races against a local
+ *        compiler.
+ *
+ * The client is asked before outputs are written, and the job is cancelled
+ * when the client goes away.
+ *
+ * @param agent an Agent
+ * @param connection the connection to the client
+ * @param config a Config
+ * @param[out] result a ResultInfo
+ * @return 0 if success, otherwise non-zero
+ */
+static int Agent_run_contending (
+    struct Agent *agent, GSocketConnection *connection,
+    const struct Config *config, struct ResultInfo * restrict result,
+    char * const remote_argv[], char * const remote_envp[]) {
+  struct Race race;
+  Race_init(&race);
+  race.claim = Agent__claim;
+  race.userdata = connection;
+  struct RemoteContender contender;
+  RemoteContender_init(&contender, &race, 0, NULL);
+
+  // watched by the main loop of the agent
+  GSource *source = g_socket_create_source(
+    g_socket_connection_get_socket(connection), G_IO_HUP | G_IO_ERR, NULL);
+  g_source_set_callback(
+    source, (GSourceFunc) Agent__hangup, g_object_ref(contender.cancellable),
+    g_object_unref);
+  g_source_attach(source, NULL);
+
+  int status = Client_run_remotely_contending(
+    agent->sessions, config, result, remote_argv, remote_envp, &contender);
+
+  g_source_destroy(source);
+  g_source_unref(source);
+  if (g_cancellable_is_cancelled(contender.cancellable)) {
+    // release the job slot on the server
+    RemoteContender_cancel(&contender);
+  }
+  RemoteContender_destroy(&contender);
+  Race_destroy(&race);
+  return status;
+}
+
+
+/**
+ * @memberof Agent
+ * @private
+ * @brief Run a job forwarded by a client. Called in a worker thread.
+ */
+static gboolean Agent_run (
+    GThreadedSocketService *service, GSocketConnection *connection,
+    GObject *source_object, gpointer user_data) {
+  struct Agent *agent = user_data;
+  GInputStream *istream = g_io_stream_get_input_stream(G_IO_STREAM(connection));
+  GOutputStream *ostream =
+    g_io_stream_get_output_stream(G_IO_STREAM(connection));
+  GError *error = NULL;
+
+  GVariant *request = g_input_stream_read_variant(
+    istream, G_VARIANT_TYPE(DFCC_AGENT_REQUEST_SIGNATURE),
+    Agent_MAX_REQUEST_SIZE, NULL, &error);
+  should (request != NULL) otherwise {
+    g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_WARNING,
+          "Cannot read request from client: %s", error->message);
+    g_error_free(error);
+    return FALSE;
+  }
+
+  const char **cc_argv;
+  const char **cc_envp;
+  const char *cc_working_directory;
+  GVariant *settings;
+  g_variant_get(request, "(^a&s^a&s&s@a{sv})",
+                &cc_argv, &cc_envp, &cc_working_directory, &settings);
+
+  struct Config config = *agent->config;
+  config.cc_working_directory = (char *) cc_working_directory;
+  // the client omits zero settings, such as `--no-prescan`, so those the
+  // agent was started with must not leak into the job
+  StructInfo_clear(&config, Config__info);
+  g_variant_get_struct(settings, &config, Config__info);
+  gboolean claim = FALSE;
+  g_variant_lookup(settings, DFCC_AGENT_SETTING_CLAIM, "b", &claim);
+  g_variant_unref(settings);
+
+  g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_DEBUG,
+        "Run job '%s' in '%s'", cc_argv[0], cc_working_directory);
+
+  struct ResultInfo result = {0};
+  int status = claim ?
+    Agent_run_contending(
+      agent, connection, &config, &result,
+      (char * const *) cc_argv, (char * const *) cc_envp) :
+    Client_run_remotely_with_sessions(
+      agent->sessions, &config, &result,
+      (char * const *) cc_argv, (char * const *) cc_envp);
+
+  g_free(cc_argv);
+  g_free(cc_envp);
+  g_variant_unref(request);
+
+  should (g_output_stream_write_variant(
+      ostream, g_variant_new(
+        "(i@a{sv})", status, g_variant_new_struct(&result, ResultInfo__info)),
+      NULL, &error)) otherwise {
+    g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_WARNING,
+          "Cannot send response to client: %s", error->message);
+    g_error_free(error);
+  }
+  return FALSE;
+}
+
+
+/**
+ * @memberof Agent
+ * @brief Frees associated resources of an Agent.
+ *
+ * @param agent an Agent
+ */
+static void Agent_destroy (struct Agent *agent) {
+  g_socket_service_stop(agent->service);
+  g_socket_listener_close(G_SOCKET_LISTENER(agent->service));
+  g_object_unref(agent->service);
+  g_unlink(agent->config->agent_socket);
+  Client_free_sessions(agent->sessions);
+}
+
+
+/**
+ * @memberof Agent
+ * @brief Initializes an Agent and listens on Config.agent_socket.
+ *
+ * @param agent an Agent
+ * @param config a Config
+ * @param[out] error a return location for a #GError, or `NULL`
+ * @return 0 if success, otherwize nonzero
+ */
+static int Agent_init (
+    struct Agent *agent, const struct Config *config, GError **error) {
+  agent->config = config;
+
+  // prepare socket
+  char *socket_dir = g_path_get_dirname(config->agent_socket);
+  int ret = g_mkdir_with_parents_e(socket_dir, 0700, error);
+  g_free(socket_dir);
+  return_if_fail(ret == 0) 1;
+  // remove stale socket
+  g_unlink(config->agent_socket);
+
+  agent->service = g_threaded_socket_service_new(Agent_MAX_THREADS);
+  GSocketAddress *address = g_unix_socket_address_new(config->agent_socket);
+  gboolean listened = g_socket_listener_add_address(
+    G_SOCKET_LISTENER(agent->service), address, G_SOCKET_TYPE_STREAM,
+    G_SOCKET_PROTOCOL_DEFAULT, NULL, NULL, error);
+  g_object_unref(address);
+  should (listened) otherwise {
+    g_object_unref(agent->service);
+    return 1;
+  }
+  g_signal_connect(agent->service, "run", G_CALLBACK(Agent_run), agent);
+
+  // prepare connection pools, before they are shared by workers
+  agent->sessions = Client_new_sessions(config);
+  for (int i = 0; agent->sessions[i] != NULL; i++) {
+    g_object_set(
+      agent->sessions[i],
+      SOUP_SESSION_MAX_CONNS_PER_HOST, Agent_MAX_CONNS_PER_HOST,
+      SOUP_SESSION_IDLE_TIMEOUT, Agent_IDLE_TIMEOUT,
+      NULL);
+    SoupURI *uri = soup_uri_new(config->server_list[i].baseurl);
+    if (uri != NULL) {
+      soup_session_prefetch_dns(
+        agent->sessions[i], uri->host, NULL, NULL, NULL);
+      soup_uri_free(uri);
+    }
+  }
+
+  return 0;
+}
+
+
+int Agent_start (struct Config *config) {
+  struct Agent agent;
+  GError *error = NULL;
+
+  should (Agent_init(&agent, config, &error) == 0) otherwise {
+    g_printerr("Unable to start agent: %s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  g_socket_service_start(agent.service);
+  g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_MESSAGE,
+        "Agent listening on %s", config->agent_socket);
+
+  agent_loop = g_main_loop_new(NULL, TRUE);
+  signal(SIGINT, Agent_quit);
+  signal(SIGTERM, Agent_quit);
+  g_main_loop_run(agent_loop);
+
+  g_main_loop_unref(agent_loop);
+  Agent_destroy(&agent);
+  return 0;
+}
+
+
+int Client_run_by_agent (
+    const struct Config *config, struct ResultInfo * restrict result,
+    char * const remote_argv[], char * const remote_envp[],
+    struct RemoteContender *contender) {
+  return_if_fail(g_file_test(config->agent_socket, G_FILE_TEST_EXISTS)) -1;
+
+  GError *error = NULL;
+  GSocketClient *client = g_socket_client_new();
+  GSocketAddress *address = g_unix_socket_address_new(config->agent_socket);
+  GSocketConnection *connection = g_socket_client_connect(
+    client, G_SOCKET_CONNECTABLE(address), NULL, &error);
+  g_object_unref(address);
+  g_object_unref(client);
+  should (connection != NULL) otherwise {
+    g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_DEBUG,
+          "Agent not available: %s", error->message);
+    g_error_free(error);
+    return -1;
+  }
+
+  GCancellable *cancellable = NULL;
+  GVariant *settings = g_variant_new_struct(config, Config__info);
+  if (contender != NULL) {
+    cancellable = contender->cancellable;
+    GVariantDict dict;
+    g_variant_dict_init(&dict, g_variant_ref_sink(settings));
+    g_variant_unref(settings);
+    g_variant_dict_insert(&dict, DFCC_AGENT_SETTING_CLAIM, "b", TRUE);
+    settings = g_variant_dict_end(&dict);
+  }
+
+  int ret = -1;
+  do_once {
+    break_if_fail(g_output_stream_write_variant(
+      g_io_stream_get_output_stream(G_IO_STREAM(connection)),
+      g_variant_new("(^as^ass@a{sv})", remote_argv, remote_envp,
+                    config->cc_working_directory, settings),
+      cancellable, &error));
+    // the job may have been submitted, so do not let the caller run it again
+    ret = 1;
+
+    while (true) {
+      GVariant *response = g_input_stream_read_variant(
+        g_io_stream_get_input_stream(G_IO_STREAM(connection)),
+        G_VARIANT_TYPE(DFCC_AGENT_RESPONSE_SIGNATURE),
+        Agent_MAX_RESPONSE_SIZE, cancellable, &error);
+      break_if_fail(response != NULL);
+
+      int status;
+      GVariant *info;
+      g_variant_get(response, "(i@a{sv})", &status, &info);
+      g_variant_unref(response);
+      if (status != DFCC_AGENT_STATUS_CLAIM) {
+        ret = status;
+        g_variant_get_struct(info, result, ResultInfo__info);
+        g_variant_unref(info);
+        break;
+      }
+      g_variant_unref(info);
+
+      // the agent is about to write the outputs
+      gboolean claimed = contender != NULL &&
+        Race_claim(contender->race, contender->id);
+      break_if_fail(g_output_stream_write_variant(
+        g_io_stream_get_output_stream(G_IO_STREAM(connection)),
+        g_variant_new_boolean(claimed), cancellable, &error));
+    }
+  }
+
+  if (error != NULL) {
+    // cancelled if another contender has won
+    if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+      g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_WARNING,
+            "Cannot communicate with agent: %s", error->message);
+    }
+    g_error_free(error);
+  }
+  g_object_unref(connection);
+  return ret;
+}
@@ -0,0 +1,54 @@
+#ifndef DFCC_CLIENT_AGENT_H
+#define DFCC_CLIENT_AGENT_H
+/**
+ * @addtogroup Client
+ * @{
+ */
+
+#include "config/config.h"
+#include "cc/resultinfo.h"
+#include "remote.h"
+
+
+/// [argv], [envp], working directory, settings
+#define DFCC_AGENT_REQUEST_SIGNATURE "(asassa{sv})"
+/// status, ResultInfo
+#define DFCC_AGENT_RESPONSE_SIGNATURE "(ia{sv})"
+/// Setting asking the agent to request a claim before writing outputs.
+#define DFCC_AGENT_SETTING_CLAIM "agent-claim"
+/// Status of a response asking the client whether the job may write its
+/// outputs; the client answers with a `b` frame.
+#define DFCC_AGENT_STATUS_CLAIM (-2)
+
+
+/**
+ * @brief Start the client agent.
+ *
+ * The agent listens on Config.agent_socket and runs jobs forwarded by
+ * short-lived clients, sharing one SoupSession so that connections to the
+ * servers are kept alive across compiler invocations.
+ *
+ * @param config a Config
+ * @return the exit status
+ */
+int Agent_start (struct Config *config);
+/**
+ * @brief Forward the job to the client agent, if there is one.
+ *
+ * If `contender` is given, the agent asks for Race_claim() before it writes
+ * the outputs, and cancelling RemoteContender.cancellable drops the job.
+ *
+ * @param config a Config
+ * @param contender a RemoteContender [nullable]
+ * @return -1 if the agent is not available and the job has not been sent,
+ *         0 if success, otherwise nonzero, also when the agent went away
+ *         after the job was sent
+ */
+int Client_run_by_agent (
+  const struct Config *config, struct ResultInfo * restrict result,
+  char * const remote_argv[], char * const remote_envp[],
+  struct RemoteContender *contender);
+
+
+/**@}*/
+#endif /* DFCC_CLIENT_AGENT_H */
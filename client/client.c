@@ -1,37 +1,71 @@
+#include <stdbool.h>
+
 #include <glib.h>
 
 #include "common/macro.h"
 #include "cc/ccargs.h"
 #include "cc/resultinfo.h"
+#include "agent.h"
+#include "jobserver.h"
 #include "log.h"
 #include "prepost.h"
 #include "local.h"
+#include "race.h"
 #include "remote.h"
 #include "client.h"
 
 
 int Client_start (struct Config *config) {
-  return_if(Client_pre(config) == 0) 0;
+  struct ResultInfo pre_result = {0};
+  return_if(Client_pre(config, &pre_result) == 0) 0;
 
   struct ResultInfo result = {0};
   int ret = 1;
+  bool done = false;
 
   char **remote_argv = g_strdupv(config->cc_argv);
   char **remote_envp = g_strdupv(config->cc_envp);
   if likely (CC_can_run_remotely(&remote_argv, &remote_envp)) {
-    if (Client_run_remotely(config, &result, remote_argv, remote_envp) == 0) {
-      ret = 0;
+    if (config->race_local) {
+      // the raced local compiler is also the fallback
+      ret = Client_run_raced(config, &result, remote_argv, remote_envp);
+      done = true;
     } else {
-      g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_WARNING, "Remote compile failed, fallback to local");
+      // let make start other jobs while we are waiting for the servers
+      struct Jobserver jobserver;
+      bool has_jobserver = Jobserver_init(
+        &jobserver, g_environ_getenv(config->cc_envp, "MAKEFLAGS")) == 0;
+      if (has_jobserver) {
+        Jobserver_lend(&jobserver);
+      }
+
+      int remote_ret = Client_run_by_agent(
+        config, &result, remote_argv, remote_envp, NULL);
+      if (remote_ret < 0) {
+        remote_ret = Client_run_remotely(
+          config, &result, remote_argv, remote_envp);
+      }
+
+      if (has_jobserver) {
+        // take a token back before compiling locally or exiting
+        Jobserver_destroy(&jobserver);
+      }
+      if (remote_ret == 0) {
+        ret = 0;
+      } else {
+        g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_WARNING, "Remote compile failed, fallback to local");
+      }
     }
   }
   g_strfreev(remote_argv);
   g_strfreev(remote_envp);
 
-  if (ret != 0) {
+  if (ret != 0 && !done) {
     ret = Client_run_locally(config, &result);
   }
 
-  Client_post(config, &result);
+  // hashes known before the compiler run
+  result.preprocessed_hash = pre_result.preprocessed_hash;
+  Client_post(config, &result, ret);
   return ret;
 }
@@ -1,7 +1,17 @@
+#include <stdbool.h>
+#include <string.h>
+
 #include <libsoup/soup.h>
 #include <glib.h>
 
+#include "common/macro.h"
+#include "common/morestring.h"
+#include "common/wrapper/file.h"
 #include "config/serverurl.h"
+#include "file/hash.h"
+#include "server/protocol.h"
+#include "log.h"
+#include "remote.h"
 #include "detect.h"
 
 
@@ -17,141 +27,496 @@ static const struct RPCResponseFormat info_response_format[] = {
   {"Nproc-online", G_VARIANT_TYPE_INT32},
   {"Jobs", G_VARIANT_TYPE_INT32},
   {"Current-jobs", G_VARIANT_TYPE_INT32},
+  {"Hash", G_VARIANT_TYPE_STRING},
+};
+
+
+gint64 ServerLoad_cost (const struct ServerLoad *load) {
+  return_if_not(load->available) G_MAXINT64;
+  return_if(load->jobs <= 0) load->rtt + ServerLoad_JOB_TIME;
+  // jobs share the cores of the server
+  return load->rtt +
+    ServerLoad_JOB_TIME * (load->current_jobs + 1) / load->jobs;
+}
+
+
+/**
+ * @memberof ServerLoad
+ * @brief Reads a ServerLoad from the cache.
+ *
+ * @param load a ServerLoad
+ * @param cache the cache
+ * @param baseurl the server
+ * @return `true` if found, even if stale
+ */
+static bool ServerLoad_init_from_cache (
+    struct ServerLoad *load, GKeyFile *cache, const char *baseurl) {
+  return_if_not(g_key_file_has_group(cache, baseurl)) false;
+
+  GError *error = NULL;
+  load->updated = g_key_file_get_int64(cache, baseurl, "Updated", &error);
+  load->available =
+    g_key_file_get_boolean(cache, baseurl, "Available", &error);
+  load->jobs = g_key_file_get_integer(cache, baseurl, "Jobs", &error);
+  load->current_jobs =
+    g_key_file_get_integer(cache, baseurl, "Current-jobs", &error);
+  load->rtt = g_key_file_get_int64(cache, baseurl, "RTT", &error);
+  should (error == NULL) otherwise {
+    g_error_free(error);
+    return false;
+  }
+  return true;
+}
+
+
+/**
+ * @memberof ServerLoad
+ * @brief Checks whether a ServerLoad is recent enough to be trusted.
+ *
+ * @param load a ServerLoad
+ * @param now current wall-clock time, in microseconds
+ * @return `true` if not stale
+ */
+static inline bool ServerLoad_is_fresh (
+    const struct ServerLoad *load, gint64 now) {
+  return now >= load->updated &&
+         now - load->updated < ServerLoad_TTL * G_TIME_SPAN_SECOND;
+}
+
+
+//! @memberof ServerLoad
+static void ServerLoad_save_to_cache (
+    const struct ServerLoad *load, GKeyFile *cache, const char *baseurl) {
+  g_key_file_set_int64(cache, baseurl, "Updated", load->updated);
+  g_key_file_set_boolean(cache, baseurl, "Available", load->available);
+  g_key_file_set_integer(cache, baseurl, "Jobs", load->jobs);
+  g_key_file_set_integer(cache, baseurl, "Current-jobs", load->current_jobs);
+  g_key_file_set_int64(cache, baseurl, "RTT", load->rtt);
+}
+
+
+/**
+ * @brief Submissions to a server not yet saved to the server load cache.
+ */
+struct ServerLoadNote {
+  /// Wall-clock time when the cache was last written, in microseconds.
+  gint64 saved;
+  /// Number of jobs accepted since.
+  int accepted;
 };
 
 
-// purly informative, the real dispatch follows a try-fail approach.
-bool Client_detect_server (
+/// Lock for the server load cache file within the process.
+static GMutex Client__server_load_mtx;
+/// Signaled when a background query finishes.
+static GCond Client__server_probe_cond;
+/// Servers being queried in the background, protected by
+/// Client__server_load_mtx [element-type utf8]
+static GHashTable *Client__server_probing;
+/// Unsaved submissions by server, protected by Client__server_load_mtx
+/// [element-type utf8 ServerLoadNote]
+static GHashTable *Client__server_load_notes;
+
+
+/**
+ * @brief Get the path to the shared server load cache.
+ *
+ * @return the path [transfer-full]
+ */
+static char *Client__server_load_cache_path (void) {
+  // servers of another algorithm are available to clients using it
+  char *filename = FileHash_algorithm == FileHash_XXH64 ?
+    g_strdup(DFCC_SERVER_LOAD_FILENAME) :
+    g_strconcat(DFCC_SERVER_LOAD_FILENAME ".",
+                FileHash_algorithm_names[FileHash_algorithm], NULL);
+  char *path = g_build_filename(
+    g_get_user_runtime_dir(), DFCC_NAME, filename, NULL);
+  g_free(filename);
+  return path;
+}
+
+
+/**
+ * @brief Load the shared server load cache.
+ *
+ * @return the cache, empty if not exists [transfer-full]
+ */
+static GKeyFile *Client__load_server_load_cache (void) {
+  GKeyFile *cache = g_key_file_new();
+  char *path = Client__server_load_cache_path();
+  g_key_file_load_from_file(cache, path, G_KEY_FILE_NONE, NULL);
+  g_free(path);
+  return cache;
+}
+
+
+/**
+ * @brief Save the shared server load cache.
+ *
+ * The file is replaced atomically. Concurrent updates from other clients may
+ * be lost, which only makes the cache a little staler.
+ *
+ * @param cache the cache
+ */
+static void Client__save_server_load_cache (GKeyFile *cache) {
+  char *path = Client__server_load_cache_path();
+  char *dir = g_path_get_dirname(path);
+  GError *error = NULL;
+  should (g_mkdir_with_parents_e(dir, 0700, &error) == 0 &&
+          g_key_file_save_to_file(cache, path, &error)) otherwise {
+    g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_DEBUG,
+          "Cannot save server load cache: %s", error->message);
+    g_error_free(error);
+  }
+  g_free(dir);
+  g_free(path);
+}
+
+
+int Client_detect_server (
     SoupSession *session, const struct ServerURL *server_url,
-    SoupURI **baseurl) {
-  Client_setup_session(session, server_url);
-  SoupURI *url = soup_uri_new(server_url->baseurl);
+    struct ServerLoad *load) {
+  load->available = false;
+  load->jobs = 0;
+  load->current_jobs = 0;
+  load->rtt = 0;
+  load->updated = g_get_real_time();
 
+  SoupURI *url = soup_uri_new(server_url->baseurl);
   SoupURI *infourl = soup_uri_new_with_base(url, DFCC_INFO_PATH);
+  soup_uri_free(url);
   SoupMessage *msg = soup_message_new_from_uri("GET", infourl);
   soup_uri_free(infourl);
-  soup_session_send_message(session, msg);
 
-  do_once {
-    if (msg->status_code != SOUP_STATUS_OK) {
-      g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_INFO,
-            "Server %s not responsing", server_url->baseurl);
-      g_object_unref(msg);
-      break;
-    }
+  gint64 start = g_get_monotonic_time();
+  soup_session_send_message(session, msg);
+  load->rtt = g_get_monotonic_time() - start;
 
-    GError *error = NULL;
-    GVariant *server_info = soup_xmlrpc_parse_response(
-      msg->response_body->data, msg->response_body->length,
-      DFCC_RPC_INFO_RESPONSE_SIGNATURE, &error);
+  should (msg->status_code == SOUP_STATUS_OK) otherwise {
+    g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_INFO,
+          "Server %s not responsing", server_url->baseurl);
     g_object_unref(msg);
+    return 1;
+  }
 
-    should (server_info != NULL) otherwise {
-      if (error->domain == SOUP_XMLRPC_FAULT) {
-        g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_MESSAGE,
-              "Server %s report fault: %d %s",
-              server_url->baseurl, error->code, error->message);
-      } else {
-        g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_MESSAGE,
-              "Error when parsing response from server %s: %s",
-              server_url->baseurl, error->message);
-      }
-      g_error_free(error);
-      break;
+  GError *error = NULL;
+  GVariant *server_info = soup_xmlrpc_parse_response(
+    msg->response_body->data, msg->response_body->length,
+    DFCC_RPC_INFO_RESPONSE_SIGNATURE, &error);
+  g_object_unref(msg);
+
+  should (server_info != NULL) otherwise {
+    if (error->domain == SOUP_XMLRPC_FAULT) {
+      g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_MESSAGE,
+            "Server %s report fault: %d %s",
+            server_url->baseurl, error->code, error->message);
+    } else {
+      g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_MESSAGE,
+            "Error when parsing response from server %s: %s",
+            server_url->baseurl, error->message);
     }
+    g_error_free(error);
+    return 1;
+  }
+
+  GVariantIter iter;
+  gchar *key;
+  GVariant *value;
+  for (g_variant_iter_init(&iter, server_info);
+       g_variant_iter_next(&iter, "{sv}", &key, &value);) {
+    const GVariantType *value_type = g_variant_get_type(value);
 
-    int jobs;
-
-    GVariantIter iter;
-    gchar *key;
-    GVariant *value;
-    for (g_variant_iter_init(&iter, server_info);
-         g_variant_iter_next(&iter, "{sv}", &key, &value);) {
-      const GVariantType *value_type = g_variant_get_type(value);
-
-      int i;
-      for (i = 0; i < G_N_ELEMENTS(info_response_format); i++) {
-        if (strcmp(key, info_response_format[i].name) == 0) {
-          should (g_variant_type_is_subtype_of(
-              value_type, info_response_format[i].type)) otherwise {
-            gchar *expected_value_type_string =
-              g_variant_type_dup_string(info_response_format[i].type);
-            g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_MESSAGE,
-                  "Item '%s' from server %s should have type '%s', got '%s'",
-                  key, server_url->baseurl,
-                  expected_value_type_string, g_variant_get_type_string(value));
-            g_free(expected_value_type_string);
-            goto unexpected;
-          }
-          break;
+    unsigned int i;
+    for (i = 0; i < G_N_ELEMENTS(info_response_format); i++) {
+      if (strcmp(key, info_response_format[i].name) == 0) {
+        should (g_variant_type_is_subtype_of(
+            value_type, info_response_format[i].type)) otherwise {
+          gchar *expected_value_type_string =
+            g_variant_type_dup_string(info_response_format[i].type);
+          g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_MESSAGE,
+                "Item '%s' from server %s should have type '%s', got '%s'",
+                key, server_url->baseurl,
+                expected_value_type_string, g_variant_get_type_string(value));
+          g_free(expected_value_type_string);
+          goto unexpected;
         }
+        break;
       }
+    }
 
-      switch (i) {
-        case 0: {
-          const gchar *server_version = g_variant_get_string(value, NULL);
-          should (strscmp(server_version, DFCC_NAME "/") == 0) otherwise {
-            g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_MESSAGE, "Unexpected server %s: %s",
-                  server_url->baseurl, server_version);
-            goto unexpected;
-          }
-          g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_DEBUG, "Server: %s", server_version);
-          break;
-        }
-        case 1: {
-          int nprocs_conf = g_variant_get_int32(value);
-          g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_DEBUG,
-                "Server has %d core(s) configured", nprocs_conf);
-          break;
-        }
-        case 2: {
-          int nprocs_onln = g_variant_get_int32(value);
-          g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_DEBUG,
-                "Server has %d core(s) online", nprocs_onln);
-          break;
+    switch (i) {
+      case 0: {
+        const gchar *server_version = g_variant_get_string(value, NULL);
+        should (strscmp(server_version, DFCC_NAME "/") == 0) otherwise {
+          g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_MESSAGE,
+                "Unexpected server %s: %s",
+                server_url->baseurl, server_version);
+          goto unexpected;
         }
-        case 3: {
-          jobs = g_variant_get_int32(value);
-          g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_DEBUG,
-                "Server can has %d job(s)", jobs);
-          break;
-        }
-        case 4: {
-          int current_jobs = g_variant_get_int32(value);
-          g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_DEBUG,
-                "Server currently has %d job(s)", current_jobs);
-          if (current_jobs >= jobs) {
-            g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_INFO,
-                  "Server %s is full", server_url->baseurl);
-            goto unexpected;
-          }
-          break;
+        g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_DEBUG,
+              "Server: %s", server_version);
+        break;
+      }
+      case 1: {
+        int nprocs_conf = g_variant_get_int32(value);
+        g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_DEBUG,
+              "Server has %d core(s) configured", nprocs_conf);
+        break;
+      }
+      case 2: {
+        int nprocs_onln = g_variant_get_int32(value);
+        g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_DEBUG,
+              "Server has %d core(s) online", nprocs_onln);
+        break;
+      }
+      case 3: {
+        load->jobs = g_variant_get_int32(value);
+        g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_DEBUG,
+              "Server can has %d job(s)", load->jobs);
+        break;
+      }
+      case 4: {
+        load->current_jobs = g_variant_get_int32(value);
+        g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_DEBUG,
+              "Server currently has %d job(s)", load->current_jobs);
+        break;
+      }
+      case 5: {
+        const gchar *hash = g_variant_get_string(value, NULL);
+        // hashes from different algorithms cannot be compared
+        should (strcmp(
+            hash, FileHash_algorithm_names[FileHash_algorithm]) == 0
+        ) otherwise {
+          g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_MESSAGE,
+                "Server %s uses hash algorithm '%s', but we use '%s'",
+                server_url->baseurl, hash,
+                FileHash_algorithm_names[FileHash_algorithm]);
+          goto unexpected;
         }
-        default:
-          g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_MESSAGE, "Item '%s' has type '%s'", key,
-                g_variant_get_type_string (value));
+        break;
       }
+      default:
+        g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_DEBUG,
+              "Item '%s' has type '%s'", key,
+              g_variant_get_type_string(value));
+    }
 
-      g_variant_unref(value);
-      g_free(key);
-      continue;
+    g_variant_unref(value);
+    g_free(key);
+    continue;
 
 unexpected:
-      g_variant_unref(value);
-      g_free(key);
-      goto fail;
+    g_variant_unref(value);
+    g_free(key);
+    g_variant_unref(server_info);
+    return 1;
+  }
+  g_variant_unref(server_info);
+
+  load->available = true;
+  g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_DEBUG,
+        "Server %s has load %d/%d, RTT %" G_GINT64_FORMAT " us",
+        server_url->baseurl, load->current_jobs, load->jobs, load->rtt);
+  return 0;
+}
+
+
+/**
+ * @brief Contains a query of the load of a server, run in its own thread.
+ */
+struct ServerProbe {
+  SoupSession *session;
+  /// Only ServerURL.baseurl is set.
+  struct ServerURL server_url;
+  /// Whether nobody waits for the result.
+  bool background;
+  struct ServerLoad load;
+};
+
+
+//! @memberof ServerProbe
+static void ServerProbe_free (struct ServerProbe *probe) {
+  g_object_unref(probe->session);
+  g_free(probe->server_url.baseurl);
+  g_free(probe);
+}
+
+
+/**
+ * @memberof ServerProbe
+ * @brief Queries the server and saves its load into the cache.
+ *
+ * @param data a ServerProbe
+ * @return `data`, or `NULL` if freed because nobody waits for it
+ */
+static gpointer ServerProbe_run (gpointer data) {
+  struct ServerProbe *probe = data;
+  Client_detect_server(probe->session, &probe->server_url, &probe->load);
+
+  g_mutex_lock(&Client__server_load_mtx);
+  GKeyFile *cache = Client__load_server_load_cache();
+  ServerLoad_save_to_cache(&probe->load, cache, probe->server_url.baseurl);
+  Client__save_server_load_cache(cache);
+  g_key_file_free(cache);
+  if (probe->background) {
+    g_hash_table_remove(Client__server_probing, probe->server_url.baseurl);
+    g_cond_broadcast(&Client__server_probe_cond);
+  }
+  g_mutex_unlock(&Client__server_load_mtx);
+
+  return_if_not(probe->background) probe;
+  ServerProbe_free(probe);
+  return NULL;
+}
+
+
+/**
+ * @memberof ServerProbe
+ * @brief Starts querying the load of a server in a new thread.
+ *
+ * The thread holds its own references, so it may outlive `session` and
+ * `server_url`. Detached threads are waited for by
+ * Client_wait_server_probes().
+ *
+ * @param session a SoupSession set up for `server_url`
+ * @param server_url a ServerURL
+ * @param background `true` to detach the thread
+ * @return the thread, whose result is the ServerProbe to be freed, or `NULL`
+ *         if `background`
+ */
+static GThread *ServerProbe_start (
+    SoupSession *session, const struct ServerURL *server_url,
+    bool background) {
+  if (background) {
+    // one background query per server is enough
+    g_mutex_lock(&Client__server_load_mtx);
+    if (Client__server_probing == NULL) {
+      Client__server_probing =
+        g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    }
+    bool probing =
+      g_hash_table_contains(Client__server_probing, server_url->baseurl);
+    if (!probing) {
+      g_hash_table_add(Client__server_probing, g_strdup(server_url->baseurl));
     }
+    g_mutex_unlock(&Client__server_load_mtx);
+    return_if(probing) NULL;
+  }
 
-    if (baseurl != NULL) {
-      *baseurl = url;
+  struct ServerProbe *probe = g_new0(struct ServerProbe, 1);
+  probe->session = g_object_ref(session);
+  probe->server_url.baseurl = g_strdup(server_url->baseurl);
+  probe->background = background;
+  GThread *thread = g_thread_new(DFCC_NAME "-probe", ServerProbe_run, probe);
+  return_if_not(background) thread;
+  g_thread_unref(thread);
+  return NULL;
+}
+
+
+int *Client_rank_servers (
+    SoupSession * const sessions[], const struct ServerURL server_list[]) {
+  int n_servers = 0;
+  while (server_list[n_servers].baseurl != NULL) {
+    n_servers++;
+  }
+  int *order = g_new(int, n_servers + 1);
+  order[0] = -1;
+  return_if(n_servers == 0) order;
+
+  struct ServerLoad loads[n_servers];
+  GThread *probes[n_servers];
+  g_mutex_lock(&Client__server_load_mtx);
+  GKeyFile *cache = Client__load_server_load_cache();
+  g_mutex_unlock(&Client__server_load_mtx);
+  gint64 now = g_get_real_time();
+  for (int i = 0; i < n_servers; i++) {
+    probes[i] = NULL;
+    if (ServerLoad_init_from_cache(loads + i, cache, server_list[i].baseurl)) {
+      // rank by the stale load, and refresh it for later jobs
+      if (!ServerLoad_is_fresh(loads + i, now)) {
+        ServerProbe_start(sessions[i], server_list + i, true);
+      }
     } else {
-      soup_uri_free(url);
+      // nothing known, query all such servers at once
+      probes[i] = ServerProbe_start(sessions[i], server_list + i, false);
     }
+  }
+  g_key_file_free(cache);
+  for (int i = 0; i < n_servers; i++) {
+    continue_if(probes[i] == NULL);
+    struct ServerProbe *probe = g_thread_join(probes[i]);
+    loads[i] = probe->load;
+    ServerProbe_free(probe);
+  }
 
-    return true;
+  // stable insertion sort, ties are kept in configured order
+  int n_available = 0;
+  for (int i = 0; i < n_servers; i++) {
+    // unreachable, or using another hash algorithm
+    continue_if_not(loads[i].available);
+    gint64 cost = ServerLoad_cost(loads + i);
+    int j;
+    for (j = n_available;
+         j > 0 && ServerLoad_cost(loads + order[j - 1]) > cost; j--) {
+      order[j] = order[j - 1];
+    }
+    order[j] = i;
+    n_available++;
   }
+  order[n_available] = -1;
+  return order;
+}
 
-fail:
-  soup_uri_free(url);
-  return false;
+
+void Client_note_server_load (const struct ServerURL *server_url, bool full) {
+  g_mutex_lock(&Client__server_load_mtx);
+  if (Client__server_load_notes == NULL) {
+    Client__server_load_notes =
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  }
+  struct ServerLoadNote *note =
+    g_hash_table_lookup(Client__server_load_notes, server_url->baseurl);
+  if (note == NULL) {
+    note = g_new0(struct ServerLoadNote, 1);
+    g_hash_table_insert(
+      Client__server_load_notes, g_strdup(server_url->baseurl), note);
+  }
+  if (!full) {
+    note->accepted++;
+  }
+
+  // the file is shared by all clients, do not rewrite it for every job; a
+  // full server is worth telling at once
+  gint64 now = g_get_real_time();
+  if (full || now - note->saved >= ServerLoad_TTL * G_TIME_SPAN_SECOND) {
+    GKeyFile *cache = Client__load_server_load_cache();
+    struct ServerLoad load;
+    if (ServerLoad_init_from_cache(&load, cache, server_url->baseurl) &&
+        ServerLoad_is_fresh(&load, now)) {
+      load.current_jobs += note->accepted;
+      if (full) {
+        load.current_jobs = max(load.current_jobs, load.jobs);
+      }
+      ServerLoad_save_to_cache(&load, cache, server_url->baseurl);
+      Client__save_server_load_cache(cache);
+    }
+    g_key_file_free(cache);
+    note->saved = now;
+    note->accepted = 0;
+  }
+  g_mutex_unlock(&Client__server_load_mtx);
+}
+
+
+void Client_wait_server_probes (void) {
+  gint64 end_time =
+    g_get_monotonic_time() + ServerLoad_PROBE_TIMEOUT * G_TIME_SPAN_SECOND;
+  g_mutex_lock(&Client__server_load_mtx);
+  while (Client__server_probing != NULL &&
+         g_hash_table_size(Client__server_probing) > 0) {
+    break_if_not(g_cond_wait_until(
+      &Client__server_probe_cond, &Client__server_load_mtx, end_time));
+  }
+  g_mutex_unlock(&Client__server_load_mtx);
 }
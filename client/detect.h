@@ -1,5 +1,11 @@
 #ifndef DFCC_CLIENT_DETECT_H
 #define DFCC_CLIENT_DETECT_H
+/**
+ * @addtogroup Client
+ * @{
+ */
+
+#include <stdbool.h>
 
 #include <libsoup/soup.h>
 #include <glib.h>
@@ -7,9 +13,94 @@
 #include "config/serverurl.h"
 
 
-bool Client_detect_server (
-    SoupSession *session, const struct ServerURL *server_url,
-    SoupURI **baseurl);
+/// Time after which a cached ServerLoad is considered stale, in seconds.
+#define ServerLoad_TTL 5
+/**
+ * @brief Rough estimation of the time of a compiling job, in microseconds.
+ *
+ * Used to weigh the load of a server against its round-trip time.
+ */
+#define ServerLoad_JOB_TIME (500 * G_TIME_SPAN_MILLISECOND)
+/// Time to wait for background queries of server load on exit, in seconds.
+#define ServerLoad_PROBE_TIMEOUT 2
+
+
+/**
+ * @brief Contains the load of a server, as reported by its info page.
+ */
+struct ServerLoad {
+  /// Whether the server responded.
+  bool available;
+  /// Maximum number of concurrent jobs, 0 if unknown.
+  int jobs;
+  /// Number of running jobs.
+  int current_jobs;
+  /// Round-trip time of the info request, in microseconds.
+  gint64 rtt;
+  /// Wall-clock time when the load was measured, in microseconds.
+  gint64 updated;
+};
+
+
+/**
+ * @memberof ServerLoad
+ * @brief Estimates the time for a new job to complete on the server.
+ *
+ * @param load a ServerLoad
+ * @return the cost in microseconds, or `G_MAXINT64` if the server is
+ *         unavailable
+ */
+gint64 ServerLoad_cost (const struct ServerLoad *load);
+
+
+/**
+ * @brief Query the load of a server.
+ *
+ * @param session a SoupSession set up for `server_url`
+ * @param server_url a ServerURL
+ * @param[out] load a return location for the load of the server
+ * @return 0 if success, otherwise non-zero
+ */
+int Client_detect_server (
+  SoupSession *session, const struct ServerURL *server_url,
+  struct ServerLoad *load);
+/**
+ * @brief Sort servers by the expected completion time of a new job.
+ *
+ * The load of servers is cached for @ref ServerLoad_TTL seconds in the user
+ * runtime directory, and shared by all clients of the user. Stale entries are
+ * still used for ranking, and refreshed in the background for later calls.
+ * Only servers never seen before are waited for, and are queried in
+ * parallel.
+ *
+ * Unavailable servers, including those using another hash algorithm, are
+ * left out.
+ *
+ * @param sessions sessions to each server, from Client_new_sessions()
+ * @param server_list a list of ServerURL, terminated by an entry with NULL
+ *                    `baseurl`
+ * @return indexes into `server_list`, terminated by -1 [transfer-full]
+ */
+int *Client_rank_servers (
+  SoupSession * const sessions[], const struct ServerURL server_list[]);
+/**
+ * @brief Record the result of a submission in the shared cache, so that other
+ *        clients see the new load before the server is queried again.
+ *
+ * Accepted jobs are saved at most once per @ref ServerLoad_TTL for each
+ * server; until then they are only counted in memory.
+ *
+ * @param server_url a ServerURL
+ * @param full `true` if the server rejected the job as full, `false` if the
+ *             job was accepted
+ */
+void Client_note_server_load (const struct ServerURL *server_url, bool full);
+/**
+ * @brief Wait for background queries of server load to save their results,
+ *        for at most @ref ServerLoad_PROBE_TIMEOUT seconds.
+ */
+void Client_wait_server_probes (void);
 
 
+/**@}*/
 #endif /* DFCC_CLIENT_DETECT_H */
@@ -0,0 +1,304 @@
+#include <stdbool.h>
+
+#include <gio/gio.h>
+#include <libsoup/soup.h>
+#include <glib.h>
+
+#include "common/macro.h"
+#include "common/wrapper/gvariant.h"
+#include "server/protocol.h"
+#include "log.h"
+#include "eventhub.h"
+
+
+/// Key of the EventHub in the data of a SoupSession.
+#define EventHub_KEY "dfcc-event-hub"
+
+
+/**
+ * @brief Events of a single job, as received by an EventHub.
+ */
+struct EventQueue {
+  /// Pending job status, as in @ref DFCC_RPC_QUERY_RESPONSE_SIGNATURE.
+  GQueue *responses;
+  /// Monotonic time when the queue was created.
+  gint64 since;
+  /// Whether a job is waiting for the events.
+  bool claimed;
+  /// EventHub.generation when the queue was claimed.
+  unsigned int generation;
+};
+
+
+//! @memberof EventQueue
+static void EventQueue_free (gpointer data) {
+  struct EventQueue *queue = (struct EventQueue *) data;
+  g_queue_free_full(queue->responses, (GDestroyNotify) g_variant_unref);
+  g_free(queue);
+}
+
+
+/**
+ * @memberof EventHub
+ * @private
+ * @brief Gets the EventQueue of a job, creating it if needed.
+ *
+ * Events may arrive before the job subscribes, so unknown jobs get a queue
+ * too; those nobody claims are dropped after @ref EventHub_ORPHAN_TIMEOUT.
+ *
+ * Must be called with the mutex held.
+ *
+ * @param hub an EventHub
+ * @param jid job ID
+ * @return an EventQueue
+ */
+static struct EventQueue *EventHub__queue (struct EventHub *hub, GPid jid) {
+  struct EventQueue *queue =
+    g_hash_table_lookup(hub->queues, GUINT_TO_POINTER(jid));
+  return_if(queue != NULL) queue;
+
+  gint64 now = g_get_monotonic_time();
+  GHashTableIter iter;
+  g_hash_table_iter_init(&iter, hub->queues);
+  struct EventQueue *orphan;
+  while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &orphan)) {
+    if (!orphan->claimed &&
+        now - orphan->since > EventHub_ORPHAN_TIMEOUT * G_USEC_PER_SEC) {
+      g_hash_table_iter_remove(&iter);
+    }
+  }
+
+  queue = g_new(struct EventQueue, 1);
+  queue->responses = g_queue_new();
+  queue->since = now;
+  queue->claimed = false;
+  queue->generation = 0;
+  g_hash_table_insert(hub->queues, GUINT_TO_POINTER(jid), queue);
+  return queue;
+}
+
+
+/**
+ * @memberof EventHub
+ * @private
+ * @brief Reads the event stream and dispatches events by jid, until the
+ *        stream breaks.
+ *
+ * @param data an EventHub
+ * @return `NULL`
+ */
+static gpointer EventHub__read (gpointer data) {
+  struct EventHub *hub = (struct EventHub *) data;
+  g_mutex_lock(&hub->mtx);
+  GInputStream *stream = g_object_ref(hub->stream);
+  g_mutex_unlock(&hub->mtx);
+
+  while (true) {
+    GError *error = NULL;
+    GVariant *event = g_input_stream_read_variant(
+      stream, G_VARIANT_TYPE(DFCC_EVENT_SIGNATURE), DFCC_EVENT_MAX_SIZE,
+      hub->cancellable, &error);
+    should (event != NULL) otherwise {
+      g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_INFO,
+            "Event stream broken: %s", error->message);
+      g_error_free(error);
+      break;
+    }
+
+    guint32 jid;
+    guchar type;
+    GVariant *response;
+    g_variant_get(event, "(uy@" DFCC_RPC_QUERY_RESPONSE_SIGNATURE ")",
+                  &jid, &type, &response);
+    g_variant_unref(event);
+    if (type == DFCC_EVENT_OUTPUT) {
+      g_variant_unref(response);
+      continue;
+    }
+
+    g_mutex_lock(&hub->mtx);
+    g_queue_push_tail(EventHub__queue(hub, jid)->responses, response);
+    g_cond_broadcast(&hub->cond);
+    g_mutex_unlock(&hub->mtx);
+  }
+
+  g_mutex_lock(&hub->mtx);
+  g_clear_object(&hub->stream);
+  g_cond_broadcast(&hub->cond);
+  g_mutex_unlock(&hub->mtx);
+  g_object_unref(stream);
+  return NULL;
+}
+
+
+/**
+ * @memberof EventHub
+ * @private
+ * @brief Opens the event stream and starts the reader.
+ *
+ * Must be called with the mutex held.
+ *
+ * @param hub an EventHub
+ * @return 0 if success, otherwize nonzero
+ */
+static int EventHub__open (struct EventHub *hub) {
+  if (hub->reader != NULL) {
+    // the previous reader has given up the stream and does not lock again
+    g_thread_join(hub->reader);
+    hub->reader = NULL;
+  }
+
+  SoupMessage *msg = soup_message_new_from_uri(SOUP_METHOD_GET, hub->uri);
+  GError *error = NULL;
+  GInputStream *stream = soup_session_send(
+    hub->session, msg, hub->cancellable, &error);
+  should (stream != NULL) otherwise {
+    g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_DEBUG,
+          "Cannot open event stream: %s", error->message);
+    g_error_free(error);
+    g_object_unref(msg);
+    return 1;
+  }
+  should (SOUP_STATUS_IS_SUCCESSFUL(msg->status_code)) otherwise {
+    g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_DEBUG,
+          "Server does not support event stream");
+    hub->unsupported = true;
+    g_object_unref(stream);
+    g_object_unref(msg);
+    return 1;
+  }
+  g_object_unref(msg);
+
+  hub->stream = stream;
+  hub->generation++;
+  hub->opened = g_get_monotonic_time();
+  hub->reader = g_thread_new("events", EventHub__read, hub);
+  return 0;
+}
+
+
+/**
+ * @memberof EventHub
+ * @private
+ * @brief Wakes up jobs waiting on an EventHub.
+ *
+ * @param cancellable a GCancellable
+ * @param user_data an EventHub
+ */
+static void EventHub__wake (GCancellable *cancellable, gpointer user_data) {
+  struct EventHub *hub = (struct EventHub *) user_data;
+  g_mutex_lock(&hub->mtx);
+  g_cond_broadcast(&hub->cond);
+  g_mutex_unlock(&hub->mtx);
+}
+
+
+//! @memberof EventHub
+static void EventHub_free (gpointer data) {
+  struct EventHub *hub = (struct EventHub *) data;
+  g_cancellable_cancel(hub->cancellable);
+  if (hub->reader != NULL) {
+    g_thread_join(hub->reader);
+  }
+  g_clear_object(&hub->stream);
+  g_hash_table_destroy(hub->queues);
+  g_object_unref(hub->cancellable);
+  soup_uri_free(hub->uri);
+  g_cond_clear(&hub->cond);
+  g_mutex_clear(&hub->mtx);
+  g_free(hub);
+}
+
+
+//! @memberof EventHub
+static struct EventHub *EventHub_new (SoupSession *session, SoupURI *uri) {
+  struct EventHub *hub = g_new(struct EventHub, 1);
+  g_mutex_init(&hub->mtx);
+  g_cond_init(&hub->cond);
+  hub->session = session;
+  hub->uri = soup_uri_copy(uri);
+  hub->stream = NULL;
+  hub->generation = 0;
+  hub->opened = 0;
+  hub->unsupported = false;
+  hub->queues = g_hash_table_new_full(
+    g_direct_hash, g_direct_equal, NULL, EventQueue_free);
+  hub->reader = NULL;
+  hub->cancellable = g_cancellable_new();
+  return hub;
+}
+
+
+/// Serializes creation of EventHub.
+static GMutex EventHub_mtx;
+
+
+struct EventHub *EventHub_get (SoupSession *session, SoupURI *uri) {
+  g_mutex_lock(&EventHub_mtx);
+  struct EventHub *hub = g_object_get_data(G_OBJECT(session), EventHub_KEY);
+  if (hub == NULL) {
+    hub = EventHub_new(session, uri);
+    g_object_set_data_full(G_OBJECT(session), EventHub_KEY, hub, EventHub_free);
+  }
+  g_mutex_unlock(&EventHub_mtx);
+  return hub;
+}
+
+
+void EventHub_detach (SoupSession *session) {
+  g_mutex_lock(&EventHub_mtx);
+  // the stream holds references to the session, so do not wait for finalize
+  g_object_set_data(G_OBJECT(session), EventHub_KEY, NULL);
+  g_mutex_unlock(&EventHub_mtx);
+}
+
+
+int EventHub_subscribe (struct EventHub *hub, GPid jid, gint64 submitted) {
+  g_mutex_lock(&hub->mtx);
+  if (hub->stream == NULL && !hub->unsupported) {
+    EventHub__open(hub);
+  }
+  int ret = -1;
+  if (hub->stream != NULL) {
+    // the server has registered the stream before responding, so no event is
+    // lost if it was opened before the job was submitted
+    ret = hub->opened < submitted ? 1 : 0;
+    struct EventQueue *queue = EventHub__queue(hub, jid);
+    queue->claimed = true;
+    queue->generation = hub->generation;
+  }
+  g_mutex_unlock(&hub->mtx);
+  return ret;
+}
+
+
+GVariant *EventHub_wait (
+    struct EventHub *hub, GPid jid, GCancellable *cancellable) {
+  // connect before locking, the callback is run at once if already cancelled
+  gulong handler = cancellable == NULL ? 0 : g_cancellable_connect(
+    cancellable, G_CALLBACK(EventHub__wake), hub, NULL);
+
+  g_mutex_lock(&hub->mtx);
+  struct EventQueue *queue =
+    g_hash_table_lookup(hub->queues, GUINT_TO_POINTER(jid));
+  GVariant *response = NULL;
+  while (queue != NULL) {
+    response = g_queue_pop_head(queue->responses);
+    break_if(response != NULL);
+    // events may have been lost while the stream was down
+    break_if(hub->stream == NULL || hub->generation != queue->generation);
+    break_if(g_cancellable_is_cancelled(cancellable));
+    g_cond_wait(&hub->cond, &hub->mtx);
+  }
+  g_mutex_unlock(&hub->mtx);
+
+  g_cancellable_disconnect(cancellable, handler);
+  return response;
+}
+
+
+void EventHub_unsubscribe (struct EventHub *hub, GPid jid) {
+  g_mutex_lock(&hub->mtx);
+  g_hash_table_remove(hub->queues, GUINT_TO_POINTER(jid));
+  g_mutex_unlock(&hub->mtx);
+}
@@ -0,0 +1,102 @@
+#ifndef DFCC_CLIENT_EVENTHUB_H
+#define DFCC_CLIENT_EVENTHUB_H
+/**
+ * @addtogroup Client
+ * @{
+ */
+
+#include <stdbool.h>
+
+#include <libsoup/soup.h>
+#include <glib.h>
+
+
+/// Seconds to keep events of jobs nobody has subscribed to.
+#define EventHub_ORPHAN_TIMEOUT 60
+
+
+/**
+ * @brief The event stream of a server session, shared by all jobs sent
+ *        through the same SoupSession.
+ *
+ * A single reader thread dispatches events to the jobs by jid, so that
+ * concurrent jobs, such as those of an agent, do not each subscribe to the
+ * events of all others.
+ */
+struct EventHub {
+  GMutex mtx;
+  GCond cond;
+  SoupSession *session;
+  SoupURI *uri;
+  /// The open event stream. [nullable]
+  GInputStream *stream;
+  /// Incremented each time the stream is opened.
+  unsigned int generation;
+  /// Monotonic time when the stream was opened.
+  gint64 opened;
+  /// Whether the server does not support event streams.
+  bool unsupported;
+  /// jid -> EventQueue
+  GHashTable *queues;
+  /// Thread reading `stream`. [nullable]
+  GThread *reader;
+  /// Stops the reader.
+  GCancellable *cancellable;
+};
+
+
+/**
+ * @memberof EventHub
+ * @brief Gets the EventHub of a session, creating it if needed.
+ *
+ * The hub is owned by the session and freed by EventHub_detach().
+ *
+ * @param session a SoupSession
+ * @param uri URI of the event stream of the server
+ * @return an EventHub
+ */
+struct EventHub *EventHub_get (SoupSession *session, SoupURI *uri);
+/**
+ * @memberof EventHub
+ * @brief Stops and frees the EventHub of a session, if any.
+ *
+ * @param session a SoupSession
+ */
+void EventHub_detach (SoupSession *session);
+/**
+ * @memberof EventHub
+ * @brief Subscribes to the events of a job, opening the event stream if
+ *        needed.
+ *
+ * @param hub an EventHub
+ * @param jid job ID
+ * @param submitted monotonic time before the job was submitted
+ * @return negative if events are not available, 0 if events emitted before
+ *         the subscription may be lost, positive if all events of the job
+ *         will be delivered
+ */
+int EventHub_subscribe (struct EventHub *hub, GPid jid, gint64 submitted);
+/**
+ * @memberof EventHub
+ * @brief Waits for the next status change of a subscribed job.
+ *
+ * @param hub an EventHub
+ * @param jid job ID
+ * @param cancellable a GCancellable [nullable]
+ * @return the job status, as in @ref DFCC_RPC_QUERY_RESPONSE_SIGNATURE, or
+ *         `NULL` if the event stream is broken or `cancellable` is cancelled
+ */
+GVariant *EventHub_wait (
+  struct EventHub *hub, GPid jid, GCancellable *cancellable);
+/**
+ * @memberof EventHub
+ * @brief Drops the events of a job.
+ *
+ * @param hub an EventHub
+ * @param jid job ID
+ */
+void EventHub_unsubscribe (struct EventHub *hub, GPid jid);
+
+
+/**@}*/
+#endif /* DFCC_CLIENT_EVENTHUB_H */
@@ -0,0 +1,103 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "common/macro.h"
+#include "common/morestring.h"
+#include "log.h"
+#include "jobserver.h"
+
+
+void Jobserver_lend (struct Jobserver *jobserver) {
+  return_if(jobserver->lent);
+  while (write(jobserver->write_fd, &jobserver->token, 1) < 0) {
+    should (errno == EINTR) otherwise {
+      g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_DEBUG,
+            "Cannot lend token to jobserver: %s", g_strerror(errno));
+      return;
+    }
+  }
+  jobserver->lent = true;
+}
+
+
+void Jobserver_reclaim (struct Jobserver *jobserver) {
+  return_if_not(jobserver->lent);
+  while (true) {
+    ssize_t ret = read(jobserver->read_fd, &jobserver->token, 1);
+    break_if(ret == 1);
+    if (ret < 0 && errno == EAGAIN) {
+      // the read end may be nonblocking
+      struct pollfd pfd = {.fd = jobserver->read_fd, .events = POLLIN};
+      poll(&pfd, 1, -1);
+      continue;
+    }
+    should (ret < 0 && errno == EINTR) otherwise {
+      g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_WARNING,
+            "Cannot take token from jobserver: %s",
+            ret == 0 ? "End of file" : g_strerror(errno));
+      break;
+    }
+  }
+  jobserver->lent = false;
+}
+
+
+void Jobserver_destroy (struct Jobserver *jobserver) {
+  Jobserver_reclaim(jobserver);
+  if (jobserver->owned) {
+    close(jobserver->read_fd);
+  }
+}
+
+
+int Jobserver_init (struct Jobserver *jobserver, const char *makeflags) {
+  return_if(makeflags == NULL) 1;
+
+  // the last option wins
+  const char *auth = NULL;
+  gchar **words = g_strsplit(makeflags, " ", 0);
+  for (int i = 0; words[i] != NULL; i++) {
+    if (strscmp(words[i], "--jobserver-auth=") == 0) {
+      auth = words[i] + strlen("--jobserver-auth=");
+    } else if (strscmp(words[i], "--jobserver-fds=") == 0) {
+      auth = words[i] + strlen("--jobserver-fds=");
+    }
+  }
+
+  int ret = 1;
+  jobserver->owned = false;
+  jobserver->lent = false;
+  jobserver->token = '+';
+  do_once {
+    break_if(auth == NULL);
+    if (strscmp(auth, "fifo:") == 0) {
+      jobserver->read_fd = g_open(
+        auth + strlen("fifo:"), O_RDWR | O_CLOEXEC, 0);
+      break_if(jobserver->read_fd < 0);
+      jobserver->write_fd = jobserver->read_fd;
+      jobserver->owned = true;
+    } else {
+      char *end;
+      jobserver->read_fd = strtol(auth, &end, 10);
+      break_if(*end != ',');
+      jobserver->write_fd = strtol(end + 1, &end, 10);
+      break_if(*end != '\0');
+      // make does not pass the pipe to recipes it deems non-recursive
+      break_if(fcntl(jobserver->read_fd, F_GETFD) < 0 ||
+               fcntl(jobserver->write_fd, F_GETFD) < 0);
+    }
+    g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_DEBUG, "Jobserver found: %s", auth);
+    ret = 0;
+  }
+
+  g_strfreev(words);
+  return ret;
+}
@@ -0,0 +1,73 @@
+#ifndef DFCC_CLIENT_JOBSERVER_H
+#define DFCC_CLIENT_JOBSERVER_H
+/**
+ * @addtogroup Client
+ * @{
+ */
+
+#include <stdbool.h>
+
+
+/**
+ * @brief Contains the client side of a GNU make jobserver.
+ *
+ * `make` starts each job with one implicit token. While a job waits for a
+ * remote server, the client lends that token back to the jobserver so that
+ * `make` can start another job, and takes a token again before it runs the
+ * compiler locally or exits.
+ */
+struct Jobserver {
+  /// File descriptor to read tokens from.
+  int read_fd;
+  /// File descriptor to write tokens to.
+  int write_fd;
+  /// Whether the file descriptors are opened by ourselves.
+  bool owned;
+  /// Whether the implicit token has been lent to the jobserver.
+  bool lent;
+  /// The token to be written back.
+  char token;
+};
+
+
+/**
+ * @memberof Jobserver
+ * @brief Lends the implicit token to the jobserver.
+ *
+ * @param jobserver a Jobserver
+ */
+void Jobserver_lend (struct Jobserver *jobserver);
+/**
+ * @memberof Jobserver
+ * @brief Takes back a token from the jobserver, blocking until one is
+ *        available.
+ *
+ * Does nothing if no token has been lent.
+ *
+ * @param jobserver a Jobserver
+ */
+void Jobserver_reclaim (struct Jobserver *jobserver);
+/**
+ * @memberof Jobserver
+ * @brief Takes back the lent token, and frees associated resources of a
+ *        Jobserver.
+ *
+ * @param jobserver a Jobserver
+ */
+void Jobserver_destroy (struct Jobserver *jobserver);
+/**
+ * @memberof Jobserver
+ * @brief Initializes a Jobserver from `MAKEFLAGS`.
+ *
+ * Both `--jobserver-auth=R,W` (and the older `--jobserver-fds=R,W`) pipes and
+ * `--jobserver-auth=fifo:PATH` named pipes are understood.
+ *
+ * @param jobserver a Jobserver
+ * @param makeflags value of `MAKEFLAGS` [nullable]
+ * @return 0 if success, otherwize nonzero if there is no usable jobserver
+ */
+int Jobserver_init (struct Jobserver *jobserver, const char *makeflags);
+
+
+/**@}*/
+#endif /* DFCC_CLIENT_JOBSERVER_H */
@@ -1,12 +1,286 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
 #include "common/macro.h"
+#include "config/config.h"
+#include "spawn/process.h"
+#include "file/hash.h"
+#include "cc/ccargs.h"
+#include "cc/resultinfo.h"
+#include "log.h"
 #include "prepost.h"
 
 
-int Client_pre (struct Config *config) {
-  return 1;
+/**
+ * @brief Calculates the key of the result cache.
+ *
+ * The key covers the compiler executable, the arguments except the output,
+ * the working directory which may be recorded in debug information, and the
+ * preprocessed source.
+ *
+ * @param config a Config
+ * @param preprocessed_hash hash of the preprocessed source
+ * @return the key, or 0 if the compiler cannot be found
+ */
+static FileHash Client__result_key (
+    const struct Config *config, FileHash preprocessed_hash) {
+  char *compiler = strchr(config->cc_argv[0], '/') != NULL ?
+    g_strdup(config->cc_argv[0]) :
+    Process_search_executable(config->cc_argv[0], config->prgpath, NULL);
+  return_if_fail(compiler != NULL) 0;
+  GStatBuf buf;
+  should (g_stat(compiler, &buf) == 0) otherwise {
+    g_free(compiler);
+    return 0;
+  }
+
+  GString *material = g_string_new(compiler);
+  g_string_append_printf(
+    material, "%c%lld %lld%c%s", '\0', (long long) buf.st_size,
+    (long long) buf.st_mtime, '\0', config->cc_working_directory);
+  char **argv = CC_preprocess_argv(config->cc_argv, false);
+  for (int i = 1; argv[i] != NULL; i++) {
+    g_string_append_c(material, '\0');
+    g_string_append(material, argv[i]);
+  }
+  g_strfreev(argv);
+  g_string_append_printf(material, "%c%016llX", '\0', preprocessed_hash);
+
+  FileHash key = FileHash_from_buf(material->str, material->len);
+  g_string_free(material, TRUE);
+  g_free(compiler);
+  return key;
+}
+
+
+/**
+ * @brief Get the path to the cached object file of `key`.
+ *
+ * @param config a Config
+ * @param key the key of the result cache
+ * @return the path [transfer-full]
+ */
+static char *Client__result_path (const struct Config *config, FileHash key) {
+  char name[FileHash_STRLEN + 1];
+  FileHash_to_string(key, name);
+  char subdir[3] = {name[0], name[1], '\0'};
+  return g_build_filename(config->result_cache_dir, subdir, name, NULL);
+}
+
+
+/**
+ * @brief Get the path to the cached stderr of `key`.
+ *
+ * @param path the path to the cached object file of `key`
+ * @return the path [transfer-full]
+ */
+static char *Client__result_stderr_path (const char *path) {
+  return g_strconcat(path, ".stderr", NULL);
+}
+
+
+/**
+ * @brief Write to the stderr of the client.
+ *
+ * @param contents the data
+ * @param length length of `contents`
+ */
+static void Client__write_stderr (const char *contents, gsize length) {
+  while (length > 0) {
+    ssize_t written = write(STDERR_FILENO, contents, length);
+    break_if_fail(written > 0);
+    contents += written;
+    length -= written;
+  }
+}
+
+
+/**
+ * @brief Preprocess the source file.
+ *
+ * The dependency file, if requested by `-MD` or `-MMD`, is written as a side
+ * effect, so that it is up to date even if the compiler is not run.
+ *
+ * @param config a Config
+ * @return hash of the preprocessed source, or 0 if failed
+ */
+static FileHash Client__preprocess (const struct Config *config) {
+  char **argv = CC_preprocess_argv(config->cc_argv, true);
+  if (strchr(argv[0], '/') == NULL) {
+    char *compiler = Process_search_executable(
+      argv[0], config->prgpath, NULL);
+    if (compiler == NULL) {
+      g_strfreev(argv);
+      return 0;
+    }
+    g_free(argv[0]);
+    argv[0] = compiler;
+  }
+  gchar **envp = g_environ_setenv(
+    g_strdupv(config->cc_envp), DFCC_LOOP_DETECTION_ENV, "1", TRUE);
+
+  FileHash hash = 0;
+  char *preprocessed = NULL;
+  int exit_status;
+  GError *error = NULL;
+  should (g_spawn_sync(
+      config->cc_working_directory, argv, envp,
+      G_SPAWN_LEAVE_DESCRIPTORS_OPEN | G_SPAWN_STDERR_TO_DEV_NULL,
+      NULL, NULL, &preprocessed, NULL, &exit_status, &error) &&
+    g_spawn_check_exit_status(exit_status, &error)) otherwise {
+    g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_DEBUG,
+          "Cannot preprocess source: %s", error->message);
+    g_error_free(error);
+  }
+  if (error == NULL) {
+    hash = FileHash_from_buf(preprocessed, strlen(preprocessed));
+  }
+  g_free(preprocessed);
+
+  g_strfreev(envp);
+  g_strfreev(argv);
+  return hash;
+}
+
+
+int Client_pre (struct Config *config, struct ResultInfo *result) {
+  return_if_not(config->result_cache) 1;
+
+  char *output;
+  return_if_not(CC_is_cacheable(
+    config->cc_argv, config->cc_working_directory, &output)) 1;
+
+  int ret = 1;
+  do_once {
+    result->preprocessed_hash = Client__preprocess(config);
+    break_if_fail(result->preprocessed_hash != 0);
+    FileHash key = Client__result_key(config, result->preprocessed_hash);
+    break_if_fail(key != 0);
+
+    char *path = Client__result_path(config, key);
+    char *contents;
+    gsize length;
+    if (g_file_get_contents(path, &contents, &length, NULL)) {
+      GError *error = NULL;
+      should (g_file_set_contents(output, contents, length, &error)) otherwise {
+        g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_WARNING,
+              "Cannot write cached result: %s", error->message);
+        g_error_free(error);
+      }
+      if (error == NULL) {
+        g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_DEBUG,
+              "Result cache hit: %s", path);
+        result->object_hash = FileHash_from_buf(contents, length);
+        ret = 0;
+      }
+      g_free(contents);
+
+      // replay the warnings of the compiler
+      char *stderr_path = Client__result_stderr_path(path);
+      if (ret == 0 &&
+          g_file_get_contents(stderr_path, &contents, &length, NULL)) {
+        Client__write_stderr(contents, length);
+        g_free(contents);
+      }
+      g_free(stderr_path);
+    } else {
+      // capture the warnings of the compiler to be stored along the result
+      char *tmp_path;
+      int fd = g_file_open_tmp(DFCC_CLIENT_NAME "-XXXXXX", &tmp_path, NULL);
+      if (fd != -1) {
+        g_unlink(tmp_path);
+        g_free(tmp_path);
+        config->cc_stderr = fd;
+      }
+    }
+    g_free(path);
+  }
+
+  g_free(output);
+  return ret;
 }
 
 
-void Client_post (struct Config *config, struct ResultInfo *result) {
+/**
+ * @brief Stops capturing stderr of the compiler, and writes the captured data
+ *        to the stderr of the client.
+ *
+ * @param config a Config
+ * @return the captured data, or `NULL` if not captured [transfer-full]
+ */
+static GBytes *Client__release_stderr (struct Config *config) {
+  return_if(config->cc_stderr < 0) NULL;
+
+  GBytes *captured = NULL;
+  GError *error = NULL;
+  GMappedFile *file = g_mapped_file_new_from_fd(
+    config->cc_stderr, FALSE, &error);
+  should (file != NULL) otherwise {
+    g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_WARNING,
+          "Cannot read stderr of compiler: %s", error->message);
+    g_error_free(error);
+  }
+  if (file != NULL) {
+    captured = g_mapped_file_get_bytes(file);
+    g_mapped_file_unref(file);
+    gsize length;
+    const char *contents = g_bytes_get_data(captured, &length);
+    Client__write_stderr(contents, length);
+  }
+
+  close(config->cc_stderr);
+  config->cc_stderr = -1;
+  return captured;
+}
+
+
+void Client_post (
+    struct Config *config, struct ResultInfo *result, int status) {
+  // only captured if the result is to be cached
+  GBytes *captured = Client__release_stderr(config);
+  return_if(captured == NULL);
+
+  char *output = NULL;
+  do_once {
+    break_if_not(status == 0 && result->preprocessed_hash != 0);
+    break_if_not(CC_is_cacheable(
+      config->cc_argv, config->cc_working_directory, &output));
+    FileHash key = Client__result_key(config, result->preprocessed_hash);
+    break_if_fail(key != 0);
+
+    char *contents;
+    gsize length;
+    break_if_fail(g_file_get_contents(output, &contents, &length, NULL));
+    result->object_hash = FileHash_from_buf(contents, length);
+
+    char *path = Client__result_path(config, key);
+    char *stderr_path = Client__result_stderr_path(path);
+    char *dir = g_path_get_dirname(path);
+    gsize stderr_length;
+    const char *stderr_contents = g_bytes_get_data(captured, &stderr_length);
+    GError *error = NULL;
+    // the object file goes last, as a hit is told by it
+    should (g_mkdir_with_parents(dir, 0700) == 0 &&
+            g_file_set_contents(
+              stderr_path, stderr_contents, stderr_length, &error) &&
+            g_file_set_contents(path, contents, length, &error)) otherwise {
+      g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_DEBUG,
+            "Cannot store result to '%s': %s",
+            path, error != NULL ? error->message : g_strerror(errno));
+      g_clear_error(&error);
+    }
+    g_free(dir);
+    g_free(stderr_path);
+    g_free(path);
+    g_free(contents);
+  }
 
+  g_free(output);
+  g_bytes_unref(captured);
 }
@@ -10,8 +10,32 @@
 #include "cc/resultinfo.h"
 
 
-int Client_pre (struct Config *config);
-void Client_post (struct Config *config, struct ResultInfo *result);
+/**
+ * @brief Actions before the compiler is run.
+ *
+ * If Config.result_cache is set, preprocess the source file and look up the
+ * result cache. On a hit, the cached object file is written to the output,
+ * and the cached stderr of the compiler is replayed. On a miss, the stderr of
+ * the local compiler is captured through Config.cc_stderr for Client_post().
+ *
+ * @param config a Config
+ * @param[out] result a ResultInfo to hold ResultInfo.preprocessed_hash, for
+ *                    Client_post()
+ * @return 0 if the job is done, otherwize nonzero
+ */
+int Client_pre (struct Config *config, struct ResultInfo *result);
+/**
+ * @brief Actions after the compiler has run.
+ *
+ * Writes out the stderr captured by Client_pre(). If the compiler has
+ * succeeded, store the object file and the stderr into the result cache.
+ *
+ * @param config a Config
+ * @param result a ResultInfo filled by Client_pre()
+ * @param status the exit status of the compiler
+ */
+void Client_post (
+  struct Config *config, struct ResultInfo *result, int status);
 
 
 /**@}*/
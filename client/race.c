@@ -0,0 +1,510 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include <libsoup/soup.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "common/macro.h"
+#include "config/config.h"
+#include "spawn/process.h"
+#include "cc/resultinfo.h"
+#include "agent.h"
+#include "jobserver.h"
+#include "local.h"
+#include "log.h"
+#include "remote.h"
+#include "race.h"
+
+
+bool Race_claim (struct Race *race, int id) {
+  g_mutex_lock(&race->mtx);
+  if (race->winner < 0 &&
+      (race->claim == NULL || race->claim(race, id, race->userdata))) {
+    race->winner = id;
+    g_cond_broadcast(&race->cond);
+  }
+  bool won = race->winner == id;
+  g_mutex_unlock(&race->mtx);
+  if (won && race->stop != NULL) {
+    race->stop(race, id, race->userdata);
+  }
+  if (race->context != NULL) {
+    g_main_context_wakeup(race->context);
+  }
+  return won;
+}
+
+
+void Race_enter (struct Race *race) {
+  g_mutex_lock(&race->mtx);
+  race->running++;
+  g_mutex_unlock(&race->mtx);
+}
+
+
+void Race_leave (struct Race *race) {
+  g_mutex_lock(&race->mtx);
+  race->running--;
+  g_cond_broadcast(&race->cond);
+  g_mutex_unlock(&race->mtx);
+  if (race->context != NULL) {
+    g_main_context_wakeup(race->context);
+  }
+}
+
+
+bool Race_wait_until (struct Race *race, gint64 end_time) {
+  bool decided = true;
+  g_mutex_lock(&race->mtx);
+  while (race->winner < 0 && race->running > 0) {
+    if (end_time == G_MAXINT64) {
+      g_cond_wait(&race->cond, &race->mtx);
+    } else if (!g_cond_wait_until(&race->cond, &race->mtx, end_time)) {
+      decided = race->winner >= 0 || race->running == 0;
+      break;
+    }
+  }
+  g_mutex_unlock(&race->mtx);
+  return decided;
+}
+
+
+void Race_destroy (struct Race *race) {
+  g_mutex_clear(&race->mtx);
+  g_cond_clear(&race->cond);
+}
+
+
+int Race_init (struct Race *race) {
+  g_mutex_init(&race->mtx);
+  g_cond_init(&race->cond);
+  race->winner = -1;
+  race->running = 0;
+  race->stop = NULL;
+  race->claim = NULL;
+  race->userdata = NULL;
+  race->context = NULL;
+  return 0;
+}
+
+
+/**
+ * @brief Get the path to the history of past job times.
+ *
+ * @return the path [transfer-full]
+ */
+static char *Client__job_times_path (void) {
+  return g_build_filename(
+    g_get_user_cache_dir(), DFCC_NAME, DFCC_JOB_TIMES_FILENAME, NULL);
+}
+
+
+/**
+ * @brief Load the history of past job times.
+ *
+ * @param[out] length the number of job times
+ * @return job times in milliseconds, or NULL if no history [transfer-full]
+ */
+static gint *Client__load_job_times (gsize *length) {
+  GKeyFile *history = g_key_file_new();
+  char *path = Client__job_times_path();
+  gint *times = NULL;
+  *length = 0;
+  if (g_key_file_load_from_file(history, path, G_KEY_FILE_NONE, NULL)) {
+    times = g_key_file_get_integer_list(
+      history, "Jobs", "Times", length, NULL);
+  }
+  g_free(path);
+  g_key_file_free(history);
+  return times;
+}
+
+
+static int Client__compare_int (const void *a, const void *b) {
+  return *(const gint *) a - *(const gint *) b;
+}
+
+
+gint64 Client_job_time_percentile (unsigned int percentile) {
+  gsize length;
+  gint *times = Client__load_job_times(&length);
+  gint64 ret = 0;
+  if (length >= Client_JOB_TIMES_MIN_SAMPLES) {
+    qsort(times, length, sizeof(gint), Client__compare_int);
+    ret = (gint64) times[(length - 1) * min(percentile, 100u) / 100] *
+          G_TIME_SPAN_MILLISECOND;
+  }
+  g_free(times);
+  return ret;
+}
+
+
+void Client_record_job_time (gint64 time) {
+  gsize length;
+  gint *times = Client__load_job_times(&length);
+  gint new_times[Client_JOB_TIMES_HISTORY];
+  // keep the most recent ones
+  gsize kept = min(length, (gsize) Client_JOB_TIMES_HISTORY - 1);
+  if (kept > 0) {
+    memcpy(new_times, times + length - kept, kept * sizeof(gint));
+  }
+  new_times[kept] = time / G_TIME_SPAN_MILLISECOND;
+  g_free(times);
+
+  GKeyFile *history = g_key_file_new();
+  g_key_file_set_integer_list(history, "Jobs", "Times", new_times, kept + 1);
+  char *path = Client__job_times_path();
+  char *dir = g_path_get_dirname(path);
+  GError *error = NULL;
+  should (g_mkdir_with_parents(dir, 0700) == 0 &&
+          g_key_file_save_to_file(history, path, &error)) otherwise {
+    g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_DEBUG,
+          "Cannot save job times to '%s': %s",
+          path, error != NULL ? error->message : g_strerror(errno));
+    g_clear_error(&error);
+  }
+  g_free(dir);
+  g_free(path);
+  g_key_file_free(history);
+}
+
+
+/**
+ * @brief Contains a remote job of a hedged run.
+ */
+struct HedgeContender {
+  struct RemoteContender;
+
+  SoupSession * const *sessions;
+  const struct Config *config;
+  char * const *remote_argv;
+  char * const *remote_envp;
+  /// Whether to run the job through the agent, if there is one.
+  bool agent;
+
+  GThread *thread;
+  struct ResultInfo result;
+  int ret;
+};
+
+
+//! @memberof HedgeContender
+static gpointer HedgeContender_run (gpointer data) {
+  struct HedgeContender *contender = (struct HedgeContender *) data;
+  contender->ret = contender->agent ? Client_run_by_agent(
+    contender->config, &contender->result,
+    contender->remote_argv, contender->remote_envp,
+    (struct RemoteContender *) contender) : -1;
+  if (contender->ret < 0) {
+    contender->ret = Client_run_remotely_contending(
+      contender->sessions, contender->config, &contender->result,
+      contender->remote_argv, contender->remote_envp,
+      (struct RemoteContender *) contender);
+  }
+  Race_leave(contender->race);
+  return NULL;
+}
+
+
+//! @memberof HedgeContender
+static void HedgeContender_start (
+    struct HedgeContender *contender, struct Race *race, int id,
+    const char *exclude, SoupSession * const sessions[],
+    const struct Config *config,
+    char * const remote_argv[], char * const remote_envp[], bool agent) {
+  RemoteContender_init(
+    (struct RemoteContender *) contender, race, id, exclude);
+  contender->sessions = sessions;
+  contender->config = config;
+  contender->remote_argv = remote_argv;
+  contender->remote_envp = remote_envp;
+  contender->agent = agent;
+  contender->result = (struct ResultInfo) {0};
+  contender->ret = 1;
+  Race_enter(race);
+  contender->thread = g_thread_new(
+    DFCC_NAME "-hedge", HedgeContender_run, contender);
+}
+
+
+int Client_run_hedged (
+    SoupSession * const sessions[], const struct Config *config,
+    struct ResultInfo * restrict result,
+    char * const remote_argv[], char * const remote_envp[]) {
+  gint64 start = g_get_monotonic_time();
+  gint64 deadline = Client_job_time_percentile(config->hedge_percentile);
+
+  struct Race race;
+  Race_init(&race);
+  struct HedgeContender contenders[2];
+  int n_contenders = 1;
+  HedgeContender_start(
+    contenders, &race, 0, NULL, sessions, config, remote_argv, remote_envp,
+    false);
+
+  if (deadline > 0 && !Race_wait_until(&race, start + deadline)) {
+    g_mutex_lock(&race.mtx);
+    const char *slow_server = contenders[0].baseurl;
+    g_mutex_unlock(&race.mtx);
+    if (slow_server != NULL) {
+      g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_DEBUG,
+            "Job on %s slower than %" G_GINT64_FORMAT " ms, hedging",
+            slow_server, deadline / G_TIME_SPAN_MILLISECOND);
+      HedgeContender_start(
+        contenders + 1, &race, 1, slow_server, sessions, config,
+        remote_argv, remote_envp, false);
+      n_contenders = 2;
+    }
+  }
+  Race_wait_until(&race, G_MAXINT64);
+
+  // release the job slot taken by the loser
+  for (int i = 0; i < n_contenders; i++) {
+    if (i != race.winner) {
+      RemoteContender_cancel((struct RemoteContender *) (contenders + i));
+    }
+  }
+  for (int i = 0; i < n_contenders; i++) {
+    g_thread_join(contenders[i].thread);
+  }
+
+  int ret = 1;
+  if (race.winner >= 0 && contenders[race.winner].ret == 0) {
+    ret = 0;
+    *result = contenders[race.winner].result;
+    Client_record_job_time(g_get_monotonic_time() - start);
+  }
+
+  for (int i = 0; i < n_contenders; i++) {
+    RemoteContender_destroy((struct RemoteContender *) (contenders + i));
+  }
+  Race_destroy(&race);
+  return ret;
+}
+
+
+/**
+ * @brief Try to take one of the local slots, which are as many as processors.
+ *
+ * @return file descriptor holding the slot, or -1 if all slots are busy
+ */
+static int Client__take_local_slot (void) {
+  char *dir = g_build_filename(g_get_user_runtime_dir(), DFCC_NAME, NULL);
+  should (g_mkdir_with_parents(dir, 0700) == 0) otherwise {
+    g_free(dir);
+    return -1;
+  }
+
+  int fd = -1;
+  unsigned int n_slots = g_get_num_processors();
+  for (unsigned int i = 0; i < n_slots; i++) {
+    char filename[sizeof(DFCC_LOCAL_SLOT_FILENAME) + 12];
+    snprintf(filename, sizeof(filename), DFCC_LOCAL_SLOT_FILENAME ".%u", i);
+    char *path = g_build_filename(dir, filename, NULL);
+    fd = g_open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    g_free(path);
+    continue_if(fd < 0);
+    break_if(flock(fd, LOCK_EX | LOCK_NB) == 0);
+    close(fd);
+    fd = -1;
+  }
+  g_free(dir);
+  return fd;
+}
+
+
+/**
+ * @brief Contains a local compiler run racing against a remote job.
+ */
+struct LocalContender {
+  struct Process;
+
+  struct Race *race;
+  int id;
+  /// Whether the compiler has been spawned.
+  bool started;
+  /// Whether the compiler has exited, protected by the mutex of the race.
+  bool exited;
+  /// Whether the compiler was killed because it lost.
+  bool killed;
+  /// The exit status of the compiler.
+  int ret;
+};
+
+
+//! @memberof LocalContender
+static void LocalContender_onchange (void *p_, int status) {
+  struct LocalContender *local = (struct LocalContender *) p_;
+  return_if(status != PROCESS_STATUS_EXIT);
+
+  if (local->error == NULL) {
+    local->ret = 0;
+  } else if (local->error->domain == G_SPAWN_EXIT_ERROR) {
+    local->ret = local->error->code;
+  } else {
+    local->ret = 254;
+  }
+
+  g_mutex_lock(&local->race->mtx);
+  local->exited = true;
+  bool killed = local->killed;
+  g_mutex_unlock(&local->race->mtx);
+
+  // a compiler error is as good as the remote one
+  if (!killed) {
+    Race_claim(local->race, local->id);
+  }
+  Race_leave(local->race);
+}
+
+
+/**
+ * @brief Contains a remote job and a local compiler run of the same job.
+ */
+struct LocalRace {
+  struct Race;
+  SoupSession **sessions;
+  struct HedgeContender remote;
+  struct LocalContender local;
+};
+
+
+//! @memberof LocalRace
+static void LocalRace_stop (struct Race *race, int winner, void *userdata) {
+  struct LocalRace *lrace = (struct LocalRace *) userdata;
+  if (winner == lrace->local.id) {
+    RemoteContender_cancel((struct RemoteContender *) &lrace->remote);
+    return;
+  }
+
+  // the local compiler writes output files in place, stop it before the
+  // remote result is written
+  g_mutex_lock(&race->mtx);
+  if (lrace->local.started && !lrace->local.exited) {
+    g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_DEBUG,
+          "Remote job finished first, kill local compiler %" G_PID_FORMAT,
+          lrace->local.pid);
+    lrace->local.killed = true;
+    Process_signal((struct Process *) &lrace->local, SIGKILL);
+  }
+  while (lrace->local.started && !lrace->local.exited) {
+    g_cond_wait(&race->cond, &race->mtx);
+  }
+  g_mutex_unlock(&race->mtx);
+}
+
+
+int Client_run_raced (
+    struct Config *config, struct ResultInfo * restrict result,
+    char * const remote_argv[], char * const remote_envp[]) {
+  gint64 start = g_get_monotonic_time();
+  int slot = Client__take_local_slot();
+
+  // let make start other jobs until the local compiler is started
+  struct Jobserver jobserver;
+  bool has_jobserver = slot < 0 && Jobserver_init(
+    &jobserver, g_environ_getenv(config->cc_envp, "MAKEFLAGS")) == 0;
+  if (has_jobserver) {
+    Jobserver_lend(&jobserver);
+  }
+
+  struct LocalRace lrace;
+  struct Race *race = (struct Race *) &lrace;
+  Race_init(race);
+  race->stop = LocalRace_stop;
+  race->userdata = &lrace;
+  race->context = g_main_context_default();
+  lrace.sessions = Client_new_sessions(config);
+  lrace.local = (struct LocalContender) {.race = race, .id = 1, .ret = 1};
+  // the remote leg shares the connections and sessions of the agent
+  HedgeContender_start(
+    &lrace.remote, race, 0, NULL, lrace.sessions, config,
+    remote_argv, remote_envp, true);
+
+  // also a fallback if the remote job failed
+  if (slot < 0) {
+    Race_wait_until(
+      race, start + config->race_local_delay * G_TIME_SPAN_MILLISECOND);
+  }
+  if (has_jobserver) {
+    g_mutex_lock(&race->mtx);
+    bool undecided = race->winner < 0;
+    g_mutex_unlock(&race->mtx);
+    if (undecided) {
+      // the local compiler needs a token of its own
+      Jobserver_reclaim(&jobserver);
+    }
+  }
+
+  g_mutex_lock(&race->mtx);
+  if (race->winner < 0) {
+    g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_DEBUG,
+          slot >= 0 ? "Local slot idle, race local compiler" :
+                      "Remote job slow, race local compiler");
+    GError *error = NULL;
+    lrace.local.ret = Process_init(
+      (struct Process *) &lrace.local, config->cc_argv, config->cc_envp,
+      config->prgpath, config->cc_stderr, LocalContender_onchange,
+      &lrace.local, &error);
+    if (lrace.local.ret == 0) {
+      lrace.local.started = true;
+      race->running++;
+    } else {
+      g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_CRITICAL, error->message);
+      g_error_free(error);
+    }
+  }
+  g_mutex_unlock(&race->mtx);
+
+  // the local compiler is reaped by the default main context
+  while (true) {
+    g_mutex_lock(&race->mtx);
+    bool done = race->running == 0 || (
+      race->winner >= 0 && !(lrace.local.started && !lrace.local.exited));
+    g_mutex_unlock(&race->mtx);
+    break_if(done);
+    g_main_context_iteration(NULL, TRUE);
+  }
+
+  g_thread_join(lrace.remote.thread);
+
+  bool remote_won = race->winner == lrace.remote.id;
+  int ret = lrace.local.ret;
+  if (remote_won) {
+    ret = lrace.remote.ret;
+    if (ret == 0) {
+      *result = lrace.remote.result;
+    }
+  }
+  g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_DEBUG, "%s compiler won the race",
+        remote_won ? "Remote" : "Local");
+
+  if (lrace.local.started) {
+    Process_destroy((struct Process *) &lrace.local);
+  }
+  RemoteContender_destroy((struct RemoteContender *) &lrace.remote);
+  Client_free_sessions(lrace.sessions);
+  Race_destroy(race);
+  if (slot >= 0) {
+    close(slot);
+  }
+  if (has_jobserver) {
+    // take a token back before compiling locally or exiting
+    Jobserver_destroy(&jobserver);
+  }
+
+  if unlikely (remote_won && ret != 0) {
+    g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_WARNING,
+          "Remote compile failed, fallback to local");
+    ret = Client_run_locally(config, result);
+  }
+  return ret;
+}
@@ -0,0 +1,156 @@
+#ifndef DFCC_CLIENT_RACE_H
+#define DFCC_CLIENT_RACE_H
+/**
+ * @addtogroup Client
+ * @{
+ */
+
+#include <stdbool.h>
+
+#include <libsoup/soup.h>
+#include <glib.h>
+
+#include "config/config.h"
+#include "cc/resultinfo.h"
+
+
+/// Number of past job times kept for hedging.
+#define Client_JOB_TIMES_HISTORY 128
+/// Minimum number of past job times before hedging kicks in.
+#define Client_JOB_TIMES_MIN_SAMPLES 16
+
+
+struct Race;
+//! @memberof Race
+typedef void (*RaceStopCallback) (struct Race *, int, void *);
+//! @memberof Race
+typedef bool (*RaceClaimCallback) (struct Race *, int, void *);
+
+
+/**
+ * @brief Contains the state of several attempts to run the same job, of which
+ *        only the first to finish is kept.
+ */
+struct Race {
+  GMutex mtx;
+  GCond cond;
+  /// Index of the winning contender, -1 if undecided.
+  int winner;
+  /// Number of running contenders.
+  int running;
+  /// Called by the winner to stop other contenders before it commits its
+  /// result, with the mutex unlocked. [optional]
+  RaceStopCallback stop;
+  /// Asked, with the mutex held, whether a contender may become the winner.
+  /// [optional]
+  RaceClaimCallback claim;
+  /// User data of Race.stop and Race.claim.
+  void *userdata;
+  /// Main context to be woken up when the race changes. [optional]
+  GMainContext *context;
+};
+
+
+/**
+ * @memberof Race
+ * @brief Try to become the winner of a race.
+ *
+ * Must be called before a contender commits its result, such as writing
+ * output files.
+ *
+ * @param race a Race
+ * @param id index of the contender
+ * @return `true` if the contender is the winner
+ */
+bool Race_claim (struct Race *race, int id);
+/**
+ * @memberof Race
+ * @brief Registers a running contender.
+ *
+ * @param race a Race
+ */
+void Race_enter (struct Race *race);
+/**
+ * @memberof Race
+ * @brief Unregisters a contender which has finished, successfully or not.
+ *
+ * @param race a Race
+ */
+void Race_leave (struct Race *race);
+/**
+ * @memberof Race
+ * @brief Waits until the race is decided or no contender is running.
+ *
+ * @param race a Race
+ * @param end_time monotonic time to wait until, or `G_MAXINT64` to wait
+ *                 forever
+ * @return `false` if timed out
+ */
+bool Race_wait_until (struct Race *race, gint64 end_time);
+/**
+ * @memberof Race
+ * @brief Frees associated resources of a Race.
+ *
+ * @param race a Race
+ */
+void Race_destroy (struct Race *race);
+/**
+ * @memberof Race
+ * @brief Initializes a Race.
+ *
+ * @param race a Race
+ * @return 0 if success, otherwize nonzero
+ */
+int Race_init (struct Race *race);
+
+
+/**
+ * @brief Get the time after which a job is considered slow, from the history
+ *        of past job times.
+ *
+ * @param percentile the percentile of past job times
+ * @return the time in microseconds, or 0 if there is not enough history
+ */
+gint64 Client_job_time_percentile (unsigned int percentile);
+/**
+ * @brief Add a job time to the history of past job times.
+ *
+ * @param time the time in microseconds
+ */
+void Client_record_job_time (gint64 time);
+/**
+ * @brief Run the compiler on a remote server, and also locally after
+ *        Config.race_local_delay or at once if a local slot is idle.
+ *
+ * The first result to arrive is taken, and the other job is cancelled. If the
+ * remote job wins but fails to deliver its result, the compiler is run again
+ * locally.
+ *
+ * The remote job is run by the agent if there is one. The implicit jobserver
+ * token is lent while only the remote job is running.
+ *
+ * @param config a Config
+ * @return 0 if the remote job succeeded, otherwise the exit status of the
+ *         local compiler
+ */
+int Client_run_raced (
+  struct Config *config, struct ResultInfo * restrict result,
+  char * const remote_argv[], char * const remote_envp[]);
+/**
+ * @brief Run the compiler on a remote server, and resubmit the job to another
+ *        server if it is slower than Config.hedge_percentile of past jobs.
+ *
+ * The first result to arrive is taken, and the other job is cancelled.
+ *
+ * @param sessions sessions from Client_new_sessions()
+ * @param config a Config
+ * @return 0 if success, otherwise non-zero
+ */
+int Client_run_hedged (
+  SoupSession * const sessions[], const struct Config *config,
+  struct ResultInfo * restrict result,
+  char * const remote_argv[], char * const remote_envp[]);
+
+
+/**@}*/
+#endif /* DFCC_CLIENT_RACE_H */
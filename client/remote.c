@@ -1,7 +1,9 @@
 #include <errno.h>
+#include <fcntl.h>
 #include <search.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <libsoup/soup.h>
 #include <glib.h>
@@ -12,31 +14,65 @@
 #include "common/wrapper/gvariant.h"
 #include "common/wrapper/mappedfile.h"
 #include "common/wrapper/soup.h"
+#include "common/wrapper/zstd.h"
 #include "config/config.h"
 #include "config/serverurl.h"
 #include "file/hash.h"
+#include "file/hashdb.h"
 #include "server/protocol.h"
+#include "cc/includescan.h"
 #include "cc/resultinfo.h"
 #include "log.h"
+#include "detect.h"
+#include "eventhub.h"
+#include "race.h"
 #include "sessionid.h"
 #include "remote.h"
 
 
+/// Maximum number of concurrent connections to a single server.
+#define Client_MAX_CONNS_PER_HOST 8
+
+
 struct RemoteConnection {
+  /// Sessions to each server, as from Client_new_sessions().
+  SoupSession * const *sessions;
+  /// Session to the server the job was submitted to.
   SoupSession *session;
-  SoupCookieJar *cookiejar;
   char sessionid_cookies[sizeof(DFCC_COOKIES_SID) + 2 * sizeof(SessionID)];
 
+  /// Working directory of the job, for resolving relative output paths.
+  const char *working_directory;
+  /// Whether the server understands binary RPC.
+  gboolean binary_rpc;
+  /// Whether the server accepts zstd-compressed uploads.
+  bool compression;
+  /// Cancels blocking operations of the connection [nullable]
+  GCancellable *cancellable;
+
+  /// The server the job was submitted to.
+  const struct ServerURL *server;
   GPid jid;
   SoupURI *baseuri;
   char *rpcurl;
   SoupURI *uploaduri;
+  SoupURI *uploadbulkuri;
   SoupURI *downloaduri;
+  SoupURI *eventsuri;
 };
 
 
-//! @memberof RemoteConnection
-static void RemoteConnection__setup_session (
+/**
+ * @brief Apply per-server settings, such as proxy and timeout, to a
+ *        SoupSession.
+ *
+ * The settings are session-wide, so this must be done before the session is
+ * shared between threads.
+ *
+ * @param session a SoupSession
+ * @param server_url a ServerURL
+ */
+static void Client__setup_session (
     SoupSession *session, const struct ServerURL *server_url) {
   SoupURI *proxyuri = server_url->proxyurl != NULL ?
     soup_uri_new(server_url->proxyurl) : NULL;
@@ -67,42 +103,69 @@ static void RemoteConnection_cleanuri (struct RemoteConnection *conn) {
   if (conn->uploaduri != NULL) {
     soup_uri_free(conn->uploaduri);
   }
+  if (conn->uploadbulkuri != NULL) {
+    soup_uri_free(conn->uploadbulkuri);
+  }
   if (conn->downloaduri != NULL) {
     soup_uri_free(conn->downloaduri);
   }
+  if (conn->eventsuri != NULL) {
+    soup_uri_free(conn->eventsuri);
+  }
 }
 
 
 //! @memberof RemoteConnection
 static SoupMessage *RemoteConnection_try_submit (
-    struct RemoteConnection *conn, const struct ServerURL *server_url,
-    const char rpcmsg[], size_t len, guint *status) {
+    struct RemoteConnection *conn, SoupSession *session,
+    const struct ServerURL *server_url, GVariant *params, guint *status) {
   // prepare uri
   SoupURI *baseuri = soup_uri_new(server_url->baseurl);
   SoupURI *rpcuri = soup_uri_new_with_base(baseuri, DFCC_RPC_PATH);
+  char *rpcurl = soup_uri_to_string(rpcuri, FALSE);
 
-  // prepare message
-  SoupMessage *msg = soup_message_new_from_uri("POST", rpcuri);
-  soup_message_set_request(msg, "text/xml", SOUP_MEMORY_TEMPORARY, rpcmsg, len);
-
-  // prepare session and cookie
-  RemoteConnection__setup_session(conn->session, server_url);
+  // prepare cookie
+  SoupCookieJar *cookiejar = SOUP_COOKIE_JAR(
+    soup_session_get_feature(session, SOUP_TYPE_COOKIE_JAR));
   SoupURI *hosturi = soup_uri_copy_host(baseuri);
-  soup_cookie_jar_set_cookie(conn->cookiejar, hosturi, conn->sessionid_cookies);
+  soup_cookie_jar_set_cookie(cookiejar, hosturi, conn->sessionid_cookies);
   soup_uri_free(hosturi);
 
-  guint status_ = soup_session_send_message(conn->session, msg);
+  // try binary RPC first, fallback to XML-RPC for old servers
+  gboolean binary = TRUE;
+  SoupMessage *msg;
+  guint status_;
+  while (true) {
+    msg = soup_rpc_message_new(
+      rpcurl, DFCC_RPC_SUBMIT_METHOD_NAME, params, binary, NULL);
+    status_ = soup_session_send_message(session, msg);
+    break_if_not(binary && SOUP_STATUS_IS_SUCCESSFUL(status_) &&
+                 !soup_message_response_is_binary_rpc(msg));
+    g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_DEBUG,
+          "Server %s does not support binary RPC", server_url->baseurl);
+    binary = FALSE;
+    g_object_unref(msg);
+  }
+
   if (!SOUP_STATUS_IS_SUCCESSFUL(status_)) {
     // fail, cleanup
     soup_uri_free(baseuri);
+    g_free(rpcurl);
   } else {
     // success, fill up uris
     RemoteConnection_cleanuri(conn);
+    conn->session = session;
+    conn->binary_rpc = binary;
+    conn->compression = soup_message_headers_accepts_encoding(
+      msg->response_headers, ZSTD_CONTENT_ENCODING);
     conn->baseuri = baseuri;
-    conn->rpcurl = soup_uri_to_string(rpcuri, FALSE);
+    conn->rpcurl = rpcurl;
     conn->uploaduri = soup_uri_new_with_base(conn->baseuri, DFCC_UPLOAD_PATH);
+    conn->uploadbulkuri =
+      soup_uri_new_with_base(conn->baseuri, DFCC_UPLOAD_BULK_PATH);
     conn->downloaduri =
       soup_uri_new_with_base(conn->baseuri, DFCC_DOWNLOAD_PATH);
+    conn->eventsuri = soup_uri_new_with_base(conn->baseuri, DFCC_EVENTS_PATH);
   }
   soup_uri_free(rpcuri);
 
@@ -116,76 +179,121 @@ static SoupMessage *RemoteConnection_try_submit (
 //! @memberof RemoteConnection
 static void RemoteConnection_destroy (struct RemoteConnection *conn) {
   RemoteConnection_cleanuri(conn);
-  g_object_unref(conn->session);
 }
 
 
 //! @memberof RemoteConnection
-static int RemoteConnection_init (struct RemoteConnection *conn, bool debug) {
+static int RemoteConnection_init (
+    struct RemoteConnection *conn, SoupSession * const sessions[],
+    const char *working_directory) {
+  conn->sessions = sessions;
+  conn->session = NULL;
+  conn->working_directory = working_directory;
+  conn->binary_rpc = TRUE;
+  conn->compression = false;
+  conn->cancellable = NULL;
+  conn->server = NULL;
+
+  // conn->sessionid_cookies = DFCC_COOKIES_SID + buf2hex(sessionid);
+  snprintf(conn->sessionid_cookies, sizeof(conn->sessionid_cookies),
+           DFCC_COOKIES_SID "%x", Client__get_session_id());
+
+  conn->baseuri = NULL;
+  conn->rpcurl = NULL;
+  conn->uploaduri = NULL;
+  conn->uploadbulkuri = NULL;
+  conn->downloaduri = NULL;
+  conn->eventsuri = NULL;
+
+  return 0;
+}
+
+
+/**
+ * @brief Create a new SoupSession suitable for talking to remote servers.
+ *
+ * @param debug whether to log HTTP traffic
+ * @return a new SoupSession
+ */
+static SoupSession *Client__new_session (bool debug) {
   // setup cookie and session
-  conn->cookiejar = soup_cookie_jar_new();
-  conn->session = soup_session_new_with_options(
-    SOUP_SESSION_ADD_FEATURE, conn->cookiejar,
+  SoupCookieJar *cookiejar = soup_cookie_jar_new();
+  SoupSession *session = soup_session_new_with_options(
+    SOUP_SESSION_ADD_FEATURE, cookiejar,
     SOUP_SESSION_ADD_FEATURE_BY_TYPE, SOUP_TYPE_CONTENT_SNIFFER,
     SOUP_SESSION_USER_AGENT, DFCC_USER_AGENT,
     NULL);
-  g_object_unref(conn->cookiejar);
+  g_object_unref(cookiejar);
+  g_object_set(
+    session, SOUP_SESSION_MAX_CONNS_PER_HOST, Client_MAX_CONNS_PER_HOST, NULL);
 
   if (debug) {
     // setup logger
     SoupLogger *logger = soup_logger_new(SOUP_LOGGER_LOG_BODY, -1);
-    soup_session_add_feature(conn->session, SOUP_SESSION_FEATURE(logger));
+    soup_session_add_feature(session, SOUP_SESSION_FEATURE(logger));
     g_object_unref(logger);
   }
 
-  // conn->sessionid_cookies = DFCC_COOKIES_SID + buf2hex(sessionid);
-  snprintf(conn->sessionid_cookies, sizeof(conn->sessionid_cookies),
-           DFCC_COOKIES_SID "%x", Client__get_session_id());
+  return session;
+}
 
-  conn->baseuri = NULL;
-  conn->rpcurl = NULL;
-  conn->uploaduri = NULL;
-  conn->downloaduri = NULL;
 
-  return 0;
+SoupSession **Client_new_sessions (const struct Config *config) {
+  int n_servers = 0;
+  while (config->server_list[n_servers].baseurl != NULL) {
+    n_servers++;
+  }
+
+  SoupSession **sessions = g_new(SoupSession *, n_servers + 1);
+  for (int i = 0; i < n_servers; i++) {
+    sessions[i] = Client__new_session(config->debug);
+    Client__setup_session(sessions[i], config->server_list + i);
+  }
+  sessions[n_servers] = NULL;
+  return sessions;
+}
+
+
+void Client_free_sessions (SoupSession **sessions) {
+  // let background queries of server load save their results
+  Client_wait_server_probes();
+  for (int i = 0; sessions[i] != NULL; i++) {
+    EventHub_detach(sessions[i]);
+    g_object_unref(sessions[i]);
+  }
+  g_free(sessions);
 }
 
 
 static int Client_try_submit (
     struct RemoteConnection *conn,
-    const struct ServerURL server_list[], char * const cc_argv[],
-    char * const cc_envp[], const char *cc_working_directory,
-    GVariant *settings) {
-  GError *error = NULL;
-
+    const struct ServerURL server_list[], const char *exclude,
+    char * const cc_argv[], char * const cc_envp[],
+    const char *cc_working_directory, GVariant *settings) {
   // prepare cc args
-  char *xmlrpc_msg = soup_xmlrpc_build_request(
-    DFCC_RPC_SUBMIT_METHOD_NAME,
-    g_variant_new("(^as^assv)", cc_argv, cc_envp,
-                  cc_working_directory, settings),
-    &error);
-  should (error == NULL) otherwise {
-    g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_CRITICAL,
-          "Error when building XML RPC query: %s", error->message);
-    g_error_free(error);
-    return 1;
-  }
-  size_t xmlrpc_msg_len = strlen(xmlrpc_msg);
+  GVariant *params = g_variant_ref_sink(g_variant_new(
+    "(^as^ass@a{sv})", cc_argv, cc_envp, cc_working_directory, settings));
 
   int ret = 1;
 
-  for (int i = 0; server_list[i].baseurl != NULL; i++) {
+  // try the server with the best expected completion time first
+  int *order = Client_rank_servers(conn->sessions, server_list);
+  for (int k = 0; order[k] != -1; k++) {
+    int i = order[k];
+    continue_if(exclude != NULL &&
+                strcmp(server_list[i].baseurl, exclude) == 0);
     g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_DEBUG,
           "Trying server %s", server_list[i].baseurl);
 
     guint status;
     SoupMessage *msg = RemoteConnection_try_submit(
-      conn, server_list + i, xmlrpc_msg, xmlrpc_msg_len, &status);
+      conn, conn->sessions[i], server_list + i, params, &status);
 
     if (!SOUP_STATUS_IS_SUCCESSFUL(status)) {
       if (status == SOUP_STATUS_SERVICE_UNAVAILABLE) {
         g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_DEBUG,
               "Server %s full", server_list[i].baseurl);
+        Client_note_server_load(server_list + i, true);
       } else {
         g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_INFO,
               "Failed to connect to server %s: %s",
@@ -195,7 +303,7 @@ static int Client_try_submit (
       continue;
     }
 
-    GVariant *response = soup_xmlrpc_parse_response_e(
+    GVariant *response = soup_rpc_parse_response_e(
       msg, DFCC_RPC_SUBMIT_RESPONSE_SIGNATURE,
       DFCC_CLIENT_NAME, G_LOG_LEVEL_MESSAGE);
     g_object_unref(msg);
@@ -204,22 +312,27 @@ static int Client_try_submit (
       g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_DEBUG,
             "Selected server %s", server_list[i].baseurl);
       conn->jid = g_variant_get_uint32(response);
+      conn->server = server_list + i;
       g_variant_unref(response);
+      Client_note_server_load(server_list + i, false);
       ret = 0;
       break;
     }
   }
 
-  g_free(xmlrpc_msg);
+  g_free(order);
+  g_variant_unref(params);
   return ret;
 }
 
 
 static GVariant *Client_query_job (
-    struct RemoteConnection *conn, gboolean *finished, GVariant **filelist) {
+    struct RemoteConnection *conn, gboolean nonblocking,
+    gboolean *finished, GVariant **filelist) {
   unsigned int status;
-  GVariant *response = dfcc_session_xmlrpc(
-    conn->session, conn->rpcurl, QUERY, DFCC_CLIENT_NAME, &status, conn->jid, FALSE);
+  GVariant *response = dfcc_session_rpc(
+    conn->session, conn->rpcurl, QUERY, DFCC_CLIENT_NAME, &status,
+    &conn->binary_rpc, conn->jid, nonblocking);
   return_if_fail(response != NULL) NULL;
   g_variant_get(response, DFCC_RPC_QUERY_RESPONSE_SIGNATURE,
                 finished, filelist);
@@ -230,8 +343,9 @@ static GVariant *Client_query_job (
 static int Client_file_associate (
     struct RemoteConnection *conn, GVariant *filelist) {
   unsigned int status;
-  GVariant *response = dfcc_session_xmlrpc_variant(
-    conn->session, conn->rpcurl, ASSOCIATE, DFCC_CLIENT_NAME, &status, filelist);
+  GVariant *response = dfcc_session_rpc_variant(
+    conn->session, conn->rpcurl, ASSOCIATE, DFCC_CLIENT_NAME, &status,
+    &conn->binary_rpc, filelist);
   return_if_fail(response != NULL) 1;
   g_variant_unref(response);
   return 0;
@@ -251,9 +365,29 @@ static int Client_file_upload (
   }
 
   SoupMessage *msg = soup_message_new_from_uri("PUT", conn->uploaduri);
-  soup_message_set_request(msg, "application/octet-stream",
-                           SOUP_MEMORY_TEMPORARY, m.content, m.length);
+  GByteArray *compressed = NULL;
+  if (conn->compression && m.length >= DFCC_COMPRESSION_MIN_SIZE) {
+    compressed = zstd_compress_e(
+      m.content, m.length, DFCC_COMPRESSION_LEVEL, &error);
+    should (compressed != NULL) otherwise {
+      g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_INFO,
+            "Compress file '%s' failed: %s", path, error->message);
+      g_error_free(error);
+    }
+  }
+  if (compressed != NULL) {
+    soup_message_headers_replace(
+      msg->request_headers, "Content-Encoding", ZSTD_CONTENT_ENCODING);
+    guint len = compressed->len;
+    soup_message_set_request(
+      msg, "application/octet-stream", SOUP_MEMORY_TAKE,
+      (char *) g_byte_array_free(compressed, FALSE), len);
+  } else {
+    soup_message_set_request(msg, "application/octet-stream",
+                             SOUP_MEMORY_TEMPORARY, m.content, m.length);
+  }
   soup_session_send_message(conn->session, msg);
+  MappedFile_destroy(&m);
 
   int ret = 0;
   should (msg->status_code == SOUP_STATUS_OK) otherwise {
@@ -266,49 +400,631 @@ static int Client_file_upload (
 }
 
 
-static int Client_file_download (
-    struct RemoteConnection *conn, const char *path, FileHash hash) {
-  char s_hash[FileHash_STRLEN + 1];
-  FileHash_to_string(hash, s_hash);
-  SoupURI *fileuri = soup_uri_new_with_base(conn->downloaduri, s_hash);
+//! @memberof MappedFile
+static void Client__mapped_file_free (gpointer m) {
+  MappedFile_destroy(m);
+  g_free(m);
+}
 
-  SoupMessage *msg = soup_message_new_from_uri("GET", fileuri);
-  soup_uri_free(fileuri);
+
+/// Size of the pieces a compressed bulk upload is fed to the compressor in.
+#define BulkUpload_SLICE_SIZE (1 << 20)
+
+
+/**
+ * @brief State of a streamed bulk upload.
+ *
+ * The request body is chunked and produced while it is being sent, so only
+ * the pieces not yet written are held in memory.
+ */
+struct BulkUpload {
+  SoupMessage *msg;
+  /// Paths to the files. [element-type filename]
+  GPtrArray *paths;
+  /// Hashes of the files, as known by the server.
+  const FileHash *hashes;
+  /// Index of the next file to open.
+  guint index;
+  /// The file being compressed, or `NULL`.
+  struct MappedFile *file;
+  /// Length of BulkUpload.file already fed to the compressor.
+  size_t offset;
+  /// Compressor if the body is compressed, or `NULL`.
+  struct ZstdEncoder *encoder;
+  /// Number of chunks appended but not yet written.
+  unsigned int n_pending;
+  /// Whether the body has been completed.
+  bool done;
+  /// The first error happened.
+  GError *error;
+};
+
+
+//! @memberof BulkUpload
+static int BulkUpload__append (const void *buf, size_t size, void *userdata) {
+  struct BulkUpload *upload = userdata;
+  soup_message_body_append(
+    upload->msg->request_body, SOUP_MEMORY_COPY, buf, size);
+  upload->n_pending++;
+  return 0;
+}
+
+
+/**
+ * @memberof BulkUpload
+ * @private
+ * @brief Appends the next piece of the request body.
+ *
+ * Uncompressed files are appended as a whole, directly from their mappings.
+ *
+ * @param upload a BulkUpload
+ * @return 0 if success, otherwize nonzero
+ */
+static int BulkUpload__step (struct BulkUpload *upload) {
+  SoupMessageBody *body = upload->msg->request_body;
+
+  if (upload->file != NULL) {
+    struct MappedFile *m = upload->file;
+    size_t size = MIN(BulkUpload_SLICE_SIZE, m->length - upload->offset);
+    int ret = ZstdEncoder_feed(
+      upload->encoder, m->content + upload->offset, size,
+      false, BulkUpload__append, upload, &upload->error);
+    upload->offset += size;
+    if (upload->offset >= m->length) {
+      Client__mapped_file_free(m);
+      upload->file = NULL;
+    }
+    return ret;
+  }
+
+  if (upload->index >= upload->paths->len) {
+    if (upload->encoder != NULL) {
+      return_if_fail(ZstdEncoder_feed(
+        upload->encoder, NULL, 0, true, BulkUpload__append, upload,
+        &upload->error) == 0) 1;
+    }
+    soup_message_body_complete(body);
+    upload->done = true;
+    return 0;
+  }
+
+  const char *path = g_ptr_array_index(upload->paths, upload->index);
+  struct MappedFile *m = g_new(struct MappedFile, 1);
+  should (MappedFile_init(m, path, &upload->error) == 0) otherwise {
+    g_free(m);
+    return 1;
+  }
+  guint64 header[2] = {
+    GUINT64_TO_BE(upload->hashes[upload->index]),
+    GUINT64_TO_BE(m->length),
+  };
+  upload->index++;
+
+  if (upload->encoder != NULL) {
+    upload->file = m;
+    upload->offset = 0;
+    return ZstdEncoder_feed(
+      upload->encoder, header, sizeof(header), false,
+      BulkUpload__append, upload, &upload->error);
+  }
+
+  soup_message_body_append(body, SOUP_MEMORY_COPY, header, sizeof(header));
+  SoupBuffer *buffer = soup_buffer_new_with_owner(
+    m->content, m->length, m, Client__mapped_file_free);
+  soup_message_body_append_buffer(body, buffer);
+  soup_buffer_free(buffer);
+  upload->n_pending += 2;
+  return 0;
+}
+
+
+/**
+ * @memberof BulkUpload
+ * @private
+ * @brief Appends pieces until a chunk is ready to be written, or the body is
+ *        complete.
+ *
+ * On error, the body is cut short, so the server rejects the request.
+ *
+ * @param upload a BulkUpload
+ */
+static void BulkUpload__fill (struct BulkUpload *upload) {
+  while (upload->n_pending == 0 && !upload->done) {
+    should (BulkUpload__step(upload) == 0) otherwise {
+      soup_message_body_complete(upload->msg->request_body);
+      upload->done = true;
+    }
+  }
+}
+
+
+/**
+ * @memberof BulkUpload
+ * @brief Callback when a chunk of the request body has been written.
+ *
+ * @param msg a SoupMessage
+ * @param user_data a BulkUpload
+ */
+static void BulkUpload_wrote_chunk (SoupMessage *msg, gpointer user_data) {
+  struct BulkUpload *upload = user_data;
+  return_if_fail(upload->n_pending > 0);
+  upload->n_pending--;
+  BulkUpload__fill(upload);
+}
+
+
+//! @memberof BulkUpload
+static void BulkUpload_destroy (struct BulkUpload *upload) {
+  if (upload->file != NULL) {
+    Client__mapped_file_free(upload->file);
+  }
+  if (upload->encoder != NULL) {
+    ZstdEncoder_destroy(upload->encoder);
+    g_free(upload->encoder);
+  }
+  if (upload->error != NULL) {
+    g_error_free(upload->error);
+  }
+}
+
+
+//! @memberof BulkUpload
+static void BulkUpload_init (
+    struct BulkUpload *upload, SoupMessage *msg, GPtrArray *paths,
+    const FileHash *hashes, bool compression) {
+  upload->msg = msg;
+  upload->paths = paths;
+  upload->hashes = hashes;
+  upload->index = 0;
+  upload->file = NULL;
+  upload->offset = 0;
+  upload->n_pending = 0;
+  upload->done = false;
+  upload->error = NULL;
+
+  // compress the whole body as a single stream
+  upload->encoder = NULL;
+  if (compression) {
+    upload->encoder = g_new(struct ZstdEncoder, 1);
+    should (ZstdEncoder_init(
+        upload->encoder, DFCC_COMPRESSION_LEVEL) == 0) otherwise {
+      g_free(upload->encoder);
+      upload->encoder = NULL;
+    }
+  }
+}
+
+
+/**
+ * @memberof BulkUpload
+ * @brief Callback when the request is about to be resent, such as after a
+ *        dropped keep-alive connection.
+ *
+ * Written chunks are not kept, so the body is produced again from the start.
+ *
+ * @param msg a SoupMessage
+ * @param user_data a BulkUpload
+ */
+static void BulkUpload_restarted (SoupMessage *msg, gpointer user_data) {
+  struct BulkUpload *upload = user_data;
+  bool compression = upload->encoder != NULL;
+  GPtrArray *paths = upload->paths;
+  const FileHash *hashes = upload->hashes;
+  BulkUpload_destroy(upload);
+  BulkUpload_init(upload, msg, paths, hashes, compression);
+  soup_message_body_truncate(msg->request_body);
+  BulkUpload__fill(upload);
+}
+
+
+/**
+ * @brief Uploads several files in a single request.
+ *
+ * The request body is streamed; uncompressed files are written to the socket
+ * directly from their mappings.
+ *
+ * @param conn a RemoteConnection
+ * @param paths paths to the files [element-type filename]
+ * @param hashes hashes of the files, as reported by the server
+ * @return 0 if success, otherwise non-zero
+ */
+static int Client_file_upload_bulk (
+    struct RemoteConnection *conn, GPtrArray *paths, const FileHash *hashes) {
+  SoupMessage *msg = soup_message_new_from_uri("POST", conn->uploadbulkuri);
+  soup_message_headers_set_content_type(
+    msg->request_headers, "application/octet-stream", NULL);
+  soup_message_headers_set_encoding(
+    msg->request_headers, SOUP_ENCODING_CHUNKED);
+  // old servers ignore this and answer in XML-RPC
+  soup_message_headers_replace(
+    msg->request_headers, "Accept", SOUP_RPC_BINARY_CONTENT_TYPE);
+  // written chunks are not needed any more
+  soup_message_body_set_accumulate(msg->request_body, FALSE);
+
+  struct BulkUpload upload;
+  BulkUpload_init(&upload, msg, paths, hashes, conn->compression);
+  if (upload.encoder != NULL) {
+    soup_message_headers_replace(
+      msg->request_headers, "Content-Encoding", ZSTD_CONTENT_ENCODING);
+  }
+  g_signal_connect(
+    msg, "wrote-chunk", G_CALLBACK(BulkUpload_wrote_chunk), &upload);
+  g_signal_connect(
+    msg, "restarted", G_CALLBACK(BulkUpload_restarted), &upload);
+  BulkUpload__fill(&upload);
+
+  soup_session_send_message(conn->session, msg);
 
   int ret = 0;
   do_once {
-    soup_session_send_message(conn->session, msg);
+    should (upload.error == NULL) otherwise {
+      g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_WARNING,
+            "Cannot upload files: %s", upload.error->message);
+      ret = 1;
+      break;
+    }
     should (msg->status_code == SOUP_STATUS_OK) otherwise {
-      g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_CRITICAL,
-            "Cannot download %s, HTTP code %d", s_hash, msg->status_code);
+      g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_WARNING,
+            "Cannot upload, HTTP code %d", msg->status_code);
       ret = 1;
       break;
     }
 
-    GError *error = NULL;
-    FILE *output = g_fopen_e(path, "w", &error);
-    should (output != NULL) otherwise {
-      g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_CRITICAL, error->message);
-      g_error_free(error);
+    GVariant *response = soup_rpc_parse_response_e(
+      msg, DFCC_RPC_UPLOAD_BULK_RESPONSE_SIGNATURE,
+      DFCC_CLIENT_NAME, G_LOG_LEVEL_WARNING);
+    should (response != NULL) otherwise {
       ret = 1;
       break;
     }
+    should (g_variant_n_children(response) == paths->len) otherwise {
+      g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_WARNING,
+            "Server accepted %zu of %u files",
+            g_variant_n_children(response), paths->len);
+      ret = 1;
+    }
+    g_variant_unref(response);
+  }
 
-    do_once {
-      should (fwrite(
-          msg->response_body->data, msg->response_body->length, 1, output
-      ) == msg->response_body->length) otherwise {
-        g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_CRITICAL,
-              "File write failed: %s", strerror(errno));
-        ret = 1;
-        break;
-      }
+  BulkUpload_destroy(&upload);
+  g_object_unref(msg);
+  return ret;
+}
+
+
+/**
+ * @brief State of a batch of concurrent downloads.
+ */
+struct DownloadBatch {
+  GMainLoop *loop;
+  /// Number of unfinished downloads.
+  unsigned int pending;
+  /// Whether any download failed.
+  bool failed;
+};
+
+
+/**
+ * @brief State of a single download.
+ */
+struct Download {
+  struct DownloadBatch *batch;
+  /// Final path of the file.
+  char *path;
+  /// Path of the temporary file, in the same directory as Download.path.
+  char *tmppath;
+  /// File descriptor of Download.tmppath.
+  int fd;
+  /// Decompressor if the response is compressed, or `NULL`.
+  struct ZstdDecoder *decoder;
+  /// Whether writing to Download.fd failed.
+  bool failed;
+};
+
+
+//! @memberof Download
+static void Download_free (struct Download *download) {
+  if (download->fd >= 0) {
+    close(download->fd);
+  }
+  if (download->decoder != NULL) {
+    ZstdDecoder_destroy(download->decoder);
+    g_free(download->decoder);
+  }
+  g_free(download->tmppath);
+  g_free(download->path);
+  g_free(download);
+}
+
+
+/**
+ * @memberof Download
+ * @brief Writes a piece of the file into the temporary file.
+ *
+ * @param buf the data
+ * @param size length of `buf`
+ * @param userdata a Download
+ * @return 0 if success, otherwise non-zero
+ */
+static int Download_write (const void *buf, size_t size, void *userdata) {
+  struct Download *download = userdata;
+  GError *error = NULL;
+  should (write_e(download->fd, buf, size, &error) == size) otherwise {
+    g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_CRITICAL,
+          "Cannot write '%s': %s", download->tmppath, error->message);
+    g_error_free(error);
+    download->failed = true;
+    return 1;
+  }
+  return 0;
+}
+
+
+/**
+ * @memberof Download
+ * @brief Callback when the response headers arrive.
+ */
+static void Download_got_headers (SoupMessage *msg, gpointer user_data) {
+  struct Download *download = user_data;
+  return_if(download->decoder != NULL);
+  return_if_not(soup_message_headers_is_encoded(
+    msg->response_headers, ZSTD_CONTENT_ENCODING));
+
+  download->decoder = g_new(struct ZstdDecoder, 1);
+  should (ZstdDecoder_init(download->decoder) == 0) otherwise {
+    g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_CRITICAL,
+          "Cannot create zstd context for '%s'", download->path);
+    g_free(download->decoder);
+    download->decoder = NULL;
+    download->failed = true;
+  }
+}
+
+
+/**
+ * @memberof Download
+ * @brief Callback when a chunk of the file arrives.
+ */
+static void Download_got_chunk (
+    SoupMessage *msg, SoupBuffer *chunk, gpointer user_data) {
+  struct Download *download = user_data;
+  return_if(download->failed);
+
+  if (download->decoder == NULL) {
+    Download_write(chunk->data, chunk->length, download);
+    return;
+  }
+
+  GError *error = NULL;
+  should (ZstdDecoder_feed(
+      download->decoder, chunk->data, chunk->length,
+      Download_write, download, &error) == 0) otherwise {
+    if (error != NULL) {
+      g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_CRITICAL,
+            "Cannot decompress '%s': %s", download->path, error->message);
+      g_error_free(error);
+    }
+    download->failed = true;
+  }
+}
+
+
+/**
+ * @memberof Download
+ * @brief Callback when the download finishes.
+ *
+ * Renames the temporary file into place if the download succeeded.
+ */
+static void Download_finish (
+    SoupSession *session, SoupMessage *msg, gpointer user_data) {
+  struct Download *download = user_data;
+  struct DownloadBatch *batch = download->batch;
+
+  do_once {
+    should (msg->status_code == SOUP_STATUS_OK) otherwise {
+      g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_CRITICAL,
+            "Cannot download '%s', HTTP code %d",
+            download->path, msg->status_code);
+      download->failed = true;
+    }
+    break_if(download->failed);
+    should (download->decoder == NULL ||
+        download->decoder->frame_end) otherwise {
+      g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_CRITICAL,
+            "Truncated download '%s'", download->path);
+      download->failed = true;
+      break;
+    }
+
+    int fd = download->fd;
+    download->fd = -1;
+    should (close(fd) == 0) otherwise {
+      g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_CRITICAL,
+            "Cannot write '%s': %s", download->tmppath, g_strerror(errno));
+      download->failed = true;
+      break;
+    }
+    should (g_rename(download->tmppath, download->path) == 0) otherwise {
+      g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_CRITICAL,
+            "Cannot rename '%s' to '%s': %s",
+            download->tmppath, download->path, g_strerror(errno));
+      download->failed = true;
     }
+  }
 
-    fclose(output);
+  if (download->failed) {
+    g_unlink(download->tmppath);
+    batch->failed = true;
   }
+  Download_free(download);
 
-  g_object_unref(msg);
+  batch->pending--;
+  if (batch->pending == 0) {
+    g_main_loop_quit(batch->loop);
+  }
+}
+
+
+/**
+ * @brief Starts downloading a file into `path`.
+ *
+ * The content is written into a temporary file next to `path` as it arrives,
+ * and the temporary file is renamed to `path` when done.
+ *
+ * @param conn a RemoteConnection
+ * @param batch a DownloadBatch, whose main context is the thread-default one
+ * @param path path to the output file
+ * @param hash the FileHash of the file
+ * @return 0 if success, otherwise non-zero
+ */
+static int Client_file_download (
+    struct RemoteConnection *conn, struct DownloadBatch *batch,
+    const char *path, FileHash hash) {
+  struct Download *download = g_new(struct Download, 1);
+  download->batch = batch;
+  download->path = g_strdup(path);
+  download->tmppath = g_strconcat(path, ".XXXXXX", NULL);
+  download->decoder = NULL;
+  download->failed = false;
+  download->fd = g_mkstemp_full(download->tmppath, O_WRONLY | O_CLOEXEC, 0666);
+  should (download->fd >= 0) otherwise {
+    g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_CRITICAL,
+          "Cannot create temporary file for '%s': %s",
+          path, g_strerror(errno));
+    Download_free(download);
+    return 1;
+  }
+
+  char s_hash[FileHash_STRLEN + 1];
+  FileHash_to_string(hash, s_hash);
+  SoupURI *fileuri = soup_uri_new_with_base(conn->downloaduri, s_hash);
+  SoupMessage *msg = soup_message_new_from_uri("GET", fileuri);
+  soup_uri_free(fileuri);
+
+  soup_message_headers_replace(
+    msg->request_headers, "Accept-Encoding", ZSTD_CONTENT_ENCODING);
+  soup_message_body_set_accumulate(msg->response_body, FALSE);
+  g_signal_connect(
+    msg, "got-headers", G_CALLBACK(Download_got_headers), download);
+  g_signal_connect(msg, "got-chunk", G_CALLBACK(Download_got_chunk), download);
+  batch->pending++;
+  soup_session_queue_message(conn->session, msg, Download_finish, download);
+  return 0;
+}
+
+
+/**
+ * @brief Get the file hash database shared by all clients on the host.
+ *
+ * @return a HashDB, or NULL if unavailable
+ */
+static struct HashDB *Client__get_hashdb (void) {
+  static struct HashDB db;
+  static bool db_vaild = false;
+  static gsize db_initialized = 0;
+
+  if (g_once_init_enter(&db_initialized)) {
+    // one database per hash algorithm
+    char *filename = FileHash_algorithm == FileHash_XXH64 ?
+      g_strdup(DFCC_HASHDB_FILENAME) :
+      g_strconcat(DFCC_HASHDB_FILENAME ".",
+                  FileHash_algorithm_names[FileHash_algorithm], NULL);
+    char *path = g_build_filename(
+      g_get_user_cache_dir(), DFCC_NAME, filename, NULL);
+    g_free(filename);
+    GError *error = NULL;
+    db_vaild = HashDB_init(&db, path, HashDB_DEFAULT_SLOTS, &error) == 0;
+    should (db_vaild) otherwise {
+      g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_INFO,
+            "Cannot open hash database '%s': %s", path, error->message);
+      g_error_free(error);
+    }
+    g_free(path);
+    g_once_init_leave(&db_initialized, 1);
+  }
+
+  return db_vaild ? &db : NULL;
+}
+
+
+/// Maximum number of threads hashing files concurrently.
+#define Client_HASH_THREADS 8
+
+
+/**
+ * @brief A file to be hashed by the pool of Client__hash_files().
+ */
+struct HashJob {
+  const char *path;
+  FileHash hash;
+  GError *error;
+  /// Queue of finished HashJob.
+  GAsyncQueue *done;
+};
+
+
+//! @memberof HashJob
+static void HashJob_run (gpointer data, gpointer hashdb) {
+  struct HashJob *job = data;
+  job->hash = HashDB_hash_file(hashdb, job->path, &job->error);
+  g_async_queue_push(job->done, job);
+}
+
+
+/**
+ * @brief Hashes files in parallel, and adds them to `builder` as results
+ *        complete.
+ *
+ * @param paths paths to files [element-type filename]
+ * @param builder a GVariantBuilder of type `a{st}`
+ * @param strict whether a file which cannot be hashed is an error, otherwise
+ *               it is skipped
+ * @return 0 if success, otherwise non-zero
+ */
+static int Client__hash_files (
+    GPtrArray *paths, GVariantBuilder *builder, bool strict) {
+  return_if(paths->len == 0) 0;
+
+  struct HashDB *hashdb = Client__get_hashdb();
+  struct HashJob *jobs = g_new0(struct HashJob, paths->len);
+  GAsyncQueue *done = g_async_queue_new();
+  GThreadPool *pool = NULL;
+  if (paths->len > 1) {
+    int n_threads = min(min(
+      g_get_num_processors(), Client_HASH_THREADS), (int) paths->len);
+    pool = g_thread_pool_new(HashJob_run, hashdb, n_threads, FALSE, NULL);
+  }
+  for (guint i = 0; i < paths->len; i++) {
+    jobs[i].path = g_ptr_array_index(paths, i);
+    jobs[i].done = done;
+    if (pool != NULL) {
+      g_thread_pool_push(pool, jobs + i, NULL);
+    } else {
+      HashJob_run(jobs + i, hashdb);
+    }
+  }
+
+  int ret = 0;
+  for (guint i = 0; i < paths->len; i++) {
+    struct HashJob *job = g_async_queue_pop(done);
+    if (job->hash != 0) {
+      g_variant_builder_add(builder, "{st}", job->path, job->hash);
+    } else if (strict && ret == 0) {
+      g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_ERROR,
+            "Coumpute hash of file '%s' failed: %s", job->path,
+            job->error != NULL ? job->error->message : "Unknown error");
+      ret = 1;
+    }
+    if (job->error != NULL) {
+      g_error_free(job->error);
+    }
+  }
+
+  if (pool != NULL) {
+    g_thread_pool_free(pool, FALSE, TRUE);
+  }
+  g_async_queue_unref(done);
+  g_free(jobs);
   return ret;
 }
 
@@ -322,35 +1038,47 @@ static int Client_remote_missing (
   GVariantBuilder builder;
   g_variant_builder_init(&builder,
                          G_VARIANT_TYPE(DFCC_RPC_ASSOCIATE_REQUEST_SIGNATURE));
-  bool need_associate = false;
+  // files to hash
+  GPtrArray *unhashed = g_ptr_array_new_with_free_func(g_free);
+  // files to upload, and their hashes known by the server
+  GPtrArray *uploads = g_ptr_array_new_with_free_func(g_free);
+  GArray *upload_hashes = g_array_new(FALSE, FALSE, sizeof(FileHash));
 
-  GError *error = NULL;
   GVariantIter iter;
   char *path;
   FileHash hash;
   for (g_variant_iter_init(&iter, filelist);
-       g_variant_iter_loop(&iter, "{st}", &path, &hash);) {
+       g_variant_iter_next(&iter, "{st}", &path, &hash);) {
     if (hash == 0) {
-      need_associate = true;
-
-      FileHash hash = FileHash_from_file(path, &error);
-      should (hash != 0) otherwise {
-        g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_ERROR,
-              "Coumpute hash of file '%s' failed: %s", path, error->message);
-        g_error_free(error);
-        goto loop_error;
-      }
-
-      g_variant_builder_add(&builder, "{st}", path, hash);
+      g_ptr_array_add(unhashed, path);
     } else {
-      goto_if_fail(Client_file_upload(conn, path) == 0) loop_error;
+      g_ptr_array_add(uploads, path);
+      g_array_append_val(upload_hashes, hash);
     }
+  }
 
-named_block(loop_error): {
-      g_free(path);
-      g_variant_builder_clear(&builder);
-      return 1;
-    }
+  bool need_associate = unhashed->len > 0;
+  int hash_ret = Client__hash_files(unhashed, &builder, true);
+  g_ptr_array_free(unhashed, TRUE);
+  should (hash_ret == 0) otherwise {
+    g_variant_builder_clear(&builder);
+    g_ptr_array_free(uploads, TRUE);
+    g_array_free(upload_hashes, TRUE);
+    return 1;
+  }
+
+  int ret = 0;
+  if (uploads->len == 1) {
+    ret = Client_file_upload(conn, g_ptr_array_index(uploads, 0));
+  } else if (uploads->len > 1) {
+    ret = Client_file_upload_bulk(
+      conn, uploads, (const FileHash *) upload_hashes->data);
+  }
+  g_ptr_array_free(uploads, TRUE);
+  g_array_free(upload_hashes, TRUE);
+  should (ret == 0) otherwise {
+    g_variant_builder_clear(&builder);
+    return 1;
   }
 
   if (need_associate) {
@@ -373,60 +1101,277 @@ static int Client_remote_finish (
   g_variant_get(filelist, DFCC_RPC_QUERY_RESPONSE_FINISH_SIGNATURE,
                 &outputs, &info);
 
+  // download all outputs concurrently in a private main context
+  GMainContext *context = g_main_context_new();
+  g_main_context_push_thread_default(context);
+  struct DownloadBatch batch = {
+    .loop = g_main_loop_new(context, FALSE),
+    .pending = 0,
+    .failed = false,
+  };
+
   GVariantIter iter;
   char *path;
   FileHash hash;
   for (g_variant_iter_init(&iter, outputs);
        g_variant_iter_loop(&iter, "{st}", &path, &hash);) {
-    should (Client_file_download(conn, path, hash) == 0) otherwise {
+    char *fullpath = g_path_is_absolute(path) ?
+      g_strdup(path) :
+      g_build_filename(conn->working_directory, path, NULL);
+    int ret = Client_file_download(conn, &batch, fullpath, hash);
+    g_free(fullpath);
+    should (ret == 0) otherwise {
+      batch.failed = true;
       g_free(path);
-      return 1;
+      break;
     }
   }
 
-  g_variant_get_struct(info, result, ResultInfo__info);
+  if (batch.pending > 0) {
+    g_main_loop_run(batch.loop);
+  }
+  g_main_loop_unref(batch.loop);
+  g_main_context_pop_thread_default(context);
+  g_main_context_unref(context);
+  g_variant_unref(outputs);
+
+  if (!batch.failed) {
+    g_variant_get_struct(info, result, ResultInfo__info);
+  }
+  g_variant_unref(info);
+
+  return batch.failed ? 1 : 0;
+}
+
+
+/**
+ * @brief Add the hashes of the include closure of the job to its settings, so
+ *        that the server rarely needs to ask for source files.
+ *
+ * @param settings settings of the job, consumed if floating
+ * @param cc_argv compiler's argument vector [array zero-terminated=1]
+ * @param cc_working_directory compiler's working directory
+ * @return new settings [transfer-floating]
+ */
+static GVariant *Client_prescan (
+    GVariant *settings, char * const cc_argv[],
+    const char *cc_working_directory) {
+  GHashTable *files = CC_scan_includes(cc_argv, cc_working_directory);
+
+  GVariantBuilder builder;
+  g_variant_builder_init(&builder,
+                         G_VARIANT_TYPE(DFCC_RPC_ASSOCIATE_REQUEST_SIGNATURE));
+  GPtrArray *paths = g_ptr_array_sized_new(g_hash_table_size(files));
+  GHashTableIter iter;
+  const char *path;
+  for (g_hash_table_iter_init(&iter, files);
+       g_hash_table_iter_next(&iter, (gpointer *) &path, NULL);) {
+    g_ptr_array_add(paths, (gpointer) path);
+  }
+  Client__hash_files(paths, &builder, false);
+  g_ptr_array_free(paths, TRUE);
+  g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_DEBUG,
+        "Prescan found %u file(s)", g_hash_table_size(files));
+  g_hash_table_destroy(files);
+
+  GVariantDict dict;
+  g_variant_dict_init(&dict, settings);
+  g_variant_dict_insert_value(
+    &dict, DFCC_RPC_SUBMIT_SETTING_FILES, g_variant_builder_end(&builder));
+  g_variant_unref(g_variant_ref_sink(settings));
+  return g_variant_dict_end(&dict);
+}
+
+
+void RemoteContender_cancel (struct RemoteContender *contender) {
+  g_cancellable_cancel(contender->cancellable);
+
+  g_mutex_lock(&contender->race->mtx);
+  SoupSession *session = contender->session;
+  char *rpcurl = g_strdup(contender->rpcurl);
+  GPid jid = contender->jid;
+  g_mutex_unlock(&contender->race->mtx);
+  // not submitted yet, the contender will cancel the job itself
+  return_if(rpcurl == NULL);
+
+  g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_DEBUG,
+        "Cancel job %" G_PID_FORMAT " on %s", jid, contender->baseurl);
+  unsigned int status;
+  gboolean binary = TRUE;
+  GVariant *response = dfcc_session_rpc(
+    session, rpcurl, CANCEL, DFCC_CLIENT_NAME, &status, &binary, jid);
+  if (response != NULL) {
+    g_variant_unref(response);
+  }
+  g_free(rpcurl);
+}
+
+
+void RemoteContender_destroy (struct RemoteContender *contender) {
+  g_object_unref(contender->cancellable);
+  g_free(contender->rpcurl);
+}
+
 
+int RemoteContender_init (
+    struct RemoteContender *contender, struct Race *race, int id,
+    const char *exclude) {
+  contender->race = race;
+  contender->id = id;
+  contender->cancellable = g_cancellable_new();
+  contender->exclude = exclude;
+  contender->baseurl = NULL;
+  contender->session = NULL;
+  contender->rpcurl = NULL;
+  contender->jid = 0;
   return 0;
 }
 
 
-int Client_run_remotely (
-    const struct Config *config, struct ResultInfo * restrict result,
-    char * const remote_argv[], char * const remote_envp[]) {
+int Client_run_remotely_contending (
+    SoupSession * const sessions[], const struct Config *config,
+    struct ResultInfo * restrict result,
+    char * const remote_argv[], char * const remote_envp[],
+    struct RemoteContender *contender) {
   int ret = 0;
   struct RemoteConnection conn;
-  RemoteConnection_init(&conn, config->debug);
+  RemoteConnection_init(&conn, sessions, config->cc_working_directory);
+  if (contender != NULL) {
+    conn.cancellable = contender->cancellable;
+  }
+
+  GVariant *info = g_variant_ref_sink(
+    g_variant_new_struct(config, Config__info));
+  GVariantDict dict;
+  g_variant_dict_init(&dict, info);
+  g_variant_unref(info);
+  // the server must hash files the same way
+  g_variant_dict_insert(
+    &dict, DFCC_RPC_SUBMIT_SETTING_HASH, "s",
+    FileHash_algorithm_names[FileHash_algorithm]);
+  GVariant *settings = g_variant_dict_end(&dict);
+  if (config->prescan) {
+    settings = Client_prescan(
+      settings, remote_argv, config->cc_working_directory);
+  }
 
+  gint64 submitted = g_get_monotonic_time();
   if unlikely (Client_try_submit(
-      &conn, config->server_list, remote_argv, remote_envp,
-      config->cc_working_directory,
-      g_variant_new_struct(config, Config__info)) != 0) {
+      &conn, config->server_list,
+      contender != NULL ? contender->exclude : NULL,
+      remote_argv, remote_envp, config->cc_working_directory,
+      settings) != 0) {
     g_log(DFCC_CLIENT_NAME, G_LOG_LEVEL_WARNING, "No server available");
     RemoteConnection_destroy(&conn);
     return 1;
   }
 
+  if (contender != NULL) {
+    // publish the job, so that it can be cancelled by others
+    g_mutex_lock(&contender->race->mtx);
+    contender->baseurl = conn.server->baseurl;
+    contender->session = conn.session;
+    contender->rpcurl = g_strdup(conn.rpcurl);
+    contender->jid = conn.jid;
+    g_mutex_unlock(&contender->race->mtx);
+
+    if unlikely (g_cancellable_is_cancelled(contender->cancellable)) {
+      RemoteContender_cancel(contender);
+      RemoteConnection_destroy(&conn);
+      return 1;
+    }
+  }
+
+  // subscribe to job events on the stream shared by all jobs of the session,
+  // or fall back to blocking queries
+  struct EventHub *events = EventHub_get(conn.session, conn.eventsuri);
+  int subscribed = EventHub_subscribe(events, conn.jid, submitted);
+  if (subscribed < 0) {
+    events = NULL;
+  }
+  // catch up with events emitted before subscription
+  gboolean nonblocking = subscribed == 0;
+
   while (true) {
     gboolean finished;
     GVariant *filelist;
 
-    GVariant *response = Client_query_job(&conn, &finished, &filelist);
+    GVariant *response;
+    if (nonblocking || events == NULL) {
+      response = Client_query_job(&conn, nonblocking, &finished, &filelist);
+    } else {
+      response = EventHub_wait(events, conn.jid, conn.cancellable);
+      if (response != NULL) {
+        g_variant_get(response, DFCC_RPC_QUERY_RESPONSE_SIGNATURE,
+                      &finished, &filelist);
+      }
+    }
+    nonblocking = FALSE;
+    if unlikely (g_cancellable_is_cancelled(conn.cancellable)) {
+      // lost the race
+      if (response != NULL) {
+        g_variant_unref(filelist);
+        g_variant_unref(response);
+      }
+      ret = 1;
+      break;
+    }
+    if unlikely (response == NULL && events != NULL) {
+      EventHub_unsubscribe(events, conn.jid);
+      events = NULL;
+      continue;
+    }
     should (response != NULL) otherwise {
       ret = 1;
       break;
     }
 
-    should ((finished ?
-        Client_remote_missing(&conn, filelist) :
-        Client_remote_finish(&conn, filelist, result)) == 0) otherwise {
-      ret = 1;
+    // only the winner may write output files
+    if (finished && contender != NULL &&
+        !Race_claim(contender->race, contender->id)) {
+      g_variant_unref(filelist);
       g_variant_unref(response);
+      ret = 1;
       break;
     }
 
+    int step_ret = finished ?
+      Client_remote_finish(&conn, filelist, result) :
+      Client_remote_missing(&conn, filelist);
+    g_variant_unref(filelist);
     g_variant_unref(response);
+    should (step_ret == 0) otherwise {
+      ret = 1;
+      break;
+    }
+    break_if(finished);
   }
 
+  if (events != NULL) {
+    EventHub_unsubscribe(events, conn.jid);
+  }
   RemoteConnection_destroy(&conn);
   return ret;
 }
+
+
+int Client_run_remotely_with_sessions (
+    SoupSession * const sessions[], const struct Config *config,
+    struct ResultInfo * restrict result,
+    char * const remote_argv[], char * const remote_envp[]) {
+  return config->hedge ?
+    Client_run_hedged(sessions, config, result, remote_argv, remote_envp) :
+    Client_run_remotely_contending(
+      sessions, config, result, remote_argv, remote_envp, NULL);
+}
+
+
+int Client_run_remotely (
+    const struct Config *config, struct ResultInfo * restrict result,
+    char * const remote_argv[], char * const remote_envp[]) {
+  SoupSession **sessions = Client_new_sessions(config);
+  int ret = Client_run_remotely_with_sessions(
+    sessions, config, result, remote_argv, remote_envp);
+  Client_free_sessions(sessions);
+  return ret;
+}
@@ -5,10 +5,124 @@
  * @{
  */
 
+#include <stdbool.h>
+
+#include <libsoup/soup.h>
+
 #include "config/config.h"
+#include "config/serverurl.h"
 #include "cc/resultinfo.h"
 
 
+/**
+ * @brief Create a SoupSession for each server of Config.server_list.
+ *
+ * Per-server settings, such as proxy and timeout, are applied once here, so
+ * that the sessions can be shared between threads.
+ *
+ * @param config a Config
+ * @return sessions in the order of Config.server_list, terminated by `NULL`
+ *         [transfer-full]
+ */
+SoupSession **Client_new_sessions (const struct Config *config);
+/**
+ * @brief Frees sessions from Client_new_sessions().
+ *
+ * @param sessions sessions
+ */
+void Client_free_sessions (SoupSession **sessions);
+struct Race;
+
+
+/**
+ * @brief Contains the state of a remote job taking part in a Race.
+ */
+struct RemoteContender {
+  /// The race.
+  struct Race *race;
+  /// Index of the contender in the race.
+  int id;
+  /// Cancelled when the contender has lost.
+  GCancellable *cancellable;
+  /// Base URL of a server to be avoided [nullable]
+  const char *exclude;
+
+  /** @name Job
+   *  Set once the job is submitted, protected by the mutex of the race
+   */
+  ///@{
+
+  /// Base URL of the server running the job.
+  const char *baseurl;
+  /// Session to the server running the job.
+  SoupSession *session;
+  /// RPC URL of the server running the job.
+  char *rpcurl;
+  /// Job ID.
+  GPid jid;
+  ///@}
+};
+
+
+/**
+ * @memberof RemoteContender
+ * @brief Cancel the contender and its remote job.
+ *
+ * @param contender a RemoteContender
+ */
+void RemoteContender_cancel (struct RemoteContender *contender);
+/**
+ * @memberof RemoteContender
+ * @brief Frees associated resources of a RemoteContender.
+ *
+ * @param contender a RemoteContender
+ */
+void RemoteContender_destroy (struct RemoteContender *contender);
+/**
+ * @memberof RemoteContender
+ * @brief Initializes a RemoteContender.
+ *
+ * @param contender a RemoteContender
+ * @param race a Race
+ * @param id index of the contender in the race
+ * @param exclude base URL of a server to be avoided [nullable]
+ * @return 0 if success, otherwize nonzero
+ */
+int RemoteContender_init (
+  struct RemoteContender *contender, struct Race *race, int id,
+  const char *exclude);
+
+
+/**
+ * @brief Try to submit and run the compiler on one of the remote servers,
+ *        as a contender of a race.
+ *
+ * Output files are only written if the contender wins the race.
+ *
+ * @param sessions sessions from Client_new_sessions()
+ * @param config a Config
+ * @param contender a RemoteContender [nullable]
+ * @return 0 if success, otherwise non-zero
+ */
+int Client_run_remotely_contending (
+  SoupSession * const sessions[], const struct Config *config,
+  struct ResultInfo * restrict result,
+  char * const remote_argv[], char * const remote_envp[],
+  struct RemoteContender *contender);
+/**
+ * @brief Try to submit and run the compiler on one of the remote servers,
+ *        reusing existing sessions.
+ *
+ * Connections kept alive in `sessions` are reused across calls.
+ *
+ * @param sessions sessions from Client_new_sessions()
+ * @param config a Config
+ * @return 0 if success, otherwise non-zero
+ */
+int Client_run_remotely_with_sessions (
+  SoupSession * const sessions[], const struct Config *config,
+  struct ResultInfo * restrict result,
+  char * const remote_argv[], char * const remote_envp[]);
 /**
  * @brief Try to submit and run the compiler on one of the remote servers.
  *
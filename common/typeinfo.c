@@ -12,3 +12,35 @@ static inline int StructInfo_match_ (
 int StructInfo_match (const void *info, const void *key) {
   return StructInfo_match_(info, key);
 }
+
+
+void StructInfo_clear (void *instance, const struct StructInfo *info) {
+#define case_type(TYPE, type) \
+  case G_TYPE_ ## TYPE: \
+    G_STRUCT_MEMBER(type, instance, info[i].offset) = 0; \
+    break;
+
+  for (int i = 0; info[i].key != NULL; i++) {
+    switch (info[i].type) {
+      case_type(CHAR, char)
+      case_type(UCHAR, unsigned char)
+      case_type(BOOLEAN, bool)
+      case_type(INT, int)
+      case_type(UINT, unsigned int)
+      case_type(LONG, long)
+      case_type(ULONG, unsigned long)
+      case_type(INT64, long long)
+      case_type(UINT64, unsigned long long)
+      case_type(FLOAT, float)
+      case_type(DOUBLE, double)
+      case_type(STRING, char *)
+      case_type(STRV, char **)
+      case_type(VARIANT, GVariant *)
+      case_type(POINTER, void *)
+      default:
+        break;
+    }
+  }
+
+#undef case_type
+}
@@ -49,6 +49,14 @@ struct StructInfo {
 
 //! @memberof StructInfo
 int StructInfo_match (const void *info, const void *key);
+/**
+ * @memberof StructInfo
+ * @brief Sets the members listed in `info` to zero, without freeing them.
+ *
+ * @param instance the struct
+ * @param info struct info, terminated by @ref STRUCT_INFO_END
+ */
+void StructInfo_clear (void *instance, const struct StructInfo *info);
 
 
 /**@}*/
@@ -7,6 +7,9 @@ extern inline int g_stat_e (
     const gchar *filename, GStatBuf *buf, GError **error);
 extern inline gint g_mkdir_with_parents_e (
     const gchar *pathname, gint mode, GError **error);
+extern inline int g_open_e (
+    const gchar *filename, int flags, int mode, GError **error);
+extern inline int fstat_e (int fd, struct stat *buf, GError **error);
 extern inline ssize_t read_e (int fd, void *buf, size_t count, GError **error);
 extern inline ssize_t write_e (
     int fd, const void *buf, size_t count, GError **error);
@@ -7,6 +7,7 @@
  * @{
  */
 
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include <glib.h>
@@ -32,6 +33,12 @@ WRAP_IO_GERROR(
   gint, g_mkdir_with_parents, (
     const gchar *pathname, gint mode, GError **error),
   (pathname, mode), == 0, "Failed to mkdir")
+WRAP_IO_GERROR(
+  int, g_open, (const gchar *filename, int flags, int mode, GError **error),
+  (filename, flags, mode), != -1, "Failed to open")
+WRAP_IO_GERROR(
+  int, fstat, (int fd, struct stat *buf, GError **error),
+  (fd, buf), == 0, "Failed to fstat")
 WRAP_IO_GERROR(
   ssize_t, read, (int fd, void *buf, size_t count, GError **error),
   (fd, buf, count), >= 0, "Failed to read")
@@ -1,6 +1,8 @@
 #include <stdbool.h>
+#include <string.h>
 
 #include <glib.h>
+#include <gio/gio.h>
 
 #include "common/macro.h"
 #include "common/typeinfo.h"
@@ -58,20 +60,19 @@ void *g_variant_get_struct (
   case G_TYPE_ ## TYPE: { \
     type value_ = value; \
     if (value_) { \
-      G_STRUCT_MEMBER(type, instance, info->offset) = value_; \
+      G_STRUCT_MEMBER(type, instance, info[i].offset) = value_; \
     } \
     break; \
   }
 
 #define case_type(TYPE, type, func) \
-  case_type_value(TYPE, type, g_variant_get_ ## func(value))
+  case_type_value(TYPE, type, g_variant_get_ ## func(v))
 
   GVariantDict dict;
   g_variant_dict_init(&dict, value);
 
   for (int i = 0; info[i].key != NULL; i++) {
-    GVariant *v = g_variant_dict_lookup_value(
-      &dict, info[i].key, G_VARIANT_TYPE_VARIANT);
+    GVariant *v = g_variant_dict_lookup_value(&dict, info[i].key, NULL);
     if (v == NULL) {
       continue;
     }
@@ -87,16 +88,160 @@ void *g_variant_get_struct (
       case_type(UINT64, unsigned long long, uint64)
       case_type(FLOAT, float, double)
       case_type(DOUBLE, double, double)
-      case_type_value(STRING, char *, g_variant_dup_string(value, NULL))
+      case_type_value(STRING, char *, g_variant_dup_string(v, NULL))
       default:
         g_log(DFCC_NAME "-GVariant", G_LOG_LEVEL_WARNING,
               "Unknown type '%s' for key '%s'",
               g_type_name(info[i].type), info[i].key);
     }
+    g_variant_unref(v);
   }
 
 #undef case_type
+#undef case_type_value
 
   g_variant_dict_clear(&dict);
   return instance;
 }
+
+
+/**
+ * @brief Serialize a GVariant into a frame.
+ *
+ * @param value a GVariant, consumed if floating
+ * @return the frame
+ */
+GBytes *g_variant_to_frame (GVariant *value) {
+  g_variant_ref_sink(value);
+  GVariant *normal = g_variant_get_normal_form(value);
+  g_variant_unref(value);
+  if (G_BYTE_ORDER == G_BIG_ENDIAN) {
+    GVariant *swapped = g_variant_byteswap(normal);
+    g_variant_unref(normal);
+    normal = swapped;
+  }
+
+  gsize size = g_variant_get_size(normal);
+  guint8 *data = g_malloc(G_VARIANT_FRAME_HEADER_LENGTH + size);
+  guint64 header = GUINT64_TO_LE(size);
+  memcpy(data, &header, G_VARIANT_FRAME_HEADER_LENGTH);
+  g_variant_store(normal, data + G_VARIANT_FRAME_HEADER_LENGTH);
+  g_variant_unref(normal);
+  return g_bytes_new_take(data, G_VARIANT_FRAME_HEADER_LENGTH + size);
+}
+
+
+/**
+ * @brief Deserialize a GVariant from a frame.
+ *
+ * @param data the frame
+ * @param size the length of the frame
+ * @param type the expected type of the GVariant
+ * @param[out] error a return location for a #GError, or `NULL`
+ * @return a new GVariant, or `NULL` if the frame is malformed
+ */
+GVariant *g_variant_from_frame (
+    const void *data, gsize size, const GVariantType *type, GError **error) {
+  guint64 header;
+  should (size >= G_VARIANT_FRAME_HEADER_LENGTH) otherwise {
+    g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                        "Frame too short");
+    return NULL;
+  }
+  memcpy(&header, data, G_VARIANT_FRAME_HEADER_LENGTH);
+  header = GUINT64_FROM_LE(header);
+  should (header == size - G_VARIANT_FRAME_HEADER_LENGTH) otherwise {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                "Frame length mismatch: expected %" G_GUINT64_FORMAT
+                ", got %" G_GSIZE_FORMAT,
+                header, size - G_VARIANT_FRAME_HEADER_LENGTH);
+    return NULL;
+  }
+
+  GBytes *bytes = g_bytes_new(
+    (const guint8 *) data + G_VARIANT_FRAME_HEADER_LENGTH, header);
+  GVariant *value = g_variant_ref_sink(
+    g_variant_new_from_bytes(type, bytes, FALSE));
+  g_bytes_unref(bytes);
+  if (G_BYTE_ORDER == G_BIG_ENDIAN) {
+    GVariant *swapped = g_variant_byteswap(value);
+    g_variant_unref(value);
+    value = swapped;
+  }
+  return value;
+}
+
+
+/**
+ * @brief Write a GVariant as a frame into a stream.
+ *
+ * @param stream a GOutputStream
+ * @param value a GVariant, consumed if floating
+ * @param cancellable optional GCancellable object, `NULL` to ignore
+ * @param[out] error a return location for a #GError, or `NULL`
+ * @return `TRUE` on success, `FALSE` if there was an error
+ */
+gboolean g_output_stream_write_variant (
+    GOutputStream *stream, GVariant *value,
+    GCancellable *cancellable, GError **error) {
+  GBytes *frame = g_variant_to_frame(value);
+  gsize size;
+  const void *data = g_bytes_get_data(frame, &size);
+  gboolean ret = g_output_stream_write_all(
+    stream, data, size, NULL, cancellable, error) &&
+    g_output_stream_flush(stream, cancellable, error);
+  g_bytes_unref(frame);
+  return ret;
+}
+
+
+/**
+ * @brief Read a GVariant frame from a stream.
+ *
+ * @param stream a GInputStream
+ * @param type the expected type of the GVariant
+ * @param max_size the maximum length of the serialized data, 0 for unlimited
+ * @param cancellable optional GCancellable object, `NULL` to ignore
+ * @param[out] error a return location for a #GError, or `NULL`
+ * @return a new GVariant, or `NULL` if there was an error
+ */
+GVariant *g_input_stream_read_variant (
+    GInputStream *stream, const GVariantType *type, gsize max_size,
+    GCancellable *cancellable, GError **error) {
+  guint64 header;
+  gsize bytes_read;
+  return_if_fail(g_input_stream_read_all(
+    stream, &header, sizeof(header), &bytes_read, cancellable, error)) NULL;
+  should (bytes_read == sizeof(header)) otherwise {
+    g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_CLOSED,
+                        "Stream closed before frame header");
+    return NULL;
+  }
+  header = GUINT64_FROM_LE(header);
+  should (max_size == 0 || header <= max_size) otherwise {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_MESSAGE_TOO_LARGE,
+                "Frame too large: %" G_GUINT64_FORMAT " bytes", header);
+    return NULL;
+  }
+
+  void *data = g_malloc(header);
+  should (g_input_stream_read_all(
+      stream, data, header, &bytes_read, cancellable, error) &&
+      bytes_read == header) otherwise {
+    if (error != NULL && *error == NULL) {
+      g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_CLOSED,
+                          "Stream closed before end of frame");
+    }
+    g_free(data);
+    return NULL;
+  }
+
+  GVariant *value = g_variant_ref_sink(
+    g_variant_new_from_data(type, data, header, FALSE, g_free, data));
+  if (G_BYTE_ORDER == G_BIG_ENDIAN) {
+    GVariant *swapped = g_variant_byteswap(value);
+    g_variant_unref(value);
+    value = swapped;
+  }
+  return value;
+}
@@ -2,6 +2,7 @@
 #define DFCC_WRAPPER_GVARIANT_H
 
 #include <glib.h>
+#include <gio/gio.h>
 
 #include "common/typeinfo.h"
 
@@ -16,5 +17,23 @@ GVariant *g_variant_new_struct (const void *instance, struct StructInfo *info);
 void *g_variant_get_struct (
   GVariant *value, void *instance, struct StructInfo *info);
 
+/**
+ * @brief The length of the header of a GVariant frame.
+ *
+ * A frame is a 64-bit little-endian length followed by the serialized data of
+ * a GVariant in little-endian byte order.
+ */
+#define G_VARIANT_FRAME_HEADER_LENGTH 8
+
+GBytes *g_variant_to_frame (GVariant *value);
+GVariant *g_variant_from_frame (
+  const void *data, gsize size, const GVariantType *type, GError **error);
+gboolean g_output_stream_write_variant (
+  GOutputStream *stream, GVariant *value,
+  GCancellable *cancellable, GError **error);
+GVariant *g_input_stream_read_variant (
+  GInputStream *stream, const GVariantType *type, gsize max_size,
+  GCancellable *cancellable, GError **error);
+
 
 #endif /* DFCC_WRAPPER_GVARIANT_H */
@@ -1,4 +1,5 @@
 #include <stdarg.h>
+#include <string.h>
 
 #include <libsoup/soup.h>
 #include <glib/gstdio.h>
@@ -87,3 +88,327 @@ GVariant *soup_session_xmlrpc (
   g_object_unref(msg);
   return response;
 }
+
+
+/**
+ * @brief Checks whether `Accept-Encoding` in `hdrs` accepts `coding`.
+ *
+ * @param hdrs a SoupMessageHeaders
+ * @param coding a content coding
+ * @return `TRUE` if `coding` is acceptable
+ */
+gboolean soup_message_headers_accepts_encoding (
+    SoupMessageHeaders *hdrs, const char *coding) {
+  const char *value = soup_message_headers_get_list(hdrs, "Accept-Encoding");
+  return_if(value == NULL) FALSE;
+  GSList *codings = soup_header_parse_quality_list(value, NULL);
+  gboolean ret = g_slist_find_custom(
+    codings, coding, (GCompareFunc) g_ascii_strcasecmp) != NULL;
+  soup_header_free_list(codings);
+  return ret;
+}
+
+
+/**
+ * @brief Checks whether the body is encoded with `coding` according to
+ *        `Content-Encoding` in `hdrs`.
+ *
+ * @param hdrs a SoupMessageHeaders
+ * @param coding a content coding
+ * @return `TRUE` if the body is encoded with `coding`
+ */
+gboolean soup_message_headers_is_encoded (
+    SoupMessageHeaders *hdrs, const char *coding) {
+  const char *value = soup_message_headers_get_one(hdrs, "Content-Encoding");
+  return value != NULL && g_ascii_strcasecmp(value, coding) == 0;
+}
+
+
+/**
+ * @brief Checks whether a message is a binary RPC request or response.
+ *
+ * @param msg a SoupMessage
+ * @return `TRUE` if the request body of `msg` is a binary RPC request
+ */
+gboolean soup_message_is_binary_rpc (SoupMessage *msg) {
+  const char *content_type =
+    soup_message_headers_get_content_type(msg->request_headers, NULL);
+  return content_type != NULL &&
+    g_ascii_strcasecmp(content_type, SOUP_RPC_BINARY_CONTENT_TYPE) == 0;
+}
+
+
+/**
+ * @brief Checks whether a binary RPC response can be sent for a message.
+ *
+ * That is, the request is a binary RPC request, or a raw request, such as an
+ * upload, whose `Accept` lists @ref SOUP_RPC_BINARY_CONTENT_TYPE.
+ *
+ * @param msg a SoupMessage
+ * @return `TRUE` if the response of `msg` may be a binary RPC response
+ */
+gboolean soup_message_accepts_binary_rpc (SoupMessage *msg) {
+  return_if(soup_message_is_binary_rpc(msg)) TRUE;
+  const char *value = soup_message_headers_get_list(
+    msg->request_headers, "Accept");
+  return_if(value == NULL) FALSE;
+  GSList *types = soup_header_parse_quality_list(value, NULL);
+  gboolean ret = g_slist_find_custom(
+    types, SOUP_RPC_BINARY_CONTENT_TYPE,
+    (GCompareFunc) g_ascii_strcasecmp) != NULL;
+  soup_header_free_list(types);
+  return ret;
+}
+
+
+/**
+ * @brief Checks whether the response of a message is a binary RPC response.
+ *
+ * @param msg a SoupMessage
+ * @return `TRUE` if the response body of `msg` is a binary RPC response
+ */
+gboolean soup_message_response_is_binary_rpc (SoupMessage *msg) {
+  const char *content_type =
+    soup_message_headers_get_content_type(msg->response_headers, NULL);
+  return content_type != NULL &&
+    g_ascii_strcasecmp(content_type, SOUP_RPC_BINARY_CONTENT_TYPE) == 0;
+}
+
+
+//! @private
+static void soup_rpc_message_set_binary_response (
+    SoupMessage *msg, gboolean fault, GVariant *value) {
+  GBytes *frame = g_variant_to_frame(g_variant_new("(bv)", fault, value));
+  gsize size;
+  const void *data = g_bytes_get_data(frame, &size);
+  soup_message_set_status(msg, SOUP_STATUS_OK);
+  soup_message_set_response(
+    msg, SOUP_RPC_BINARY_CONTENT_TYPE, SOUP_MEMORY_COPY, data, size);
+  g_bytes_unref(frame);
+}
+
+
+//! @private
+static void soup_rpc_message_set_fault_valist (
+    SoupMessage *msg, int fault_code, const char *format, va_list args) {
+  gchar *error_msg = g_strdup_vprintf(format, args);
+  if (soup_message_accepts_binary_rpc(msg)) {
+    soup_rpc_message_set_binary_response(
+      msg, TRUE, g_variant_new("(is)", fault_code, error_msg));
+  } else {
+    soup_xmlrpc_message_set_fault(msg, fault_code, "%s", error_msg);
+  }
+  g_free(error_msg);
+}
+
+
+/**
+ * @brief Sets the response of `msg` to a fault, encoded in the same way as
+ *        the request.
+ *
+ * @param msg a SoupMessage
+ * @param fault_code the fault code
+ * @param format a printf()-style format string
+ * @param ... the parameters to `format`
+ */
+void soup_rpc_message_set_fault (
+    SoupMessage *msg, int fault_code, const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  soup_rpc_message_set_fault_valist(msg, fault_code, format, args);
+  va_end(args);
+}
+
+
+void soup_rpc_message_log_and_set_fault (
+    SoupMessage *msg, int fault_code, const char *log_domain,
+    GLogLevelFlags log_level, const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  gchar *error_msg = g_strdup_vprintf(format, args);
+  va_end(args);
+
+  g_log(log_domain, log_level, "%s", error_msg);
+  soup_rpc_message_set_fault(msg, fault_code, "%s", error_msg);
+  g_free(error_msg);
+}
+
+
+/**
+ * @brief Sets the response of `msg`, encoded in the same way as the request.
+ *
+ * @param msg a SoupMessage
+ * @param value the response value, consumed if floating
+ * @param log_domain log domain
+ * @return `TRUE` on success
+ */
+gboolean soup_rpc_message_set_response_e (
+    SoupMessage *msg, GVariant *value, const char *log_domain) {
+  if (soup_message_accepts_binary_rpc(msg)) {
+    soup_rpc_message_set_binary_response(msg, FALSE, value);
+    return TRUE;
+  }
+  return soup_xmlrpc_message_set_response_e(msg, value, log_domain);
+}
+
+
+/**
+ * @brief Creates a new RPC request.
+ *
+ * @param uri URI of the RPC endpoint
+ * @param method_name the name of the RPC method
+ * @param params the parameters, consumed if floating
+ * @param binary whether to use the binary encoding instead of XML-RPC
+ * @param[out] error a return location for a #GError, or `NULL`
+ * @return a new SoupMessage, or `NULL` if error happened
+ */
+SoupMessage *soup_rpc_message_new (
+    const char *uri, const char *method_name, GVariant *params,
+    gboolean binary, GError **error) {
+  if (!binary) {
+    return soup_xmlrpc_message_new(uri, method_name, params, error);
+  }
+
+  SoupMessage *msg = soup_message_new("POST", uri);
+  should (msg != NULL) otherwise {
+    g_set_error(error, SOUP_REQUEST_ERROR, SOUP_REQUEST_ERROR_BAD_URI,
+                "Could not parse URI '%s'", uri);
+    return NULL;
+  }
+  GBytes *frame = g_variant_to_frame(g_variant_new("(sv)", method_name, params));
+  gsize size;
+  const void *data = g_bytes_get_data(frame, &size);
+  soup_message_set_request(
+    msg, SOUP_RPC_BINARY_CONTENT_TYPE, SOUP_MEMORY_COPY, data, size);
+  g_bytes_unref(frame);
+  return msg;
+}
+
+
+/**
+ * @brief Parses the response of a RPC request, in either encoding.
+ *
+ * @param msg a SoupMessage
+ * @param signature the expected signature of the response
+ * @param log_domain log domain
+ * @param log_level log level of parsing errors
+ * @return the response, or `NULL` if error happened or the response is a fault
+ */
+GVariant *soup_rpc_parse_response_e (
+    SoupMessage *msg, const char *signature,
+    const char *log_domain, GLogLevelFlags log_level) {
+  if (!soup_message_response_is_binary_rpc(msg)) {
+    return soup_xmlrpc_parse_response_e(msg, signature, log_domain, log_level);
+  }
+
+  GError *error = NULL;
+  GVariant *frame = g_variant_from_frame(
+    msg->response_body->data, msg->response_body->length,
+    G_VARIANT_TYPE("(bv)"), &error);
+  should (frame != NULL) otherwise {
+    g_log(log_domain, log_level,
+          "Error when parsing the response: %s", error->message);
+    g_error_free(error);
+    return NULL;
+  }
+
+  gboolean fault;
+  GVariant *response;
+  g_variant_get(frame, "(bv)", &fault, &response);
+  g_variant_unref(frame);
+
+  do_once {
+    if unlikely (fault) {
+      if (g_variant_is_of_type(response, G_VARIANT_TYPE("(is)"))) {
+        int fault_code;
+        const char *fault_msg;
+        g_variant_get(response, "(i&s)", &fault_code, &fault_msg);
+        g_log(log_domain, log_level,
+              "Error when connecting to server: %s (%d)",
+              fault_msg, fault_code);
+      } else {
+        g_log(log_domain, log_level, "Error when connecting to server");
+      }
+      break;
+    }
+    if (signature != NULL) {
+      should (g_variant_is_of_type(
+          response, G_VARIANT_TYPE(signature))) otherwise {
+        g_log(log_domain, log_level,
+              "Error when parsing the response: expect type '%s', got '%s'",
+              signature, g_variant_get_type_string(response));
+        break;
+      }
+    }
+    return response;
+  }
+
+  g_variant_unref(response);
+  return NULL;
+}
+
+
+/**
+ * @brief Performs a RPC request synchronously.
+ *
+ * If `*binary` is `TRUE`, the binary encoding is tried first. If the server
+ * does not answer in the binary encoding, `*binary` is set to `FALSE` and the
+ * request is retried with XML-RPC.
+ *
+ * @param session a SoupSession
+ * @param uri URI of the RPC endpoint
+ * @param method_name the name of the RPC method
+ * @param params the parameters, consumed if floating
+ * @param signature the expected signature of the response
+ * @param log_domain log domain
+ * @param[out] status HTTP status code [optional]
+ * @param[in,out] binary whether to use the binary encoding
+ * @return the response, or `NULL` if error happened
+ */
+GVariant *soup_session_rpc (
+    SoupSession *session, const char *uri, const char *method_name,
+    GVariant *params, const char *signature, const char *log_domain,
+    unsigned int *status, gboolean *binary) {
+  g_variant_ref_sink(params);
+  GVariant *response = NULL;
+
+  while (TRUE) {
+    GError *error = NULL;
+    SoupMessage *msg = soup_rpc_message_new(
+      uri, method_name, params, *binary, &error);
+    should (msg != NULL) otherwise {
+      g_log(log_domain, G_LOG_LEVEL_CRITICAL,
+            "Error when building RPC query: %s", error->message);
+      g_error_free(error);
+      break;
+    }
+
+    unsigned int status_ = soup_session_send_message(session, msg);
+    if (status != NULL) {
+      *status = status_;
+    }
+    should (SOUP_STATUS_IS_SUCCESSFUL(status_)) otherwise {
+      g_log(log_domain, G_LOG_LEVEL_WARNING,
+            "Failed to perform RPC request: %s", msg->reason_phrase);
+      g_object_unref(msg);
+      break;
+    }
+
+    if (*binary && !soup_message_response_is_binary_rpc(msg)) {
+      // old server, fallback to XML-RPC
+      g_log(log_domain, G_LOG_LEVEL_DEBUG,
+            "Binary RPC not supported by server, fallback to XML-RPC");
+      *binary = FALSE;
+      g_object_unref(msg);
+      continue;
+    }
+
+    response = soup_rpc_parse_response_e(
+      msg, signature, log_domain, G_LOG_LEVEL_WARNING);
+    g_object_unref(msg);
+    break;
+  }
+
+  g_variant_unref(params);
+  return response;
+}
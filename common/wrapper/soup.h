@@ -13,6 +13,19 @@
 #include "gvariant.h"
 
 
+/**
+ * @brief Content-Type of binary RPC messages.
+ *
+ * A binary RPC request is a GVariant frame of `(sv)`, which is the method name
+ * and the parameters. A binary RPC response is a GVariant frame of `(bv)`,
+ * which is whether the response is a fault, and the value. The value of a
+ * fault is `(is)`, which is the fault code and the message.
+ *
+ * @sa g_variant_to_frame()
+ */
+#define SOUP_RPC_BINARY_CONTENT_TYPE "application/x-gvariant"
+
+
 void soup_xmlrpc_message_log_and_set_fault (
   SoupMessage *msg, int fault_code, const char *log_domain,
   GLogLevelFlags log_level, const char *format, ...) G_GNUC_PRINTF(5, 6) ;
@@ -26,6 +39,33 @@ GVariant *soup_session_xmlrpc (
   GVariant *params, const char *signature, const char *log_domain,
   unsigned int *status);
 
+gboolean soup_message_headers_accepts_encoding (
+  SoupMessageHeaders *hdrs, const char *coding);
+gboolean soup_message_headers_is_encoded (
+  SoupMessageHeaders *hdrs, const char *coding);
+
+gboolean soup_message_is_binary_rpc (SoupMessage *msg);
+gboolean soup_message_accepts_binary_rpc (SoupMessage *msg);
+gboolean soup_message_response_is_binary_rpc (SoupMessage *msg);
+void soup_rpc_message_set_fault (
+  SoupMessage *msg, int fault_code, const char *format, ...)
+  G_GNUC_PRINTF(3, 4);
+void soup_rpc_message_log_and_set_fault (
+  SoupMessage *msg, int fault_code, const char *log_domain,
+  GLogLevelFlags log_level, const char *format, ...) G_GNUC_PRINTF(5, 6);
+gboolean soup_rpc_message_set_response_e (
+  SoupMessage *msg, GVariant *value, const char *log_domain);
+SoupMessage *soup_rpc_message_new (
+  const char *uri, const char *method_name, GVariant *params,
+  gboolean binary, GError **error);
+GVariant *soup_rpc_parse_response_e (
+  SoupMessage *msg, const char *signature,
+  const char *log_domain, GLogLevelFlags log_level);
+GVariant *soup_session_rpc (
+  SoupSession *session, const char *uri, const char *method_name,
+  GVariant *params, const char *signature, const char *log_domain,
+  unsigned int *status, gboolean *binary);
+
 #define dfcc_session_xmlrpc_variant(session, uri, method, log_domain, status, value) \
   soup_session_xmlrpc( \
     (session), (uri), DFCC_RPC_ ## method ## _METHOD_NAME, (value), \
@@ -37,6 +77,18 @@ GVariant *soup_session_xmlrpc (
     g_variant_new(DFCC_RPC_ ## method ## _REQUEST_SIGNATURE, __VA_ARGS__))
 
 
+#define dfcc_session_rpc_variant(session, uri, method, log_domain, status, binary, value) \
+  soup_session_rpc( \
+    (session), (uri), DFCC_RPC_ ## method ## _METHOD_NAME, (value), \
+    DFCC_RPC_ ## method ## _RESPONSE_SIGNATURE, (log_domain), (status), \
+    (binary))
+
+#define dfcc_session_rpc(session, uri, method, log_domain, status, binary, ...) \
+  dfcc_session_rpc_variant( \
+    (session), (uri), method, (log_domain), (status), (binary), \
+    g_variant_new(DFCC_RPC_ ## method ## _REQUEST_SIGNATURE, __VA_ARGS__))
+
+
 /**@}*/
 
 #endif /* DFCC_WRAPPER_SOUP_H */
@@ -0,0 +1,164 @@
+#include <stdbool.h>
+
+#include <glib.h>
+#include <zstd.h>
+
+#include "common/macro.h"
+#include "zstd.h"
+
+
+#define ZSTD_ERROR g_quark_from_static_string("zstd")
+
+
+int ZstdEncoder_feed (
+    struct ZstdEncoder *encoder, const void *src, size_t size, bool end,
+    ZstdWriteFunc write, void *userdata, GError **error) {
+  ZSTD_inBuffer input = {src, size, 0};
+  ZSTD_EndDirective mode = end ? ZSTD_e_end : ZSTD_e_continue;
+
+  while (true) {
+    ZSTD_outBuffer output = {encoder->out, encoder->out_size, 0};
+    size_t remaining = ZSTD_compressStream2(
+      encoder->cctx, &output, &input, mode);
+    should (!ZSTD_isError(remaining)) otherwise {
+      g_set_error(error, ZSTD_ERROR, ZSTD_getErrorCode(remaining),
+                  "Cannot compress: %s", ZSTD_getErrorName(remaining));
+      return 1;
+    }
+    if (output.pos > 0) {
+      return_if_fail(write(output.buf, output.pos, userdata) == 0) 1;
+    }
+    // the last chunk is done when the frame is flushed, otherwise when the
+    // input is consumed
+    break_if(end ? remaining == 0 : input.pos == input.size);
+  }
+  return 0;
+}
+
+
+void ZstdEncoder_destroy (struct ZstdEncoder *encoder) {
+  ZSTD_freeCCtx(encoder->cctx);
+  g_free(encoder->out);
+}
+
+
+int ZstdEncoder_init (struct ZstdEncoder *encoder, int level) {
+  encoder->cctx = ZSTD_createCCtx();
+  return_if_fail(encoder->cctx != NULL) 1;
+  ZSTD_CCtx_setParameter(encoder->cctx, ZSTD_c_compressionLevel, level);
+  encoder->out_size = ZSTD_CStreamOutSize();
+  encoder->out = g_malloc(encoder->out_size);
+  return 0;
+}
+
+
+int ZstdDecoder_feed (
+    struct ZstdDecoder *decoder, const void *src, size_t size,
+    ZstdWriteFunc write, void *userdata, GError **error) {
+  ZSTD_inBuffer input = {src, size, 0};
+
+  while (true) {
+    ZSTD_outBuffer output = {decoder->out, decoder->out_size, 0};
+    size_t ret = ZSTD_decompressStream(decoder->dctx, &output, &input);
+    should (!ZSTD_isError(ret)) otherwise {
+      g_set_error(error, ZSTD_ERROR, ZSTD_getErrorCode(ret),
+                  "Cannot decompress: %s", ZSTD_getErrorName(ret));
+      return 1;
+    }
+    decoder->frame_end = ret == 0;
+    if (output.pos > 0) {
+      return_if_fail(write(output.buf, output.pos, userdata) == 0) 1;
+    }
+    // a full output buffer may leave data inside the context
+    break_if(input.pos == input.size && output.pos < output.size);
+  }
+  return 0;
+}
+
+
+void ZstdDecoder_destroy (struct ZstdDecoder *decoder) {
+  ZSTD_freeDCtx(decoder->dctx);
+  g_free(decoder->out);
+}
+
+
+int ZstdDecoder_init (struct ZstdDecoder *decoder) {
+  decoder->dctx = ZSTD_createDCtx();
+  return_if_fail(decoder->dctx != NULL) 1;
+  decoder->frame_end = true;
+  decoder->out_size = ZSTD_DStreamOutSize();
+  decoder->out = g_malloc(decoder->out_size);
+  return 0;
+}
+
+
+//! @private
+struct ZstdByteArrayWriter {
+  GByteArray *array;
+  size_t max_size;
+};
+
+
+//! @private
+static int zstd__write_byte_array (
+    const void *buf, size_t size, void *userdata) {
+  struct ZstdByteArrayWriter *writer = userdata;
+  return_if(writer->max_size != 0 &&
+            writer->array->len + size > writer->max_size) 1;
+  g_byte_array_append(writer->array, buf, size);
+  return 0;
+}
+
+
+GByteArray *zstd_compress_e (
+    const void *src, size_t size, int level, GError **error) {
+  struct ZstdEncoder encoder;
+  should (ZstdEncoder_init(&encoder, level) == 0) otherwise {
+    g_set_error_literal(error, ZSTD_ERROR, 0, "Cannot create zstd context");
+    return NULL;
+  }
+
+  struct ZstdByteArrayWriter writer = {
+    g_byte_array_sized_new(ZSTD_compressBound(size)), 0};
+  int ret = ZstdEncoder_feed(
+    &encoder, src, size, true, zstd__write_byte_array, &writer, error);
+  ZstdEncoder_destroy(&encoder);
+
+  should (ret == 0) otherwise {
+    g_byte_array_unref(writer.array);
+    return NULL;
+  }
+  return writer.array;
+}
+
+
+GByteArray *zstd_decompress_e (
+    const void *src, size_t size, size_t max_size, GError **error) {
+  struct ZstdDecoder decoder;
+  should (ZstdDecoder_init(&decoder) == 0) otherwise {
+    g_set_error_literal(error, ZSTD_ERROR, 0, "Cannot create zstd context");
+    return NULL;
+  }
+
+  struct ZstdByteArrayWriter writer = {g_byte_array_new(), max_size};
+  GError *error_ = NULL;
+  int ret = ZstdDecoder_feed(
+    &decoder, src, size, zstd__write_byte_array, &writer, &error_);
+  if (ret == 0 && !decoder.frame_end) {
+    g_set_error_literal(&error_, ZSTD_ERROR, 0, "Truncated zstd frame");
+    ret = 1;
+  }
+  ZstdDecoder_destroy(&decoder);
+
+  should (ret == 0) otherwise {
+    if (error_ != NULL) {
+      g_propagate_error(error, error_);
+    } else {
+      g_set_error(error, ZSTD_ERROR, 0,
+                  "Decompressed data exceeds %zu bytes", max_size);
+    }
+    g_byte_array_unref(writer.array);
+    return NULL;
+  }
+  return writer.array;
+}
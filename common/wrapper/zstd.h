@@ -0,0 +1,137 @@
+#ifndef DFCC_WRAPPER_ZSTD_H
+#define DFCC_WRAPPER_ZSTD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <glib.h>
+#include <zstd.h>
+
+#include "common/cdecls.h"
+
+BEGIN_C_DECLS
+
+
+/// Value of `Content-Encoding` for zstd-compressed bodies.
+#define ZSTD_CONTENT_ENCODING "zstd"
+
+
+/**
+ * @ingroup Wrapper
+ * @brief Callback which receives (de)compressed data.
+ *
+ * @param buf the data
+ * @param size length of `buf`
+ * @param userdata the data passed to the stream
+ * @return 0 if success, otherwize nonzero
+ */
+typedef int (*ZstdWriteFunc) (const void *buf, size_t size, void *userdata);
+
+
+/**
+ * @ingroup Wrapper
+ * @brief Streaming zstd compressor.
+ */
+struct ZstdEncoder {
+  ZSTD_CCtx *cctx;
+  /// Output buffer.
+  void *out;
+  /// Length of ZstdEncoder.out.
+  size_t out_size;
+};
+
+
+/**
+ * @memberof ZstdEncoder
+ * @brief Compresses a piece of data.
+ *
+ * @param encoder a ZstdEncoder
+ * @param src the data
+ * @param size length of `src`
+ * @param end whether `src` is the last piece
+ * @param write callback which receives compressed data
+ * @param userdata the data passed to `write`
+ * @param[out] error a return location for a GError [optional]
+ * @return 0 if success, otherwize nonzero
+ */
+int ZstdEncoder_feed (
+  struct ZstdEncoder *encoder, const void *src, size_t size, bool end,
+  ZstdWriteFunc write, void *userdata, GError **error);
+//! @memberof ZstdEncoder
+void ZstdEncoder_destroy (struct ZstdEncoder *encoder);
+/**
+ * @memberof ZstdEncoder
+ * @brief Initializes a ZstdEncoder.
+ *
+ * @param encoder a ZstdEncoder
+ * @param level compression level
+ * @return 0 if success, otherwize nonzero
+ */
+int ZstdEncoder_init (struct ZstdEncoder *encoder, int level);
+
+
+/**
+ * @ingroup Wrapper
+ * @brief Streaming zstd decompressor.
+ */
+struct ZstdDecoder {
+  ZSTD_DCtx *dctx;
+  /// Output buffer.
+  void *out;
+  /// Length of ZstdDecoder.out.
+  size_t out_size;
+  /// Whether the data fed so far ends at a frame boundary.
+  bool frame_end;
+};
+
+
+/**
+ * @memberof ZstdDecoder
+ * @brief Decompresses a piece of data.
+ *
+ * @param decoder a ZstdDecoder
+ * @param src the compressed data
+ * @param size length of `src`
+ * @param write callback which receives decompressed data
+ * @param userdata the data passed to `write`
+ * @param[out] error a return location for a GError [optional]
+ * @return 0 if success, otherwize nonzero
+ */
+int ZstdDecoder_feed (
+  struct ZstdDecoder *decoder, const void *src, size_t size,
+  ZstdWriteFunc write, void *userdata, GError **error);
+//! @memberof ZstdDecoder
+void ZstdDecoder_destroy (struct ZstdDecoder *decoder);
+//! @memberof ZstdDecoder
+int ZstdDecoder_init (struct ZstdDecoder *decoder);
+
+
+/**
+ * @ingroup Wrapper
+ * @brief Compresses a buffer into a GByteArray.
+ *
+ * @param src the data
+ * @param size length of `src`
+ * @param level compression level
+ * @param[out] error a return location for a GError [optional]
+ * @return the compressed data, or `NULL` if error happened
+ */
+GByteArray *zstd_compress_e (
+  const void *src, size_t size, int level, GError **error);
+/**
+ * @ingroup Wrapper
+ * @brief Decompresses a buffer into a GByteArray.
+ *
+ * @param src the compressed data
+ * @param size length of `src`
+ * @param max_size maximum length of the decompressed data, 0 for unlimited
+ * @param[out] error a return location for a GError [optional]
+ * @return the decompressed data, or `NULL` if error happened
+ */
+GByteArray *zstd_decompress_e (
+  const void *src, size_t size, size_t max_size, GError **error);
+
+
+END_C_DECLS
+
+#endif /* DFCC_WRAPPER_ZSTD_H */
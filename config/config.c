@@ -16,6 +16,9 @@
 struct StructInfo Config__info[] = {
 #define STRUCT_INFO_TYPE struct Config
   STRUCT_INFO(trust),
+  STRUCT_INFO(prescan),
+  STRUCT_INFO(hedge),
+  STRUCT_INFO(hedge_percentile),
   STRUCT_INFO_END
 #undef STRUCT_INFO_TYPE
 };
@@ -68,6 +71,7 @@ static void Config_destroy_server (struct Config *config) {
   g_free(config->tls_key_file);
 
   g_free(config->cache_dir);
+  g_free(config->cache_durability);
   g_free(config->hookfs);
 }
 
@@ -83,6 +87,8 @@ static void Config_destroy_client (struct Config *config) {
   g_strfreev(config->cc_argv);
   g_strfreev(config->cc_envp);
   g_free(config->cc_working_directory);
+  g_free(config->result_cache_dir);
+  g_free(config->agent_socket);
 
   if (config->server_list != NULL) {
     for (int i = 0; config->server_list[i].baseurl != NULL; i++) {
@@ -97,6 +103,7 @@ static void Config_destroy_client (struct Config *config) {
 void Config_destroy (struct Config *config) {
   g_free(config->confpath);
   g_free(config->prgpath);
+  g_free(config->hash_algorithm);
 
   if (config->server_mode) {
     Config_destroy_server(config);
@@ -110,6 +117,11 @@ int Config_init (
     struct Config *config, int argc,
     const char * const argv[], const char * const envp[]) {
   memset(config, 0, sizeof(struct Config));
+  config->cache_trust_window = Config_UNSET;
+  config->cache_scrub_rate = Config_UNSET;
+  config->hedge_percentile = Config_UNSET;
+  config->race_local_delay = Config_UNSET;
+  config->cc_stderr = -1;
 
   int ret;
 
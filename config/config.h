@@ -10,6 +10,14 @@
 #include "config/serverurl.h"
 
 
+/**
+ * @ingroup Config
+ * @brief Value of unsigned options not given yet, for those where 0 is
+ *        meaningful.
+ */
+#define Config_UNSET ((unsigned int) -1)
+
+
 /**
  * @ingroup Config
  * @brief All information `dfcc` needed.
@@ -34,6 +42,11 @@ struct Config {
   bool server_mode;
   /// Enable debug mode.
   bool debug;
+  /**
+   * @brief Name of the algorithm to hash files.
+   * @sa FileHashAlgorithm
+   */
+  char *hash_algorithm;
   ///@}
 
   /** @name Server
@@ -88,6 +101,39 @@ struct Config {
    * @sa Cache.cache_dir
    */
   char *cache_dir;
+  /**
+   * @brief Seconds during which a checked cache entry is trusted, or 0 to
+   *        check on every access.
+   * @sa Cache.trust_window
+   */
+  unsigned int cache_trust_window;
+  /**
+   * @brief KiB per second the cache scrubber may rehash, or 0 to disable
+   *        scrubbing.
+   * @sa Cache_start_scrubber
+   */
+  unsigned int cache_scrub_rate;
+  /// Maximum size of cache files in MiB, or 0 for unlimited.
+  unsigned int cache_quota;
+  /// Maximum number of cache files, or 0 for unlimited.
+  unsigned int cache_quota_files;
+  /**
+   * @brief Blobs up to this many KiB are packed into segment files, or 0 to
+   *        store every blob in its own file.
+   * @sa Cache_open_pack
+   */
+  unsigned int cache_pack_threshold;
+  /**
+   * @brief Name of the durability policy of cache files.
+   * @sa CacheDurability
+   */
+  char *cache_durability;
+  /**
+   * @brief MiB of memfds for small inputs which jobs often read, or 0 to
+   *        disable.
+   * @sa Cache_hot_path
+   */
+  unsigned int cache_hot_budget;
 
   /// Path to the preload library `hookfs`.
   char *hookfs;
@@ -104,12 +150,37 @@ struct Config {
   char **cc_envp;
   /// Compiler's working directory.
   char *cc_working_directory;
+  /// File descriptor the local compiler's stderr is redirected to, or -1 to
+  /// inherit.
+  int cc_stderr;
   /// URL and information of remote servers.
   struct ServerURL *server_list;
   /// Contact and test remote servers with random sequence.
   bool randomize;
   /// Trust server-provided source files.
   bool trust;
+  /// Scan the include closure of sources and send it along with the job.
+  /// Without it the server only learns the hashes of the files the compiler
+  /// has fetched in the session, so its result cache rarely hits for the
+  /// first job of a session.
+  bool prescan;
+  /// Submit slow jobs to a second server and take the faster result.
+  bool hedge;
+  /// Percentile of past job times after which a job is considered slow.
+  unsigned int hedge_percentile;
+  /// Run the compiler locally as well, and take the faster result.
+  bool race_local;
+  /// Delay in milliseconds before racing the local compiler, if no local slot
+  /// is idle.
+  unsigned int race_local_delay;
+  /// Cache compilation results locally, keyed by the preprocessed source.
+  bool result_cache;
+  /// Directory where cached compilation results are stored.
+  char *result_cache_dir;
+  /// Run as a persistent agent which forwards jobs from short-lived clients.
+  bool agent_mode;
+  /// Path to the agent socket.
+  char *agent_socket;
   ///@}
 };
 
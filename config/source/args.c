@@ -32,6 +32,7 @@ int Config_parse_args (struct Config *config, char *args[]) {
     {"debug", 'd', 0, G_OPTION_ARG_NONE, &config->debug, "Enable debug output", NULL},
     {"version", 'v', 0, G_OPTION_ARG_NONE, &config->show_version, "Print the version and exit", NULL},
     {"config", 'c', 0, G_OPTION_ARG_STRING, &config->confpath, "Path to the config file", "file"},
+    {"hash", 0, 0, G_OPTION_ARG_STRING, &config->hash_algorithm, "Hash algorithm of files (xxh64, xxh3)", "name"},
     {G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_CALLBACK, (void *) Config_parse_cc_argv, NULL, NULL},
     {NULL}
   };
@@ -40,6 +41,15 @@ int Config_parse_args (struct Config *config, char *args[]) {
   GOptionGroup *group_client = g_option_group_new("client", "Client Options:", "Show client help options", NULL, NULL);
   const GOptionEntry entries_client[] = {
     {"randomize", 0, 0, G_OPTION_ARG_NONE, &config->randomize, "Randomize the order of the host list before execution", NULL},
+    {"prescan", 0, 0, G_OPTION_ARG_NONE, &config->prescan, "Send hashes of included files along with the job, so that the server can reuse results of other clients", NULL},
+    {"hedge", 0, 0, G_OPTION_ARG_NONE, &config->hedge, "Resubmit slow jobs to another server", NULL},
+    {"hedge_percentile", 0, 0, G_OPTION_ARG_INT, &config->hedge_percentile, "Percentile of past job times after which a job is resubmitted", "N"},
+    {"race_local", 0, 0, G_OPTION_ARG_NONE, &config->race_local, "Also run slow jobs locally and take the faster result", NULL},
+    {"race_local_delay", 0, 0, G_OPTION_ARG_INT, &config->race_local_delay, "Milliseconds before a job is also run locally", "ms"},
+    {"result_cache", 0, 0, G_OPTION_ARG_NONE, &config->result_cache, "Cache compilation results locally", NULL},
+    {"result_cache_dir", 0, 0, G_OPTION_ARG_FILENAME, &config->result_cache_dir, "Directory of cached compilation results", "dir"},
+    {"agent", 0, 0, G_OPTION_ARG_NONE, &config->agent_mode, "Run as a persistent client agent", NULL},
+    {"agent_socket", 0, 0, G_OPTION_ARG_FILENAME, &config->agent_socket, "Path to the agent socket", "path"},
     {NULL}
   };
   g_option_group_add_entries(group_client, entries_client);
@@ -58,6 +68,13 @@ int Config_parse_args (struct Config *config, char *args[]) {
     {"tls_key_file", 0, 0, G_OPTION_ARG_STRING, &config->tls_key_file, "TLS key file", "key"},
     {"cache_dir", 0, 0, G_OPTION_ARG_STRING, &config->cache_dir, "Cache dir", "dir"},
     {"no_verify_cache", 0, 0, G_OPTION_ARG_NONE, &config->no_verify_cache, "No verify cache", NULL},
+    {"cache_trust_window", 0, 0, G_OPTION_ARG_INT, &config->cache_trust_window, "Seconds a checked cache file is trusted, 0 to always check", "s"},
+    {"cache_scrub_rate", 0, 0, G_OPTION_ARG_INT, &config->cache_scrub_rate, "Cache scrubbing rate, 0 to disable", "KiB/s"},
+    {"cache_quota", 0, 0, G_OPTION_ARG_INT, &config->cache_quota, "Maximum size of cache", "MiB"},
+    {"cache_quota_files", 0, 0, G_OPTION_ARG_INT, &config->cache_quota_files, "Maximum number of cache files", "N"},
+    {"cache_pack_threshold", 0, 0, G_OPTION_ARG_INT, &config->cache_pack_threshold, "Maximum size of packed cache blobs", "KiB"},
+    {"cache_durability", 0, 0, G_OPTION_ARG_STRING, &config->cache_durability, "When to sync cache files", "none|batch|file"},
+    {"cache_hot_budget", 0, 0, G_OPTION_ARG_INT, &config->cache_hot_budget, "Memory for hot cache blobs", "MiB"},
     {"hookfs", 0, 0, G_OPTION_ARG_FILENAME, &config->hookfs, "Path to hookfs so", "hookfs.so"},
     {NULL}
   };
@@ -77,6 +94,10 @@ int Config_parse_args (struct Config *config, char *args[]) {
     g_setenv("G_MESSAGES_DEBUG", "all", TRUE);
   }
 
+  if (config->agent_mode) {
+    config->server_mode = false;
+  }
+
   if (config->server_mode) {
     if (config->hookfs != NULL) {
       should (config->hookfs[0] == '\0' ||
@@ -90,7 +111,8 @@ int Config_parse_args (struct Config *config, char *args[]) {
       return 1;
     }
   } else {
-    should (config->port == 0 && config->foreground == 0) otherwise {
+    should (config->port == 0 &&
+        (config->foreground == 0 || config->agent_mode)) otherwise {
       g_printerr("Option parsing failed: Server options in client mode\n");
       return 1;
     }
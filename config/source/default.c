@@ -4,6 +4,9 @@
 #include <glib.h>
 
 #include "./version.h"
+#include "common/macro.h"
+#include "file/cache.h"
+#include "file/hash.h"
 #include "../log.h"
 #include "../config.h"
 #include "default.h"
@@ -87,6 +90,21 @@ static int Config_fill_default_server (struct Config *config) {
   if (config->cache_dir == NULL) {
     config->cache_dir = g_strdup("~/.cache/dfcc");
   }
+  if (config->cache_trust_window == Config_UNSET) {
+    config->cache_trust_window = 5;
+  }
+  if (config->cache_scrub_rate == Config_UNSET) {
+    config->cache_scrub_rate = 4096;
+  }
+  if (config->cache_durability == NULL) {
+    config->cache_durability =
+      g_strdup(CacheDurability_names[CacheDurability_BATCH]);
+  }
+  int durability = CacheDurability_from_string(config->cache_durability);
+  should (durability >= 0) otherwise {
+    g_printerr("Unknown cache durability \"%s\"\n", config->cache_durability);
+    return 1;
+  }
 
   return 0;
 }
@@ -96,6 +114,22 @@ static int Config_fill_default_client (struct Config *config) {
   if (config->cc_working_directory == NULL) {
     config->cc_working_directory = g_get_current_dir();
   }
+  if (config->hedge_percentile == Config_UNSET) {
+    config->hedge_percentile = 95;
+  } else if (config->hedge_percentile > 100) {
+    config->hedge_percentile = 100;
+  }
+  if (config->race_local_delay == Config_UNSET) {
+    config->race_local_delay = 2000;
+  }
+  if (config->result_cache_dir == NULL) {
+    config->result_cache_dir = g_build_filename(
+      g_get_user_cache_dir(), DFCC_NAME, DFCC_RESULT_CACHE_DIRNAME, NULL);
+  }
+  if (config->agent_socket == NULL) {
+    config->agent_socket = g_build_filename(
+      g_get_user_runtime_dir(), DFCC_NAME, DFCC_AGENT_SOCKET_FILENAME, NULL);
+  }
 
   // temp
   if (config->server_list == NULL) {
@@ -110,8 +144,25 @@ static int Config_fill_default_client (struct Config *config) {
 
 
 int Config_fill_default (struct Config *config) {
+  if (config->hash_algorithm == NULL) {
+    config->hash_algorithm =
+      g_strdup(FileHash_algorithm_names[FileHash_XXH64]);
+  }
+  should (FileHash_set_algorithm(config->hash_algorithm) == 0) otherwise {
+    g_printerr("Unknown hash algorithm \"%s\"\n", config->hash_algorithm);
+    return 1;
+  }
+
   if (config->server_mode) {
-    return Config_fill_default_server(config);
+    int ret = Config_fill_default_server(config);
+    if (ret == 0 && FileHash_algorithm != FileHash_XXH64) {
+      // cache files are named by their hashes
+      char *cache_dir = g_build_filename(
+        config->cache_dir, config->hash_algorithm, NULL);
+      g_free(config->cache_dir);
+      config->cache_dir = cache_dir;
+    }
+    return ret;
   } else {
     return Config_fill_default_client(config);
   }
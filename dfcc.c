@@ -5,6 +5,7 @@
 #include <glib.h>
 
 #include "common/macro.h"
+#include "client/agent.h"
 #include "client/client.h"
 #include "server/server.h"
 #include "config/config.h"
@@ -37,7 +38,16 @@ int main (int argc, char *argv[]) {
     return EXIT_SUCCESS;
   }
 
-  if (config.server_mode) {
+  if (config.agent_mode) {
+    g_log(DFCC_NAME, G_LOG_LEVEL_DEBUG, "Agent mode");
+    if (config.debug == config.foreground) {
+      should (daemon(1, 0) == 0) otherwise {
+        g_printerr("Daemonization failed\n");
+        return EXIT_FAILURE;
+      }
+    }
+    ret = Agent_start(&config);
+  } else if (config.server_mode) {
     g_log(DFCC_NAME, G_LOG_LEVEL_DEBUG, "Server mode");
     if (config.debug == config.foreground) {
       should (daemon(1, 0) == 0) otherwise {
@@ -1,19 +1,49 @@
+#define _GNU_SOURCE  /* O_TMPFILE, syncfs(), memfd_create() */
 #include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdbool.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <gmodule.h>
+#include <glib-unix.h>
 
 #include "common/hexstring.h"
 #include "common/macro.h"
+#include "common/wrapper/errno.h"
 #include "common/wrapper/file.h"
+#include "common/wrapper/mappedfile.h"
 #include "log.h"
 #include "entry.h"
+#include "cachejournal.h"
+#include "cachepack.h"
+#include "cachewatch.h"
 #include "cache.h"
 
 
 extern inline bool FileTag_is_cache (const struct FileTag *tag);
 
 
+const char * const CacheDurability_names[CacheDurability_N] = {
+  [CacheDurability_NONE] = "none",
+  [CacheDurability_BATCH] = "batch",
+  [CacheDurability_FILE] = "file",
+};
+
+
+int CacheDurability_from_string (const char *name) {
+  for (int i = 0; i < CacheDurability_N; i++) {
+    if (strcmp(name, CacheDurability_names[i]) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+
 static int Cache__construct_subdir (
     FileHash hash, char *cache_subdir) {
   hash = htobe64(hash);
@@ -90,6 +120,209 @@ static inline char *Cache_construct_abspath (
 }
 
 
+/**
+ * @memberof Cache
+ * @private
+ * @brief Returns the shard holding `hash`.
+ *
+ * @param cache a Cache
+ * @param hash a FileHash
+ * @return the CacheShard
+ */
+static inline struct CacheShard *Cache__shard (
+    struct Cache *cache, FileHash hash) {
+  // the high bits already select the subdir, use the low ones
+  return cache->shards + (hash & (Cache_N_SHARDS - 1));
+}
+
+
+/**
+ * @memberof Cache
+ * @private
+ * @brief Creates the subdir containing the cache file `cache_fullpath`.
+ *
+ * @param cache a Cache
+ * @param cache_fullpath the absolute path to a cache file
+ * @param[out] error a return location for a GError [optional]
+ * @return 0 if success, otherwize nonzero
+ */
+static int Cache__mkdir_subdir (
+    const struct Cache *cache, char *cache_fullpath, GError **error) {
+  // mkdir -p
+  cache_fullpath[cache->cache_dir_len + 1 + Cache_SUBDIR_LENGTH] = '\0';
+  int ret = g_mkdir_with_parents_e(
+    cache_fullpath, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH, error);
+  cache_fullpath[cache->cache_dir_len + 1 + Cache_SUBDIR_LENGTH] = '/';
+  return ret;
+}
+
+
+/**
+ * @memberof Cache
+ * @private
+ * @brief Returns the current monotonic time in seconds, for
+ *        CacheEntry.verified and CacheEntry.scrubbed.
+ *
+ * @return the time, never 0
+ */
+static inline gint Cache__now (void) {
+  return g_get_monotonic_time() / G_TIME_SPAN_SECOND + 1;
+}
+
+
+/**
+ * @memberof Cache
+ * @private
+ * @brief Records an access to `entry`.
+ *
+ * @param cache a Cache
+ * @param entry a CacheEntry
+ */
+static inline void Cache__touch (
+    struct Cache *cache, struct CacheEntry *entry) {
+  CountMinSketch_add(&cache->sketch, entry->hash);
+  g_atomic_int_set(&entry->accessed, Cache__now());
+}
+
+
+/**
+ * @memberof Cache
+ * @private
+ * @brief Records a change of the cache file of `entry` in Cache.journal, if
+ *        enabled.
+ *
+ * @param cache a Cache
+ * @param op a CacheJournalOp
+ * @param entry a CacheEntry
+ */
+static void Cache__journal (
+    struct Cache *cache, enum CacheJournalOp op,
+    const struct CacheEntry *entry) {
+  return_if(cache->journal == NULL);
+  // packed blobs are recorded by Cache.pack itself
+  return_if(entry->packed);
+  return_if_not(FileTag_is_cache((const struct FileTag *) entry));
+  GError *error = NULL;
+  should (CacheJournal_append(
+      cache->journal, op, entry->hash, entry->stat_.size, entry->stat_.mtime,
+      &error) == 0) otherwise {
+    g_log(DFCC_FILE_NAME, G_LOG_LEVEL_WARNING,
+          "Cannot update cache journal: %s", error->message);
+    g_error_free(error);
+  }
+}
+
+
+/**
+ * @memberof Cache
+ * @private
+ * @brief Updates Cache.total_size and Cache.n_files as `entry` enters or
+ *        leaves the index.
+ *
+ * Must be called with the lock of the shard of `entry` held.
+ *
+ * @param cache a Cache
+ * @param entry a CacheEntry [nullable]
+ * @param added whether `entry` enters the index
+ */
+static void Cache__account (
+    struct Cache *cache, const struct CacheEntry *entry, bool added) {
+  return_if(entry == NULL);
+  return_if_not(FileTag_is_cache((const struct FileTag *) entry));
+  g_mutex_lock(&cache->usage_mtx);
+  if (added) {
+    cache->total_size += entry->stat_.size;
+    cache->n_files++;
+  } else {
+    cache->total_size -= entry->stat_.size;
+    cache->n_files--;
+  }
+  g_mutex_unlock(&cache->usage_mtx);
+}
+
+
+/**
+ * @memberof Cache
+ * @private
+ * @brief Unpins the content of `entry` from memory.
+ *
+ * Jobs which were handed the memfd keep it open until they finish.
+ *
+ * @param cache a Cache
+ * @param entry a CacheEntry
+ */
+static void Cache__demote (struct Cache *cache, struct CacheEntry *entry) {
+  g_mutex_lock(&cache->hot_mtx);
+  struct CacheMemfd *hot = entry->hot;
+  entry->hot = NULL;
+  if (hot != NULL) {
+    cache->hot_size -= hot->size;
+  }
+  g_mutex_unlock(&cache->hot_mtx);
+
+  if (hot != NULL) {
+    CacheMemfd_unref(hot);
+  }
+}
+
+
+/**
+ * @memberof Cache
+ * @private
+ * @brief Removes an invalid entry from the index, and deletes its cache file.
+ *
+ * @param cache a Cache
+ * @param entry a CacheEntry
+ * @param cache_fullpath the absolute path of `entry`
+ */
+static void Cache__drop (
+    struct Cache *cache, struct CacheEntry *entry,
+    const char *cache_fullpath) {
+  struct CacheShard *shard = Cache__shard(cache, entry->hash);
+  g_rw_lock_writer_lock(&shard->rwlock);
+  // it may have been replaced in the meantime
+  bool removed = g_hash_table_lookup(shard->index, &entry->hash) == entry;
+  if (removed) {
+    Cache__account(cache, entry, false);
+    g_hash_table_remove(shard->index, &entry->hash);
+  }
+  g_rw_lock_writer_unlock(&shard->rwlock);
+
+  if (removed) {
+    Cache__journal(cache, CacheJournal_REMOVE, entry);
+  }
+
+  if (entry->packed) {
+    if (removed && cache->pack != NULL) {
+      CachePack_remove(cache->pack, entry->hash);
+    }
+  } else if (FileTag_is_cache((struct FileTag *) entry)) {
+    // invalid cache file, delete
+    g_remove(cache_fullpath);
+  }
+  entry->invalid = true;
+  Cache__demote(cache, entry);
+}
+
+
+/**
+ * @memberof Cache
+ * @private
+ * @brief Starts watching the file of `entry`, if Cache.watch is enabled.
+ *
+ * @param cache a Cache
+ * @param entry a CacheEntry
+ * @param cache_fullpath the absolute path of `entry`
+ */
+static inline void Cache__watch_entry (
+    struct Cache *cache, struct CacheEntry *entry,
+    const char *cache_fullpath) {
+  if (cache->watch != NULL && !entry->packed) {
+    CacheWatch_add(cache->watch, cache_fullpath, entry->hash);
+  }
+}
+
+
 bool Cache_verify (
     struct Cache *cache, struct CacheEntry *entry, GError **error) {
   if unlikely (entry->invalid) {
@@ -108,6 +341,13 @@ bool Cache_verify (
   }
 
   do_once {
+    if (entry->packed) {
+      // packed blobs are not modified in place
+      entry_valid = cache->pack != NULL &&
+                    CachePack_lookup(cache->pack, entry->hash, NULL);
+      break;
+    }
+
     GStatBuf sb;
     should (g_stat_e(cache_fullpath, &sb, error) == 0) otherwise break;
     entry_valid = FileStat_isvalid_stat(&entry->stat_, &sb);
@@ -123,22 +363,18 @@ bool Cache_verify (
           // so we can rescue
           entry->stat_.mtime = sb.st_mtime;
           entry_valid = true;
+          Cache__journal(cache, CacheJournal_ADD, entry);
         }
       }
     }
   }
 
-  if (!entry_valid) {
+  if (entry_valid) {
+    Cache__watch_entry(cache, entry, cache_fullpath);
+    g_atomic_int_set(&entry->verified, Cache__now());
+  } else {
     // invalid entry, delete
-    g_rw_lock_writer_lock(&cache->rwlock);
-    g_hash_table_remove(cache->index, &entry->hash);
-    g_rw_lock_writer_unlock(&cache->rwlock);
-
-    if (entry_is_cache) {
-      // invalid cache file, delete
-      g_remove(cache_fullpath);
-    }
-    entry->invalid = true;
+    Cache__drop(cache, entry, cache_fullpath);
     CacheEntry_unref(entry);
   }
 
@@ -150,21 +386,64 @@ bool Cache_verify (
 
 
 static struct CacheEntry *Cache_index (
-    struct Cache *cache, char *path, GStatBuf *sb, FileHash hash) {
+    struct Cache *cache, char *path, GStatBuf *sb, FileHash hash,
+    bool packed) {
   struct CacheEntry *entry = g_new(struct CacheEntry, 1);
   CacheEntry_init(entry, path, sb, hash);
+  entry->packed = packed;
 
+  struct CacheShard *shard = Cache__shard(cache, hash);
   GRWLockWriterLocker *locker =
-    g_rw_lock_writer_locker_new(&cache->rwlock);
-  g_hash_table_insert(cache->index, &entry->hash, entry);
+    g_rw_lock_writer_locker_new(&shard->rwlock);
+  struct CacheEntry *old_entry = g_hash_table_lookup(shard->index, &hash);
+  if (old_entry != NULL) {
+    Cache__demote(cache, old_entry);
+  }
+  Cache__account(cache, old_entry, false);
+  Cache__account(cache, entry, true);
+  // the key points into the entry, so replace it as well
+  g_hash_table_replace(shard->index, &entry->hash, entry);
   g_rw_lock_writer_locker_free(locker);
 
+  Cache__journal(cache, CacheJournal_ADD, entry);
+  if (cache->watch != NULL) {
+    char *cache_fullpath = Cache_realpath(cache, path);
+    Cache__watch_entry(cache, entry, cache_fullpath);
+    g_free(cache_fullpath);
+  }
+  CountMinSketch_add(&cache->sketch, hash);
   return entry;
 }
 
 
+/**
+ * @memberof Cache
+ * @private
+ * @brief Adds a blob stored in Cache.pack into the index.
+ *
+ * @param cache a Cache
+ * @param hash the FileHash of the blob
+ * @param size the length of the blob
+ * @return the associated CacheEntry [transfer-none]
+ */
+static struct CacheEntry *Cache__index_packed (
+    struct Cache *cache, FileHash hash, size_t size) {
+  // the path only names the blob, it does not exist
+  char cache_relpath[Cache_RELPATH_LENGTH + 1];
+  Cache__construct_relpath(hash, cache_relpath);
+  GStatBuf sb = {.st_size = size};
+  return Cache_index(
+    cache, g_memdup(cache_relpath, sizeof(cache_relpath)), &sb, hash, true);
+}
+
+
 static struct CacheEntry *Cache_index_cache (
     struct Cache *cache, FileHash hash, GError **error) {
+  size_t size;
+  if (cache->pack != NULL && CachePack_lookup(cache->pack, hash, &size)) {
+    return Cache__index_packed(cache, hash, size);
+  }
+
   char cache_relpath[Cache_RELPATH_LENGTH + 1];
   Cache__construct_relpath(hash, cache_relpath);
   char *cache_fullpath = Cache_realpath_force(cache, cache_relpath);
@@ -176,7 +455,7 @@ static struct CacheEntry *Cache_index_cache (
     }
 
     do_once {
-      // file should match its hash
+      // file should match its hash, the scrubber only catches later rot
       if (!cache->no_verify_cache) {
         FileHash file_hash = FileHash_from_file(cache_fullpath, error);
         break_if_fail(file_hash != 0);
@@ -189,7 +468,9 @@ static struct CacheEntry *Cache_index_cache (
       GStatBuf sb;
       should (g_stat_e(cache_fullpath, &sb, error) == 0) otherwise break;
       free(cache_fullpath);
-      return Cache_index(cache, g_memdup(cache_relpath, sizeof(cache_relpath)), &sb, hash);
+      return Cache_index(
+        cache, g_memdup(cache_relpath, sizeof(cache_relpath)), &sb, hash,
+        false);
     }
 
     g_remove(cache_fullpath);
@@ -202,17 +483,25 @@ static struct CacheEntry *Cache_index_cache (
 
 struct CacheEntry *Cache_try_get (struct Cache *cache, FileHash hash) {
   // find an existing one
-  GRWLockReaderLocker *locker =
-    g_rw_lock_reader_locker_new(&cache->rwlock);
-  struct CacheEntry *entry = g_hash_table_lookup(cache->index, &hash);
+  struct CacheShard *shard = Cache__shard(cache, hash);
+  GRWLockReaderLocker *locker = g_rw_lock_reader_locker_new(&shard->rwlock);
+  struct CacheEntry *entry = g_hash_table_lookup(shard->index, &hash);
   if (entry != NULL) {
     CacheEntry_ref(entry);
   }
   g_rw_lock_reader_locker_free(locker);
 
   if (entry != NULL) {
+    // checked recently, and not modified since as far as we know
+    if likely (!entry->invalid && Cache__now() - g_atomic_int_get(
+        &entry->verified) < (gint) cache->trust_window) {
+      Cache__touch(cache, entry);
+      return entry;
+    }
+
     GError *error_ = NULL;
     if (Cache_verify(cache, entry, &error_)) {
+      Cache__touch(cache, entry);
       return entry;
     }
     if (error_ != NULL) {
@@ -236,6 +525,170 @@ struct CacheEntry *Cache_get (
 }
 
 
+//! @memberof Cache
+static void Cache__mapped_file_free (gpointer m) {
+  MappedFile_destroy(m);
+  g_free(m);
+}
+
+
+GBytes *Cache_read (
+    struct Cache *cache, struct CacheEntry *entry, GError **error) {
+  return_if(entry->packed) CachePack_get(cache->pack, entry->hash, error);
+
+  char *cache_fullpath = Cache_realpath(cache, entry->path);
+  struct MappedFile *m = g_new(struct MappedFile, 1);
+  int ret = MappedFile_init(m, cache_fullpath, error);
+  g_free(cache_fullpath);
+  should (ret == 0) otherwise {
+    g_free(m);
+    return NULL;
+  }
+  // the bytes keep the mapping alive
+  return g_bytes_new_with_free_func(
+    m->content, m->length, Cache__mapped_file_free, m);
+}
+
+
+/**
+ * @memberof Cache
+ * @private
+ * @brief Notes that a blob was packed, for Cache_sync().
+ *
+ * @param cache a Cache
+ */
+static inline void Cache__packed (struct Cache *cache) {
+  // synced by CachePack_put() under CacheDurability_FILE
+  if (cache->durability == CacheDurability_BATCH) {
+    g_atomic_int_set(&cache->dirty, 1);
+  }
+}
+
+
+/**
+ * @memberof Cache
+ * @private
+ * @brief Creates a temporary file in Cache.cache_dir, without a name if the
+ *        file system supports it.
+ *
+ * @param cache a Cache
+ * @param[out] tmppath path to the file, or `NULL` if it has no name
+ *                     [transfer-full]
+ * @param[out] error a return location for a GError [optional]
+ * @return file descriptor opened for reading and writing, or -1 if error
+ *         happened
+ */
+static int Cache__open_tmp (
+    struct Cache *cache, char **tmppath, GError **error) {
+  return_if_fail(g_mkdir_with_parents_e(
+    cache->cache_dir, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH, error) == 0) -1;
+
+  // same filesystem as the cache files, so that publishing is atomic
+  if (!g_atomic_int_get(&cache->no_tmpfile)) {
+    int fd = open(cache->cache_dir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0644);
+    if (fd >= 0) {
+      *tmppath = NULL;
+      return fd;
+    }
+    if (errno == EOPNOTSUPP || errno == EISDIR || errno == EINVAL) {
+      g_atomic_int_set(&cache->no_tmpfile, 1);
+    }
+  }
+
+  *tmppath = g_build_filename(cache->cache_dir, ".tmp-XXXXXX", NULL);
+  int fd = g_mkstemp_full(*tmppath, O_RDWR | O_CLOEXEC, 0644);
+  should (fd >= 0) otherwise {
+    g_set_error_errno(error, G_FILE_ERROR, "Failed to mkstemp: %s");
+    g_free(*tmppath);
+    *tmppath = NULL;
+    return -1;
+  }
+  return fd;
+}
+
+
+/**
+ * @memberof Cache
+ * @private
+ * @brief Gives a temporary file its name in Cache, making it durable as
+ *        required by Cache.durability.
+ *
+ * An existing file at `cache_fullpath` is replaced.
+ *
+ * @param cache a Cache
+ * @param fd file descriptor of the temporary file
+ * @param tmppath path to the temporary file, or `NULL` if it has no name
+ * @param cache_fullpath the absolute path to the cache file
+ * @param[out] error a return location for a GError [optional]
+ * @return 0 if success, otherwize nonzero
+ */
+static int Cache__publish (
+    struct Cache *cache, int fd, const char *tmppath, char *cache_fullpath,
+    GError **error) {
+  bool sync = cache->durability == CacheDurability_FILE;
+  // the content must be durable before the name
+  should (!sync || fdatasync(fd) == 0) otherwise {
+    g_set_error_errno(error, G_FILE_ERROR, "Failed to fdatasync: %s");
+    return 1;
+  }
+  return_if_fail(Cache__mkdir_subdir(cache, cache_fullpath, error) == 0) 1;
+
+  if (tmppath != NULL) {
+    should (g_rename(tmppath, cache_fullpath) == 0) otherwise {
+      g_set_error_errno(error, G_FILE_ERROR, "Failed to rename: %s");
+      return 1;
+    }
+  } else {
+    char fdpath[32];
+    snprintf(fdpath, sizeof(fdpath), "/proc/self/fd/%d", fd);
+    int ret = linkat(
+      AT_FDCWD, fdpath, AT_FDCWD, cache_fullpath, AT_SYMLINK_FOLLOW);
+    if (ret != 0 && errno == EEXIST) {
+      // a stale file not in the index, linkat() does not replace it; link
+      // aside and rename over it, so that the name never goes missing
+      char *linkpath = NULL;
+      do {
+        g_free(linkpath);
+        linkpath = g_strdup_printf(
+          "%s/.tmp-%08" G_GINT32_MODIFIER "x", cache->cache_dir,
+          g_random_int());
+        ret = linkat(AT_FDCWD, fdpath, AT_FDCWD, linkpath, AT_SYMLINK_FOLLOW);
+      } while (ret != 0 && errno == EEXIST);
+      if (ret == 0) {
+        ret = g_rename(linkpath, cache_fullpath);
+        should (ret == 0) otherwise {
+          int saved_errno = errno;
+          g_remove(linkpath);
+          errno = saved_errno;
+        }
+      }
+      g_free(linkpath);
+    }
+    should (ret == 0) otherwise {
+      g_set_error_errno(error, G_FILE_ERROR, "Failed to link: %s");
+      return 1;
+    }
+  }
+
+  if (sync) {
+    cache_fullpath[cache->cache_dir_len + 1 + Cache_SUBDIR_LENGTH] = '\0';
+    int dirfd = open(cache_fullpath, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    should (dirfd >= 0 && fsync(dirfd) == 0) otherwise {
+      // already published, the file is only less durable
+      g_log(DFCC_FILE_NAME, G_LOG_LEVEL_WARNING,
+            "Cannot sync '%s': %s", cache_fullpath, g_strerror(errno));
+    }
+    if (dirfd >= 0) {
+      close(dirfd);
+    }
+    cache_fullpath[cache->cache_dir_len + 1 + Cache_SUBDIR_LENGTH] = '/';
+  } else if (cache->durability == CacheDurability_BATCH) {
+    g_atomic_int_set(&cache->dirty, 1);
+  }
+  return 0;
+}
+
+
 struct CacheEntry *Cache_index_buf (
     struct Cache *cache, const char *buf, size_t size, GError **error) {
   FileHash hash = FileHash_from_buf(buf, size);
@@ -251,37 +704,262 @@ struct CacheEntry *Cache_index_buf (
     return NULL;
   }
 
-  // write to cache dir
-  char cache_relpath[Cache_RELPATH_LENGTH + 1];
-  Cache__construct_relpath(hash, cache_relpath);
-  char *cache_fullpath = Cache_realpath(cache, cache_relpath);
+  if (cache->pack != NULL && size <= cache->pack_threshold) {
+    return_if_fail(
+      CachePack_put(cache->pack, hash, buf, size, error) == 0) NULL;
+    Cache__packed(cache);
+    return Cache__index_packed(cache, hash, size);
+  }
+
+  // write to a temporary file, so that readers never see a partial file
+  char *tmppath;
+  int fd = Cache__open_tmp(cache, &tmppath, error);
+  return_if_fail(fd >= 0) NULL;
+  if (write_e(fd, buf, size, error) == (ssize_t) size) {
+    entry = Cache_index_tmpfile(cache, fd, tmppath, hash, error);
+  } else if (tmppath != NULL) {
+    g_remove(tmppath);
+  }
+  close(fd);
+  g_free(tmppath);
+  return entry;
+}
 
-  do_once {
-    // mkdir -p
-    cache_fullpath[cache->cache_dir_len + 1 + Cache_SUBDIR_LENGTH] = '\0';
-    should (g_mkdir_with_parents_e(
-      cache_fullpath, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH, error) == 0
-    ) otherwise break;
-    cache_fullpath[cache->cache_dir_len + 1 + Cache_SUBDIR_LENGTH] = '/';
 
-    // write
-    FILE *f = g_fopen_e(cache_fullpath, "wb", error);
-    should (f != NULL) otherwise break;
+struct CacheEntry *Cache_index_tmpfile (
+    struct Cache *cache, int fd, const char *tmppath, FileHash hash,
+    GError **error) {
+  GError *error_ = NULL;
+  struct CacheEntry *entry = Cache_get(cache, hash, &error_);
+  bool published = false;
 
-    size_t wrote_len = fwrite_e(buf, 1, size, f, error);
-    fclose(f);
-    should (wrote_len == size) otherwise break;
+  do_once {
+    break_if(entry != NULL);
+    should (error_ == NULL) otherwise {
+      g_propagate_error(error, error_);
+      break;
+    }
 
     GStatBuf sb;
-    should (g_stat_e(cache_fullpath, &sb, error) == 0) otherwise break;
+    should (fstat_e(fd, &sb, error) == 0) otherwise break;
+    if (cache->pack != NULL && (size_t) sb.st_size <= cache->pack_threshold) {
+      struct MappedFile m;
+      break_if_fail(MappedFile_init_from_fd(&m, fd, error) == 0);
+      int ret = CachePack_put(cache->pack, hash, m.content, m.length, error);
+      MappedFile_destroy(&m);
+      break_if_fail(ret == 0);
+      Cache__packed(cache);
+      entry = Cache__index_packed(cache, hash, sb.st_size);
+      break;
+    }
+
+    char cache_relpath[Cache_RELPATH_LENGTH + 1];
+    Cache__construct_relpath(hash, cache_relpath);
+    char *cache_fullpath = Cache_realpath(cache, cache_relpath);
+    published = Cache__publish(cache, fd, tmppath, cache_fullpath, error) == 0;
     free(cache_fullpath);
-    return Cache_index(
-      cache, g_memdup(cache_relpath, sizeof(cache_relpath)), &sb, hash);
+    break_if_not(published);
+    entry = Cache_index(
+      cache, g_memdup(cache_relpath, sizeof(cache_relpath)), &sb, hash,
+      false);
   }
 
-  g_remove(cache_fullpath);
-  free(cache_fullpath);
-  return NULL;
+  // an unnamed file vanishes by itself
+  if (!published && tmppath != NULL) {
+    g_remove(tmppath);
+  }
+  return entry;
+}
+
+
+char *Cache_file_path (
+    struct Cache *cache, struct CacheEntry *entry, GError **error) {
+  return_if_not(entry->packed) Cache_realpath(cache, entry->path);
+
+  GError *error_ = NULL;
+  GBytes *bytes = cache->pack == NULL ?
+    NULL : CachePack_get(cache->pack, entry->hash, &error_);
+  should (bytes != NULL) otherwise {
+    if (error_ == NULL) {
+      g_set_error_literal(
+        &error_, G_FILE_ERROR, G_FILE_ERROR_NOENT, "Packed blob gone");
+    }
+    g_propagate_error(error, error_);
+    return NULL;
+  }
+
+  char cache_relpath[Cache_RELPATH_LENGTH + 1];
+  Cache__construct_relpath(entry->hash, cache_relpath);
+  char *cache_fullpath = Cache_realpath_force(cache, cache_relpath);
+  bool published = false;
+
+  char *tmppath;
+  int fd = Cache__open_tmp(cache, &tmppath, error);
+  if (fd >= 0) {
+    gsize size;
+    gconstpointer data = g_bytes_get_data(bytes, &size);
+    GStatBuf sb;
+    published = write_e(fd, data, size, error) == (ssize_t) size &&
+                fstat_e(fd, &sb, error) == 0 &&
+                Cache__publish(cache, fd, tmppath, cache_fullpath, error) == 0;
+    if (published) {
+      // the file replaces the packed entry
+      CacheEntry_unref(Cache_index(
+        cache, g_memdup(cache_relpath, sizeof(cache_relpath)), &sb,
+        entry->hash, false));
+      CachePack_remove(cache->pack, entry->hash);
+      entry->invalid = true;
+    } else if (tmppath != NULL) {
+      g_remove(tmppath);
+    }
+    close(fd);
+    g_free(tmppath);
+  }
+  g_bytes_unref(bytes);
+
+  if (!published) {
+    g_free(cache_fullpath);
+    return NULL;
+  }
+  return cache_fullpath;
+}
+
+
+/**
+ * @memberof Cache
+ * @private
+ * @brief Copies the content of `entry` into a sealed memfd.
+ *
+ * @param cache a Cache
+ * @param entry a CacheEntry
+ * @param[out] error a return location for a GError [optional]
+ * @return the CacheMemfd, or `NULL` if error happened [transfer-full]
+ */
+static struct CacheMemfd *Cache__memfd_new (
+    struct Cache *cache, struct CacheEntry *entry, GError **error) {
+  GError *error_ = NULL;
+  GBytes *bytes = Cache_read(cache, entry, &error_);
+  should (bytes != NULL) otherwise {
+    if (error_ == NULL) {
+      g_set_error_literal(
+        &error_, G_FILE_ERROR, G_FILE_ERROR_NOENT, "Packed blob gone");
+    }
+    g_propagate_error(error, error_);
+    return NULL;
+  }
+
+  int fd = memfd_create(DFCC_NAME "-hot", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  should (fd >= 0) otherwise {
+    g_set_error_errno(error, G_FILE_ERROR, "Failed to memfd_create: %s");
+    g_bytes_unref(bytes);
+    return NULL;
+  }
+  gsize size;
+  gconstpointer data = g_bytes_get_data(bytes, &size);
+  int ret = write_e(fd, data, size, error) == (ssize_t) size ? 0 : 1;
+  g_bytes_unref(bytes);
+  if (ret == 0) {
+    // shared by jobs, none of them may change it
+    ret = fcntl(
+      fd, F_ADD_SEALS,
+      F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+    should (ret == 0) otherwise {
+      g_set_error_errno(error, G_FILE_ERROR, "Failed to seal: %s");
+    }
+  }
+  should (ret == 0) otherwise {
+    close(fd);
+    return NULL;
+  }
+
+  struct CacheMemfd *memfd = g_new(struct CacheMemfd, 1);
+  g_atomic_ref_count_init(&memfd->arc);
+  memfd->fd = fd;
+  memfd->size = size;
+  return memfd;
+}
+
+
+/**
+ * @memberof Cache
+ * @private
+ * @brief Pins the content of `entry` in a memfd, if it is small and popular
+ *        enough and fits in Cache.hot_budget.
+ *
+ * @param cache a Cache
+ * @param entry a CacheEntry
+ * @return the CacheMemfd, or `NULL` if not pinned [transfer-full]
+ */
+static struct CacheMemfd *Cache__promote (
+    struct Cache *cache, struct CacheEntry *entry) {
+  size_t size = entry->stat_.size;
+  return_if(size > Cache_HOT_MAX_SIZE || size > cache->hot_budget) NULL;
+  return_if(CountMinSketch_estimate(&cache->sketch, entry->hash) <
+            Cache_HOT_MIN_FREQUENCY) NULL;
+  g_mutex_lock(&cache->hot_mtx);
+  bool fits = cache->hot_size + size <= cache->hot_budget;
+  g_mutex_unlock(&cache->hot_mtx);
+  return_if_not(fits) NULL;
+
+  GError *error = NULL;
+  struct CacheMemfd *hot = Cache__memfd_new(cache, entry, &error);
+  should (hot != NULL) otherwise {
+    g_log(DFCC_FILE_NAME, G_LOG_LEVEL_INFO,
+          "Cannot pin '%s': %s", entry->path, error->message);
+    g_error_free(error);
+    return NULL;
+  }
+
+  struct CacheMemfd *ret = NULL;
+  struct CacheShard *shard = Cache__shard(cache, entry->hash);
+  g_rw_lock_reader_lock(&shard->rwlock);
+  g_mutex_lock(&cache->hot_mtx);
+  if (entry->hot != NULL) {
+    // pinned by someone else meanwhile
+    ret = CacheMemfd_ref(entry->hot);
+  } else if (g_hash_table_lookup(shard->index, &entry->hash) == entry &&
+             cache->hot_size + size <= cache->hot_budget) {
+    // entries dropped or replaced are demoted once, and must stay so
+    entry->hot = CacheMemfd_ref(hot);
+    cache->hot_size += size;
+    ret = hot;
+    hot = NULL;
+  }
+  g_mutex_unlock(&cache->hot_mtx);
+  g_rw_lock_reader_unlock(&shard->rwlock);
+
+  if (hot != NULL) {
+    CacheMemfd_unref(hot);
+  }
+  return ret;
+}
+
+
+char *Cache_hot_path (
+    struct Cache *cache, struct CacheEntry *entry, struct CacheMemfd **memfd,
+    GError **error) {
+  *memfd = NULL;
+  if (cache->hot_budget != 0) {
+    g_mutex_lock(&cache->hot_mtx);
+    struct CacheMemfd *hot =
+      entry->hot == NULL ? NULL : CacheMemfd_ref(entry->hot);
+    if (hot != NULL) {
+      cache->hot_hits++;
+    } else {
+      cache->hot_misses++;
+    }
+    g_mutex_unlock(&cache->hot_mtx);
+
+    if (hot == NULL) {
+      hot = Cache__promote(cache, entry);
+    }
+    if (hot != NULL) {
+      // jobs are our children, and may open our descriptors
+      *memfd = hot;
+      return g_strdup_printf("/proc/%d/fd/%d", (int) getpid(), hot->fd);
+    }
+  }
+  return Cache_file_path(cache, entry, error);
 }
 
 
@@ -326,7 +1004,7 @@ struct CacheEntry *Cache_index_path (
     should (g_stat_e(path, &sb, error) == 0) otherwise break;
     entry = Cache_index(
       cache, cache_fullpath == NULL ? g_strdup(path) : cache_fullpath,
-      &sb, hash);
+      &sb, hash, false);
     should (entry != NULL) otherwise break;
     added_ = true;
   }
@@ -341,20 +1019,668 @@ struct CacheEntry *Cache_index_path (
 }
 
 
+/**
+ * @memberof Cache
+ * @private
+ * @brief Forces the entry of `hash`, or every entry if `hash` is 0, to be
+ *        checked on the next access.
+ *
+ * @param cache_ a Cache
+ * @param hash a FileHash
+ */
+static void Cache__distrust (void *cache_, FileHash hash) {
+  struct Cache *cache = cache_;
+  for (int i = 0; i < Cache_N_SHARDS; i++) {
+    struct CacheShard *shard =
+      hash == 0 ? cache->shards + i : Cache__shard(cache, hash);
+    g_rw_lock_reader_lock(&shard->rwlock);
+    if (hash == 0) {
+      GHashTableIter iter;
+      struct CacheEntry *entry;
+      for (g_hash_table_iter_init(&iter, shard->index);
+           g_hash_table_iter_next(&iter, NULL, (gpointer *) &entry);) {
+        g_atomic_int_set(&entry->verified, 0);
+      }
+    } else {
+      struct CacheEntry *entry = g_hash_table_lookup(shard->index, &hash);
+      if (entry != NULL) {
+        g_atomic_int_set(&entry->verified, 0);
+      }
+    }
+    g_rw_lock_reader_unlock(&shard->rwlock);
+    break_if(hash != 0);
+  }
+}
+
+
+//! @memberof Cache
+static gboolean Cache__on_watch (
+    gint fd, GIOCondition condition, gpointer cache_) {
+  struct Cache *cache = cache_;
+  CacheWatch_dispatch(cache->watch, Cache__distrust, cache);
+  return G_SOURCE_CONTINUE;
+}
+
+
+int Cache_watch (struct Cache *cache, GError **error) {
+  return_if(cache->watch != NULL) 0;
+  struct CacheWatch *watch = g_new(struct CacheWatch, 1);
+  should (CacheWatch_init(watch, error) == 0) otherwise {
+    g_free(watch);
+    return 1;
+  }
+  cache->watch = watch;
+  cache->watch_source = g_unix_fd_add(
+    watch->fd, G_IO_IN, Cache__on_watch, cache);
+  return 0;
+}
+
+
+/**
+ * @memberof Cache
+ * @private
+ * @brief Applies a record of Cache.journal to the index.
+ *
+ * @param cache_ a Cache
+ * @param record a CacheJournalRecord
+ */
+static void Cache__replay (
+    void *cache_, const struct CacheJournalRecord *record) {
+  struct Cache *cache = cache_;
+  struct CacheShard *shard = Cache__shard(cache, record->hash);
+
+  struct CacheEntry *entry = NULL;
+  if (record->op == CacheJournal_ADD) {
+    char cache_relpath[Cache_RELPATH_LENGTH + 1];
+    Cache__construct_relpath(record->hash, cache_relpath);
+    GStatBuf sb = {.st_size = record->size, .st_mtime = record->mtime};
+    entry = g_new(struct CacheEntry, 1);
+    CacheEntry_init(
+      entry, g_memdup(cache_relpath, sizeof(cache_relpath)), &sb,
+      record->hash);
+    // the file may have changed while we were down, check it on first access
+    entry->verified = 0;
+  }
+
+  g_rw_lock_writer_lock(&shard->rwlock);
+  Cache__account(
+    cache, g_hash_table_lookup(shard->index, &record->hash), false);
+  if (entry != NULL) {
+    Cache__account(cache, entry, true);
+    g_hash_table_replace(shard->index, &entry->hash, entry);
+  } else {
+    g_hash_table_remove(shard->index, &record->hash);
+  }
+  g_rw_lock_writer_unlock(&shard->rwlock);
+
+  if (entry != NULL) {
+    // only the index holds it
+    CacheEntry_unref(entry);
+  }
+}
+
+
+int Cache_open_journal (struct Cache *cache, GError **error) {
+  return_if(cache->journal != NULL) 0;
+  struct CacheJournal *journal = g_new(struct CacheJournal, 1);
+  char *path = g_build_filename(
+    cache->cache_dir, DFCC_CACHE_JOURNAL_FILENAME, NULL);
+  int ret = CacheJournal_init(journal, path, Cache__replay, cache, error);
+  g_free(path);
+  should (ret == 0) otherwise {
+    g_free(journal);
+    return 1;
+  }
+  cache->journal = journal;
+
+  guint n_entries = 0;
+  for (int i = 0; i < Cache_N_SHARDS; i++) {
+    n_entries += g_hash_table_size(cache->shards[i].index);
+  }
+  g_log(DFCC_FILE_NAME, G_LOG_LEVEL_INFO,
+        "Restored %u cache entries from %u journal record(s)",
+        n_entries, journal->n_records);
+  return 0;
+}
+
+
+/**
+ * @memberof Cache
+ * @private
+ * @brief Collects the cache files in the index as CacheJournalRecord.
+ *
+ * @param cache_ a Cache
+ * @param records a GArray of CacheJournalRecord
+ */
+static void Cache__collect (void *cache_, GArray *records) {
+  struct Cache *cache = cache_;
+  for (int i = 0; i < Cache_N_SHARDS; i++) {
+    struct CacheShard *shard = cache->shards + i;
+    g_rw_lock_reader_lock(&shard->rwlock);
+    GHashTableIter iter;
+    struct CacheEntry *entry;
+    for (g_hash_table_iter_init(&iter, shard->index);
+         g_hash_table_iter_next(&iter, NULL, (gpointer *) &entry);) {
+      continue_if_not(FileTag_is_cache((struct FileTag *) entry));
+      // packed blobs are recorded by the pack itself
+      continue_if(entry->packed);
+      struct CacheJournalRecord record = {
+        .op = CacheJournal_ADD,
+        .hash = entry->hash,
+        .size = entry->stat_.size,
+        .mtime = entry->stat_.mtime,
+      };
+      g_array_append_val(records, record);
+    }
+    g_rw_lock_reader_unlock(&shard->rwlock);
+  }
+}
+
+
+int Cache_compact_journal (struct Cache *cache, GError **error) {
+  return_if(cache->journal == NULL) 0;
+
+  guint n_entries = 0;
+  for (int i = 0; i < Cache_N_SHARDS; i++) {
+    struct CacheShard *shard = cache->shards + i;
+    g_rw_lock_reader_lock(&shard->rwlock);
+    n_entries += g_hash_table_size(shard->index);
+    g_rw_lock_reader_unlock(&shard->rwlock);
+  }
+  g_mutex_lock(&cache->journal->mtx);
+  unsigned int n_records = cache->journal->n_records;
+  g_mutex_unlock(&cache->journal->mtx);
+  return_if(n_records < Cache_JOURNAL_MIN_RECORDS ||
+            n_records < 2 * n_entries) 0;
+
+  g_log(DFCC_FILE_NAME, G_LOG_LEVEL_DEBUG,
+        "Compact cache journal of %u record(s)", n_records);
+  return CacheJournal_compact(cache->journal, Cache__collect, cache, error);
+}
+
+
+int Cache_sync (struct Cache *cache, GError **error) {
+  return_if_not(g_atomic_int_compare_and_exchange(&cache->dirty, 1, 0)) 0;
+
+  int fd = g_open_e(
+    cache->cache_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC, 0, error);
+  int ret = fd != -1 ? syncfs(fd) : -1;
+  should (ret == 0) otherwise {
+    if (fd != -1) {
+      g_set_error_errno(error, G_FILE_ERROR, "Failed to syncfs: %s");
+    }
+    // try again next time
+    g_atomic_int_set(&cache->dirty, 1);
+  }
+  if (fd != -1) {
+    close(fd);
+  }
+  return ret == 0 ? 0 : 1;
+}
+
+
+//! @memberof Cache
+static void Cache__restore_packed (void *cache_, FileHash hash, size_t size) {
+  CacheEntry_unref(Cache__index_packed(cache_, hash, size));
+}
+
+
+int Cache_open_pack (struct Cache *cache, size_t threshold, GError **error) {
+  return_if(cache->pack != NULL) 0;
+  struct CachePack *pack = g_new(struct CachePack, 1);
+  char *dir = g_build_filename(
+    cache->cache_dir, DFCC_CACHE_PACK_DIRNAME, NULL);
+  int ret = CachePack_init(pack, dir, error);
+  g_free(dir);
+  should (ret == 0) otherwise {
+    g_free(pack);
+    return 1;
+  }
+
+  pack->sync = cache->durability == CacheDurability_FILE;
+  guint n_blobs = g_hash_table_size(pack->index);
+  CachePack_foreach(pack, Cache__restore_packed, cache);
+  cache->pack_threshold = threshold;
+  cache->pack = pack;
+  g_log(DFCC_FILE_NAME, G_LOG_LEVEL_INFO,
+        "Restored %u packed blob(s) from %u segment(s)",
+        n_blobs, g_hash_table_size(pack->segments));
+  return 0;
+}
+
+
+/**
+ * @memberof Cache
+ * @private
+ * @brief Rehashes the content of `entry`.
+ *
+ * @param cache a Cache
+ * @param entry a CacheEntry
+ * @param cache_fullpath the absolute path of `entry`
+ * @param[out] error a return location for a GError [optional]
+ * @return the FileHash, or 0 if not found or error happened
+ */
+static FileHash Cache__rehash (
+    struct Cache *cache, struct CacheEntry *entry, const char *cache_fullpath,
+    GError **error) {
+  if (!entry->packed) {
+    return FileHash_from_file(cache_fullpath, error);
+  }
+
+  GBytes *bytes = CachePack_get(cache->pack, entry->hash, error);
+  return_if(bytes == NULL) 0;
+  gsize size;
+  gconstpointer data = g_bytes_get_data(bytes, &size);
+  FileHash hash = FileHash_from_buf(data, size);
+  g_bytes_unref(bytes);
+  return hash;
+}
+
+
+size_t Cache_scrub (struct Cache *cache, size_t budget) {
+  gint now = Cache__now();
+  size_t scrubbed = 0;
+
+  for (int n_shards = 0; n_shards < Cache_N_SHARDS && scrubbed < budget;
+       n_shards++) {
+    struct CacheShard *shard = cache->shards + cache->scrub_cursor;
+    cache->scrub_cursor = (cache->scrub_cursor + 1) % Cache_N_SHARDS;
+
+    // pick cold entries
+    GPtrArray *entries = g_ptr_array_new();
+    size_t picked = scrubbed;
+    g_rw_lock_reader_lock(&shard->rwlock);
+    GHashTableIter iter;
+    struct CacheEntry *entry;
+    for (g_hash_table_iter_init(&iter, shard->index);
+         picked < budget &&
+         g_hash_table_iter_next(&iter, NULL, (gpointer *) &entry);) {
+      continue_if(now - g_atomic_int_get(&entry->scrubbed) < Cache_SCRUB_AGE);
+      g_ptr_array_add(entries, CacheEntry_ref(entry));
+      picked += entry->stat_.size;
+    }
+    g_rw_lock_reader_unlock(&shard->rwlock);
+
+    // rehash them without holding the lock
+    for (guint i = 0; i < entries->len; i++) {
+      entry = g_ptr_array_index(entries, i);
+      char *cache_fullpath = Cache_realpath(cache, entry->path);
+      GError *error = NULL;
+      FileHash hash = Cache__rehash(cache, entry, cache_fullpath, &error);
+      if (error != NULL) {
+        g_log(DFCC_FILE_NAME, G_LOG_LEVEL_INFO,
+              "Cannot scrub '%s': %s", cache_fullpath, error->message);
+        g_error_free(error);
+      } else if (hash != entry->hash) {
+        g_log(DFCC_FILE_NAME, G_LOG_LEVEL_WARNING,
+              "Corrupted cache file '%s', drop", cache_fullpath);
+        Cache__drop(cache, entry, cache_fullpath);
+      } else {
+        g_atomic_int_set(&entry->scrubbed, now);
+      }
+      scrubbed += entry->stat_.size;
+      g_free(cache_fullpath);
+      CacheEntry_unref(entry);
+    }
+    g_ptr_array_free(entries, TRUE);
+  }
+
+  return scrubbed;
+}
+
+
+void Cache_housekeep (struct Cache *cache) {
+  Cache_evict(cache, cache->quota_size, cache->quota_files);
+  if (cache->hot_budget != 0) {
+    Cache_rebalance_hot(cache);
+  }
+  GError *error = NULL;
+  should (Cache_sync(cache, &error) == 0) otherwise {
+    g_log(DFCC_FILE_NAME, G_LOG_LEVEL_WARNING,
+          "Cannot sync cache: %s", error->message);
+    g_clear_error(&error);
+  }
+  should (Cache_compact_journal(cache, &error) == 0) otherwise {
+    g_log(DFCC_FILE_NAME, G_LOG_LEVEL_WARNING,
+          "Cannot compact cache journal: %s", error->message);
+    g_error_free(error);
+  }
+}
+
+
+//! @memberof Cache
+static gpointer Cache__scrubber_run (gpointer cache_) {
+  struct Cache *cache = cache_;
+  gint64 housekept = g_get_monotonic_time();
+
+  g_mutex_lock(&cache->scrub_mtx);
+  while (!cache->scrub_stop) {
+    g_mutex_unlock(&cache->scrub_mtx);
+    gint64 now = g_get_monotonic_time();
+    if (cache->housekeeping_interval != 0 &&
+        now - housekept >=
+          (gint64) cache->housekeeping_interval * G_TIME_SPAN_SECOND) {
+      housekept = now;
+      Cache_housekeep(cache);
+    }
+    if (!cache->no_verify_cache) {
+      Cache_scrub(cache, cache->scrub_rate);
+    }
+    if (cache->pack != NULL) {
+      GError *error = NULL;
+      should (CachePack_compact(cache->pack, &error) >= 0) otherwise {
+        g_log(DFCC_FILE_NAME, G_LOG_LEVEL_WARNING,
+              "Cannot compact cache pack: %s", error->message);
+        g_error_free(error);
+      }
+    }
+    g_mutex_lock(&cache->scrub_mtx);
+    g_cond_wait_until(&cache->scrub_cond, &cache->scrub_mtx,
+                      g_get_monotonic_time() + G_TIME_SPAN_SECOND);
+  }
+  g_mutex_unlock(&cache->scrub_mtx);
+  return NULL;
+}
+
+
+int Cache_start_scrubber (
+    struct Cache *cache, size_t rate, GError **error) {
+  return_if(cache->scrubber != NULL) 0;
+  cache->scrub_rate = rate;
+  cache->scrub_stop = false;
+  cache->scrubber = g_thread_try_new(
+    DFCC_NAME "-scrubber", Cache__scrubber_run, cache, error);
+  return cache->scrubber != NULL ? 0 : 1;
+}
+
+
+/**
+ * @brief A cache file which may be evicted.
+ */
+struct CacheEvictCandidate {
+  struct CacheEntry *entry;
+  unsigned int frequency;
+  gint accessed;
+};
+
+
+//! @memberof CacheEvictCandidate
+static gint CacheEvictCandidate_compare (gconstpointer a, gconstpointer b) {
+  const struct CacheEvictCandidate *x = a;
+  const struct CacheEvictCandidate *y = b;
+  if (x->frequency != y->frequency) {
+    return x->frequency < y->frequency ? -1 : 1;
+  }
+  return x->accessed < y->accessed ? -1 : x->accessed > y->accessed;
+}
+
+
+unsigned int Cache_evict (
+    struct Cache *cache, guint64 max_size, unsigned int max_files) {
+  return_if(max_size == 0 && max_files == 0) 0;
+  // only scan the index when over quota
+  g_mutex_lock(&cache->usage_mtx);
+  bool over_quota = (max_size != 0 && cache->total_size > max_size) ||
+                    (max_files != 0 && cache->n_files > max_files);
+  g_mutex_unlock(&cache->usage_mtx);
+  return_if_not(over_quota) 0;
+
+  GArray *candidates =
+    g_array_new(FALSE, FALSE, sizeof(struct CacheEvictCandidate));
+  guint64 total_size = 0;
+  for (int i = 0; i < Cache_N_SHARDS; i++) {
+    struct CacheShard *shard = cache->shards + i;
+    g_rw_lock_reader_lock(&shard->rwlock);
+    GHashTableIter iter;
+    struct CacheEntry *entry;
+    for (g_hash_table_iter_init(&iter, shard->index);
+         g_hash_table_iter_next(&iter, NULL, (gpointer *) &entry);) {
+      continue_if_not(FileTag_is_cache((struct FileTag *) entry));
+      struct CacheEvictCandidate candidate = {
+        .entry = CacheEntry_ref(entry),
+        .frequency = CountMinSketch_estimate(&cache->sketch, entry->hash),
+        .accessed = g_atomic_int_get(&entry->accessed),
+      };
+      g_array_append_val(candidates, candidate);
+      total_size += entry->stat_.size;
+    }
+    g_rw_lock_reader_unlock(&shard->rwlock);
+  }
+
+  unsigned int evicted = 0;
+  guint n_files = candidates->len;
+  if ((max_size != 0 && total_size > max_size) ||
+      (max_files != 0 && n_files > max_files)) {
+    // leave some room, so that we do not evict on every call
+    guint64 target_size = max_size / 10 * 9;
+    guint target_files = max_files / 10 * 9;
+    gint now = Cache__now();
+    g_array_sort(candidates, CacheEvictCandidate_compare);
+
+    for (guint i = 0; i < candidates->len; i++) {
+      break_if((max_size == 0 || total_size <= target_size) &&
+               (max_files == 0 || n_files <= target_files));
+      struct CacheEvictCandidate *candidate =
+        &g_array_index(candidates, struct CacheEvictCandidate, i);
+      continue_if(now - candidate->accessed < Cache_EVICT_MIN_AGE);
+
+      struct CacheEntry *entry = candidate->entry;
+      char *cache_fullpath = Cache_realpath(cache, entry->path);
+      Cache__drop(cache, entry, cache_fullpath);
+      g_free(cache_fullpath);
+      total_size -= entry->stat_.size;
+      n_files--;
+      evicted++;
+    }
+
+    g_log(DFCC_FILE_NAME, G_LOG_LEVEL_INFO,
+          "Evicted %u cache file(s), %u file(s) of %" G_GUINT64_FORMAT
+          " byte(s) left", evicted, n_files, total_size);
+  }
+
+  for (guint i = 0; i < candidates->len; i++) {
+    CacheEntry_unref(
+      g_array_index(candidates, struct CacheEvictCandidate, i).entry);
+  }
+  g_array_free(candidates, TRUE);
+  return evicted;
+}
+
+
+/**
+ * @brief A content which may be pinned in memory.
+ */
+struct CacheHotCandidate {
+  struct CacheEntry *entry;
+  unsigned int frequency;
+  gint accessed;
+};
+
+
+//! @memberof CacheHotCandidate
+static gint CacheHotCandidate_compare (gconstpointer a, gconstpointer b) {
+  const struct CacheHotCandidate *x = a;
+  const struct CacheHotCandidate *y = b;
+  // most popular first
+  if (x->frequency != y->frequency) {
+    return x->frequency > y->frequency ? -1 : 1;
+  }
+  return x->accessed > y->accessed ? -1 : x->accessed < y->accessed;
+}
+
+
+unsigned int Cache_rebalance_hot (struct Cache *cache) {
+  GArray *candidates =
+    g_array_new(FALSE, FALSE, sizeof(struct CacheHotCandidate));
+  for (int i = 0; i < Cache_N_SHARDS; i++) {
+    struct CacheShard *shard = cache->shards + i;
+    g_rw_lock_reader_lock(&shard->rwlock);
+    GHashTableIter iter;
+    struct CacheEntry *entry;
+    for (g_hash_table_iter_init(&iter, shard->index);
+         g_hash_table_iter_next(&iter, NULL, (gpointer *) &entry);) {
+      continue_if(entry->stat_.size > Cache_HOT_MAX_SIZE);
+      struct CacheHotCandidate candidate = {
+        .entry = CacheEntry_ref(entry),
+        .frequency = CountMinSketch_estimate(&cache->sketch, entry->hash),
+        .accessed = g_atomic_int_get(&entry->accessed),
+      };
+      g_array_append_val(candidates, candidate);
+    }
+    g_rw_lock_reader_unlock(&shard->rwlock);
+  }
+  g_array_sort(candidates, CacheHotCandidate_compare);
+
+  // keep the most popular ones which fit, as if everything were reloaded
+  unsigned int demoted = 0;
+  size_t room = cache->hot_budget;
+  for (guint i = 0; i < candidates->len; i++) {
+    struct CacheHotCandidate *candidate =
+      &g_array_index(candidates, struct CacheHotCandidate, i);
+    struct CacheEntry *entry = candidate->entry;
+    if (candidate->frequency >= Cache_HOT_MIN_FREQUENCY &&
+        entry->stat_.size <= room) {
+      room -= entry->stat_.size;
+    } else {
+      g_mutex_lock(&cache->hot_mtx);
+      bool hot = entry->hot != NULL;
+      g_mutex_unlock(&cache->hot_mtx);
+      if (hot) {
+        Cache__demote(cache, entry);
+        demoted++;
+      }
+    }
+    CacheEntry_unref(entry);
+  }
+  g_array_free(candidates, TRUE);
+
+  g_mutex_lock(&cache->hot_mtx);
+  g_log(DFCC_FILE_NAME, G_LOG_LEVEL_DEBUG,
+        "Hot tier: %zu byte(s) pinned, %" G_GUINT64_FORMAT " hit(s), %"
+        G_GUINT64_FORMAT " miss(es), %u unpinned",
+        cache->hot_size, cache->hot_hits, cache->hot_misses, demoted);
+  g_mutex_unlock(&cache->hot_mtx);
+  return demoted;
+}
+
+
 void Cache_destroy (struct Cache *cache) {
-  g_rw_lock_writer_lock(&cache->rwlock);
-  g_hash_table_destroy(cache->index);
-  g_rw_lock_writer_unlock(&cache->rwlock);
-  g_rw_lock_clear(&cache->rwlock);
+  if (cache->scrubber != NULL) {
+    g_mutex_lock(&cache->scrub_mtx);
+    cache->scrub_stop = true;
+    g_cond_signal(&cache->scrub_cond);
+    g_mutex_unlock(&cache->scrub_mtx);
+    g_thread_join(cache->scrubber);
+  }
+  g_mutex_clear(&cache->scrub_mtx);
+  g_cond_clear(&cache->scrub_cond);
+  if (cache->watch != NULL) {
+    g_source_remove(cache->watch_source);
+    CacheWatch_destroy(cache->watch);
+    g_free(cache->watch);
+  }
+  CountMinSketch_destroy(&cache->sketch);
+  g_mutex_clear(&cache->usage_mtx);
+  g_mutex_clear(&cache->hot_mtx);
+  if (cache->journal != NULL) {
+    CacheJournal_destroy(cache->journal);
+    g_free(cache->journal);
+  }
+  if (cache->pack != NULL) {
+    CachePack_destroy(cache->pack);
+    g_free(cache->pack);
+  }
+
+  for (int i = 0; i < Cache_N_SHARDS; i++) {
+    struct CacheShard *shard = cache->shards + i;
+    g_rw_lock_writer_lock(&shard->rwlock);
+    g_hash_table_destroy(shard->index);
+    g_rw_lock_writer_unlock(&shard->rwlock);
+    g_rw_lock_clear(&shard->rwlock);
+  }
 }
 
 
 int Cache_init (struct Cache *cache, const char *cache_dir, bool no_verify_cache) {
-  cache->index =
-    g_hash_table_new_full(FileHash_hash, FileHash_equal, NULL, (GDestroyNotify) CacheEntry_unref);
-  g_rw_lock_init(&cache->rwlock);
+  for (int i = 0; i < Cache_N_SHARDS; i++) {
+    struct CacheShard *shard = cache->shards + i;
+    shard->index = g_hash_table_new_full(
+      FileHash_hash, FileHash_equal, NULL, (GDestroyNotify) CacheEntry_unref);
+    g_rw_lock_init(&shard->rwlock);
+  }
   cache->cache_dir = cache_dir;
   cache->cache_dir_len = strlen(cache_dir);
   cache->no_verify_cache = no_verify_cache;
+  cache->trust_window = 0;
+  cache->watch = NULL;
+  cache->scrubber = NULL;
+  cache->scrub_cursor = 0;
+  g_mutex_init(&cache->scrub_mtx);
+  g_cond_init(&cache->scrub_cond);
+  CountMinSketch_init(&cache->sketch, Cache_SKETCH_WIDTH);
+  cache->total_size = 0;
+  cache->n_files = 0;
+  g_mutex_init(&cache->usage_mtx);
+  cache->quota_size = 0;
+  cache->quota_files = 0;
+  cache->housekeeping_interval = 0;
+  cache->journal = NULL;
+  cache->pack = NULL;
+  cache->pack_threshold = 0;
+  cache->durability = CacheDurability_NONE;
+  cache->dirty = 0;
+  cache->no_tmpfile = 0;
+  cache->hot_budget = 0;
+  cache->hot_size = 0;
+  cache->hot_hits = 0;
+  cache->hot_misses = 0;
+  g_mutex_init(&cache->hot_mtx);
+  return 0;
+}
+
+
+int CacheWriter_write (
+    struct CacheWriter *writer, const void *buf, size_t size, GError **error) {
+  return_if(size == 0) 0;
+  return_if_fail(
+    write_e(writer->fd, buf, size, error) == (ssize_t) size) 1;
+  FileHashState_update(writer->state, buf, size);
+  writer->size += size;
+  return 0;
+}
+
+
+struct CacheEntry *CacheWriter_commit (
+    struct CacheWriter *writer, GError **error) {
+  struct CacheEntry *entry = Cache_index_tmpfile(
+    writer->cache, writer->fd, writer->tmppath,
+    FileHashState_digest(writer->state), error);
+  close(writer->fd);
+  writer->fd = -1;
+  g_free(writer->tmppath);
+  writer->tmppath = NULL;
+  return entry;
+}
+
+
+void CacheWriter_destroy (struct CacheWriter *writer) {
+  if (writer->fd >= 0) {
+    close(writer->fd);
+  }
+  if (writer->tmppath != NULL) {
+    g_remove(writer->tmppath);
+    g_free(writer->tmppath);
+  }
+  FileHashState_free(writer->state);
+}
+
+
+int CacheWriter_init (
+    struct CacheWriter *writer, struct Cache *cache, GError **error) {
+  writer->fd = Cache__open_tmp(cache, &writer->tmppath, error);
+  return_if_fail(writer->fd >= 0) 1;
+  writer->cache = cache;
+  writer->state = FileHashState_new();
+  writer->size = 0;
   return 0;
 }
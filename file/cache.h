@@ -8,6 +8,10 @@
 
 #include "common/cdecls.h"
 #include "cacheentry.h"
+#include "cachejournal.h"
+#include "cachepack.h"
+#include "hash.h"
+#include "sketch.h"
 
 BEGIN_C_DECLS
 
@@ -26,19 +30,71 @@ inline bool FileTag_is_cache (const struct FileTag *tag) {
 
 /**
  * @ingroup File
- * @brief Contains the information of the cache storage.
+ * @brief How hard a Cache tries to keep stored files across a crash.
+ *
+ * Files are always published complete, but without syncing, a crash may leave
+ * a file with lost content under its name, which is caught by verification.
  */
-struct Cache {
+enum CacheDurability {
+  /// Leave writeback to the kernel.
+  CacheDurability_NONE = 0,
+  /// Sync the file system of the cache periodically, see Cache_sync().
+  CacheDurability_BATCH,
+  /// Sync every file and its directory before it is indexed.
+  CacheDurability_FILE,
+  CacheDurability_N,
+};
+
+
+/// Names of CacheDurability, as in Config.cache_durability.
+extern const char * const CacheDurability_names[CacheDurability_N];
+
+
+/**
+ * @memberof CacheDurability
+ * @brief Parses the name of a CacheDurability.
+ *
+ * @param name a name in @ref CacheDurability_names
+ * @return the CacheDurability, or -1 if unknown
+ */
+int CacheDurability_from_string (const char *name);
+
+
+/**
+ * @ingroup File
+ * @brief The number of shards of the index of a Cache. Must be a power of 2.
+ */
+#define Cache_N_SHARDS 64
+
+
+/**
+ * @ingroup File
+ * @brief A segment of the index of a Cache.
+ */
+struct CacheShard {
   /**
-   * @brief Hash table from file path to CacheEntry
+   * @brief Hash table from FileHash to CacheEntry
    *
-   * Relative paths are relative to Config.cache_dir.
+   * Relative paths of entries are relative to Config.cache_dir.
    *
    * Absolute paths means local non-cache files.
    */
   GHashTable *index;
-  /// Lock for Cache.index.
+  /// Lock for CacheShard.index.
   GRWLock rwlock;
+};
+
+
+/**
+ * @ingroup File
+ * @brief Contains the information of the cache storage.
+ */
+struct Cache {
+  /**
+   * @brief Index of entries, split by FileHash so that lookups only contend
+   *        with writers of the same shard.
+   */
+  struct CacheShard shards[Cache_N_SHARDS];
 
   /// The base directory to store cache files.
   const char *cache_dir;
@@ -47,9 +103,107 @@ struct Cache {
 
   /// Whether to check cached files against its claimed hash.
   bool no_verify_cache;
+
+  /// Durability policy of stored files.
+  enum CacheDurability durability;
+  /// Whether files were stored since the last Cache_sync(). Accessed
+  /// atomically.
+  gint dirty;
+  /// Whether the file system does not support `O_TMPFILE`. Accessed
+  /// atomically.
+  gint no_tmpfile;
+
+  /// Seconds after a check during which an entry is trusted without being
+  /// checked again. 0 means checking on every access.
+  unsigned int trust_window;
+  /// Watches on indexed files, or `NULL` if disabled.
+  struct CacheWatch *watch;
+  /// Source of Cache.watch in the main context.
+  guint watch_source;
+
+  /// Background thread rehashing cold entries and doing Cache_housekeep(),
+  /// or `NULL` if not started.
+  GThread *scrubber;
+  /// Bytes per second the scrubber may rehash.
+  size_t scrub_rate;
+  /// The shard the scrubber continues with.
+  unsigned int scrub_cursor;
+  /// Whether the scrubber should stop.
+  bool scrub_stop;
+  /// Lock for Cache.scrub_stop.
+  GMutex scrub_mtx;
+  /// Condition for Cache.scrub_stop.
+  GCond scrub_cond;
+
+  /// Recent popularity of entries, for Cache_evict().
+  struct CountMinSketch sketch;
+  /// Total size of indexed cache files, for Cache_evict().
+  guint64 total_size;
+  /// Number of indexed cache files, for Cache_evict().
+  guint n_files;
+  /// Lock for Cache.total_size and Cache.n_files.
+  GMutex usage_mtx;
+  /// Maximum total size of cache files in bytes, or 0 for unlimited.
+  guint64 quota_size;
+  /// Maximum number of cache files, or 0 for unlimited.
+  unsigned int quota_files;
+  /// Seconds between calls of Cache_housekeep() by the scrubber, or 0 to
+  /// disable.
+  unsigned int housekeeping_interval;
+
+  /// Log of stored and deleted cache files, or `NULL` if disabled.
+  struct CacheJournal *journal;
+
+  /// Storage of small blobs, or `NULL` if disabled.
+  struct CachePack *pack;
+  /// Blobs up to this many bytes are stored in Cache.pack.
+  size_t pack_threshold;
+
+  /// Maximum total size of contents pinned in memfds, or 0 to disable.
+  size_t hot_budget;
+  /// Total size of contents pinned in memfds.
+  size_t hot_size;
+  /// Number of Cache_hot_path() served from a memfd.
+  guint64 hot_hits;
+  /// Number of Cache_hot_path() not served from a memfd, while enabled.
+  guint64 hot_misses;
+  /// Lock for CacheEntry.hot and the fields above.
+  GMutex hot_mtx;
 };
 
 
+/**
+ * @ingroup File
+ * @brief Seconds after which the scrubber rehashes an entry again.
+ */
+#define Cache_SCRUB_AGE (6 * 60 * 60)
+/**
+ * @ingroup File
+ * @brief Width of Cache.sketch.
+ */
+#define Cache_SKETCH_WIDTH (1 << 16)
+/**
+ * @ingroup File
+ * @brief Seconds after its last access before which an entry is not evicted,
+ *        since running jobs may still open it.
+ */
+#define Cache_EVICT_MIN_AGE (10 * 60)
+/**
+ * @ingroup File
+ * @brief Maximum size of a blob pinned in a memfd.
+ */
+#define Cache_HOT_MAX_SIZE (256 << 10)
+/**
+ * @ingroup File
+ * @brief Minimum popularity, as estimated by Cache.sketch, for a blob to be
+ *        pinned in a memfd.
+ */
+#define Cache_HOT_MIN_FREQUENCY 4
+/**
+ * @ingroup File
+ * @brief Number of records below which Cache.journal is never compacted.
+ */
+#define Cache_JOURNAL_MIN_RECORDS 4096
 /**
  * @ingroup File
  * @brief The length of the cache subdir name.
@@ -103,6 +257,51 @@ struct CacheEntry *Cache_try_get (struct Cache *cache, FileHash hash);
  */
 struct CacheEntry *Cache_get (
     struct Cache *cache, FileHash hash, GError **error);
+/**
+ * @memberof Cache
+ * @brief Reads the content of an entry.
+ *
+ * @param cache a Cache
+ * @param entry a CacheEntry
+ * @param[out] error a return location for a GError [optional]
+ * @return the content, or `NULL` if not found or error happened
+ *         [transfer-full]
+ */
+GBytes *Cache_read (
+    struct Cache *cache, struct CacheEntry *entry, GError **error);
+/**
+ * @memberof Cache
+ * @brief Returns the path to a file with the content of an entry, for other
+ *        processes to open.
+ *
+ * A packed blob is written out to its cache file and removed from Cache.pack
+ * first, since it has no file of its own.
+ *
+ * @param cache a Cache
+ * @param entry a CacheEntry
+ * @param[out] error a return location for a GError [optional]
+ * @return the absolute path, or `NULL` if error happened [transfer-full]
+ */
+char *Cache_file_path (
+    struct Cache *cache, struct CacheEntry *entry, GError **error);
+/**
+ * @memberof Cache
+ * @brief Like Cache_file_path(), but serves small, popular contents from
+ *        sealed memfds, pinned within Cache.hot_budget as they are asked for.
+ *
+ * The memfd is closed once unpinned and no longer referenced, so the caller
+ * must keep `memfd` until the path has been opened.
+ *
+ * @param cache a Cache
+ * @param entry a CacheEntry
+ * @param[out] memfd the memfd behind the path, or `NULL` if the path is a
+ *                   cache file [transfer-full]
+ * @param[out] error a return location for a GError [optional]
+ * @return the absolute path, or `NULL` if error happened [transfer-full]
+ */
+char *Cache_hot_path (
+    struct Cache *cache, struct CacheEntry *entry, struct CacheMemfd **memfd,
+    GError **error);
 /**
  * @memberof Cache
  * @brief Stores a piece of data into Cache.
@@ -128,6 +327,151 @@ struct CacheEntry *Cache_index_buf (
  */
 struct CacheEntry *Cache_index_path (
     struct Cache *cache, const char *path, bool *added, GError **error);
+/**
+ * @memberof Cache
+ * @brief Stores a temporary file into Cache under `hash`.
+ *
+ * The file is renamed or linked to its place, or removed if `hash` is already
+ * stored. `fd` is left open.
+ *
+ * @param cache a Cache
+ * @param fd file descriptor of the temporary file, opened for reading
+ * @param tmppath path to the temporary file in Cache.cache_dir, or `NULL` if
+ *                `fd` was opened with `O_TMPFILE` there
+ * @param hash the FileHash of the content of the file
+ * @param[out] error a return location for a GError [optional]
+ * @return the associated CacheEntry, or NULL if error happened [transfer-none]
+ */
+struct CacheEntry *Cache_index_tmpfile (
+    struct Cache *cache, int fd, const char *tmppath, FileHash hash,
+    GError **error);
+/**
+ * @memberof Cache
+ * @brief Watches files with inotify, so that modified entries are checked on
+ *        their next access regardless of Cache.trust_window.
+ *
+ * Only entries indexed or checked afterwards are watched. Events are
+ * dispatched in the default main context.
+ *
+ * @param cache a Cache
+ * @param[out] error a return location for a GError [optional]
+ * @return 0 if success, otherwize nonzero
+ */
+int Cache_watch (struct Cache *cache, GError **error);
+/**
+ * @memberof Cache
+ * @brief Restores the index from the journal in Config.cache_dir, and records
+ *        further changes to cache files in it.
+ *
+ * Restored entries are trusted as far as their hash goes, but are checked by
+ * their stat on the first access, so a file changed while the server was down
+ * is still caught.
+ *
+ * @param cache a Cache
+ * @param[out] error a return location for a GError [optional]
+ * @return 0 if success, otherwize nonzero
+ */
+int Cache_open_journal (struct Cache *cache, GError **error);
+/**
+ * @memberof Cache
+ * @brief Stores blobs up to `threshold` bytes in segment files under
+ *        Config.cache_dir, instead of a cache file each, and restores the
+ *        blobs stored there.
+ *
+ * Packed entries have no file at Cache_realpath(); read them with
+ * CachePack_get().
+ *
+ * @param cache a Cache
+ * @param threshold maximum length of packed blobs
+ * @param[out] error a return location for a GError [optional]
+ * @return 0 if success, otherwize nonzero
+ */
+int Cache_open_pack (struct Cache *cache, size_t threshold, GError **error);
+/**
+ * @memberof Cache
+ * @brief Syncs the file system of the cache, if files were stored since the
+ *        last call.
+ *
+ * This is what makes files durable under @ref CacheDurability_BATCH.
+ *
+ * @param cache a Cache
+ * @param[out] error a return location for a GError [optional]
+ * @return 0 if success, otherwize nonzero
+ */
+int Cache_sync (struct Cache *cache, GError **error);
+/**
+ * @memberof Cache
+ * @brief Rewrites the journal with the current index, if it has grown to twice
+ *        the number of entries.
+ *
+ * @param cache a Cache
+ * @param[out] error a return location for a GError [optional]
+ * @return 0 if success, otherwize nonzero
+ */
+int Cache_compact_journal (struct Cache *cache, GError **error);
+/**
+ * @memberof Cache
+ * @brief Rehashes entries not rehashed in @ref Cache_SCRUB_AGE seconds, and
+ *        drops corrupted ones.
+ *
+ * Continues where the last call stopped. Not thread-safe with itself.
+ *
+ * @param cache a Cache
+ * @param budget the number of bytes to rehash, roughly
+ * @return the number of bytes rehashed
+ */
+size_t Cache_scrub (struct Cache *cache, size_t budget);
+/**
+ * @memberof Cache
+ * @brief Evicts cache files over the quota, unpins contents no longer hot,
+ *        syncs stored files, and compacts the journal.
+ *
+ * Does blocking I/O, so it is called by the scrubber instead of the main
+ * loop. Errors are logged.
+ *
+ * @param cache a Cache
+ */
+void Cache_housekeep (struct Cache *cache);
+/**
+ * @memberof Cache
+ * @brief Unpins contents which are no longer among the most popular ones that
+ *        fit in Cache.hot_budget, making room for those which now are.
+ *
+ * @param cache a Cache
+ * @return number of unpinned contents
+ */
+unsigned int Cache_rebalance_hot (struct Cache *cache);
+/**
+ * @memberof Cache
+ * @brief Starts a thread calling Cache_scrub() every second, unless
+ *        Cache.no_verify_cache, compacting Cache.pack if enabled, and calling
+ *        Cache_housekeep() every Cache.housekeeping_interval seconds.
+ *
+ * @param cache a Cache
+ * @param rate bytes to rehash per second, or 0 not to rehash
+ * @param[out] error a return location for a GError [optional]
+ * @return 0 if success, otherwize nonzero
+ */
+int Cache_start_scrubber (struct Cache *cache, size_t rate, GError **error);
+/**
+ * @memberof Cache
+ * @brief Deletes cache files until they fit in 90% of the quota, if the quota
+ *        is exceeded.
+ *
+ * Only cache files are counted. Rarely used entries go first, as estimated by
+ * Cache.sketch, so that one-off files do not push out popular ones; among
+ * equally used entries, the least recently used go first.
+ *
+ * The index is only scanned when Cache.total_size or Cache.n_files exceeds
+ * the quota.
+ *
+ * @param cache a Cache
+ * @param max_size maximum total size in bytes, or 0 for unlimited
+ * @param max_files maximum number of files, or 0 for unlimited
+ * @return number of deleted files
+ */
+unsigned int Cache_evict (
+  struct Cache *cache, guint64 max_size, unsigned int max_files);
 /**
  * @memberof Cache
  * @brief Frees associated resources of a Cache.
@@ -147,6 +491,71 @@ void Cache_destroy (struct Cache *cache);
 int Cache_init (struct Cache *cache, const char *cache_dir, bool no_verify_cache);
 
 
+
+/**
+ * @ingroup File
+ * @brief Writes a piece of data into Cache incrementally.
+ *
+ * The data is hashed and written into a temporary file as it arrives, then
+ * moved to its place by CacheWriter_commit(). The temporary file has no name
+ * if the file system supports `O_TMPFILE`, so that nothing is left behind
+ * on a crash.
+ */
+struct CacheWriter {
+  struct Cache *cache;
+  /// Path to the temporary file, or `NULL` if it has no name or is committed.
+  char *tmppath;
+  /// File descriptor of the temporary file.
+  int fd;
+  /// State of the hash of received data.
+  struct FileHashState *state;
+  /// Length of received data.
+  guint64 size;
+};
+
+
+/**
+ * @memberof CacheWriter
+ * @brief Appends a piece of data.
+ *
+ * @param writer a CacheWriter
+ * @param buf the data buf
+ * @param size length of `buf`
+ * @param[out] error a return location for a GError [optional]
+ * @return 0 if success, otherwize nonzero
+ */
+int CacheWriter_write (
+    struct CacheWriter *writer, const void *buf, size_t size, GError **error);
+/**
+ * @memberof CacheWriter
+ * @brief Stores the written data into Cache.
+ *
+ * @param writer a CacheWriter
+ * @param[out] error a return location for a GError [optional]
+ * @return the associated CacheEntry, or NULL if error happened [transfer-none]
+ */
+struct CacheEntry *CacheWriter_commit (
+    struct CacheWriter *writer, GError **error);
+/**
+ * @memberof CacheWriter
+ * @brief Frees associated resources of a CacheWriter, discarding the
+ *        uncommitted data.
+ *
+ * @param writer a CacheWriter
+ */
+void CacheWriter_destroy (struct CacheWriter *writer);
+/**
+ * @memberof CacheWriter
+ * @brief Initializes a CacheWriter.
+ *
+ * @param writer a CacheWriter
+ * @param cache a Cache
+ * @param[out] error a return location for a GError [optional]
+ * @return 0 if success, otherwize nonzero
+ */
+int CacheWriter_init (
+    struct CacheWriter *writer, struct Cache *cache, GError **error);
+
 END_C_DECLS
 
 #endif /* DFCC_FILE_CACHE_H */
@@ -1,4 +1,5 @@
 #include <stdbool.h>
+#include <unistd.h>
 
 #include <glib.h>
 
@@ -6,16 +7,30 @@
 #include "cacheentry.h"
 
 
+extern inline struct CacheMemfd *CacheMemfd_ref (struct CacheMemfd *memfd);
 extern inline void CacheEntry_destroy (struct CacheEntry *entry);
 extern inline void CacheEntry_unref (struct CacheEntry *entry);
 extern inline struct CacheEntry *CacheEntry_ref (struct CacheEntry *entry);
 
 
+void CacheMemfd_unref (struct CacheMemfd *memfd) {
+  if (g_atomic_ref_count_dec(&memfd->arc)) {
+    close(memfd->fd);
+    g_free(memfd);
+  }
+}
+
+
 int CacheEntry_init (
     struct CacheEntry *entry, char *path, GStatBuf *sb, FileHash hash) {
   g_atomic_ref_count_init(&entry->arc);
   CacheEntry_ref(entry);
   entry->invalid = false;
+  entry->packed = false;
+  entry->hot = NULL;
+  entry->verified = g_get_monotonic_time() / G_TIME_SPAN_SECOND;
+  entry->scrubbed = entry->verified;
+  entry->accessed = entry->verified;
   return FileEntry_init_full((struct FileEntry *) entry, path, sb, hash);
 }
 
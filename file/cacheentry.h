@@ -11,6 +11,45 @@
 BEGIN_C_DECLS
 
 
+/**
+ * @ingroup File
+ * @brief A sealed memfd with the content of a CacheEntry, which jobs open
+ *        through `/proc`.
+ */
+struct CacheMemfd {
+  /// Reference counter.
+  gatomicrefcount arc;
+  /// File descriptor of the memfd.
+  int fd;
+  /// Length of the content.
+  size_t size;
+};
+
+
+/**
+ * @memberof CacheMemfd
+ * @brief Releases a reference on memfd.
+ *
+ * If the reference was the last one, it closes the memfd.
+ *
+ * @param memfd a CacheMemfd
+ */
+void CacheMemfd_unref (struct CacheMemfd *memfd);
+
+
+/**
+ * @memberof CacheMemfd
+ * @brief Acquires a reference on memfd.
+ *
+ * @param memfd a CacheMemfd
+ * @return memfd
+ */
+inline struct CacheMemfd *CacheMemfd_ref (struct CacheMemfd *memfd) {
+  g_atomic_ref_count_inc(&memfd->arc);
+  return memfd;
+}
+
+
 /**
  * @ingroup File
  * @extends FileEntry
@@ -24,6 +63,19 @@ struct CacheEntry {
   gatomicrefcount arc;
   /// Whether the cache file is outdated.
   bool invalid;
+  /// Whether the content is stored in Cache.pack instead of a cache file.
+  bool packed;
+  /// Monotonic time in seconds when the file was last checked by its stat.
+  /// Accessed atomically.
+  gint verified;
+  /// Monotonic time in seconds when the content was last checked by its hash,
+  /// or 0 if never. Accessed atomically.
+  gint scrubbed;
+  /// Monotonic time in seconds when the entry was last looked up. Accessed
+  /// atomically.
+  gint accessed;
+  /// Content pinned in memory, or `NULL`. Protected by Cache.hot_mtx.
+  struct CacheMemfd *hot;
 };
 
 
@@ -34,6 +86,9 @@ struct CacheEntry {
  * @param entry a CacheEntry
  */
 inline void CacheEntry_destroy (struct CacheEntry *entry) {
+  if (entry->hot != NULL) {
+    CacheMemfd_unref(entry->hot);
+  }
   FileEntry_destroy((struct FileEntry *) entry);
 }
 
@@ -0,0 +1,254 @@
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <xxhash.h>
+
+#include "common/macro.h"
+#include "common/wrapper/file.h"
+#include "log.h"
+#include "cachejournal.h"
+
+
+#define CacheJournal_MAGIC "DFCCJNL1"
+
+
+/**
+ * @memberof CacheJournal
+ * @private
+ * @brief The header of the journal file.
+ */
+struct CacheJournalHeader {
+  char magic[8];
+  uint32_t record_size;
+  uint32_t reserved;
+};
+
+
+//! @memberof CacheJournalHeader
+static void CacheJournalHeader_init (struct CacheJournalHeader *header) {
+  memset(header, 0, sizeof(struct CacheJournalHeader));
+  memcpy(header->magic, CacheJournal_MAGIC, sizeof(header->magic));
+  header->record_size = sizeof(struct CacheJournalRecord);
+}
+
+
+/**
+ * @memberof CacheJournalRecord
+ * @private
+ * @brief Computes the checksum of a record.
+ *
+ * @param record a CacheJournalRecord
+ * @return the checksum
+ */
+static inline uint32_t CacheJournalRecord__checksum (
+    const struct CacheJournalRecord *record) {
+  return XXH32(
+    &record->hash,
+    sizeof(struct CacheJournalRecord) -
+      offsetof(struct CacheJournalRecord, hash),
+    record->op);
+}
+
+
+int CacheJournal_append (
+    struct CacheJournal *journal, enum CacheJournalOp op, FileHash hash,
+    uint64_t size, int64_t mtime, GError **error) {
+  struct CacheJournalRecord record = {
+    .op = op, .hash = hash, .size = size, .mtime = mtime};
+  record.checksum = CacheJournalRecord__checksum(&record);
+
+  g_mutex_lock(&journal->mtx);
+  int ret = write_e(
+    journal->fd, &record, sizeof(record), error) == sizeof(record) ? 0 : 1;
+  if (ret == 0) {
+    journal->n_records++;
+  } else {
+    // do not leave a torn record in front of later ones
+    should (ftruncate(
+      journal->fd, sizeof(struct CacheJournalHeader) +
+        (off_t) journal->n_records * sizeof(struct CacheJournalRecord)
+    ) == 0) otherwise {}
+  }
+  g_mutex_unlock(&journal->mtx);
+  return ret;
+}
+
+
+int CacheJournal_compact (
+    struct CacheJournal *journal, CacheJournalCollector collect, void *userdata,
+    GError **error) {
+  GArray *records =
+    g_array_new(FALSE, FALSE, sizeof(struct CacheJournalRecord));
+  char *tmppath = g_strconcat(journal->path, ".tmp", NULL);
+  int ret = 1;
+
+  g_mutex_lock(&journal->mtx);
+  collect(userdata, records);
+  for (guint i = 0; i < records->len; i++) {
+    struct CacheJournalRecord *record =
+      &g_array_index(records, struct CacheJournalRecord, i);
+    record->checksum = CacheJournalRecord__checksum(record);
+  }
+
+  do_once {
+    int fd = g_open_e(
+      tmppath, O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644, error);
+    break_if_fail(fd != -1);
+
+    struct CacheJournalHeader header;
+    CacheJournalHeader_init(&header);
+    size_t len = records->len * sizeof(struct CacheJournalRecord);
+    should (write_e(fd, &header, sizeof(header), error) == sizeof(header) &&
+            write_e(fd, records->data, len, error) == (ssize_t) len
+    ) otherwise {
+      close(fd);
+      g_remove(tmppath);
+      break;
+    }
+    // the new file must be complete before it replaces the old one
+    should (fsync(fd) == 0) otherwise {
+      g_set_error_errno(error, G_FILE_ERROR, "Failed to fsync: %s");
+      close(fd);
+      g_remove(tmppath);
+      break;
+    }
+    should (g_rename(tmppath, journal->path) == 0) otherwise {
+      g_set_error_errno(error, G_FILE_ERROR, "Failed to rename: %s");
+      close(fd);
+      g_remove(tmppath);
+      break;
+    }
+
+    close(journal->fd);
+    journal->fd = fd;
+    journal->n_records = records->len;
+    ret = 0;
+  }
+  g_mutex_unlock(&journal->mtx);
+
+  g_free(tmppath);
+  g_array_free(records, TRUE);
+  return ret;
+}
+
+
+void CacheJournal_destroy (struct CacheJournal *journal) {
+  close(journal->fd);
+  g_free(journal->path);
+  g_mutex_clear(&journal->mtx);
+}
+
+
+/**
+ * @memberof CacheJournal
+ * @private
+ * @brief Replays the journal file, recreating it if needed.
+ *
+ * The caller must hold an exclusive lock on `fd`.
+ *
+ * @param fd file descriptor of the journal file
+ * @param callback function receiving the records [nullable]
+ * @param userdata user data for `callback`
+ * @param[out] n_records number of valid records
+ * @param[out] error a return location for a GError [optional]
+ * @return 0 if success, otherwize nonzero
+ */
+static int CacheJournal__replay (
+    int fd, CacheJournalCallback callback, void *userdata,
+    unsigned int *n_records, GError **error) {
+  struct stat sb;
+  return_if_fail(fstat_e(fd, &sb, error) == 0) 1;
+  *n_records = 0;
+
+  if ((size_t) sb.st_size >= sizeof(struct CacheJournalHeader)) {
+    void *map = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    should (map != MAP_FAILED) otherwise {
+      g_set_error_errno(error, G_FILE_ERROR, "Failed to mmap: %s");
+      return 1;
+    }
+
+    const struct CacheJournalHeader *header = map;
+    if (memcmp(header->magic, CacheJournal_MAGIC, sizeof(header->magic)) == 0 &&
+        header->record_size == sizeof(struct CacheJournalRecord)) {
+      const struct CacheJournalRecord *records =
+        (const struct CacheJournalRecord *) (header + 1);
+      size_t max_records =
+        ((size_t) sb.st_size - sizeof(struct CacheJournalHeader)) /
+        sizeof(struct CacheJournalRecord);
+      size_t n = 0;
+      for (; n < max_records; n++) {
+        break_if_not(
+          CacheJournalRecord__checksum(records + n) == records[n].checksum);
+        if (callback != NULL) {
+          callback(userdata, records + n);
+        }
+      }
+      munmap(map, sb.st_size);
+      *n_records = n;
+
+      off_t valid_size = sizeof(struct CacheJournalHeader) +
+                         (off_t) n * sizeof(struct CacheJournalRecord);
+      return_if(valid_size == sb.st_size) 0;
+      g_log(DFCC_FILE_NAME, G_LOG_LEVEL_INFO,
+            "Discard %jd byte(s) of torn cache journal",
+            (intmax_t) (sb.st_size - valid_size));
+      should (ftruncate(fd, valid_size) == 0) otherwise {
+        g_set_error_errno(error, G_FILE_ERROR, "Failed to truncate: %s");
+        return 1;
+      }
+      return 0;
+    }
+    munmap(map, sb.st_size);
+  }
+
+  if (sb.st_size != 0) {
+    g_log(DFCC_FILE_NAME, G_LOG_LEVEL_INFO, "Recreate broken cache journal");
+  }
+
+  should (ftruncate(fd, 0) == 0) otherwise {
+    g_set_error_errno(error, G_FILE_ERROR, "Failed to truncate: %s");
+    return 1;
+  }
+  struct CacheJournalHeader header;
+  CacheJournalHeader_init(&header);
+  return_if_fail(
+    write_e(fd, &header, sizeof(header), error) == sizeof(header)) 1;
+  return 0;
+}
+
+
+int CacheJournal_init (
+    struct CacheJournal *journal, const char *path,
+    CacheJournalCallback callback, void *userdata, GError **error) {
+  char *dir = g_path_get_dirname(path);
+  int ret = g_mkdir_with_parents_e(dir, 0755, error);
+  g_free(dir);
+  return_if_fail(ret == 0) 1;
+
+  // appends never overwrite each other
+  int fd = g_open_e(
+    path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644, error);
+  return_if_fail(fd != -1) 1;
+
+  unsigned int n_records;
+  flock(fd, LOCK_EX);
+  ret = CacheJournal__replay(fd, callback, userdata, &n_records, error);
+  flock(fd, LOCK_UN);
+  should (ret == 0) otherwise {
+    close(fd);
+    return 1;
+  }
+
+  journal->fd = fd;
+  journal->path = g_strdup(path);
+  journal->n_records = n_records;
+  g_mutex_init(&journal->mtx);
+  return 0;
+}
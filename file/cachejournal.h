@@ -0,0 +1,143 @@
+#ifndef DFCC_FILE_CACHEJOURNAL_H
+#define DFCC_FILE_CACHEJOURNAL_H
+
+#include <stdint.h>
+
+#include <glib.h>
+
+#include "common/cdecls.h"
+#include "hash.h"
+
+BEGIN_C_DECLS
+
+
+/**
+ * @ingroup File
+ * @brief Operations recorded in a CacheJournal.
+ */
+enum CacheJournalOp {
+  /// The cache file was stored.
+  CacheJournal_ADD = 1,
+  /// The cache file was deleted.
+  CacheJournal_REMOVE,
+};
+
+
+/**
+ * @ingroup File
+ * @brief A record of CacheJournal.
+ *
+ * The relative path of the cache file is derived from `hash`.
+ */
+struct CacheJournalRecord {
+  /// The CacheJournalOp.
+  uint32_t op;
+  /// Checksum of the record, to detect torn writes.
+  uint32_t checksum;
+  FileHash hash;
+  /// The size of the cache file.
+  uint64_t size;
+  /// The modified time of the cache file.
+  int64_t mtime;
+};
+
+
+/**
+ * @ingroup File
+ * @brief Fills a compacted journal with the current state.
+ *
+ * @param userdata user data
+ * @param records a GArray of CacheJournalRecord to append to
+ */
+typedef void (*CacheJournalCollector) (void *userdata, GArray *records);
+/**
+ * @ingroup File
+ * @brief Receives a record when a CacheJournal is loaded.
+ *
+ * @param userdata user data
+ * @param record a CacheJournalRecord
+ */
+typedef void (*CacheJournalCallback) (
+  void *userdata, const struct CacheJournalRecord *record);
+
+
+/**
+ * @ingroup File
+ * @brief An append-only log of changes to the cache files, so that a Cache can
+ *        be restored without scanning or rehashing the cache files.
+ *
+ * Records are checksummed, so a torn write at the end of the file is detected
+ * and discarded. The log is not synced on every append; records lost in a
+ * crash only make the Cache rediscover the files lazily.
+ */
+struct CacheJournal {
+  /// File descriptor of the journal file.
+  int fd;
+  /// Path to the journal file.
+  char *path;
+  /// Number of records in the journal file.
+  unsigned int n_records;
+  /// Lock for CacheJournal.fd and CacheJournal.n_records.
+  GMutex mtx;
+};
+
+
+/**
+ * @memberof CacheJournal
+ * @brief Appends a record.
+ *
+ * @param journal a CacheJournal
+ * @param op a CacheJournalOp
+ * @param hash the FileHash of the cache file
+ * @param size the size of the cache file
+ * @param mtime the modified time of the cache file
+ * @param[out] error a return location for a GError [optional]
+ * @return 0 if success, otherwize nonzero
+ */
+int CacheJournal_append (
+  struct CacheJournal *journal, enum CacheJournalOp op, FileHash hash,
+  uint64_t size, int64_t mtime, GError **error);
+/**
+ * @memberof CacheJournal
+ * @brief Replaces the journal file with the records from `collect`.
+ *
+ * Appends are blocked while `collect` runs, so none of them is lost. The new
+ * file is synced before it replaces the old one.
+ *
+ * @param journal a CacheJournal
+ * @param collect function filling the records
+ * @param userdata user data for `collect`
+ * @param[out] error a return location for a GError [optional]
+ * @return 0 if success, otherwize nonzero
+ */
+int CacheJournal_compact (
+  struct CacheJournal *journal, CacheJournalCollector collect, void *userdata,
+  GError **error);
+/**
+ * @memberof CacheJournal
+ * @brief Frees associated resources of a CacheJournal.
+ *
+ * @param journal a CacheJournal
+ */
+void CacheJournal_destroy (struct CacheJournal *journal);
+/**
+ * @memberof CacheJournal
+ * @brief Opens or creates a CacheJournal at `path`, and replays its records.
+ *
+ * A broken journal file is recreated; a torn record at its end is truncated.
+ *
+ * @param journal a CacheJournal
+ * @param path path to the journal file
+ * @param callback function receiving the records, in order [nullable]
+ * @param userdata user data for `callback`
+ * @param[out] error a return location for a GError [optional]
+ * @return 0 if success, otherwize nonzero
+ */
+int CacheJournal_init (
+  struct CacheJournal *journal, const char *path,
+  CacheJournalCallback callback, void *userdata, GError **error);
+
+
+END_C_DECLS
+
+#endif /* DFCC_FILE_CACHEJOURNAL_H */
@@ -0,0 +1,525 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <xxhash.h>
+
+#include "common/macro.h"
+#include "common/wrapper/errno.h"
+#include "common/wrapper/file.h"
+#include "log.h"
+#include "cachepack.h"
+
+
+#define CachePack_SUFFIX ".pack"
+
+
+/**
+ * @memberof CachePackRecord
+ * @private
+ * @brief Computes the checksum of a record header.
+ *
+ * @param record a CachePackRecord
+ * @return the checksum
+ */
+static inline uint32_t CachePackRecord__checksum (
+    const struct CachePackRecord *record) {
+  return XXH32(record, offsetof(struct CachePackRecord, checksum), 0);
+}
+
+
+/**
+ * @memberof CachePackRecord
+ * @private
+ * @brief Returns the length of a record in the segment file.
+ *
+ * @param size CachePackRecord.size
+ * @return the length, including the header and the padding
+ */
+static inline guint64 CachePackRecord__length (uint32_t size) {
+  return sizeof(struct CachePackRecord) +
+         (size == CachePack_TOMBSTONE ? 0 : ((guint64) size + 7) & ~7ull);
+}
+
+
+//! @memberof CachePackSegment
+static void CachePackSegment_free (void *segment_) {
+  struct CachePackSegment *segment = segment_;
+  close(segment->fd);
+  g_free(segment);
+}
+
+
+//! @memberof CachePack
+static inline char *CachePack__segment_path (
+    const struct CachePack *pack, guint32 id) {
+  return g_strdup_printf(
+    "%s/%08" G_GUINT32_FORMAT CachePack_SUFFIX, pack->dir, id);
+}
+
+
+//! @memberof CachePack
+static inline struct CachePackSegment *CachePack__segment (
+    const struct CachePack *pack, guint32 id) {
+  return g_hash_table_lookup(pack->segments, GUINT_TO_POINTER(id));
+}
+
+
+/**
+ * @memberof CachePack
+ * @private
+ * @brief Opens the segment file `id`, and adds it to CachePack.segments.
+ *
+ * @param pack a CachePack
+ * @param id CachePackSegment.id
+ * @param flags extra flags for open()
+ * @param[out] error a return location for a GError [optional]
+ * @return the CachePackSegment, or `NULL` if error happened
+ */
+static struct CachePackSegment *CachePack__open_segment (
+    struct CachePack *pack, guint32 id, int flags, GError **error) {
+  char *path = CachePack__segment_path(pack, id);
+  int fd = g_open_e(path, O_RDWR | O_CLOEXEC | flags, 0644, error);
+  g_free(path);
+  return_if_fail(fd != -1) NULL;
+
+  struct CachePackSegment *segment = g_new(struct CachePackSegment, 1);
+  segment->fd = fd;
+  segment->id = id;
+  segment->size = 0;
+  segment->garbage = 0;
+  g_hash_table_insert(pack->segments, GUINT_TO_POINTER(id), segment);
+  return segment;
+}
+
+
+/**
+ * @memberof CachePack
+ * @private
+ * @brief Appends a record to the active segment, starting a new segment if
+ *        it is full.
+ *
+ * The caller must hold the writer lock.
+ *
+ * @param pack a CachePack
+ * @param header the header of the record
+ * @param buf the data of the record
+ * @param[out] error a return location for a GError [optional]
+ * @return the offset of the record in CachePack.active, or -1 if error
+ *         happened
+ */
+static gint64 CachePack__append (
+    struct CachePack *pack, const struct CachePackRecord *header,
+    const void *buf, GError **error) {
+  if (pack->active->size >= CachePack_SEGMENT_SIZE) {
+    struct CachePackSegment *segment = CachePack__open_segment(
+      pack, pack->active->id + 1, O_CREAT | O_EXCL, error);
+    return_if_fail(segment != NULL) -1;
+    pack->active = segment;
+  }
+
+  static const char padding[8];
+  guint64 length = CachePackRecord__length(header->size);
+  size_t size = header->size == CachePack_TOMBSTONE ? 0 : header->size;
+  struct iovec iov[3] = {
+    {(void *) header, sizeof(struct CachePackRecord)},
+    {(void *) buf, size},
+    {(void *) padding, length - sizeof(struct CachePackRecord) - size},
+  };
+
+  struct CachePackSegment *segment = pack->active;
+  ssize_t wrote_len = pwritev(segment->fd, iov, 3, segment->size);
+  should (wrote_len == (ssize_t) length) otherwise {
+    if (wrote_len < 0) {
+      g_set_error_errno(error, G_FILE_ERROR, "Failed to write: %s");
+    } else {
+      g_set_error_literal(
+        error, G_FILE_ERROR, G_FILE_ERROR_NOSPC,
+        "Failed to write: short write");
+    }
+    // do not leave a torn record in front of later ones
+    should (ftruncate(segment->fd, segment->size) == 0) otherwise {}
+    return -1;
+  }
+
+  gint64 offset = segment->size;
+  segment->size += length;
+  return offset;
+}
+
+
+/**
+ * @memberof CachePack
+ * @private
+ * @brief Applies a record read from a segment file to the index.
+ *
+ * @param pack a CachePack
+ * @param segment the segment containing the record
+ * @param header the header of the record
+ * @param offset the offset of the record
+ */
+static void CachePack__apply (
+    struct CachePack *pack, struct CachePackSegment *segment,
+    const struct CachePackRecord *header, guint64 offset) {
+  struct CachePackBlob *blob = g_hash_table_lookup(pack->index, &header->hash);
+  if (blob != NULL) {
+    // the blob was overridden or removed
+    CachePack__segment(pack, blob->segment)->garbage +=
+      CachePackRecord__length(blob->size);
+  }
+
+  if (header->size == CachePack_TOMBSTONE) {
+    segment->garbage += CachePackRecord__length(header->size);
+    if (blob != NULL) {
+      g_hash_table_remove(pack->index, &header->hash);
+    }
+    return;
+  }
+
+  if (blob == NULL) {
+    blob = g_new(struct CachePackBlob, 1);
+    blob->hash = header->hash;
+    g_hash_table_insert(pack->index, &blob->hash, blob);
+  }
+  blob->segment = segment->id;
+  blob->size = header->size;
+  blob->offset = offset;
+}
+
+
+/**
+ * @memberof CachePack
+ * @private
+ * @brief Loads the records of a segment file.
+ *
+ * @param pack a CachePack
+ * @param segment a CachePackSegment
+ * @param[out] error a return location for a GError [optional]
+ * @return 0 if success, otherwize nonzero
+ */
+static int CachePack__load_segment (
+    struct CachePack *pack, struct CachePackSegment *segment, GError **error) {
+  struct stat sb;
+  return_if_fail(fstat_e(segment->fd, &sb, error) == 0) 1;
+  return_if(sb.st_size == 0) 0;
+
+  const char *map = mmap(
+    NULL, sb.st_size, PROT_READ, MAP_PRIVATE, segment->fd, 0);
+  should (map != MAP_FAILED) otherwise {
+    g_set_error_errno(error, G_FILE_ERROR, "Failed to mmap: %s");
+    return 1;
+  }
+
+  guint64 offset = 0;
+  while (offset + sizeof(struct CachePackRecord) <= (guint64) sb.st_size) {
+    const struct CachePackRecord *header =
+      (const struct CachePackRecord *) (map + offset);
+    break_if_not(CachePackRecord__checksum(header) == header->checksum);
+    guint64 length = CachePackRecord__length(header->size);
+    break_if(offset + length > (guint64) sb.st_size);
+    CachePack__apply(pack, segment, header, offset);
+    offset += length;
+  }
+  munmap((void *) map, sb.st_size);
+  segment->size = offset;
+
+  return_if(offset == (guint64) sb.st_size) 0;
+  g_log(DFCC_FILE_NAME, G_LOG_LEVEL_INFO,
+        "Discard %" G_GUINT64_FORMAT " byte(s) of torn pack segment %08"
+        G_GUINT32_FORMAT, (guint64) sb.st_size - offset, segment->id);
+  should (ftruncate(segment->fd, offset) == 0) otherwise {
+    g_set_error_errno(error, G_FILE_ERROR, "Failed to truncate: %s");
+    return 1;
+  }
+  return 0;
+}
+
+
+bool CachePack_lookup (struct CachePack *pack, FileHash hash, size_t *size) {
+  g_rw_lock_reader_lock(&pack->rwlock);
+  struct CachePackBlob *blob = g_hash_table_lookup(pack->index, &hash);
+  if (blob != NULL && size != NULL) {
+    *size = blob->size;
+  }
+  g_rw_lock_reader_unlock(&pack->rwlock);
+  return blob != NULL;
+}
+
+
+GBytes *CachePack_get (struct CachePack *pack, FileHash hash, GError **error) {
+  GBytes *ret = NULL;
+
+  g_rw_lock_reader_lock(&pack->rwlock);
+  do_once {
+    struct CachePackBlob *blob = g_hash_table_lookup(pack->index, &hash);
+    break_if(blob == NULL);
+
+    // the segment is not closed while we hold the lock
+    struct CachePackSegment *segment = CachePack__segment(pack, blob->segment);
+    char *data = g_malloc(blob->size);
+    ssize_t read_len = pread(
+      segment->fd, data, blob->size,
+      blob->offset + sizeof(struct CachePackRecord));
+    should (read_len == (ssize_t) blob->size) otherwise {
+      if (read_len < 0) {
+        g_set_error_errno(error, G_FILE_ERROR, "Failed to read: %s");
+      } else {
+        g_set_error_literal(
+          error, G_FILE_ERROR, G_FILE_ERROR_IO, "Failed to read: short read");
+      }
+      g_free(data);
+      break;
+    }
+    ret = g_bytes_new_take(data, blob->size);
+  }
+  g_rw_lock_reader_unlock(&pack->rwlock);
+
+  return ret;
+}
+
+
+int CachePack_put (
+    struct CachePack *pack, FileHash hash, const void *buf, size_t size,
+    GError **error) {
+  should (size < CachePack_TOMBSTONE) otherwise {
+    g_set_error_literal(
+      error, G_FILE_ERROR, G_FILE_ERROR_FBIG, "Blob too large to be packed");
+    return 1;
+  }
+
+  struct CachePackRecord header = {.hash = hash, .size = size};
+  header.checksum = CachePackRecord__checksum(&header);
+
+  int ret = 0;
+  g_rw_lock_writer_lock(&pack->rwlock);
+  if (!g_hash_table_contains(pack->index, &hash)) {
+    gint64 offset = CachePack__append(pack, &header, buf, error);
+    if (offset >= 0) {
+      struct CachePackBlob *blob = g_new(struct CachePackBlob, 1);
+      blob->hash = hash;
+      blob->segment = pack->active->id;
+      blob->size = size;
+      blob->offset = offset;
+      g_hash_table_insert(pack->index, &blob->hash, blob);
+      should (!pack->sync || fdatasync(pack->active->fd) == 0) otherwise {
+        g_set_error_errno(error, G_FILE_ERROR, "Failed to fdatasync: %s");
+        ret = 1;
+      }
+    } else {
+      ret = 1;
+    }
+  }
+  g_rw_lock_writer_unlock(&pack->rwlock);
+  return ret;
+}
+
+
+bool CachePack_remove (struct CachePack *pack, FileHash hash) {
+  struct CachePackRecord header = {.hash = hash, .size = CachePack_TOMBSTONE};
+  header.checksum = CachePackRecord__checksum(&header);
+
+  g_rw_lock_writer_lock(&pack->rwlock);
+  struct CachePackBlob *blob = g_hash_table_lookup(pack->index, &hash);
+  if (blob != NULL) {
+    CachePack__segment(pack, blob->segment)->garbage +=
+      CachePackRecord__length(blob->size);
+    g_hash_table_remove(pack->index, &hash);
+
+    GError *error = NULL;
+    if (CachePack__append(pack, &header, NULL, &error) >= 0) {
+      pack->active->garbage += CachePackRecord__length(header.size);
+    } else {
+      g_log(DFCC_FILE_NAME, G_LOG_LEVEL_WARNING,
+            "Cannot record removal, blob may reappear: %s", error->message);
+      g_error_free(error);
+    }
+  }
+  g_rw_lock_writer_unlock(&pack->rwlock);
+  return blob != NULL;
+}
+
+
+void CachePack_foreach (
+    struct CachePack *pack, void (*func) (void *, FileHash, size_t),
+    void *userdata) {
+  g_rw_lock_reader_lock(&pack->rwlock);
+  GHashTableIter iter;
+  struct CachePackBlob *blob;
+  for (g_hash_table_iter_init(&iter, pack->index);
+       g_hash_table_iter_next(&iter, NULL, (gpointer *) &blob);) {
+    func(userdata, blob->hash, blob->size);
+  }
+  g_rw_lock_reader_unlock(&pack->rwlock);
+}
+
+
+gint64 CachePack_compact (struct CachePack *pack, GError **error) {
+  // pick the sealed segment with the most garbage
+  struct CachePackSegment *victim = NULL;
+  guint32 oldest = G_MAXUINT32;
+  g_rw_lock_reader_lock(&pack->rwlock);
+  GHashTableIter iter;
+  struct CachePackSegment *segment;
+  for (g_hash_table_iter_init(&iter, pack->segments);
+       g_hash_table_iter_next(&iter, NULL, (gpointer *) &segment);) {
+    oldest = min(oldest, segment->id);
+    continue_if(segment == pack->active);
+    continue_if(segment->garbage * 2 < segment->size);
+    if (victim == NULL || segment->garbage > victim->garbage) {
+      victim = segment;
+    }
+  }
+  g_rw_lock_reader_unlock(&pack->rwlock);
+  return_if(victim == NULL) 0;
+
+  // sealed segments do not change, and only we close them
+  const char *map = NULL;
+  if (victim->size != 0) {
+    map = mmap(NULL, victim->size, PROT_READ, MAP_PRIVATE, victim->fd, 0);
+    should (map != MAP_FAILED) otherwise {
+      g_set_error_errno(error, G_FILE_ERROR, "Failed to mmap: %s");
+      return -1;
+    }
+  }
+
+  guint64 copied = 0;
+  int ret = 0;
+  for (guint64 offset = 0; offset < victim->size;) {
+    const struct CachePackRecord *header =
+      (const struct CachePackRecord *) (map + offset);
+    guint64 length = CachePackRecord__length(header->size);
+
+    g_rw_lock_writer_lock(&pack->rwlock);
+    struct CachePackBlob *blob =
+      g_hash_table_lookup(pack->index, &header->hash);
+    bool keep;
+    if (header->size == CachePack_TOMBSTONE) {
+      // a tombstone is needed as long as a removed record may precede it
+      keep = blob == NULL && victim->id != oldest;
+    } else {
+      keep = blob != NULL && blob->segment == victim->id &&
+             blob->offset == offset;
+    }
+    if (keep) {
+      gint64 new_offset = CachePack__append(pack, header, header + 1, error);
+      if (new_offset < 0) {
+        ret = 1;
+      } else if (blob != NULL) {
+        blob->segment = pack->active->id;
+        blob->offset = new_offset;
+      } else {
+        pack->active->garbage += length;
+      }
+      copied += length;
+    }
+    g_rw_lock_writer_unlock(&pack->rwlock);
+
+    break_if(ret != 0);
+    offset += length;
+  }
+  if (map != NULL) {
+    munmap((void *) map, victim->size);
+  }
+  return_if(ret != 0) -1;
+
+  // copies must be durable before the originals are gone
+  g_rw_lock_reader_lock(&pack->rwlock);
+  ret = fdatasync(pack->active->fd);
+  g_rw_lock_reader_unlock(&pack->rwlock);
+  should (ret == 0) otherwise {
+    g_set_error_errno(error, G_FILE_ERROR, "Failed to fdatasync: %s");
+    return -1;
+  }
+
+  guint64 size = victim->size;
+  char *path = CachePack__segment_path(pack, victim->id);
+  g_rw_lock_writer_lock(&pack->rwlock);
+  g_remove(path);
+  g_hash_table_remove(pack->segments, GUINT_TO_POINTER(victim->id));
+  g_rw_lock_writer_unlock(&pack->rwlock);
+  g_free(path);
+
+  g_log(DFCC_FILE_NAME, G_LOG_LEVEL_DEBUG,
+        "Compacted pack segment of %" G_GUINT64_FORMAT " byte(s), %"
+        G_GUINT64_FORMAT " byte(s) copied", size, copied);
+  return size - copied;
+}
+
+
+void CachePack_destroy (struct CachePack *pack) {
+  g_rw_lock_writer_lock(&pack->rwlock);
+  g_hash_table_destroy(pack->index);
+  g_hash_table_destroy(pack->segments);
+  g_rw_lock_writer_unlock(&pack->rwlock);
+  g_rw_lock_clear(&pack->rwlock);
+  g_free(pack->dir);
+}
+
+
+//! @private
+static gint CachePack__compare_id (gconstpointer a, gconstpointer b) {
+  guint32 x = *(const guint32 *) a;
+  guint32 y = *(const guint32 *) b;
+  return x < y ? -1 : x > y;
+}
+
+
+int CachePack_init (struct CachePack *pack, const char *dir, GError **error) {
+  return_if_fail(g_mkdir_with_parents_e(
+    dir, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH, error) == 0) 1;
+  GDir *d = g_dir_open(dir, 0, error);
+  return_if_fail(d != NULL) 1;
+
+  // segments must be replayed in order
+  GArray *ids = g_array_new(FALSE, FALSE, sizeof(guint32));
+  for (const char *name; (name = g_dir_read_name(d)) != NULL;) {
+    char *end;
+    guint64 id = g_ascii_strtoull(name, &end, 10);
+    continue_if_not(end != name && strcmp(end, CachePack_SUFFIX) == 0);
+    continue_if(id == 0 || id >= G_MAXUINT32);
+    guint32 id_ = id;
+    g_array_append_val(ids, id_);
+  }
+  g_dir_close(d);
+  g_array_sort(ids, CachePack__compare_id);
+
+  pack->dir = g_strdup(dir);
+  pack->index = g_hash_table_new_full(
+    FileHash_hash, FileHash_equal, NULL, g_free);
+  pack->segments = g_hash_table_new_full(
+    g_direct_hash, g_direct_equal, NULL, CachePackSegment_free);
+  pack->active = NULL;
+  g_rw_lock_init(&pack->rwlock);
+  pack->sync = false;
+
+  int ret = 0;
+  for (guint i = 0; i < ids->len; i++) {
+    struct CachePackSegment *segment = CachePack__open_segment(
+      pack, g_array_index(ids, guint32, i), 0, error);
+    should (segment != NULL &&
+            CachePack__load_segment(pack, segment, error) == 0) otherwise {
+      ret = 1;
+      break;
+    }
+    pack->active = segment;
+  }
+  if (ret == 0 && pack->active == NULL) {
+    pack->active = CachePack__open_segment(pack, 1, O_CREAT, error);
+    if (pack->active == NULL) {
+      ret = 1;
+    }
+  }
+  g_array_free(ids, TRUE);
+
+  if (ret != 0) {
+    CachePack_destroy(pack);
+  }
+  return ret;
+}
@@ -0,0 +1,183 @@
+#ifndef DFCC_FILE_CACHEPACK_H
+#define DFCC_FILE_CACHEPACK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <glib.h>
+
+#include "common/cdecls.h"
+#include "hash.h"
+
+BEGIN_C_DECLS
+
+
+/**
+ * @ingroup File
+ * @brief The header of a record in a segment file, followed by `size` bytes of
+ *        data and padded to 8 bytes.
+ */
+struct CachePackRecord {
+  FileHash hash;
+  /// Length of the data, or @ref CachePack_TOMBSTONE if the blob was removed.
+  uint32_t size;
+  /// Checksum of the header, to detect torn writes.
+  uint32_t checksum;
+};
+
+
+/// CachePackRecord.size of a record removing a blob.
+#define CachePack_TOMBSTONE UINT32_MAX
+/// Size after which the active segment is sealed and a new one is started.
+#define CachePack_SEGMENT_SIZE (64 << 20)
+
+
+/**
+ * @ingroup File
+ * @brief An append-only file of CachePackRecord.
+ */
+struct CachePackSegment {
+  /// File descriptor of the segment file.
+  int fd;
+  /// Sequence number of the segment, also its file name.
+  guint32 id;
+  /// Length of the segment file.
+  guint64 size;
+  /// Bytes of removed or overridden records.
+  guint64 garbage;
+};
+
+
+/**
+ * @ingroup File
+ * @brief Location of a blob in a CachePack.
+ */
+struct CachePackBlob {
+  FileHash hash;
+  /// CachePackSegment.id of the segment containing the blob.
+  guint32 segment;
+  /// Length of the blob.
+  guint32 size;
+  /// Offset of the CachePackRecord of the blob.
+  guint64 offset;
+};
+
+
+/**
+ * @ingroup File
+ * @brief Stores small blobs in a few large segment files, so that they do not
+ *        cost an inode and a directory lookup each.
+ *
+ * Blobs are appended to the newest segment. Removing a blob appends a
+ * tombstone, and segments which are mostly garbage are rewritten by
+ * CachePack_compact().
+ */
+struct CachePack {
+  /// Directory of segment files.
+  char *dir;
+  /// Hash table from FileHash to CachePackBlob.
+  GHashTable *index;
+  /// Hash table from CachePackSegment.id to CachePackSegment.
+  GHashTable *segments;
+  /// The segment being appended to.
+  struct CachePackSegment *active;
+  /// Lock for all fields above. Reads hold the reader lock while reading.
+  GRWLock rwlock;
+  /// Whether CachePack_put() syncs the active segment before returning.
+  bool sync;
+};
+
+
+/**
+ * @memberof CachePack
+ * @brief Looks up a blob.
+ *
+ * @param pack a CachePack
+ * @param hash the FileHash of the blob
+ * @param[out] size the length of the blob [optional]
+ * @return true if the blob is stored
+ */
+bool CachePack_lookup (struct CachePack *pack, FileHash hash, size_t *size);
+/**
+ * @memberof CachePack
+ * @brief Reads a blob.
+ *
+ * @param pack a CachePack
+ * @param hash the FileHash of the blob
+ * @param[out] error a return location for a GError [optional]
+ * @return the content, or `NULL` if not found or error happened
+ *         [transfer-full]
+ */
+GBytes *CachePack_get (struct CachePack *pack, FileHash hash, GError **error);
+/**
+ * @memberof CachePack
+ * @brief Stores a blob.
+ *
+ * @param pack a CachePack
+ * @param hash the FileHash of `buf`
+ * @param buf the data buf
+ * @param size length of `buf`
+ * @param[out] error a return location for a GError [optional]
+ * @return 0 if success, otherwize nonzero
+ */
+int CachePack_put (
+  struct CachePack *pack, FileHash hash, const void *buf, size_t size,
+  GError **error);
+/**
+ * @memberof CachePack
+ * @brief Removes a blob.
+ *
+ * @param pack a CachePack
+ * @param hash the FileHash of the blob
+ * @return true if the blob was stored
+ */
+bool CachePack_remove (struct CachePack *pack, FileHash hash);
+/**
+ * @memberof CachePack
+ * @brief Calls `func` for each blob.
+ *
+ * `func` must not call into `pack`.
+ *
+ * @param pack a CachePack
+ * @param func function receiving the hash and the length of each blob
+ * @param userdata user data for `func`
+ */
+void CachePack_foreach (
+  struct CachePack *pack, void (*func) (void *, FileHash, size_t),
+  void *userdata);
+/**
+ * @memberof CachePack
+ * @brief Rewrites a sealed segment which is at least half garbage, by copying
+ *        its live records into the active segment.
+ *
+ * Not thread-safe with itself.
+ *
+ * @param pack a CachePack
+ * @param[out] error a return location for a GError [optional]
+ * @return number of bytes reclaimed, or -1 if error happened
+ */
+gint64 CachePack_compact (struct CachePack *pack, GError **error);
+/**
+ * @memberof CachePack
+ * @brief Frees associated resources of a CachePack.
+ *
+ * @param pack a CachePack
+ */
+void CachePack_destroy (struct CachePack *pack);
+/**
+ * @memberof CachePack
+ * @brief Opens or creates a CachePack in `dir`, and loads its segments.
+ *
+ * A torn record at the end of the newest segment is truncated.
+ *
+ * @param pack a CachePack
+ * @param dir directory of segment files
+ * @param[out] error a return location for a GError [optional]
+ * @return 0 if success, otherwize nonzero
+ */
+int CachePack_init (struct CachePack *pack, const char *dir, GError **error);
+
+
+END_C_DECLS
+
+#endif /* DFCC_FILE_CACHEPACK_H */
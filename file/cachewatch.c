@@ -0,0 +1,131 @@
+#include <errno.h>
+#include <limits.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include "common/macro.h"
+#include "common/wrapper/errno.h"
+#include "log.h"
+#include "cachewatch.h"
+
+
+/// Events which mean the content of a file may have changed.
+#define CacheWatch_EVENTS \
+  (IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_DELETE | IN_MOVED_FROM | \
+   IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF)
+
+
+int CacheWatch_add (struct CacheWatch *watch, const char *path, FileHash hash) {
+  char *dir = g_path_get_dirname(path);
+  int ret = 0;
+
+  g_mutex_lock(&watch->mtx);
+  do_once {
+    if (!g_hash_table_contains(watch->wds, dir)) {
+      int wd = inotify_add_watch(watch->fd, dir, CacheWatch_EVENTS);
+      should (wd >= 0) otherwise {
+        g_log(DFCC_FILE_NAME, G_LOG_LEVEL_INFO,
+              "Cannot watch '%s': %s", dir, g_strerror(errno));
+        ret = 1;
+        break;
+      }
+      g_hash_table_insert(watch->dirs, GINT_TO_POINTER(wd), g_strdup(dir));
+      g_hash_table_insert(watch->wds, g_strdup(dir), GINT_TO_POINTER(wd));
+    }
+    FileHash *value = g_new(FileHash, 1);
+    *value = hash;
+    g_hash_table_replace(watch->files, g_strdup(path), value);
+  }
+  g_mutex_unlock(&watch->mtx);
+
+  g_free(dir);
+  return ret;
+}
+
+
+int CacheWatch_dispatch (
+    struct CacheWatch *watch, CacheWatchCallback callback, void *userdata) {
+  char buf[4096]
+    __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+  while (true) {
+    ssize_t len = read(watch->fd, buf, sizeof(buf));
+    if (len < 0) {
+      break_if(errno == EAGAIN);
+      continue_if(errno == EINTR);
+      g_log(DFCC_FILE_NAME, G_LOG_LEVEL_WARNING,
+            "Cannot read inotify events: %s", g_strerror(errno));
+      return 1;
+    }
+
+    for (char *p = buf; p < buf + len;) {
+      const struct inotify_event *event = (const struct inotify_event *) p;
+      p += sizeof(struct inotify_event) + event->len;
+
+      if unlikely (event->mask & IN_Q_OVERFLOW) {
+        g_log(DFCC_FILE_NAME, G_LOG_LEVEL_INFO,
+              "inotify queue overflowed, distrust all files");
+        callback(userdata, 0);
+        continue;
+      }
+
+      g_mutex_lock(&watch->mtx);
+      if (event->mask & IN_IGNORED) {
+        // the directory is gone
+        const char *dir =
+          g_hash_table_lookup(watch->dirs, GINT_TO_POINTER(event->wd));
+        if (dir != NULL) {
+          g_hash_table_remove(watch->wds, dir);
+          g_hash_table_remove(watch->dirs, GINT_TO_POINTER(event->wd));
+        }
+        g_mutex_unlock(&watch->mtx);
+        continue;
+      }
+
+      FileHash hash = 0;
+      const char *dir =
+        g_hash_table_lookup(watch->dirs, GINT_TO_POINTER(event->wd));
+      if (dir != NULL && event->len > 0) {
+        char *path = g_build_filename(dir, event->name, NULL);
+        FileHash *value = g_hash_table_lookup(watch->files, path);
+        if (value != NULL) {
+          hash = *value;
+          g_hash_table_remove(watch->files, path);
+        }
+        g_free(path);
+      }
+      g_mutex_unlock(&watch->mtx);
+
+      if (hash != 0) {
+        callback(userdata, hash);
+      }
+    }
+  }
+
+  return 0;
+}
+
+
+void CacheWatch_destroy (struct CacheWatch *watch) {
+  close(watch->fd);
+  g_hash_table_destroy(watch->dirs);
+  g_hash_table_destroy(watch->wds);
+  g_hash_table_destroy(watch->files);
+  g_mutex_clear(&watch->mtx);
+}
+
+
+int CacheWatch_init (struct CacheWatch *watch, GError **error) {
+  watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  should (watch->fd >= 0) otherwise {
+    g_set_error_errno(error, G_FILE_ERROR, "Failed to init inotify: %s");
+    return 1;
+  }
+  watch->dirs = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+  watch->wds = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  watch->files = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  g_mutex_init(&watch->mtx);
+  return 0;
+}
@@ -0,0 +1,89 @@
+#ifndef DFCC_FILE_CACHEWATCH_H
+#define DFCC_FILE_CACHEWATCH_H
+
+#include <glib.h>
+
+#include "common/cdecls.h"
+#include "hash.h"
+
+BEGIN_C_DECLS
+
+
+/**
+ * @memberof CacheWatch
+ * @brief Called when a watched file is modified.
+ *
+ * @param userdata userdata passed to CacheWatch_dispatch()
+ * @param hash hash the file was indexed with, or 0 if events were lost and
+ *             every file must be considered modified
+ */
+typedef void (*CacheWatchCallback) (void *userdata, FileHash hash);
+
+
+/**
+ * @ingroup File
+ * @brief Watches indexed files with inotify, so that they need not be checked
+ *        on every access.
+ *
+ * Directories are watched, instead of files, to keep the number of watches
+ * bounded by the number of cache subdirs.
+ */
+struct CacheWatch {
+  /// inotify file descriptor.
+  int fd;
+  /// Hash table from watch descriptor to directory.
+  /// [element-type int filename]
+  GHashTable *dirs;
+  /// Hash table from directory to watch descriptor.
+  /// [element-type filename int]
+  GHashTable *wds;
+  /// Hash table from watched file to its hash.
+  /// [element-type filename FileHash]
+  GHashTable *files;
+  /// Lock for the tables.
+  GMutex mtx;
+};
+
+
+/**
+ * @memberof CacheWatch
+ * @brief Starts watching a file.
+ *
+ * @param watch a CacheWatch
+ * @param path absolute path to the file
+ * @param hash hash of the file
+ * @return 0 if success, otherwize nonzero
+ */
+int CacheWatch_add (struct CacheWatch *watch, const char *path, FileHash hash);
+/**
+ * @memberof CacheWatch
+ * @brief Reads pending events, and calls `callback` for modified files.
+ *
+ * @param watch a CacheWatch
+ * @param callback function to call
+ * @param userdata userdata for `callback`
+ * @return 0 if success, otherwize nonzero
+ */
+int CacheWatch_dispatch (
+  struct CacheWatch *watch, CacheWatchCallback callback, void *userdata);
+/**
+ * @memberof CacheWatch
+ * @brief Frees associated resources of a CacheWatch.
+ *
+ * @param watch a CacheWatch
+ */
+void CacheWatch_destroy (struct CacheWatch *watch);
+/**
+ * @memberof CacheWatch
+ * @brief Initializes a CacheWatch.
+ *
+ * @param watch a CacheWatch
+ * @param[out] error a return location for a GError [optional]
+ * @return 0 if success, otherwize nonzero
+ */
+int CacheWatch_init (struct CacheWatch *watch, GError **error);
+
+
+END_C_DECLS
+
+#endif /* DFCC_FILE_CACHEWATCH_H */
@@ -1,6 +1,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <glib.h>
 
@@ -15,6 +16,29 @@ extern inline char *FileHash_to_buf (FileHash hash, char *s);
 extern inline char *FileHash_to_string (FileHash hash, char *s);
 extern inline FileHash FileHash_from_string (const char *s);
 extern inline FileHash FileHash_from_buf (const void* buf, size_t size);
+extern inline struct FileHashState *FileHashState_new (void);
+extern inline void FileHashState_free (struct FileHashState *state);
+extern inline void FileHashState_update (
+    struct FileHashState *state, const void *buf, size_t size);
+extern inline FileHash FileHashState_digest (struct FileHashState *state);
+
+
+const char * const FileHash_algorithm_names[FileHash_N_ALGORITHMS] = {
+  [FileHash_XXH64] = "xxh64",
+  [FileHash_XXH3_64] = "xxh3",
+};
+enum FileHashAlgorithm FileHash_algorithm = FileHash_XXH64;
+
+
+int FileHash_set_algorithm (const char *name) {
+  for (int i = 0; i < FileHash_N_ALGORITHMS; i++) {
+    if (strcmp(name, FileHash_algorithm_names[i]) == 0) {
+      FileHash_algorithm = i;
+      return 0;
+    }
+  }
+  return 1;
+}
 
 
 FileHash FileHash_from_file (const char* path, GError **error) {
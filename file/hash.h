@@ -103,6 +103,44 @@ inline FileHash FileHash_from_string (const char *s) {
   return hash;
 }
 
+/**
+ * @ingroup File
+ * @brief Algorithms to compute a FileHash.
+ *
+ * Clients and servers must agree on the algorithm, which is advertised by the
+ * server at @ref DFCC_INFO_PATH.
+ */
+enum FileHashAlgorithm {
+  /// XXH64, seed 0. The default.
+  FileHash_XXH64 = 0,
+  /// 64-bit XXH3, seed 0. Faster on CPUs with SIMD.
+  FileHash_XXH3_64,
+  /// Number of algorithms.
+  FileHash_N_ALGORITHMS,
+};
+
+/**
+ * @memberof FileHash
+ * @brief Names of FileHashAlgorithm, indexed by the enum value.
+ */
+extern const char * const FileHash_algorithm_names[FileHash_N_ALGORITHMS];
+/**
+ * @memberof FileHash
+ * @brief The algorithm used by this process.
+ */
+extern enum FileHashAlgorithm FileHash_algorithm;
+
+/**
+ * @memberof FileHash
+ * @brief Selects the algorithm used by this process.
+ *
+ * Must be called before any hash is computed.
+ *
+ * @param name name of the algorithm
+ * @return 0 if success, otherwize nonzero
+ */
+int FileHash_set_algorithm (const char *name);
+
 /**
  * @memberof FileHash
  * @brief Initializes a FileHash by hashing the content of the buffer `buf`.
@@ -113,7 +151,110 @@ inline FileHash FileHash_from_string (const char *s) {
  * @return 0 if success, otherwize nonzero
  */
 inline FileHash FileHash_from_buf (const void* buf, size_t size) {
-  FileHash hash = XXH64(buf, size, 0);
+  FileHash hash;
+  switch (FileHash_algorithm) {
+    case FileHash_XXH3_64:
+      hash = XXH3_64bits(buf, size);
+      break;
+    default:
+      hash = XXH64(buf, size, 0);
+  }
+  if unlikely (hash == 0) {
+    g_log(DFCC_NAME, G_LOG_LEVEL_WARNING, "hash is 0");
+    hash = 1;
+  }
+  return hash;
+}
+
+/**
+ * @ingroup File
+ * @brief Contains the state of an incremental hash computation.
+ */
+struct FileHashState {
+  /// The algorithm, fixed when the state is created.
+  enum FileHashAlgorithm algorithm;
+  union {
+    XXH64_state_t *xxh64;
+    XXH3_state_t *xxh3;
+  };
+};
+
+/**
+ * @memberof FileHashState
+ * @brief Creates a new FileHashState, using FileHash_algorithm.
+ *
+ * @return a FileHashState [transfer-full]
+ */
+inline struct FileHashState *FileHashState_new (void) {
+  struct FileHashState *state = g_new(struct FileHashState, 1);
+  state->algorithm = FileHash_algorithm;
+  switch (state->algorithm) {
+    case FileHash_XXH3_64:
+      state->xxh3 = XXH3_createState();
+      XXH3_64bits_reset(state->xxh3);
+      break;
+    default:
+      state->xxh64 = XXH64_createState();
+      XXH64_reset(state->xxh64, 0);
+  }
+  return state;
+}
+
+/**
+ * @memberof FileHashState
+ * @brief Frees a FileHashState.
+ *
+ * @param state a FileHashState [nullable]
+ */
+inline void FileHashState_free (struct FileHashState *state) {
+  return_if(state == NULL);
+  switch (state->algorithm) {
+    case FileHash_XXH3_64:
+      XXH3_freeState(state->xxh3);
+      break;
+    default:
+      XXH64_freeState(state->xxh64);
+  }
+  g_free(state);
+}
+
+/**
+ * @memberof FileHashState
+ * @brief Feeds a piece of data into a FileHashState.
+ *
+ * @param state a FileHashState
+ * @param buf the buffer
+ * @param size the length of buffer
+ */
+inline void FileHashState_update (
+    struct FileHashState *state, const void *buf, size_t size) {
+  switch (state->algorithm) {
+    case FileHash_XXH3_64:
+      XXH3_64bits_update(state->xxh3, buf, size);
+      break;
+    default:
+      XXH64_update(state->xxh64, buf, size);
+  }
+}
+
+/**
+ * @memberof FileHashState
+ * @brief Returns the FileHash of all data fed so far.
+ *
+ * The result equals to FileHash_from_buf() on the concatenated data.
+ *
+ * @param state a FileHashState
+ * @return the FileHash
+ */
+inline FileHash FileHashState_digest (struct FileHashState *state) {
+  FileHash hash;
+  switch (state->algorithm) {
+    case FileHash_XXH3_64:
+      hash = XXH3_64bits_digest(state->xxh3);
+      break;
+    default:
+      hash = XXH64_digest(state->xxh64);
+  }
   if unlikely (hash == 0) {
     g_log(DFCC_NAME, G_LOG_LEVEL_WARNING, "hash is 0");
     hash = 1;
@@ -0,0 +1,321 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <xxhash.h>
+
+#include "common/macro.h"
+#include "common/wrapper/file.h"
+#include "common/wrapper/mappedfile.h"
+#include "log.h"
+#include "hashdb.h"
+
+
+#define HashDB_MAGIC "DFCCHDB1"
+
+
+/**
+ * @memberof HashDB
+ * @private
+ * @brief The header of the database file.
+ */
+struct HashDBHeader {
+  char magic[8];
+  uint32_t n_slots;
+  uint32_t slot_size;
+  char reserved[48];
+};
+
+
+void HashDBKey_init_from_stat (struct HashDBKey *key, const struct stat *sb) {
+  key->dev = sb->st_dev;
+  key->ino = sb->st_ino;
+  key->size = sb->st_size;
+  key->mtime_ns =
+    (int64_t) sb->st_mtim.tv_sec * 1000000000 + sb->st_mtim.tv_nsec;
+  key->ctime_ns =
+    (int64_t) sb->st_ctim.tv_sec * 1000000000 + sb->st_ctim.tv_nsec;
+}
+
+
+/**
+ * @memberof HashDBSlot
+ * @brief Reads a consistent snapshot of a slot.
+ *
+ * @param slot a HashDBSlot
+ * @param[out] key the key in the slot
+ * @return the FileHash in the slot, or 0 if the slot is empty or being written
+ */
+static FileHash HashDBSlot_read (
+    struct HashDBSlot *slot, struct HashDBKey *key) {
+  uint_least32_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+  return_if(seq & 1) 0;
+  memcpy(key, &slot->key, sizeof(struct HashDBKey));
+  FileHash hash = slot->hash;
+  atomic_thread_fence(memory_order_acquire);
+  return_if_not(
+    atomic_load_explicit(&slot->seq, memory_order_relaxed) == seq) 0;
+  return hash;
+}
+
+
+/**
+ * @memberof HashDBSlot
+ * @brief Writes a slot, unless it is being written by someone else.
+ *
+ * @param slot a HashDBSlot
+ * @param key a HashDBKey
+ * @param hash a FileHash
+ */
+static void HashDBSlot_write (
+    struct HashDBSlot *slot, const struct HashDBKey *key, FileHash hash) {
+  uint_least32_t seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+  return_if(seq & 1);
+  return_if_not(atomic_compare_exchange_strong_explicit(
+    &slot->seq, &seq, seq + 1, memory_order_acquire, memory_order_relaxed));
+  atomic_thread_fence(memory_order_release);
+  memcpy(&slot->key, key, sizeof(struct HashDBKey));
+  slot->hash = hash;
+  atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+}
+
+
+//! @memberof HashDB
+static inline uint64_t HashDB__key_hash (const struct HashDBKey *key) {
+  return XXH64(key, sizeof(struct HashDBKey), 0);
+}
+
+
+FileHash HashDB_lookup (struct HashDB *db, const struct HashDBKey *key) {
+  uint64_t h = HashDB__key_hash(key);
+  for (uint32_t i = 0; i < HashDB_PROBE; i++) {
+    struct HashDBSlot *slot = db->slots + ((h + i) & (db->n_slots - 1));
+    struct HashDBKey slot_key;
+    FileHash hash = HashDBSlot_read(slot, &slot_key);
+    if (hash != 0 && memcmp(&slot_key, key, sizeof(struct HashDBKey)) == 0) {
+      return hash;
+    }
+  }
+  return 0;
+}
+
+
+void HashDB_store (
+    struct HashDB *db, const struct HashDBKey *key, FileHash hash) {
+  uint64_t h = HashDB__key_hash(key);
+  struct HashDBSlot *victim = NULL;
+  for (uint32_t i = 0; i < HashDB_PROBE; i++) {
+    struct HashDBSlot *slot = db->slots + ((h + i) & (db->n_slots - 1));
+    struct HashDBKey slot_key;
+    FileHash slot_hash = HashDBSlot_read(slot, &slot_key);
+    if (slot_hash == 0 ||
+        memcmp(&slot_key, key, sizeof(struct HashDBKey)) == 0) {
+      victim = slot;
+      break;
+    }
+  }
+  if (victim == NULL) {
+    // all slots taken, evict a pseudo-random one
+    victim = db->slots + ((h + (h >> 32) % HashDB_PROBE) & (db->n_slots - 1));
+  }
+  HashDBSlot_write(victim, key, hash);
+}
+
+
+/**
+ * @memberof HashDB
+ * @private
+ * @brief Tests if a file was changed so recently that a further change may
+ *        not be reflected in its timestamps.
+ *
+ * @param sb stat buf of a file
+ * @return true if racy
+ */
+static bool HashDB__is_racy (const struct stat *sb) {
+  struct timespec now;
+  return_if_fail(clock_gettime(CLOCK_REALTIME, &now) == 0) true;
+  return sb->st_ctim.tv_sec + 1 >= now.tv_sec;
+}
+
+
+FileHash HashDB_hash_file (
+    struct HashDB *db, const char *path, GError **error) {
+  int fd = g_open_e(path, O_RDONLY | O_CLOEXEC, 0, error);
+  return_if_fail(fd != -1) 0;
+
+  FileHash hash = 0;
+  do_once {
+    struct stat sb;
+    break_if_fail(fstat_e(fd, &sb, error) == 0);
+    struct HashDBKey key;
+    HashDBKey_init_from_stat(&key, &sb);
+    if (db != NULL) {
+      hash = HashDB_lookup(db, &key);
+      break_if(hash != 0);
+    }
+
+    struct MappedFile m;
+    break_if_fail(MappedFile_init_from_fd(&m, fd, error) == 0);
+    hash = FileHash_from_buf(m.content, m.length);
+    MappedFile_destroy(&m);
+    break_if(db == NULL);
+
+    // do not remember files which may be still changing
+    struct stat sb_after;
+    break_if_fail(fstat(fd, &sb_after) == 0);
+    struct HashDBKey key_after;
+    HashDBKey_init_from_stat(&key_after, &sb_after);
+    break_if_not(memcmp(&key, &key_after, sizeof(struct HashDBKey)) == 0);
+    break_if(HashDB__is_racy(&sb_after));
+    HashDB_store(db, &key, hash);
+  }
+
+  close(fd);
+  return hash;
+}
+
+
+void HashDB_destroy (struct HashDB *db) {
+  munmap(db->map, db->map_size);
+}
+
+
+/**
+ * @memberof HashDB
+ * @private
+ * @brief Validates the database file, recreating it if needed.
+ *
+ * The caller must hold an exclusive lock on `*fd`. A broken file is never
+ * resized in place, since other processes, such as those built with another
+ * slot layout, may have it mapped and would get `SIGBUS`; a new file is built
+ * and renamed over it instead, and `*fd` is replaced with it.
+ *
+ * @param path path to the database file
+ * @param[in,out] fd file descriptor of the database file
+ * @param n_slots number of slots if the database is to be created
+ * @param[out] header the header of the database
+ * @param[out] error a return location for a GError [optional]
+ * @return 0 if success, otherwize nonzero
+ */
+static int HashDB__prepare (
+    const char *path, int *fd, uint32_t n_slots, struct HashDBHeader *header,
+    GError **error) {
+  struct stat sb;
+  return_if_fail(fstat_e(*fd, &sb, error) == 0) 1;
+
+  if ((size_t) sb.st_size >= sizeof(struct HashDBHeader) &&
+      pread(*fd, header, sizeof(struct HashDBHeader), 0) ==
+        sizeof(struct HashDBHeader) &&
+      memcmp(header->magic, HashDB_MAGIC, sizeof(header->magic)) == 0 &&
+      header->slot_size == sizeof(struct HashDBSlot) &&
+      header->n_slots != 0 &&
+      (header->n_slots & (header->n_slots - 1)) == 0 &&
+      (size_t) sb.st_size == sizeof(struct HashDBHeader) +
+        (size_t) header->n_slots * sizeof(struct HashDBSlot)) {
+    return 0;
+  }
+
+  if (sb.st_size != 0) {
+    g_log(DFCC_FILE_NAME, G_LOG_LEVEL_INFO, "Recreate broken hash database");
+  }
+
+  memset(header, 0, sizeof(struct HashDBHeader));
+  memcpy(header->magic, HashDB_MAGIC, sizeof(header->magic));
+  header->n_slots = 1;
+  while (header->n_slots < n_slots && header->n_slots < (1u << 30)) {
+    header->n_slots <<= 1;
+  }
+  header->slot_size = sizeof(struct HashDBSlot);
+
+  char *tmppath = g_strconcat(path, ".XXXXXX", NULL);
+  int tmpfd = g_mkstemp_full(tmppath, O_RDWR | O_CLOEXEC, 0644);
+  should (tmpfd != -1) otherwise {
+    g_set_error_errno(error, G_FILE_ERROR, "Failed to mkstemp: %s");
+    g_free(tmppath);
+    return 1;
+  }
+  int ret = 1;
+  do_once {
+    // the file is sparse, so empty slots cost nothing
+    should (ftruncate(
+        tmpfd, sizeof(struct HashDBHeader) +
+               (size_t) header->n_slots * sizeof(struct HashDBSlot)
+      ) == 0) otherwise {
+      g_set_error_errno(error, G_FILE_ERROR, "Failed to truncate: %s");
+      break;
+    }
+    should (pwrite(tmpfd, header, sizeof(struct HashDBHeader), 0) ==
+            sizeof(struct HashDBHeader)) otherwise {
+      g_set_error_errno(error, G_FILE_ERROR, "Failed to write header: %s");
+      break;
+    }
+    should (rename(tmppath, path) == 0) otherwise {
+      g_set_error_errno(error, G_FILE_ERROR, "Failed to rename: %s");
+      break;
+    }
+    ret = 0;
+  }
+  should (ret == 0) otherwise {
+    unlink(tmppath);
+    g_free(tmppath);
+    close(tmpfd);
+    return 1;
+  }
+  g_free(tmppath);
+
+  // also releases the lock on the old file
+  close(*fd);
+  *fd = tmpfd;
+  return 0;
+}
+
+
+int HashDB_init (
+    struct HashDB *db, const char *path, uint32_t n_slots, GError **error) {
+  char *dir = g_path_get_dirname(path);
+  int ret = g_mkdir_with_parents_e(dir, 0755, error);
+  g_free(dir);
+  return_if_fail(ret == 0) 1;
+
+  int fd;
+  while (true) {
+    fd = g_open_e(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644, error);
+    return_if_fail(fd != -1) 1;
+    flock(fd, LOCK_EX);
+    // the file may have been replaced while waiting for the lock
+    struct stat sb_fd;
+    struct stat sb_path;
+    break_if(fstat(fd, &sb_fd) != 0);
+    break_if(stat(path, &sb_path) == 0 && sb_fd.st_dev == sb_path.st_dev &&
+             sb_fd.st_ino == sb_path.st_ino);
+    close(fd);
+  }
+
+  struct HashDBHeader header;
+  ret = HashDB__prepare(path, &fd, n_slots, &header, error);
+  flock(fd, LOCK_UN);
+
+  if (ret == 0) {
+    db->n_slots = header.n_slots;
+    db->map_size = sizeof(struct HashDBHeader) +
+                   (size_t) db->n_slots * sizeof(struct HashDBSlot);
+    db->map = mmap(
+      NULL, db->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    should (db->map != MAP_FAILED) otherwise {
+      g_set_error_errno(error, G_FILE_ERROR, "Failed to mmap: %s");
+      ret = 1;
+    }
+    db->slots = (struct HashDBSlot *) (
+      (char *) db->map + sizeof(struct HashDBHeader));
+  }
+
+  close(fd);
+  return ret;
+}
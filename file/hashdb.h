@@ -0,0 +1,145 @@
+#ifndef DFCC_FILE_HASHDB_H
+#define DFCC_FILE_HASHDB_H
+
+#ifdef __cplusplus
+# include <atomic>
+using std::atomic_uint_least32_t;
+#else
+# include <stdatomic.h>
+#endif
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#include "common/cdecls.h"
+#include "hash.h"
+
+BEGIN_C_DECLS
+
+
+/**
+ * @ingroup File
+ * @brief Identifies a particular version of a file, by its (dev, inode, size,
+ *        mtime, ctime) fingerprint.
+ */
+struct HashDBKey {
+  uint64_t dev;
+  uint64_t ino;
+  uint64_t size;
+  int64_t mtime_ns;
+  int64_t ctime_ns;
+};
+
+
+/**
+ * @memberof HashDBKey
+ * @brief Initializes a HashDBKey with the stat buf `sb`.
+ *
+ * @param key a HashDBKey
+ * @param sb stat buf of a file
+ */
+void HashDBKey_init_from_stat (struct HashDBKey *key, const struct stat *sb);
+
+
+/**
+ * @ingroup File
+ * @brief A slot of HashDB.
+ *
+ * Slots are protected by seqlocks: `seq` is odd while the slot is being
+ * written, and readers retry if `seq` changed during reading.
+ */
+struct HashDBSlot {
+  atomic_uint_least32_t seq;
+  uint32_t reserved;
+  struct HashDBKey key;
+  FileHash hash;
+};
+
+
+/// Number of slots probed for a key.
+#define HashDB_PROBE 8
+/// Default number of slots in a newly created HashDB.
+#define HashDB_DEFAULT_SLOTS (1 << 18)
+
+
+/**
+ * @ingroup File
+ * @brief A persistent, memory-mapped hash table from file fingerprints to file
+ *        hashes.
+ *
+ * The database is shared by all processes mapping the same file, and is
+ * updated lock-free. It is a cache: entries may be evicted or dropped at any
+ * time.
+ */
+struct HashDB {
+  /// The mapped file.
+  void *map;
+  /// The length of the mapped file.
+  size_t map_size;
+  /// Slots in the table.
+  struct HashDBSlot *slots;
+  /// Number of slots, always a power of 2.
+  uint32_t n_slots;
+};
+
+
+/**
+ * @memberof HashDB
+ * @brief Looks up the hash of a file version.
+ *
+ * @param db a HashDB
+ * @param key a HashDBKey
+ * @return the FileHash, or 0 if not found
+ */
+FileHash HashDB_lookup (struct HashDB *db, const struct HashDBKey *key);
+/**
+ * @memberof HashDB
+ * @brief Stores the hash of a file version.
+ *
+ * The store is silently dropped if the slot is being written by another
+ * process.
+ *
+ * @param db a HashDB
+ * @param key a HashDBKey
+ * @param hash a FileHash
+ */
+void HashDB_store (
+  struct HashDB *db, const struct HashDBKey *key, FileHash hash);
+/**
+ * @memberof HashDB
+ * @brief Computes the hash of the file `path`, consulting and updating the
+ *        database.
+ *
+ * @param db a HashDB [nullable]
+ * @param path path to the file
+ * @param[out] error a return location for a GError [optional]
+ * @return the FileHash, or 0 if failed
+ */
+FileHash HashDB_hash_file (struct HashDB *db, const char *path, GError **error);
+/**
+ * @memberof HashDB
+ * @brief Frees associated resources of a HashDB.
+ *
+ * @param db a HashDB
+ */
+void HashDB_destroy (struct HashDB *db);
+/**
+ * @memberof HashDB
+ * @brief Opens or creates a HashDB at `path`.
+ *
+ * @param db a HashDB
+ * @param path path to the database file
+ * @param n_slots number of slots if the database is to be created, rounded up
+ *                to a power of 2
+ * @param[out] error a return location for a GError [optional]
+ * @return 0 if success, otherwize nonzero
+ */
+int HashDB_init (
+  struct HashDB *db, const char *path, uint32_t n_slots, GError **error);
+
+
+END_C_DECLS
+
+#endif /* DFCC_FILE_HASHDB_H */
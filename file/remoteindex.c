@@ -16,7 +16,8 @@ bool RemoteFileIndex_add (
   }
 
   g_rw_lock_writer_lock(&index->rwlock);
-  g_hash_table_insert(index->table, tag->path, tag);
+  // the key belongs to the old tag, so it must be replaced too
+  g_hash_table_replace(index->table, tag->path, tag);
   g_rw_lock_writer_unlock(&index->rwlock);
 
   return true;
@@ -0,0 +1,207 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "common/macro.h"
+#include "log.h"
+#include "resultcache.h"
+
+
+FileHash ResultCache_key (
+    char * const argv[], char * const envp[], const char *working_directory,
+    const char *compiler) {
+  static const char * const env_names[] = {ResultCache_ENV_NAMES};
+
+  GStatBuf sb;
+  return_if_fail(compiler != NULL && g_stat(compiler, &sb) == 0) 0;
+
+  GString *material = g_string_new(working_directory);
+  g_string_append_c(material, '\0');
+  g_string_append(material, compiler);
+  g_string_append_printf(
+    material, "%c%jd%c%jd.%09ld", '\0', (intmax_t) sb.st_size, '\0',
+    (intmax_t) sb.st_mtim.tv_sec, sb.st_mtim.tv_nsec);
+  for (int i = 0; argv[i] != NULL; i++) {
+    g_string_append_c(material, '\0');
+    g_string_append(material, argv[i]);
+  }
+  // unset variables are distinguished from empty ones
+  g_string_append_c(material, '\0');
+  for (unsigned int i = 0; i < G_N_ELEMENTS(env_names); i++) {
+    const char *value = g_environ_getenv((gchar **) envp, env_names[i]);
+    g_string_append_c(material, '\0');
+    if (value != NULL) {
+      g_string_append_c(material, '=');
+      g_string_append(material, value);
+    }
+  }
+  FileHash key = FileHash_from_buf(material->str, material->len);
+  g_string_free(material, TRUE);
+  return key;
+}
+
+
+/**
+ * @memberof ResultCache
+ * @private
+ * @brief Get the path to the file of `key`.
+ *
+ * @return the path [transfer-full]
+ */
+static char *ResultCache__path (struct ResultCache *cache, FileHash key) {
+  char name[FileHash_STRLEN + 1];
+  FileHash_to_string(key, name);
+  return g_build_filename(cache->dir, name, NULL);
+}
+
+
+/**
+ * @memberof ResultCache
+ * @private
+ * @brief Get the entries of `key`, loading them from disk if needed.
+ *
+ * Must be called with the lock held.
+ *
+ * @return entries as @ref ResultCache_ENTRIES_SIGNATURE, or NULL
+ *         [transfer-none]
+ */
+static GVariant *ResultCache__get (struct ResultCache *cache, FileHash key) {
+  GVariant *entries = g_hash_table_lookup(cache->table, &key);
+  return_if(entries != NULL) entries;
+
+  char *path = ResultCache__path(cache, key);
+  char *contents;
+  gsize length;
+  bool loaded = g_file_get_contents(path, &contents, &length, NULL);
+  g_free(path);
+  return_if_not(loaded) NULL;
+
+  entries = g_variant_ref_sink(g_variant_new_from_data(
+    G_VARIANT_TYPE(ResultCache_ENTRIES_SIGNATURE), contents, length, FALSE,
+    g_free, contents));
+  g_hash_table_insert(cache->table, g_memdup(&key, sizeof(key)), entries);
+  return entries;
+}
+
+
+/**
+ * @memberof ResultCache
+ * @private
+ * @brief Tests if every input file resolves to its recorded hash.
+ */
+static bool ResultCache__match (
+    GVariant *inputs, ResultCacheResolver resolver, void *userdata) {
+  GVariantIter iter;
+  const char *path;
+  FileHash hash;
+  g_variant_iter_init(&iter, inputs);
+  while (g_variant_iter_next(&iter, "{&st}", &path, &hash)) {
+    return_if(resolver(userdata, path) != hash) false;
+  }
+  return true;
+}
+
+
+GVariant *ResultCache_lookup (
+    struct ResultCache *cache, FileHash key, ResultCacheResolver resolver,
+    void *userdata) {
+  g_mutex_lock(&cache->mtx);
+  GVariant *entries = ResultCache__get(cache, key);
+  if (entries != NULL) {
+    g_variant_ref(entries);
+  }
+  g_mutex_unlock(&cache->mtx);
+  return_if(entries == NULL) NULL;
+
+  GVariant *ret = NULL;
+  GVariantIter iter;
+  GVariant *inputs;
+  GVariant *outputs;
+  g_variant_iter_init(&iter, entries);
+  while (g_variant_iter_next(&iter, "(@a{st}@a{st})", &inputs, &outputs)) {
+    bool matched = ResultCache__match(inputs, resolver, userdata);
+    g_variant_unref(inputs);
+    if (matched) {
+      ret = outputs;
+      break;
+    }
+    g_variant_unref(outputs);
+  }
+  g_variant_unref(entries);
+  return ret;
+}
+
+
+void ResultCache_store (
+    struct ResultCache *cache, FileHash key, GVariant *inputs,
+    GVariant *outputs) {
+  g_variant_ref_sink(inputs);
+  g_variant_ref_sink(outputs);
+
+  GVariantBuilder builder;
+  g_variant_builder_init(
+    &builder, G_VARIANT_TYPE(ResultCache_ENTRIES_SIGNATURE));
+  g_variant_builder_add(&builder, "(@a{st}@a{st})", inputs, outputs);
+
+  g_mutex_lock(&cache->mtx);
+
+  // newest first, replacing the entry with the same inputs
+  GVariant *old_entries = ResultCache__get(cache, key);
+  if (old_entries != NULL) {
+    unsigned int n_entries = 1;
+    GVariantIter iter;
+    GVariant *entry;
+    g_variant_iter_init(&iter, old_entries);
+    while (n_entries < ResultCache_MAX_ENTRIES &&
+           (entry = g_variant_iter_next_value(&iter)) != NULL) {
+      GVariant *old_inputs = g_variant_get_child_value(entry, 0);
+      if (!g_variant_equal(old_inputs, inputs)) {
+        g_variant_builder_add_value(&builder, entry);
+        n_entries++;
+      }
+      g_variant_unref(old_inputs);
+      g_variant_unref(entry);
+    }
+  }
+  GVariant *entries = g_variant_ref_sink(g_variant_builder_end(&builder));
+  g_hash_table_replace(
+    cache->table, g_memdup(&key, sizeof(key)), g_variant_ref(entries));
+
+  g_mutex_unlock(&cache->mtx);
+
+  char *path = ResultCache__path(cache, key);
+  GError *error = NULL;
+  should (g_file_set_contents(
+      path, g_variant_get_data(entries), g_variant_get_size(entries),
+      &error)) otherwise {
+    g_log(DFCC_FILE_NAME, G_LOG_LEVEL_WARNING,
+          "Cannot save result cache '%s': %s", path, error->message);
+    g_error_free(error);
+  }
+  g_free(path);
+
+  g_variant_unref(entries);
+  g_variant_unref(inputs);
+  g_variant_unref(outputs);
+}
+
+
+void ResultCache_destroy (struct ResultCache *cache) {
+  g_hash_table_destroy(cache->table);
+  g_mutex_clear(&cache->mtx);
+  g_free(cache->dir);
+}
+
+
+int ResultCache_init (struct ResultCache *cache, const char *dir) {
+  return_if_fail(g_mkdir_with_parents(dir, 0755) == 0) 1;
+  cache->table = g_hash_table_new_full(
+    FileHash_hash, FileHash_equal, g_free,
+    (GDestroyNotify) g_variant_unref);
+  g_mutex_init(&cache->mtx);
+  cache->dir = g_strdup(dir);
+  return 0;
+}
@@ -0,0 +1,119 @@
+#ifndef DFCC_FILE_RESULTCACHE_H
+#define DFCC_FILE_RESULTCACHE_H
+
+#include <glib.h>
+
+#include "common/cdecls.h"
+#include "hash.h"
+
+BEGIN_C_DECLS
+
+
+/// Environment variables which change what a compiler reads or writes.
+#define ResultCache_ENV_NAMES \
+  "GCC_EXEC_PREFIX", "COMPILER_PATH", "LIBRARY_PATH", "CPATH", \
+  "C_INCLUDE_PATH", "CPLUS_INCLUDE_PATH", "OBJC_INCLUDE_PATH", \
+  "DEPENDENCIES_OUTPUT", "SUNPRO_DEPENDENCIES", "SOURCE_DATE_EPOCH", \
+  "GCC_COMPARE_DEBUG", "LANG", "LC_ALL", "LC_CTYPE", "LC_MESSAGES", \
+  "LD_LIBRARY_PATH"
+/// Maximum number of input sets remembered for a job key.
+#define ResultCache_MAX_ENTRIES 8
+/// path, hash
+#define ResultCache_FILELIST_SIGNATURE "a{st}"
+/// [(inputs, outputs)]
+#define ResultCache_ENTRIES_SIGNATURE "a(a{st}a{st})"
+
+
+//! @memberof ResultCache
+typedef FileHash (*ResultCacheResolver) (void *, const char *);
+
+
+/**
+ * @ingroup File
+ * @brief Maps jobs to the hashes of their outputs, whose contents are stored in
+ *        Cache.
+ *
+ * A job is identified by its key, which covers its arguments, its compiler
+ * and its environment, and the hashes of the files it read when it was run,
+ * including the programs it ran. A key may map to several input sets, since
+ * the same arguments may be run against different headers.
+ */
+struct ResultCache {
+  /// Hash table from job key to entries. [element-type FileHash GVariant]
+  GHashTable *table;
+  /// Lock for ResultCache.table.
+  GMutex mtx;
+  /// Directory where entries are persisted, one file per job key.
+  char *dir;
+};
+
+
+/**
+ * @memberof ResultCache
+ * @brief Calculates the key of a job.
+ *
+ * The compiler is identified by its path, size and modification time, so that
+ * upgrading the toolchain invalidates its results. Of the environment, only
+ * @ref ResultCache_ENV_NAMES are taken into account.
+ *
+ * @param argv compiler's argument vector [array zero-terminated=1]
+ * @param envp compiler's environment [array zero-terminated=1]
+ * @param working_directory compiler's working directory
+ * @param compiler path to the compiler executable, as resolved from `argv[0]`
+ * @return the key, or 0 if the job is not to be cached
+ */
+FileHash ResultCache_key (
+  char * const argv[], char * const envp[], const char *working_directory,
+  const char *compiler);
+/**
+ * @memberof ResultCache
+ * @brief Looks up the outputs of a job.
+ *
+ * An entry matches if every input file it recorded resolves to the same hash
+ * now, where 0 stands for a missing file.
+ *
+ * @param cache a ResultCache
+ * @param key the key of the job
+ * @param resolver function to get the current hash of a path
+ * @param userdata user data of `resolver`
+ * @return the outputs as @ref ResultCache_FILELIST_SIGNATURE, or NULL if no
+ *         entry matches [transfer-full]
+ */
+GVariant *ResultCache_lookup (
+  struct ResultCache *cache, FileHash key, ResultCacheResolver resolver,
+  void *userdata);
+/**
+ * @memberof ResultCache
+ * @brief Records the outputs of a job.
+ *
+ * @param cache a ResultCache
+ * @param key the key of the job
+ * @param inputs files read as @ref ResultCache_FILELIST_SIGNATURE, consumed if
+ *               floating
+ * @param outputs files written as @ref ResultCache_FILELIST_SIGNATURE,
+ *                consumed if floating
+ */
+void ResultCache_store (
+  struct ResultCache *cache, FileHash key, GVariant *inputs,
+  GVariant *outputs);
+/**
+ * @memberof ResultCache
+ * @brief Frees associated resources of a ResultCache.
+ *
+ * @param cache a ResultCache
+ */
+void ResultCache_destroy (struct ResultCache *cache);
+/**
+ * @memberof ResultCache
+ * @brief Initializes a ResultCache.
+ *
+ * @param cache a ResultCache
+ * @param dir directory where entries are persisted
+ * @return 0 if success, otherwize nonzero
+ */
+int ResultCache_init (struct ResultCache *cache, const char *dir);
+
+
+END_C_DECLS
+
+#endif /* DFCC_FILE_RESULTCACHE_H */
@@ -0,0 +1,86 @@
+#include <glib.h>
+
+#include "common/macro.h"
+#include "sketch.h"
+
+
+/**
+ * @memberof CountMinSketch
+ * @private
+ * @brief Returns the counter of `hash` in row `row`.
+ *
+ * @param sketch a CountMinSketch
+ * @param row the row
+ * @param hash a FileHash
+ * @return the counter
+ */
+static inline gint *CountMinSketch__counter (
+    const struct CountMinSketch *sketch, int row, FileHash hash) {
+  static const guint64 seeds[CountMinSketch_DEPTH] = {
+    0x9E3779B97F4A7C15ull, 0xC2B2AE3D27D4EB4Full,
+    0x165667B19E3779F9ull, 0xD6E8FEB86659FD93ull,
+  };
+  guint64 x = (hash ^ seeds[row]) * 0xFF51AFD7ED558CCDull;
+  x ^= x >> 32;
+  return sketch->table + row * sketch->width + (x & (sketch->width - 1));
+}
+
+
+/**
+ * @memberof CountMinSketch
+ * @private
+ * @brief Halves all counters.
+ *
+ * @param sketch a CountMinSketch
+ */
+static void CountMinSketch__age (struct CountMinSketch *sketch) {
+  for (unsigned int i = 0; i < CountMinSketch_DEPTH * sketch->width; i++) {
+    g_atomic_int_set(
+      sketch->table + i, g_atomic_int_get(sketch->table + i) >> 1);
+  }
+}
+
+
+void CountMinSketch_add (struct CountMinSketch *sketch, FileHash hash) {
+  // conservative update: only raise the smallest counters
+  unsigned int estimate = CountMinSketch_estimate(sketch, hash);
+  return_if(estimate >= CountMinSketch_MAX);
+  for (int row = 0; row < CountMinSketch_DEPTH; row++) {
+    gint *counter = CountMinSketch__counter(sketch, row, hash);
+    g_atomic_int_compare_and_exchange(counter, estimate, estimate + 1);
+  }
+
+  if unlikely (g_atomic_int_add(&sketch->additions, 1) + 1 ==
+               (gint) (10 * sketch->width)) {
+    g_atomic_int_set(&sketch->additions, 0);
+    CountMinSketch__age(sketch);
+  }
+}
+
+
+unsigned int CountMinSketch_estimate (
+    const struct CountMinSketch *sketch, FileHash hash) {
+  unsigned int estimate = CountMinSketch_MAX;
+  for (int row = 0; row < CountMinSketch_DEPTH; row++) {
+    unsigned int value =
+      g_atomic_int_get(CountMinSketch__counter(sketch, row, hash));
+    estimate = min(estimate, value);
+  }
+  return estimate;
+}
+
+
+void CountMinSketch_destroy (struct CountMinSketch *sketch) {
+  g_free(sketch->table);
+}
+
+
+int CountMinSketch_init (struct CountMinSketch *sketch, unsigned int width) {
+  sketch->width = 1;
+  while (sketch->width < width) {
+    sketch->width <<= 1;
+  }
+  sketch->table = g_new0(gint, CountMinSketch_DEPTH * sketch->width);
+  sketch->additions = 0;
+  return 0;
+}
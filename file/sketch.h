@@ -0,0 +1,75 @@
+#ifndef DFCC_FILE_SKETCH_H
+#define DFCC_FILE_SKETCH_H
+
+#include <glib.h>
+
+#include "common/cdecls.h"
+#include "hash.h"
+
+BEGIN_C_DECLS
+
+
+/// Number of rows of a CountMinSketch.
+#define CountMinSketch_DEPTH 4
+/// Maximum value of a counter of a CountMinSketch.
+#define CountMinSketch_MAX 15
+
+
+/**
+ * @ingroup File
+ * @brief Estimates how often a FileHash was seen recently, in constant space.
+ *
+ * Counters saturate at @ref CountMinSketch_MAX, and are halved after every
+ * 10 × width additions, so that old popularity fades. All operations are
+ * lock-free; concurrent updates may be lost, which only makes the estimate a
+ * bit lower.
+ */
+struct CountMinSketch {
+  /// Counters, CountMinSketch_DEPTH rows of CountMinSketch.width each.
+  gint *table;
+  /// Number of counters of a row, a power of 2.
+  unsigned int width;
+  /// Number of additions since the last halving.
+  gint additions;
+};
+
+
+/**
+ * @memberof CountMinSketch
+ * @brief Records an occurrence of `hash`.
+ *
+ * @param sketch a CountMinSketch
+ * @param hash a FileHash
+ */
+void CountMinSketch_add (struct CountMinSketch *sketch, FileHash hash);
+/**
+ * @memberof CountMinSketch
+ * @brief Estimates the recent number of occurrences of `hash`.
+ *
+ * @param sketch a CountMinSketch
+ * @param hash a FileHash
+ * @return the estimate, at most @ref CountMinSketch_MAX
+ */
+unsigned int CountMinSketch_estimate (
+  const struct CountMinSketch *sketch, FileHash hash);
+/**
+ * @memberof CountMinSketch
+ * @brief Frees associated resources of a CountMinSketch.
+ *
+ * @param sketch a CountMinSketch
+ */
+void CountMinSketch_destroy (struct CountMinSketch *sketch);
+/**
+ * @memberof CountMinSketch
+ * @brief Initializes a CountMinSketch.
+ *
+ * @param sketch a CountMinSketch
+ * @param width number of counters of a row, rounded up to a power of 2
+ * @return 0 if success, otherwize nonzero
+ */
+int CountMinSketch_init (struct CountMinSketch *sketch, unsigned int width);
+
+
+END_C_DECLS
+
+#endif /* DFCC_FILE_SKETCH_H */
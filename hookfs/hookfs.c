@@ -10,6 +10,8 @@
 #include <unistd.h>
 #include <dirent.h>
 #include <dlfcn.h>  // RTLD_NEXT
+#include <fcntl.h>
+#include <spawn.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/un.h>
@@ -187,6 +189,28 @@ HOOK(int, execvp, (file, argv),
 )
 
 
+WRAP(int, posix_spawn) (
+    pid_t *pid, const char *path,
+    const posix_spawn_file_actions_t *file_actions,
+    const posix_spawnattr_t *attrp, char *const argv[], char *const envp[])
+HOOK(int, posix_spawn, (pid, path, file_actions, attrp, argv, envp),
+  serialize_string(&serdes, path);
+  serialize_strv(&serdes, argv);
+  serialize_strv(&serdes, envp);
+)
+
+
+WRAP(int, posix_spawnp) (
+    pid_t *pid, const char *file,
+    const posix_spawn_file_actions_t *file_actions,
+    const posix_spawnattr_t *attrp, char *const argv[], char *const envp[])
+HOOK(int, posix_spawnp, (pid, file, file_actions, attrp, argv, envp),
+  serialize_string(&serdes, file);
+  serialize_strv(&serdes, argv);
+  serialize_strv(&serdes, envp);
+)
+
+
 WRAP(int, access) (const char *pathname, int mode)
 HOOK_PATH(int, access, (pathname, mode), pathname,
   serialize_string(&serdes, pathname);
@@ -208,8 +232,30 @@ HOOK_PATH(int, lstat, (pathname, statbuf), pathname,
 )
 
 
-/*
-WRAP(int, open) (const char *path, int oflag, mode_t mode)
+/**
+ * @brief Gets the optional `mode` argument of `open()`.
+ *
+ * @param oflag flags of `open()`
+ * @param ap the variable arguments after `oflag`
+ */
+#define open_mode(oflag, ap) \
+  ((oflag) & (O_CREAT | O_TMPFILE) ? va_arg(ap, mode_t) : 0)
+
+
+static int open_hooked (const char *path, int oflag, mode_t mode);
+static int open64_hooked (const char *path, int oflag, mode_t mode);
+
+
+WRAP(int, open) (const char *path, int oflag, ...) {
+  va_list ap;
+  va_start(ap, oflag);
+  mode_t mode = open_mode(oflag, ap);
+  va_end(ap);
+  return open_hooked(path, oflag, mode);
+}
+
+
+static int open_hooked (const char *path, int oflag, mode_t mode)
 HOOK_PATH(int, open, (path, oflag, mode), path,
   serialize_string(&serdes, path);
   serialize_printf(&serdes, "%d", oflag);
@@ -217,13 +263,21 @@ HOOK_PATH(int, open, (path, oflag, mode), path,
 )
 
 
-WRAP(int, open64) (const char *path, int oflag, mode_t mode)
+WRAP(int, open64) (const char *path, int oflag, ...) {
+  va_list ap;
+  va_start(ap, oflag);
+  mode_t mode = open_mode(oflag, ap);
+  va_end(ap);
+  return open64_hooked(path, oflag, mode);
+}
+
+
+static int open64_hooked (const char *path, int oflag, mode_t mode)
 HOOK_PATH(int, open64, (path, oflag, mode), path,
   serialize_string(&serdes, path);
   serialize_printf(&serdes, "%d", oflag);
   serialize_printf(&serdes, "%d", mode);
 )
-*/
 
 
 WRAP(FILE *, fopen) (const char *filename, const char *mode)
@@ -1,6 +1,8 @@
 #include <gmodule.h>
 
+#include "common/macro.h"
 #include "config/config.h"
+#include "file/cache.h"
 #include "log.h"
 #include "session.h"
 #include "context.h"
@@ -41,5 +43,47 @@ int ServerContext_init (
   ) == 0) 1;
   server_ctx->server = server;
   server_ctx->config = config;
+
+  // restore the index of the last run
+  struct Cache *cache = &server_ctx->session_manager.cache;
+  cache->durability = CacheDurability_from_string(config->cache_durability);
+  cache->hot_budget = (size_t) config->cache_hot_budget << 20;
+  cache->quota_size = (guint64) config->cache_quota << 20;
+  cache->quota_files = config->cache_quota_files;
+  cache->housekeeping_interval = config->housekeeping_interval;
+  GError *error_ = NULL;
+  should (Cache_open_journal(cache, &error_) == 0) otherwise {
+    g_log(DFCC_SERVER_NAME, G_LOG_LEVEL_WARNING,
+          "Cannot open cache journal: %s", error_->message);
+    g_clear_error(&error_);
+  }
+  if (config->cache_pack_threshold != 0) {
+    should (Cache_open_pack(
+        cache, (size_t) config->cache_pack_threshold << 10, &error_) == 0
+    ) otherwise {
+      g_log(DFCC_SERVER_NAME, G_LOG_LEVEL_WARNING,
+            "Cannot open cache pack: %s", error_->message);
+      g_clear_error(&error_);
+    }
+  }
+
+  // verification policy of the cache
+  if (Cache_watch(cache, &error_) == 0) {
+    cache->trust_window = config->cache_trust_window;
+  } else {
+    // without notifications, only trust the cache briefly
+    g_log(DFCC_SERVER_NAME, G_LOG_LEVEL_INFO,
+          "Cannot watch cache: %s", error_->message);
+    g_clear_error(&error_);
+    cache->trust_window = min(config->cache_trust_window, 1);
+  }
+  // also does the housekeeping I/O, off the main loop
+  should (Cache_start_scrubber(
+      cache, (size_t) config->cache_scrub_rate << 10, &error_) == 0
+  ) otherwise {
+    g_log(DFCC_SERVER_NAME, G_LOG_LEVEL_WARNING,
+          "Cannot start cache scrubber: %s", error_->message);
+    g_error_free(error_);
+  }
   return 0;
 }
@@ -30,6 +30,10 @@
                           &server_ctx, NULL); \
 }
 
+#define ADD_EARLY_HANDLER(handler, early_handler) \
+  soup_server_add_early_handler(server, SOUP_HANDLER_PATH(handler), \
+                                early_handler, &server_ctx, NULL)
+
 
 /**@}*/
 
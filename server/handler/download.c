@@ -1,6 +1,15 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "common/macro.h"
+#include "common/morestring.h"
 #include "common/wrapper/soup.h"
+#include "common/wrapper/zstd.h"
+#include "file/cache.h"
 #include "../protocol.h"
+#include "../log.h"
 #include "middleware.h"
 #include "download.h"
 
@@ -8,19 +17,352 @@
 const char SOUP_HANDLER_PATH(Server_handle_download)[] = DFCC_DOWNLOAD_PATH;
 
 
+/**
+ * @private
+ * @brief Checks whether `If-None-Match` matches `etag`, using the weak
+ *        comparison.
+ *
+ * @param header value of `If-None-Match`
+ * @param etag the quoted entity tag
+ * @return `true` if matches
+ */
+static bool Server__etag_match (const char *header, const char *etag) {
+  bool ret = false;
+  gchar **tags = g_strsplit(header, ",", 0);
+  for (int i = 0; tags[i] != NULL; i++) {
+    const char *tag = g_strstrip(tags[i]);
+    if (strscmp(tag, "W/") == 0) {
+      tag += 2;
+    }
+    if (strcmp(tag, "*") == 0 || strcmp(tag, etag) == 0) {
+      ret = true;
+      break;
+    }
+  }
+  g_strfreev(tags);
+  return ret;
+}
+
+
+/**
+ * @private
+ * @brief Parses a single byte range of `Range`.
+ *
+ * Multiple ranges are not supported and are treated as if no `Range` were
+ * given.
+ *
+ * @param header value of `Range`
+ * @param length length of the entity
+ * @param[out] start first byte of the range
+ * @param[out] end last byte of the range
+ * @return 0 if a satisfiable range is found, -1 if the range is not
+ *         satisfiable, otherwize 1
+ */
+static int Server__parse_range (
+    const char *header, goffset length, goffset *start, goffset *end) {
+  return_if_fail(strscmp(header, "bytes=") == 0) 1;
+  const char *spec = header + strlen("bytes=");
+  return_if(strchr(spec, ',') != NULL) 1;
+
+  char *endptr;
+  if (*spec == '-') {
+    // suffix range
+    goffset suffix = g_ascii_strtoll(spec + 1, &endptr, 10);
+    return_if_fail(endptr != spec + 1 && *endptr == '\0') 1;
+    return_if(suffix <= 0 || length == 0) -1;
+    *start = suffix >= length ? 0 : length - suffix;
+    *end = length - 1;
+    return 0;
+  }
+
+  *start = g_ascii_strtoll(spec, &endptr, 10);
+  return_if_fail(endptr != spec && *endptr == '-') 1;
+  spec = endptr + 1;
+  if (*spec == '\0') {
+    *end = length - 1;
+  } else {
+    *end = g_ascii_strtoll(spec, &endptr, 10);
+    return_if_fail(*endptr == '\0' && *end >= *start) 1;
+    *end = min(*end, length - 1);
+  }
+  return_if(*start >= length) -1;
+  return 0;
+}
+
+
+/**
+ * @ingroup ServerHandler
+ * @brief Compresses a blob into a chunked response piece by piece, so that
+ *        the compressed blob is never held in memory as a whole.
+ */
+struct DownloadStream {
+  SoupServer *server;
+  SoupMessage *msg;
+  /// The uncompressed content.
+  SoupBuffer *buffer;
+  /// Length of DownloadStream.buffer compressed so far.
+  gsize offset;
+  /// Number of chunks appended but not yet written.
+  unsigned int n_pending;
+  struct ZstdEncoder encoder;
+};
+
+
+//! @memberof DownloadStream
+static void DownloadStream_free (struct DownloadStream *stream) {
+  ZstdEncoder_destroy(&stream->encoder);
+  soup_buffer_free(stream->buffer);
+  g_free(stream);
+}
+
+
+/**
+ * @memberof DownloadStream
+ * @private
+ * @brief Appends compressed data as a chunk, as a ZstdWriteFunc.
+ */
+static int DownloadStream__write (
+    const void *buf, size_t size, void *userdata) {
+  struct DownloadStream *stream = (struct DownloadStream *) userdata;
+  soup_message_body_append(
+    stream->msg->response_body, SOUP_MEMORY_COPY, buf, size);
+  stream->n_pending++;
+  return 0;
+}
+
+
+/**
+ * @memberof DownloadStream
+ * @private
+ * @brief Compresses pieces of the content until a chunk is produced, or the
+ *        content is finished.
+ *
+ * @param stream a DownloadStream
+ * @return 0 if success, otherwize nonzero
+ */
+static int DownloadStream__pump (struct DownloadStream *stream) {
+  while (stream->n_pending == 0 && stream->offset < stream->buffer->length) {
+    gsize size = min(
+      (gsize) DFCC_DOWNLOAD_CHUNK_SIZE,
+      stream->buffer->length - stream->offset);
+    bool end = stream->offset + size == stream->buffer->length;
+    GError *error = NULL;
+    should (ZstdEncoder_feed(
+        &stream->encoder, stream->buffer->data + stream->offset, size, end,
+        DownloadStream__write, stream, &error) == 0) otherwise {
+      g_log(DFCC_SERVER_NAME, G_LOG_LEVEL_WARNING,
+            "Cannot compress: %s", error->message);
+      g_error_free(error);
+      return 1;
+    }
+    stream->offset += size;
+  }
+  if (stream->offset == stream->buffer->length) {
+    soup_message_body_complete(stream->msg->response_body);
+  }
+  return 0;
+}
+
+
+/**
+ * @memberof DownloadStream
+ * @brief Callback when a chunk has been written.
+ *
+ * @param msg a SoupMessage
+ * @param user_data a DownloadStream
+ */
+static void DownloadStream_wrote_chunk (SoupMessage *msg, gpointer user_data) {
+  struct DownloadStream *stream = (struct DownloadStream *) user_data;
+  return_if(stream->offset == stream->buffer->length);
+  stream->n_pending--;
+  return_if(stream->n_pending > 0);
+  should (DownloadStream__pump(stream) == 0) otherwise {
+    // the body can only be cut short
+    soup_message_body_complete(msg->response_body);
+  }
+  soup_server_unpause_message(stream->server, msg);
+}
+
+
+/**
+ * @memberof DownloadStream
+ * @brief Callback when the response has been sent, or the client goes away.
+ *
+ * @param msg a SoupMessage
+ * @param user_data a DownloadStream
+ */
+static void DownloadStream_finished (SoupMessage *msg, gpointer user_data) {
+  DownloadStream_free((struct DownloadStream *) user_data);
+}
+
+
+/**
+ * @memberof DownloadStream
+ * @brief Starts a zstd-compressed chunked response of `buffer`.
+ *
+ * @param server a SoupServer
+ * @param msg a SoupMessage
+ * @param buffer the content [transfer-full]
+ * @return 0 if success, otherwize nonzero, in which case `buffer` is left
+ *         untouched
+ */
+static int DownloadStream_start (
+    SoupServer *server, SoupMessage *msg, SoupBuffer *buffer) {
+  struct DownloadStream *stream = g_new(struct DownloadStream, 1);
+  should (ZstdEncoder_init(
+      &stream->encoder, DFCC_COMPRESSION_LEVEL) == 0) otherwise {
+    g_free(stream);
+    return 1;
+  }
+  stream->server = server;
+  stream->msg = msg;
+  stream->buffer = buffer;
+  stream->offset = 0;
+  stream->n_pending = 0;
+
+  soup_message_headers_set_encoding(
+    msg->response_headers, SOUP_ENCODING_CHUNKED);
+  // sent chunks are not needed any more
+  soup_message_body_set_accumulate(msg->response_body, FALSE);
+  should (DownloadStream__pump(stream) == 0) otherwise {
+    stream->buffer = NULL;
+    ZstdEncoder_destroy(&stream->encoder);
+    g_free(stream);
+    soup_message_headers_set_encoding(
+      msg->response_headers, SOUP_ENCODING_CONTENT_LENGTH);
+    soup_message_body_truncate(msg->response_body);
+    soup_message_body_set_accumulate(msg->response_body, TRUE);
+    return 1;
+  }
+  g_signal_connect(
+    msg, "wrote-chunk", G_CALLBACK(DownloadStream_wrote_chunk), stream);
+  g_signal_connect(
+    msg, "finished", G_CALLBACK(DownloadStream_finished), stream);
+  return 0;
+}
+
+
 void Server_handle_download (
     SoupServer *server, SoupMessage *msg, const char *path, GHashTable *query,
     SoupClientContext *context, gpointer user_data) {
   SOUP_HANDLER_MIDDLEWARE(Server_handle_download, false, true);
 
-  do_once {
-    const char *s_token =
-      path + server_ctx->config->base_path_len +
-      strlen(SOUP_HANDLER_PATH(Server_handle_download));
-    FileHash hash = FileHash_from_string(s_token);
-    break_if_fail(hash != 0);
-    //g_hash_table_lookup(server_ctx->jobs, &hash);
+  // only GET and HEAD allowed
+  if unlikely (msg->method != SOUP_METHOD_GET &&
+               msg->method != SOUP_METHOD_HEAD) {
+    soup_message_set_status(msg, SOUP_STATUS_METHOD_NOT_ALLOWED);
+    return;
   }
 
-  soup_xmlrpc_message_set_fault(msg, 1, "err");
+  const char *s_token =
+    path + server_ctx->config->base_path_len +
+    strlen(SOUP_HANDLER_PATH(Server_handle_download));
+  FileHash hash = FileHash_from_string(s_token);
+  should (hash != 0) otherwise {
+    soup_message_set_status(msg, SOUP_STATUS_BAD_REQUEST);
+    return;
+  }
+
+  GError *error = NULL;
+  struct Cache *cache = &server_ctx->session_manager.cache;
+  struct CacheEntry *entry = Cache_get(cache, hash, &error);
+  should (entry != NULL) otherwise {
+    if (error != NULL) {
+      g_log(DFCC_SERVER_NAME, G_LOG_LEVEL_WARNING,
+            "Cannot look up %s: %s", s_token, error->message);
+      g_error_free(error);
+    }
+    soup_message_set_status(msg, SOUP_STATUS_NOT_FOUND);
+    return;
+  }
+
+  // blobs are content-addressed, so the hash is a strong validator
+  char etag[FileHash_STRLEN + 3];
+  etag[0] = '"';
+  FileHash_to_string(hash, etag + 1);
+  etag[FileHash_STRLEN + 1] = '"';
+  etag[FileHash_STRLEN + 2] = '\0';
+  soup_message_headers_replace(msg->response_headers, "ETag", etag);
+  soup_message_headers_replace(
+    msg->response_headers, "Accept-Ranges", "bytes");
+
+  const char *if_none_match = soup_message_headers_get_list(
+    msg->request_headers, "If-None-Match");
+  if (if_none_match != NULL && Server__etag_match(if_none_match, etag)) {
+    CacheEntry_unref(entry);
+    soup_message_set_status(msg, SOUP_STATUS_NOT_MODIFIED);
+    return;
+  }
+
+  GBytes *bytes = Cache_read(cache, entry, &error);
+  CacheEntry_unref(entry);
+  should (bytes != NULL) otherwise {
+    if (error == NULL) {
+      // removed in the meantime
+      soup_message_set_status(msg, SOUP_STATUS_NOT_FOUND);
+      return;
+    }
+    g_log(DFCC_SERVER_NAME, G_LOG_LEVEL_WARNING,
+          "Cannot open %s: %s", s_token, error->message);
+    g_error_free(error);
+    soup_message_set_status(msg, SOUP_STATUS_INTERNAL_SERVER_ERROR);
+    return;
+  }
+  // the buffer keeps the content alive until the response is sent
+  gsize length;
+  gconstpointer data = g_bytes_get_data(bytes, &length);
+  SoupBuffer *buffer = soup_buffer_new_with_owner(
+    data, length, bytes, (GDestroyNotify) g_bytes_unref);
+  guint status = SOUP_STATUS_OK;
+
+  const char *range = soup_message_headers_get_one(
+    msg->request_headers, "Range");
+  const char *if_range = soup_message_headers_get_one(
+    msg->request_headers, "If-Range");
+  if (range != NULL && (if_range == NULL || strcmp(if_range, etag) == 0)) {
+    goffset start;
+    goffset end;
+    switch (Server__parse_range(range, buffer->length, &start, &end)) {
+      case 0: {
+        SoupBuffer *subbuffer = soup_buffer_new_subbuffer(
+          buffer, start, end - start + 1);
+        soup_buffer_free(buffer);
+        buffer = subbuffer;
+        soup_message_headers_set_content_range(
+          msg->response_headers, start, end, length);
+        status = SOUP_STATUS_PARTIAL_CONTENT;
+        break;
+      }
+      case -1: {
+        char content_range[32];
+        snprintf(content_range, sizeof(content_range),
+                 "bytes */%zu", length);
+        soup_message_headers_replace(
+          msg->response_headers, "Content-Range", content_range);
+        soup_buffer_free(buffer);
+        soup_message_set_status(
+          msg, SOUP_STATUS_REQUESTED_RANGE_NOT_SATISFIABLE);
+        return;
+      }
+    }
+  }
+
+  soup_message_headers_set_content_type(
+    msg->response_headers, "application/octet-stream", NULL);
+  if (status == SOUP_STATUS_OK && msg->method == SOUP_METHOD_GET &&
+      buffer->length >= DFCC_COMPRESSION_MIN_SIZE &&
+      soup_message_headers_accepts_encoding(
+        msg->request_headers, ZSTD_CONTENT_ENCODING) &&
+      DownloadStream_start(server, msg, buffer) == 0) {
+    // the encoded representation differs byte-wise
+    char weak_etag[sizeof(etag) + 2] = "W/";
+    strcpy(weak_etag + 2, etag);
+    soup_message_headers_replace(msg->response_headers, "ETag", weak_etag);
+    soup_message_headers_replace(
+      msg->response_headers, "Content-Encoding", ZSTD_CONTENT_ENCODING);
+  } else {
+    soup_message_body_append_buffer(msg->response_body, buffer);
+    soup_buffer_free(buffer);
+  }
+  soup_message_set_status(msg, status);
 }
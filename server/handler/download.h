@@ -6,7 +6,7 @@
 
 /**
  * @ingroup ServerHandler
- * @brief Processes download (PUT) requests of object files.
+ * @brief Processes download (GET) requests of object files.
  *
  * @param server the SoupServer
  * @param msg the message being processed
@@ -0,0 +1,198 @@
+#include <libsoup/soup.h>
+
+#include "common/macro.h"
+#include "common/wrapper/gvariant.h"
+#include "../protocol.h"
+#include "../log.h"
+#include "rpc/query.h"
+#include "middleware.h"
+#include "events.h"
+
+
+const char SOUP_HANDLER_PATH(Server_handle_events)[] = DFCC_EVENTS_PATH;
+
+
+/**
+ * @ingroup ServerHandler
+ * @brief Contains the information of a subscribed event stream.
+ */
+struct EventStream {
+  SoupServer *server;
+  SoupMessage *msg;
+  struct Session *session;
+  /// number of frames appended but not yet written
+  unsigned int n_pending;
+};
+
+
+/**
+ * @brief Userdata for Server_events__push.
+ *
+ * The session is looked up again at push time, since it may have been expired
+ * in the meantime.
+ */
+struct EventPushContext {
+  struct HookedProcessGroupManager *manager;
+  HookedProcessGroupID hgid;
+  GBytes *frame;
+};
+
+
+/**
+ * @memberof EventStream
+ * @brief Callback when the client goes away.
+ *
+ * @param msg a SoupMessage
+ * @param user_data an EventStream
+ */
+static void EventStream_finished (SoupMessage *msg, gpointer user_data) {
+  struct EventStream *stream = (struct EventStream *) user_data;
+  g_log(DFCC_SERVER_NAME, G_LOG_LEVEL_DEBUG,
+        "Event stream of session %x closed", stream->session->hgid);
+  // may have been dropped already
+  g_ptr_array_remove_fast(stream->session->listeners, stream);
+  Session_touch(stream->session);
+  Session_disconnect(stream->session);
+  g_free(stream);
+}
+
+
+/**
+ * @memberof EventStream
+ * @brief Callback when a frame has been written to the client.
+ *
+ * @param msg a SoupMessage
+ * @param user_data an EventStream
+ */
+static void EventStream_wrote_chunk (SoupMessage *msg, gpointer user_data) {
+  struct EventStream *stream = (struct EventStream *) user_data;
+  return_if_fail(stream->n_pending > 0);
+  stream->n_pending--;
+}
+
+
+/**
+ * @memberof EventStream
+ * @brief Appends a frame to an event stream.
+ *
+ * If the client does not keep up and more than @ref DFCC_EVENTS_MAX_BACKLOG
+ * frames are queued, the stream is closed and removed from the listeners of
+ * the session; the client falls back to polling.
+ *
+ * @param stream an EventStream
+ * @param frame frame to append
+ * @return `true` if the stream is still alive
+ */
+static bool EventStream_push (struct EventStream *stream, GBytes *frame) {
+  SoupMessageBody *body = stream->msg->response_body;
+  if unlikely (stream->n_pending >= DFCC_EVENTS_MAX_BACKLOG) {
+    g_log(DFCC_SERVER_NAME, G_LOG_LEVEL_INFO,
+          "Event stream of session %x too slow, dropped",
+          stream->session->hgid);
+    soup_message_body_complete(body);
+    soup_server_unpause_message(stream->server, stream->msg);
+    return false;
+  }
+  soup_message_body_append_bytes(body, frame);
+  stream->n_pending++;
+  soup_server_unpause_message(stream->server, stream->msg);
+  return true;
+}
+
+
+/**
+ * @brief Appends a frame to all event streams of a session.
+ *
+ * Runs in the main context.
+ *
+ * @param user_data an EventPushContext
+ * @return `G_SOURCE_REMOVE`
+ */
+static gboolean Server_events__push (gpointer user_data) {
+  struct EventPushContext *ctx = (struct EventPushContext *) user_data;
+  // sessions are only expired in the main context
+  struct Session *session = (struct Session *)
+    HookedProcessGroupManager_lookup(ctx->manager, ctx->hgid);
+  if likely (session != NULL) {
+    for (guint i = 0; i < session->listeners->len;) {
+      struct EventStream *stream = g_ptr_array_index(session->listeners, i);
+      if likely (EventStream_push(stream, ctx->frame)) {
+        i++;
+      } else {
+        g_ptr_array_remove_index_fast(session->listeners, i);
+      }
+    }
+  }
+  g_bytes_unref(ctx->frame);
+  g_free(ctx);
+  return G_SOURCE_REMOVE;
+}
+
+
+void Server_events_emit (
+    struct Session *session, GPid jid, guchar event, GVariant *status) {
+  struct EventPushContext *ctx = g_new(struct EventPushContext, 1);
+  ctx->manager = session->manager;
+  ctx->hgid = session->hgid;
+  ctx->frame = g_variant_to_frame(g_variant_new(
+    "(uy@" DFCC_RPC_QUERY_RESPONSE_SIGNATURE ")", (guint32) jid, event, status));
+  g_main_context_invoke(NULL, Server_events__push, ctx);
+}
+
+
+void Server_events_onchange (void *p_, int status) {
+  struct HookedProcess *p = (struct HookedProcess *) p_;
+  guchar event;
+  switch (status) {
+    case PROCESS_STATUS_EXIT:
+      event = DFCC_EVENT_FINISH;
+      break;
+    case HOOKEDPROCESS_FILE_MISSING:
+      event = DFCC_EVENT_MISSING;
+      break;
+    case HOOKEDPROCESS_OUTPUT:
+      event = DFCC_EVENT_OUTPUT;
+      break;
+    default:
+      return;
+  }
+  Server_events_emit(
+    (struct Session *) p->group, p->pid, event, Server_rpc_query_status(p));
+}
+
+
+void Server_handle_events (
+    SoupServer *server, SoupMessage *msg, const char *path, GHashTable *query,
+    SoupClientContext *context, gpointer user_data) {
+  SOUP_HANDLER_MIDDLEWARE(Server_handle_events, true, true);
+
+  // only GET allowed
+  if unlikely (msg->method != SOUP_METHOD_GET) {
+    soup_message_set_status(msg, SOUP_STATUS_METHOD_NOT_ALLOWED);
+    return;
+  }
+
+  struct EventStream *stream = g_new(struct EventStream, 1);
+  stream->server = server;
+  stream->msg = msg;
+  stream->session = session;
+  stream->n_pending = 0;
+  Session_connect(session);
+  g_ptr_array_add(session->listeners, stream);
+  g_signal_connect(
+    msg, "finished", G_CALLBACK(EventStream_finished), stream);
+  g_signal_connect(
+    msg, "wrote-chunk", G_CALLBACK(EventStream_wrote_chunk), stream);
+
+  soup_message_set_status(msg, SOUP_STATUS_OK);
+  soup_message_headers_set_encoding(
+    msg->response_headers, SOUP_ENCODING_CHUNKED);
+  soup_message_headers_set_content_type(
+    msg->response_headers, DFCC_EVENTS_CONTENT_TYPE, NULL);
+  // sent chunks are not needed any more
+  soup_message_body_set_accumulate(msg->response_body, FALSE);
+  soup_server_pause_message(server, msg);
+
+  g_log(DFCC_SERVER_NAME, G_LOG_LEVEL_DEBUG,
+        "Event stream of session %x opened", session->hgid);
+}
@@ -0,0 +1,52 @@
+#ifndef DFCC_SERVER_HANDLER_EVENTS_H
+#define DFCC_SERVER_HANDLER_EVENTS_H
+
+#include <glib.h>
+
+#include "spawn/hookedprocess.h"
+#include "common.h"
+
+
+/**
+ * @ingroup ServerHandler
+ * @brief Processes requests of subscribing to job events of a session.
+ *
+ * The response is a never-ending chunked stream of GVariant frames of type
+ * `DFCC_EVENT_SIGNATURE`, one for each event of any job in the session.
+ *
+ * @param server the SoupServer
+ * @param msg the message being processed
+ * @param path the path component of `msg`'s Request-URI
+ * @param query the parsed query component of `msg`'s Request-URI
+ *              [element-type utf8 utf8][allow-none]
+ * @param context additional contextual information about the client
+ * @param user_data the data passed to `soup_server_add_handler()` or
+ *                  `soup_server_add_early_handler()`.
+ */
+SOUP_HANDLER_PROTOTYPE(Server_handle_events);
+/**
+ * @ingroup ServerHandler
+ * @brief Pushes an event to all event streams of a session.
+ *
+ * May be called from any thread.
+ *
+ * @param session a Session
+ * @param jid the job ID
+ * @param event the event type, one of `DFCC_EVENT_*`
+ * @param status status of the job in `DFCC_RPC_QUERY_RESPONSE_SIGNATURE`,
+ *               consumed if floating
+ */
+void Server_events_emit (
+  struct Session *session, GPid jid, guchar event, GVariant *status);
+/**
+ * @ingroup ServerHandler
+ * @brief Callback when a job changes its status, for use as `onchange` of
+ *        HookedProcess.
+ *
+ * @param p a HookedProcess
+ * @param status the new status
+ */
+void Server_events_onchange (void *p, int status);
+
+
+#endif /* DFCC_SERVER_HANDLER_EVENTS_H */
@@ -9,6 +9,7 @@
 
 #include "common.h"
 #include "download.h"
+#include "events.h"
 #include "homepage.h"
 #include "info.h"
 #include "rpc.h"
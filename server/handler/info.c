@@ -1,5 +1,8 @@
 #include "common/macro.h"
 #include "common/wrapper/soup.h"
+#include "common/wrapper/zstd.h"
+#include "file/cache.h"
+#include "file/hash.h"
 #include "../protocol.h"
 #include "../log.h"
 #include "middleware.h"
@@ -27,6 +30,23 @@ void Server_handle_info (
                         g_variant_new_int32(server_ctx->config->jobs));
   g_variant_builder_add(&builder, "{sv}", "Current-jobs", g_variant_new_int32(
     server_ctx->config->jobs - server_ctx->session_manager.n_available));
+  g_variant_builder_add(&builder, "{sv}", "Compression",
+                        g_variant_new_string(ZSTD_CONTENT_ENCODING));
+  g_variant_builder_add(&builder, "{sv}", "Hash", g_variant_new_string(
+    FileHash_algorithm_names[FileHash_algorithm]));
+
+  struct Cache *cache = &server_ctx->session_manager.cache;
+  g_mutex_lock(&cache->hot_mtx);
+  guint64 hot_hits = cache->hot_hits;
+  guint64 hot_misses = cache->hot_misses;
+  guint64 hot_size = cache->hot_size;
+  g_mutex_unlock(&cache->hot_mtx);
+  g_variant_builder_add(&builder, "{sv}", "Cache-hot-hits",
+                        g_variant_new_uint64(hot_hits));
+  g_variant_builder_add(&builder, "{sv}", "Cache-hot-misses",
+                        g_variant_new_uint64(hot_misses));
+  g_variant_builder_add(&builder, "{sv}", "Cache-hot-size",
+                        g_variant_new_uint64(hot_size));
   soup_xmlrpc_message_set_response_e(
     msg, g_variant_builder_end(&builder), DFCC_SERVER_NAME);
 }
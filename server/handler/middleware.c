@@ -10,6 +10,7 @@
 #include "common/macro.h"
 #include "common/morestring.h"
 #include "common/wrapper/soup.h"
+#include "common/wrapper/zstd.h"
 #include "../debug.h"
 #include "../protocol.h"
 #include "middleware.h"
@@ -41,6 +42,10 @@ struct Session *Server_handle_middleware (
     SoupServer *server, SoupMessage *msg, const char *path, GHashTable *query,
     SoupClientContext *context, struct ServerContext *server_ctx,
     bool proper_required, int prefix_len) {
+  // advertise supported request content codings (RFC 7694)
+  soup_message_headers_replace(
+    msg->response_headers, "Accept-Encoding", ZSTD_CONTENT_ENCODING);
+
   // check for proper path
   if (proper_required) {
     should (Server_is_path_proper(server_ctx, path, prefix_len)) otherwise {
@@ -1,6 +1,7 @@
 #include <libsoup/soup.h>
 
 #include "common/macro.h"
+#include "common/wrapper/gvariant.h"
 #include "common/wrapper/soup.h"
 #include "../protocol.h"
 #include "../debug.h"
@@ -9,6 +10,7 @@
 #include "../session.h"
 #include "middleware.h"
 #include "rpc/associate.h"
+#include "rpc/cancel.h"
 #include "rpc/query.h"
 #include "rpc/submit.h"
 #include "rpc.h"
@@ -30,6 +32,7 @@ static const struct ServerRPCTable rpcs[] = {
   {DFCC_RPC_SUBMIT_METHOD_NAME, DFCC_RPC_SUBMIT_REQUEST_SIGNATURE, Server_rpc_submit, NULL},
   {DFCC_RPC_ASSOCIATE_METHOD_NAME, DFCC_RPC_ASSOCIATE_REQUEST_SIGNATURE, Server_rpc_associate, NULL},
   {DFCC_RPC_QUERY_METHOD_NAME, DFCC_RPC_QUERY_REQUEST_SIGNATURE, Server_rpc_query, NULL},
+  {DFCC_RPC_CANCEL_METHOD_NAME, DFCC_RPC_CANCEL_REQUEST_SIGNATURE, Server_rpc_cancel, NULL},
 };
 
 
@@ -43,56 +46,125 @@ static inline int Server__find_method_name (const char *method_name) {
 }
 
 
-void Server_handle_rpc (
-    SoupServer *server, SoupMessage *msg, const char *path, GHashTable *query,
-    SoupClientContext *context, gpointer user_data) {
-  SOUP_HANDLER_MIDDLEWARE(Server_handle_rpc, true, true);
+/**
+ * @brief Parses a XML-RPC request.
+ *
+ * @param msg the message being processed
+ * @param[out] method_index index of the method in the table
+ * @return the parameters, or `NULL` if error happened, in which case a fault
+ *         is set as the response
+ */
+static GVariant *Server_parse_rpc_xml (SoupMessage *msg, int *method_index) {
+  GError *error = NULL;
+  SoupXMLRPCParams *xmlrpc_params;
+  char *method_name = soup_xmlrpc_parse_request(
+    msg->request_body->data, msg->request_body->length,
+    &xmlrpc_params, &error);
+  should (method_name != NULL) otherwise {
+    soup_xmlrpc_message_log_and_set_fault(
+      msg, 1, DFCC_SERVER_NAME, G_LOG_LEVEL_WARNING,
+      "Error when parsing XMLRPC request: %s", error->message);
+    g_error_free(error);
+    return NULL;
+  }
 
-  // only POST allowed
-  if unlikely (msg->method != SOUP_METHOD_POST) {
-    soup_message_set_status(msg, SOUP_STATUS_METHOD_NOT_ALLOWED);
-    return;
+  *method_index = Server__find_method_name(method_name);
+  should (*method_index != -1) otherwise {
+    soup_xmlrpc_message_log_and_set_fault(
+      msg, 1, DFCC_SERVER_NAME, G_LOG_LEVEL_WARNING,
+      "Unknown XMLRPC request: %s", method_name);
+    g_free(method_name);
+    soup_xmlrpc_params_free(xmlrpc_params);
+    return NULL;
   }
+  g_free(method_name);
+
+  GVariant *param = soup_xmlrpc_params_parse(
+    xmlrpc_params, rpcs[*method_index].signature, &error);
+  soup_xmlrpc_params_free(xmlrpc_params);
+  should (param != NULL) otherwise {
+    soup_xmlrpc_message_log_and_set_fault(
+      msg, 1, DFCC_SERVER_NAME, G_LOG_LEVEL_WARNING,
+      "Error when parsing XMLRPC params: %s", error->message);
+    g_error_free(error);
+    return NULL;
+  }
+  return param;
+}
 
+
+/**
+ * @brief Parses a binary RPC request.
+ *
+ * @param msg the message being processed
+ * @param[out] method_index index of the method in the table
+ * @return the parameters, or `NULL` if error happened, in which case a fault
+ *         is set as the response
+ * @sa SOUP_RPC_BINARY_CONTENT_TYPE
+ */
+static GVariant *Server_parse_rpc_binary (
+    SoupMessage *msg, int *method_index) {
   GError *error = NULL;
+  GVariant *request = g_variant_from_frame(
+    msg->request_body->data, msg->request_body->length,
+    G_VARIANT_TYPE("(sv)"), &error);
+  should (request != NULL) otherwise {
+    soup_rpc_message_log_and_set_fault(
+      msg, 1, DFCC_SERVER_NAME, G_LOG_LEVEL_WARNING,
+      "Error when parsing binary RPC request: %s", error->message);
+    g_error_free(error);
+    return NULL;
+  }
+
+  const char *method_name;
+  GVariant *param;
+  g_variant_get(request, "(&sv)", &method_name, &param);
+
   do_once {
-    SoupXMLRPCParams *xmlrpc_params;
-    char *method_name = soup_xmlrpc_parse_request(
-      msg->request_body->data, msg->request_body->length,
-      &xmlrpc_params, &error);
-    should (method_name != NULL) otherwise {
-      soup_xmlrpc_message_log_and_set_fault(
+    *method_index = Server__find_method_name(method_name);
+    should (*method_index != -1) otherwise {
+      soup_rpc_message_log_and_set_fault(
         msg, 1, DFCC_SERVER_NAME, G_LOG_LEVEL_WARNING,
-        "Error when parsing XMLRPC request: %s", error->message);
+        "Unknown binary RPC request: %s", method_name);
       break;
     }
-
-    int method_index = Server__find_method_name(method_name);
-    should (method_index != -1) otherwise {
-      soup_xmlrpc_message_log_and_set_fault(
+    should (g_variant_is_of_type(
+        param, G_VARIANT_TYPE(rpcs[*method_index].signature))) otherwise {
+      soup_rpc_message_log_and_set_fault(
         msg, 1, DFCC_SERVER_NAME, G_LOG_LEVEL_WARNING,
-        "Unknown XMLRPC request: %s", method_name);
-      g_free(method_name);
+        "Error when parsing binary RPC params: expect type '%s', got '%s'",
+        rpcs[*method_index].signature, g_variant_get_type_string(param));
       break;
     }
-    g_free(method_name);
 
-    GVariant *xmlrpc_variant = soup_xmlrpc_params_parse(
-      xmlrpc_params, rpcs[method_index].signature, &error);
-    soup_xmlrpc_params_free(xmlrpc_params);
-    should (xmlrpc_variant != NULL) otherwise {
-      soup_xmlrpc_message_log_and_set_fault(
-        msg, 1, DFCC_SERVER_NAME, G_LOG_LEVEL_WARNING,
-        "Error when parsing XMLRPC params: %s", error->message);
-      break;
-    }
+    g_variant_unref(request);
+    return param;
+  }
+
+  g_variant_unref(param);
+  g_variant_unref(request);
+  return NULL;
+}
 
-    rpcs[method_index].handler(server_ctx, session, msg, xmlrpc_variant);
-    Server_Debug_request_response(msg, path);
+
+void Server_handle_rpc (
+    SoupServer *server, SoupMessage *msg, const char *path, GHashTable *query,
+    SoupClientContext *context, gpointer user_data) {
+  SOUP_HANDLER_MIDDLEWARE(Server_handle_rpc, true, true);
+
+  // only POST allowed
+  if unlikely (msg->method != SOUP_METHOD_POST) {
+    soup_message_set_status(msg, SOUP_STATUS_METHOD_NOT_ALLOWED);
     return;
   }
 
-  if (error != NULL) {
-    g_error_free(error);
-  }
+  // the encoding is chosen by Content-Type
+  int method_index;
+  GVariant *param = soup_message_is_binary_rpc(msg) ?
+    Server_parse_rpc_binary(msg, &method_index) :
+    Server_parse_rpc_xml(msg, &method_index);
+  return_if_fail(param != NULL);
+
+  rpcs[method_index].handler(server_ctx, session, msg, param);
+  Server_Debug_request_response(msg, path);
 }
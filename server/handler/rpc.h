@@ -6,7 +6,7 @@
 
 /**
  * @ingroup ServerHandler
- * @brief Processes XMLRPC requests.
+ * @brief Processes RPC requests, encoded in either XML-RPC or binary GVariant.
  *
  * @param server the SoupServer
  * @param msg the message being processed
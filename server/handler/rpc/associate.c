@@ -9,15 +9,13 @@
 #include "associate.h"
 
 
-void Server_rpc_associate (
-    struct ServerContext *server_ctx, struct Session *session,
-    SoupMessage *msg, GVariant *param) {
+void Server_associate_files (
+    struct Session *session, GVariant *filelist, bool force) {
   GVariantIter iter;
   gchar *path;
-  size_t size;
   FileHash hash;
-  for (g_variant_iter_init(&iter, param);
-       g_variant_iter_next(&iter, "{s(tt)}", &path, &size, &hash);) {
+  for (g_variant_iter_init(&iter, filelist);
+       g_variant_iter_next(&iter, "{st}", &path, &hash);) {
     if unlikely (!g_path_is_absolute(path)) {
       //warn
       g_free(path);
@@ -27,13 +25,21 @@ void Server_rpc_associate (
     struct FileTag *tag = g_new(struct FileTag, 1);
     FileTag_init_with_hash(tag, path, hash);
     should (RemoteFileIndex_add(
-        &((struct HookedProcessGroup *) session)->file_index, tag, false)
+        &((struct HookedProcessGroup *) session)->file_index, tag, force)
     ) otherwise {
       FileTag_destroy(tag);
       g_free(tag);
       g_free(path);
     }
   }
+}
 
+
+void Server_rpc_associate (
+    struct ServerContext *server_ctx, struct Session *session,
+    SoupMessage *msg, GVariant *param) {
+  Server_associate_files(session, param, false);
   g_variant_unref(param);
+  soup_rpc_message_set_response_e(
+    msg, g_variant_new_boolean(TRUE), DFCC_SERVER_NAME);
 }
@@ -14,6 +14,16 @@
  * @param param a GVariant
  */
 DFCC_RPC_HANDLER(Server_rpc_associate);
+/**
+ * @ingroup ServerRPCHandler
+ * @brief Maps file paths to hashes in the file index of a session.
+ *
+ * @param session a Session
+ * @param filelist a GVariant of type `DFCC_RPC_ASSOCIATE_REQUEST_SIGNATURE`
+ * @param force whether to replace existing mappings
+ */
+void Server_associate_files (
+  struct Session *session, GVariant *filelist, bool force);
 
 
 #endif /* DFCC_SERVER_HANDLER_RPC_ASSOCIATE_H */
@@ -0,0 +1,42 @@
+#include <signal.h>
+
+#include <libsoup/soup.h>
+
+#include "common/macro.h"
+#include "common/wrapper/soup.h"
+#include "common/wrapper/threads.h"
+#include "../../protocol.h"
+#include "../../log.h"
+#include "cancel.h"
+
+
+void Server_rpc_cancel (
+    struct ServerContext *server_ctx, struct Session *session,
+    SoupMessage *msg, GVariant *param) {
+  GPid pid;
+  g_variant_get(param, DFCC_RPC_CANCEL_REQUEST_SIGNATURE, &pid);
+  g_variant_unref(param);
+
+  struct HookedProcess *p = HookedProcessGroup_lookup(
+    (struct HookedProcessGroup *) session, pid);
+  should (p != NULL) otherwise {
+    soup_message_set_status(msg, SOUP_STATUS_NOT_FOUND);
+    soup_rpc_message_set_fault(msg, 0, "JID %d not found", pid);
+    return;
+  }
+
+  gboolean killed = FALSE;
+
+  CRITICAL_SECTIONS_START(&p->mtx, event);
+
+  if (!p->stopped) {
+    g_log(DFCC_SERVER_NAME, G_LOG_LEVEL_DEBUG,
+          "Cancel job %" G_PID_FORMAT " of session %x", pid, session->hgid);
+    killed = Process_signal((struct Process *) p, SIGKILL) == 0;
+  }
+
+  CRITICAL_SECTIONS_END(&p->mtx, event);
+
+  soup_rpc_message_set_response_e(
+    msg, g_variant_new_boolean(killed), DFCC_SERVER_NAME);
+}
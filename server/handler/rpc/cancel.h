@@ -0,0 +1,21 @@
+#ifndef DFCC_SERVER_HANDLER_RPC_CANCEL_H
+#define DFCC_SERVER_HANDLER_RPC_CANCEL_H
+
+#include "common.h"
+
+
+/**
+ * @ingroup ServerRPCHandler
+ * @brief Processes XMLRPC requests of cancelling a compiling job.
+ *
+ * The compiler is killed, and its job slot is released once it exits.
+ *
+ * @param server_ctx a ServerContext
+ * @param session a Session
+ * @param msg a SoupMessage
+ * @param param a GVariant
+ */
+DFCC_RPC_HANDLER(Server_rpc_cancel);
+
+
+#endif /* DFCC_SERVER_HANDLER_RPC_CANCEL_H */
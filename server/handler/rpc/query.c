@@ -13,9 +13,29 @@ struct QueryCallbackContext {
   struct ServerContext *server_ctx;
   struct Session *session;
   SoupMessage *msg;
+  /// Previous callback of the job, to be chained.
+  ProcessOnchangeCallback onchange;
+  /// Previous user data of the job.
+  void *userdata;
 };
 
 
+GVariant *Server_rpc_query_status (struct HookedProcess *p) {
+  GVariant *filelist;
+  if (p->finished) {
+    // outputs, and an empty ResultInfo
+    filelist = g_variant_new(
+      "(@a{st}a{sv})", p->filelist != NULL ? p->filelist :
+        g_variant_new_array(G_VARIANT_TYPE("{st}"), NULL, 0),
+      NULL);
+  } else {
+    filelist = g_variant_new_array(G_VARIANT_TYPE("{st}"), NULL, 0);
+  }
+  return g_variant_new(
+    DFCC_RPC_QUERY_RESPONSE_SIGNATURE, p->finished, filelist);
+}
+
+
 /**
  * @brief Processes XMLRPC requests of nonblockingly querying status of
  *        compiling jobs.
@@ -23,16 +43,8 @@ struct QueryCallbackContext {
 static void Server_rpc_query_response (
     struct ServerContext *server_ctx, struct Session *session,
     SoupMessage *msg, struct HookedProcess *p) {
-  GVariant *filelist;
-  if (p->stopped) {
-    GVariant *outputs;
-    GVariant *info;
-    filelist = g_variant_new_boolean(p->stopped);
-  } else {
-    filelist = g_variant_new_boolean(p->stopped);
-  }
-  soup_xmlrpc_message_set_response_e(msg, g_variant_new(
-    DFCC_RPC_QUERY_RESPONSE_SIGNATURE, p->stopped, filelist), DFCC_SERVER_NAME);
+  soup_rpc_message_set_response_e(
+    msg, Server_rpc_query_status(p), DFCC_SERVER_NAME);
 }
 
 
@@ -40,9 +52,25 @@ static void Server_rpc_query_callback (void *p_, int status) {
   struct HookedProcess *p = (struct HookedProcess *) p_;
   struct QueryCallbackContext *cb_ctx =
     (struct QueryCallbackContext *) p->userdata;
+
+  // restore the previous callback, so that it sees its own user data
+  p->onchange_hooked = cb_ctx->onchange;
+  p->userdata = cb_ctx->userdata;
+  if (p->onchange_hooked != NULL) {
+    p->onchange_hooked(p, status);
+  }
+
+  if (status == HOOKEDPROCESS_OUTPUT) {
+    // not interesting for the query, keep waiting
+    p->onchange_hooked = Server_rpc_query_callback;
+    p->userdata = cb_ctx;
+    return;
+  }
+
   Server_rpc_query_response(
     cb_ctx->server_ctx, cb_ctx->session, cb_ctx->msg, p);
   soup_server_unpause_message(cb_ctx->server_ctx->server, cb_ctx->msg);
+  g_free(cb_ctx);
 }
 
 
@@ -57,19 +85,21 @@ void Server_rpc_query (
     (struct HookedProcessGroup *) session, pid);
   should (p != NULL) otherwise {
     soup_message_set_status(msg, SOUP_STATUS_NOT_FOUND);
-    soup_xmlrpc_message_set_fault(msg, 0, "JID %d not found", pid);
+    soup_rpc_message_set_fault(msg, 0, "JID %d not found", pid);
     return;
   }
 
   CRITICAL_SECTIONS_START(&p->mtx, event);
 
-  if (p->stopped || nonblocking) {
+  if (p->finished || nonblocking) {
     Server_rpc_query_response(server_ctx, session, msg, p);
   } else {
     struct QueryCallbackContext *cb_ctx = g_new(struct QueryCallbackContext, 1);
     cb_ctx->server_ctx = server_ctx;
     cb_ctx->session = session;
     cb_ctx->msg = msg;
+    cb_ctx->onchange = p->onchange_hooked;
+    cb_ctx->userdata = p->userdata;
     p->userdata = cb_ctx;
     p->onchange_hooked = Server_rpc_query_callback;
     soup_server_pause_message(server_ctx->server, msg);
@@ -1,6 +1,7 @@
 #ifndef DFCC_SERVER_HANDLER_RPC_QUERY_H
 #define DFCC_SERVER_HANDLER_RPC_QUERY_H
 
+#include "spawn/hookedprocess.h"
 #include "common.h"
 
 
@@ -14,6 +15,16 @@
  * @param param a GVariant
  */
 DFCC_RPC_HANDLER(Server_rpc_query);
+/**
+ * @ingroup ServerRPCHandler
+ * @brief Gets the current status of a compiling job.
+ *
+ * The caller must hold the mutex of `p`.
+ *
+ * @param p a HookedProcess
+ * @return a floating GVariant of type `DFCC_RPC_QUERY_RESPONSE_SIGNATURE`
+ */
+GVariant *Server_rpc_query_status (struct HookedProcess *p);
 
 
 #endif /* DFCC_SERVER_HANDLER_RPC_QUERY_H */
@@ -1,9 +1,15 @@
+#include <string.h>
+
 #include <libsoup/soup.h>
 
 #include "common/macro.h"
 #include "common/wrapper/soup.h"
+#include "file/hash.h"
+#include "file/resultcache.h"
 #include "../../protocol.h"
 #include "../../log.h"
+#include "../events.h"
+#include "associate.h"
 #include "submit.h"
 
 
@@ -13,18 +19,63 @@ void Server_rpc_submit (
   char **cc_argv;
   char **cc_envp;
   const char *cc_working_directory;
-  GVariantIter *settings_iter;
-  g_variant_get(param, "(^a&s^a&s&sa{sv})",
-                &cc_argv, &cc_envp, &cc_working_directory, &settings_iter);
+  GVariant *settings;
+  g_variant_get(param, "(^a&s^a&s&s@a{sv})",
+                &cc_argv, &cc_envp, &cc_working_directory, &settings);
 
+  // hashes of the client are meaningless under another algorithm
+  const char *hash_algorithm = FileHash_algorithm_names[FileHash_XXH64];
+  g_variant_lookup(
+    settings, DFCC_RPC_SUBMIT_SETTING_HASH, "&s", &hash_algorithm);
+  should (strcmp(
+      hash_algorithm, FileHash_algorithm_names[FileHash_algorithm]) == 0
+  ) otherwise {
+    g_log(DFCC_SERVER_NAME, G_LOG_LEVEL_INFO,
+          "Session %x uses hash algorithm '%s', but we use '%s'",
+          session->hgid, hash_algorithm,
+          FileHash_algorithm_names[FileHash_algorithm]);
+    soup_rpc_message_set_fault(
+      msg, 0, "Hash algorithm '%s' not supported", hash_algorithm);
+    g_free(cc_argv);
+    g_free(cc_envp);
+    g_variant_unref(settings);
+    g_variant_unref(param);
+    return;
+  }
+
+  // files known in advance, so that the job need not ask for them
+  GVariantIter settings_iter;
+  const char *key;
+  GVariant *value;
+  g_variant_iter_init(&settings_iter, settings);
+  while (g_variant_iter_loop(&settings_iter, "{&sv}", &key, &value)) {
+    if (strcmp(key, DFCC_RPC_SUBMIT_SETTING_FILES) == 0 &&
+        g_variant_is_of_type(value, G_VARIANT_TYPE(
+          DFCC_RPC_ASSOCIATE_REQUEST_SIGNATURE))) {
+      Server_associate_files(session, value, true);
+    }
+  }
+
+  // identical jobs which read the same files need not run again
+  FileHash result_key = HookedProcessGroup_job_key(
+    (struct HookedProcessGroup *) session, cc_argv, cc_envp,
+    cc_working_directory);
   GError *error = NULL;
-  struct HookedProcess *p = HookedProcessGroup_new_job(
-    (struct HookedProcessGroup *) session, cc_argv, cc_envp, NULL, NULL, &error);
+  struct HookedProcess *p = HookedProcessGroup_new_cached_job(
+    (struct HookedProcessGroup *) session, result_key);
+  if (p == NULL) {
+    p = HookedProcessGroup_new_job(
+      (struct HookedProcessGroup *) session, cc_argv, cc_envp,
+      Server_events_onchange, NULL, &error);
+    if (p != NULL) {
+      p->result_key = result_key;
+    }
+  }
   should (p != NULL) otherwise {
     g_log(DFCC_SERVER_NAME, G_LOG_LEVEL_INFO,
           "Cannot create job for session %x: %s",
           session->hgid, error->message);
-    soup_xmlrpc_message_set_fault(msg, 0, error->message);
+    soup_rpc_message_set_fault(msg, 0, "%s", error->message);
     if (error->domain == DFCC_SPAWN_ERROR &&
         SOUP_STATUS_IS_SERVER_ERROR(error->code)) {
       soup_message_set_status(msg, error->code);
@@ -34,10 +85,10 @@ void Server_rpc_submit (
 
   g_free(cc_argv);
   g_free(cc_envp);
-  g_variant_iter_free(settings_iter);
+  g_variant_unref(settings);
   g_variant_unref(param);
 
   return_if_fail(p != NULL);
-  soup_xmlrpc_message_set_response_e(
+  soup_rpc_message_set_response_e(
     msg, g_variant_new_uint32(p->pid), DFCC_SERVER_NAME);
 }
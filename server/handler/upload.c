@@ -1,5 +1,9 @@
+#include <string.h>
+
 #include "common/macro.h"
 #include "common/wrapper/soup.h"
+#include "common/wrapper/zstd.h"
+#include "file/cache.h"
 #include "../protocol.h"
 #include "../log.h"
 #include "middleware.h"
@@ -7,6 +11,114 @@
 
 
 const char SOUP_HANDLER_PATH(Server_handle_upload)[] = DFCC_UPLOAD_PATH;
+const char SOUP_HANDLER_PATH(Server_handle_upload_bulk)[] =
+  DFCC_UPLOAD_BULK_PATH;
+
+
+/// Key of the UploadContext attached to a SoupMessage.
+#define UploadContext_KEY DFCC_NAME "-upload"
+
+
+/**
+ * @brief State of an upload request.
+ */
+struct UploadContext {
+  /// Writer of the file, or `NULL` if failed to create.
+  struct CacheWriter *writer;
+  /// Decompressor if the body is compressed, or `NULL`.
+  struct ZstdDecoder *decoder;
+  /// The first error happened.
+  GError *error;
+};
+
+
+//! @memberof UploadContext
+static void UploadContext_free (struct UploadContext *ctx) {
+  if (ctx->writer != NULL) {
+    CacheWriter_destroy(ctx->writer);
+    g_free(ctx->writer);
+  }
+  if (ctx->decoder != NULL) {
+    ZstdDecoder_destroy(ctx->decoder);
+    g_free(ctx->decoder);
+  }
+  if (ctx->error != NULL) {
+    g_error_free(ctx->error);
+  }
+  g_free(ctx);
+}
+
+
+//! @memberof UploadContext
+static struct UploadContext *UploadContext_new (struct Cache *cache) {
+  struct UploadContext *ctx = g_new(struct UploadContext, 1);
+  ctx->decoder = NULL;
+  ctx->error = NULL;
+  ctx->writer = g_new(struct CacheWriter, 1);
+  should (CacheWriter_init(ctx->writer, cache, &ctx->error) == 0) otherwise {
+    g_free(ctx->writer);
+    ctx->writer = NULL;
+  }
+  return ctx;
+}
+
+
+/**
+ * @memberof UploadContext
+ * @brief Writes a piece of (decompressed) request body.
+ *
+ * @param buf the data
+ * @param len length of `buf`
+ * @param userdata an UploadContext
+ * @return 0 if success, otherwize nonzero
+ */
+static int UploadContext_feed (const void *buf, size_t len, void *userdata) {
+  struct UploadContext *ctx = userdata;
+  return CacheWriter_write(ctx->writer, buf, len, &ctx->error);
+}
+
+
+/**
+ * @memberof UploadContext
+ * @brief Callback when a chunk of the request body arrives.
+ */
+static void UploadContext_got_chunk (
+    SoupMessage *msg, SoupBuffer *chunk, gpointer user_data) {
+  struct UploadContext *ctx = user_data;
+  return_if(ctx->error != NULL);
+
+  if (ctx->decoder != NULL) {
+    ZstdDecoder_feed(ctx->decoder, chunk->data, chunk->length,
+                     UploadContext_feed, ctx, &ctx->error);
+  } else {
+    UploadContext_feed(chunk->data, chunk->length, ctx);
+  }
+}
+
+
+void Server_prepare_upload (
+    SoupServer *server, SoupMessage *msg, const char *path, GHashTable *query,
+    SoupClientContext *context, gpointer user_data) {
+  SOUP_HANDLER_MIDDLEWARE(Server_handle_upload, true, true);
+
+  struct UploadContext *ctx =
+    UploadContext_new(&server_ctx->session_manager.cache);
+  if (ctx->error == NULL && soup_message_headers_is_encoded(
+      msg->request_headers, ZSTD_CONTENT_ENCODING)) {
+    ctx->decoder = g_new(struct ZstdDecoder, 1);
+    should (ZstdDecoder_init(ctx->decoder) == 0) otherwise {
+      g_free(ctx->decoder);
+      ctx->decoder = NULL;
+      g_set_error_literal(&ctx->error, g_quark_from_static_string(DFCC_NAME),
+                          0, "Cannot create zstd context");
+    }
+  }
+  g_object_set_data_full(
+    G_OBJECT(msg), UploadContext_KEY, ctx, (GDestroyNotify) UploadContext_free);
+  soup_message_body_set_accumulate(msg->request_body, FALSE);
+  g_signal_connect(
+    msg, "got-chunk", G_CALLBACK(UploadContext_got_chunk), ctx);
+}
 
 
 void Server_handle_upload (
@@ -14,17 +126,249 @@ void Server_handle_upload (
     SoupClientContext *context, gpointer user_data) {
   SOUP_HANDLER_MIDDLEWARE(Server_handle_upload, true, true);
 
-  GError *error = NULL;
-  struct CacheEntry *entry = Cache_index_buf(
-    &server_ctx->session_manager.cache, msg->request_body->data,
-    msg->request_body->length, &error);
-  should (error == NULL) otherwise {
-    soup_xmlrpc_message_set_fault(msg, 1, "Cannot save file: %s", error->message);
+  struct UploadContext *ctx =
+    g_object_get_data(G_OBJECT(msg), UploadContext_KEY);
+  should (ctx != NULL) otherwise {
+    soup_message_set_status(msg, SOUP_STATUS_BAD_REQUEST);
+    return;
+  }
+
+  should (ctx->error == NULL) otherwise {
+    soup_rpc_message_set_fault(
+      msg, 1, "Cannot save file: %s", ctx->error->message);
+    return;
+  }
+  should (ctx->decoder == NULL || ctx->decoder->frame_end) otherwise {
+    soup_rpc_message_set_fault(msg, 1, "Cannot decode file: Truncated");
     return;
   }
 
-  soup_xmlrpc_message_set_response_e(msg, g_variant_new(
-    DFCC_RPC_UPLOAD_RESPONSE_SIGNATURE,
-    msg->request_body->length, entry->hash), DFCC_SERVER_NAME);
+  guint64 size = ctx->writer->size;
+  struct CacheEntry *entry = CacheWriter_commit(ctx->writer, &ctx->error);
+  should (entry != NULL) otherwise {
+    soup_rpc_message_set_fault(
+      msg, 1, "Cannot save file: %s", ctx->error->message);
+    return;
+  }
+
+  soup_rpc_message_set_response_e(msg, g_variant_new(
+    DFCC_RPC_UPLOAD_RESPONSE_SIGNATURE, size, entry->hash), DFCC_SERVER_NAME);
+  CacheEntry_unref(entry);
   return;
 }
+
+
+/// Key of the UploadBulkContext attached to a SoupMessage.
+#define UploadBulkContext_KEY DFCC_NAME "-upload-bulk"
+
+
+/**
+ * @brief State of the parser of a bulk upload request.
+ */
+struct UploadBulkContext {
+  struct Cache *cache;
+
+  /// Header of the current record.
+  unsigned char header[DFCC_UPLOAD_BULK_HEADER_LENGTH];
+  /// Received length of UploadBulkContext.header.
+  unsigned int header_len;
+  /// Claimed hash of the current record.
+  FileHash hash;
+  /// Claimed length of the current record.
+  guint64 size;
+  /// Writer of the current record, or `NULL` if not started.
+  struct CacheWriter *writer;
+  /// Decompressor if the body is compressed, or `NULL`.
+  struct ZstdDecoder *decoder;
+
+  /// List of stored records.
+  GVariantBuilder builder;
+  /// The first error happened.
+  GError *error;
+};
+
+
+//! @memberof UploadBulkContext
+static void UploadBulkContext_free (struct UploadBulkContext *ctx) {
+  if (ctx->writer != NULL) {
+    CacheWriter_destroy(ctx->writer);
+    g_free(ctx->writer);
+  }
+  if (ctx->decoder != NULL) {
+    ZstdDecoder_destroy(ctx->decoder);
+    g_free(ctx->decoder);
+  }
+  g_variant_builder_clear(&ctx->builder);
+  if (ctx->error != NULL) {
+    g_error_free(ctx->error);
+  }
+  g_free(ctx);
+}
+
+
+//! @memberof UploadBulkContext
+static struct UploadBulkContext *UploadBulkContext_new (struct Cache *cache) {
+  struct UploadBulkContext *ctx = g_new(struct UploadBulkContext, 1);
+  ctx->cache = cache;
+  ctx->header_len = 0;
+  ctx->writer = NULL;
+  ctx->decoder = NULL;
+  g_variant_builder_init(
+    &ctx->builder, G_VARIANT_TYPE(DFCC_RPC_UPLOAD_BULK_RESPONSE_SIGNATURE));
+  ctx->error = NULL;
+  return ctx;
+}
+
+
+/**
+ * @memberof UploadBulkContext
+ * @brief Stores the current record into Cache.
+ *
+ * @param ctx an UploadBulkContext
+ * @return 0 if success, otherwize nonzero
+ */
+static int UploadBulkContext_commit (struct UploadBulkContext *ctx) {
+  struct CacheEntry *entry = CacheWriter_commit(ctx->writer, &ctx->error);
+  CacheWriter_destroy(ctx->writer);
+  g_free(ctx->writer);
+  ctx->writer = NULL;
+  return_if_fail(entry != NULL) 1;
+  FileHash hash = entry->hash;
+  CacheEntry_unref(entry);
+  should (hash == ctx->hash) otherwise {
+    char s_hash[FileHash_STRLEN + 1];
+    FileHash_to_string(ctx->hash, s_hash);
+    g_set_error(&ctx->error, g_quark_from_static_string(DFCC_NAME), 0,
+                "Hash mismatch for record %s", s_hash);
+    return 1;
+  }
+
+  g_variant_builder_add(&ctx->builder, "(tt)", ctx->size, hash);
+  ctx->header_len = 0;
+  return 0;
+}
+
+
+/**
+ * @memberof UploadBulkContext
+ * @brief Parses a piece of (decompressed) request body.
+ *
+ * @param buf the data
+ * @param len length of `buf`
+ * @param userdata an UploadBulkContext
+ * @return 0 if success, otherwize nonzero
+ */
+static int UploadBulkContext_feed (
+    const void *buf, size_t len, void *userdata) {
+  struct UploadBulkContext *ctx = userdata;
+  const unsigned char *p = buf;
+
+  while (len > 0 && ctx->error == NULL) {
+    if (ctx->header_len < DFCC_UPLOAD_BULK_HEADER_LENGTH) {
+      gsize n = min(len, DFCC_UPLOAD_BULK_HEADER_LENGTH - ctx->header_len);
+      memcpy(ctx->header + ctx->header_len, p, n);
+      ctx->header_len += n;
+      p += n;
+      len -= n;
+      continue_if(ctx->header_len < DFCC_UPLOAD_BULK_HEADER_LENGTH);
+
+      guint64 field;
+      memcpy(&field, ctx->header, sizeof(field));
+      ctx->hash = GUINT64_FROM_BE(field);
+      memcpy(&field, ctx->header + sizeof(field), sizeof(field));
+      ctx->size = GUINT64_FROM_BE(field);
+
+      ctx->writer = g_new(struct CacheWriter, 1);
+      should (CacheWriter_init(
+          ctx->writer, ctx->cache, &ctx->error) == 0) otherwise {
+        g_free(ctx->writer);
+        ctx->writer = NULL;
+        break;
+      }
+    }
+
+    gsize n = min(len, ctx->size - ctx->writer->size);
+    break_if_fail(CacheWriter_write(ctx->writer, p, n, &ctx->error) == 0);
+    p += n;
+    len -= n;
+    if (ctx->writer->size == ctx->size) {
+      UploadBulkContext_commit(ctx);
+    }
+  }
+
+  return ctx->error == NULL ? 0 : 1;
+}
+
+
+/**
+ * @memberof UploadBulkContext
+ * @brief Callback when a chunk of the request body arrives.
+ */
+static void UploadBulkContext_got_chunk (
+    SoupMessage *msg, SoupBuffer *chunk, gpointer user_data) {
+  struct UploadBulkContext *ctx = user_data;
+  return_if(ctx->error != NULL);
+
+  if (ctx->decoder != NULL) {
+    ZstdDecoder_feed(ctx->decoder, chunk->data, chunk->length,
+                     UploadBulkContext_feed, ctx, &ctx->error);
+  } else {
+    UploadBulkContext_feed(chunk->data, chunk->length, ctx);
+  }
+}
+
+
+void Server_prepare_upload_bulk (
+    SoupServer *server, SoupMessage *msg, const char *path, GHashTable *query,
+    SoupClientContext *context, gpointer user_data) {
+  SOUP_HANDLER_MIDDLEWARE(Server_handle_upload_bulk, true, true);
+
+  struct UploadBulkContext *ctx =
+    UploadBulkContext_new(&server_ctx->session_manager.cache);
+  if (soup_message_headers_is_encoded(
+      msg->request_headers, ZSTD_CONTENT_ENCODING)) {
+    ctx->decoder = g_new(struct ZstdDecoder, 1);
+    should (ZstdDecoder_init(ctx->decoder) == 0) otherwise {
+      g_free(ctx->decoder);
+      ctx->decoder = NULL;
+      g_set_error_literal(&ctx->error, g_quark_from_static_string(DFCC_NAME),
+                          0, "Cannot create zstd context");
+    }
+  }
+  g_object_set_data_full(
+    G_OBJECT(msg), UploadBulkContext_KEY, ctx,
+    (GDestroyNotify) UploadBulkContext_free);
+  soup_message_body_set_accumulate(msg->request_body, FALSE);
+  g_signal_connect(
+    msg, "got-chunk", G_CALLBACK(UploadBulkContext_got_chunk), ctx);
+}
+
+
+void Server_handle_upload_bulk (
+    SoupServer *server, SoupMessage *msg, const char *path, GHashTable *query,
+    SoupClientContext *context, gpointer user_data) {
+  SOUP_HANDLER_MIDDLEWARE(Server_handle_upload_bulk, true, true);
+
+  struct UploadBulkContext *ctx =
+    g_object_get_data(G_OBJECT(msg), UploadBulkContext_KEY);
+  should (ctx != NULL) otherwise {
+    soup_message_set_status(msg, SOUP_STATUS_BAD_REQUEST);
+    return;
+  }
+
+  should (ctx->error == NULL) otherwise {
+    soup_rpc_message_log_and_set_fault(
+      msg, 1, DFCC_SERVER_NAME, G_LOG_LEVEL_INFO,
+      "Cannot save file: %s", ctx->error->message);
+    return;
+  }
+  should (ctx->header_len == 0 &&
+      (ctx->decoder == NULL || ctx->decoder->frame_end)) otherwise {
+    soup_rpc_message_log_and_set_fault(
+      msg, 1, DFCC_SERVER_NAME, G_LOG_LEVEL_INFO, "Truncated record");
+    return;
+  }
+
+  soup_rpc_message_set_response_e(
+    msg, g_variant_builder_end(&ctx->builder), DFCC_SERVER_NAME);
+}
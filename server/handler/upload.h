@@ -4,6 +4,16 @@
 #include "common.h"
 
 
+/**
+ * @ingroup ServerHandler
+ * @brief Prepares upload (PUT) requests of source files.
+ *
+ * Called when the request headers arrive. The file is hashed and written into
+ * the Cache as it streams in.
+ *
+ * @sa Server_handle_upload
+ */
+SOUP_HANDLER(Server_prepare_upload);
 /**
  * @ingroup ServerHandler
  * @brief Processes upload (PUT) requests of source files.
@@ -18,6 +28,34 @@
  *                  `soup_server_add_early_handler()`.
  */
 SOUP_HANDLER_PROTOTYPE(Server_handle_upload);
+/**
+ * @ingroup ServerHandler
+ * @brief Prepares bulk upload (POST) requests of source files.
+ *
+ * Called when the request headers arrive. Records are inserted into the
+ * Cache as they stream in.
+ *
+ * @sa Server_handle_upload_bulk
+ */
+SOUP_HANDLER(Server_prepare_upload_bulk);
+/**
+ * @ingroup ServerHandler
+ * @brief Processes bulk upload (POST) requests of source files.
+ *
+ * The request body is a sequence of records. Each record is a header of
+ * @ref DFCC_UPLOAD_BULK_HEADER_LENGTH bytes (the FileHash and the length of
+ * the content), followed by the content.
+ *
+ * @param server the SoupServer
+ * @param msg the message being processed
+ * @param path the path component of `msg`'s Request-URI
+ * @param query the parsed query component of `msg`'s Request-URI
+ *              [element-type utf8 utf8][allow-none]
+ * @param context additional contextual information about the client
+ * @param user_data the data passed to `soup_server_add_handler()` or
+ *                  `soup_server_add_early_handler()`.
+ */
+SOUP_HANDLER_PROTOTYPE(Server_handle_upload_bulk);
 
 
 #endif /* DFCC_SERVER_HANDLER_UPLOAD_H */
@@ -15,6 +15,12 @@
 #define DFCC_RPC_SUBMIT_REQUEST_SIGNATURE "(asassa{sv})"
 // jid
 #define DFCC_RPC_SUBMIT_RESPONSE_SIGNATURE "u"
+// setting of source files known in advance, path -> hash as in
+// DFCC_RPC_ASSOCIATE_REQUEST_SIGNATURE
+#define DFCC_RPC_SUBMIT_SETTING_FILES "Files"
+// setting of the hash algorithm of the client, as in FileHash_algorithm_names,
+// xxh64 if absent
+#define DFCC_RPC_SUBMIT_SETTING_HASH "Hash"
 
 #define DFCC_RPC_ASSOCIATE_METHOD_NAME "associate"
 // path -> hash
@@ -32,14 +38,44 @@
 // output -> (size, hash), info -> value
 #define DFCC_RPC_QUERY_RESPONSE_FINISH_SIGNATURE "(a{st}a{sv})"
 
+#define DFCC_EVENTS_PATH "/events"
+// chunked stream of GVariant frames, see g_variant_to_frame()
+#define DFCC_EVENTS_CONTENT_TYPE "application/x-gvariant-stream"
+// jid, event, (finished, filelist) as in DFCC_RPC_QUERY_RESPONSE_SIGNATURE
+#define DFCC_EVENT_SIGNATURE "(uy(bv))"
+#define DFCC_EVENT_MAX_SIZE (16 * 1024 * 1024)
+// frames queued per stream before the server drops a slow client
+#define DFCC_EVENTS_MAX_BACKLOG 1024
+#define DFCC_EVENT_MISSING 'm'
+#define DFCC_EVENT_OUTPUT 'o'
+#define DFCC_EVENT_FINISH 'f'
+
+#define DFCC_RPC_CANCEL_METHOD_NAME "cancel"
+// jid
+#define DFCC_RPC_CANCEL_REQUEST_SIGNATURE "u"
+// killed
+#define DFCC_RPC_CANCEL_RESPONSE_SIGNATURE "b"
+
 #define DFCC_INFO_PATH "/info"
 #define DFCC_RPC_INFO_RESPONSE_SIGNATURE "a{sv}"
 
 #define DFCC_DOWNLOAD_PATH "/download/"
 
+// bodies shorter than this are sent uncompressed
+#define DFCC_COMPRESSION_MIN_SIZE 4096
+#define DFCC_COMPRESSION_LEVEL 3
+// compressed downloads are produced this many bytes of content at a time
+#define DFCC_DOWNLOAD_CHUNK_SIZE (256 * 1024)
+
 #define DFCC_UPLOAD_PATH "/upload"
 // (size hash)
 #define DFCC_RPC_UPLOAD_RESPONSE_SIGNATURE "(tt)"
 
+#define DFCC_UPLOAD_BULK_PATH "/upload/bulk"
+// records of (hash, size, data), hash and size are big-endian 64-bit integers
+#define DFCC_UPLOAD_BULK_HEADER_LENGTH 16
+// [(size hash)]
+#define DFCC_RPC_UPLOAD_BULK_RESPONSE_SIGNATURE "a(tt)"
+
 
 #endif /* DFCC_PROTOCOL_H */
@@ -78,7 +78,11 @@ int Server_start (struct Config *config) {
   ADD_HANDLER(Server_handle_homepage);
   ADD_HANDLER(Server_handle_rpc);
   ADD_HANDLER(Server_handle_upload);
+  ADD_EARLY_HANDLER(Server_handle_upload, Server_prepare_upload);
+  ADD_HANDLER(Server_handle_upload_bulk);
+  ADD_EARLY_HANDLER(Server_handle_upload_bulk, Server_prepare_upload_bulk);
   ADD_HANDLER(Server_handle_download);
+  ADD_HANDLER(Server_handle_events);
   ADD_HANDLER(Server_handle_info);
 
   // set session cleaner
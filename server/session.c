@@ -15,6 +15,7 @@ extern inline void Session_connect (struct Session *session);
 
 
 void Session_destroy (struct Session *session) {
+  g_ptr_array_free(session->listeners, TRUE);
   HookedProcessGroup_destroy((struct HookedProcessGroup *) session);
 }
 
@@ -32,6 +33,7 @@ int Session_init (
     (struct HookedProcessGroup *) session, sid, manager) == 0) 1;
   Session_touch(session);
   session->rc = 0;
+  session->listeners = g_ptr_array_new();
   session->destructor = (void (*) (void *)) Session_destroy;
   return 0;
 }
@@ -35,6 +35,13 @@ struct Session {
    *         currently using this session.
    */
   atomic_int rc;
+  /** @brief Event streams subscribed to this session.
+   *
+   * Only accessed from the main context.
+   *
+   * @sa Server_handle_events
+   */
+  GPtrArray *listeners;
 };
 
 
@@ -1,7 +1,15 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <string.h>
+
 #include <glib.h>
 
 #include "common/macro.h"
+#include "common/wrapper/mappedfile.h"
+#include "common/wrapper/threads.h"
+#include "file/cache.h"
 #include "file/hash.h"
+#include "file/resultcache.h"
 #include "log.h"
 #include "hookedprocessgroup.h"
 #include "process.h"
@@ -12,6 +20,172 @@ extern inline struct HookedProcessOutput *HookedProcessOutput_new (
   gchar *path, int mode, GError **error);
 
 
+/**
+ * @ingroup Spawn
+ * @brief Outputs of a finished job to be stored by HookedProcess_finish_func.
+ */
+struct HookedProcessFinish {
+  /// The job, only to be compared with in the main context.
+  struct HookedProcess *p;
+  struct HookedProcessGroupManager *manager;
+  HookedProcessGroupID hgid;
+  GPid pid;
+  /// Outputs taken from the job.
+  /// [element-type filename HookedProcessOutput]
+  GHashTable *outputs;
+  /// Key of the job in ResultCache, 0 if the result is not to be cached.
+  FileHash result_key;
+  /// Files read by the job. [ResultCache_FILELIST_SIGNATURE][nullable]
+  GVariant *inputs;
+  /// Outputs and their hashes. [ResultCache_FILELIST_SIGNATURE]
+  GVariant *filelist;
+};
+
+
+/**
+ * @memberof HookedProcessFinish
+ * @brief Frees a HookedProcessFinish and associated resources.
+ *
+ * @param finish a HookedProcessFinish
+ */
+static void HookedProcessFinish_free (struct HookedProcessFinish *finish) {
+  if (finish->outputs != NULL) {
+    g_hash_table_destroy(finish->outputs);
+  }
+  if (finish->inputs != NULL) {
+    g_variant_unref(finish->inputs);
+  }
+  if (finish->filelist != NULL) {
+    g_variant_unref(finish->filelist);
+  }
+  g_free(finish);
+}
+
+
+/**
+ * @memberof HookedProcess
+ * @private
+ * @brief Hands the finished job its outputs, and dispatches the exit event.
+ *
+ * Runs in the main context.
+ *
+ * @param user_data a HookedProcessFinish
+ * @return `G_SOURCE_REMOVE`
+ */
+static gboolean HookedProcess__finished (gpointer user_data) {
+  struct HookedProcessFinish *finish = (struct HookedProcessFinish *) user_data;
+
+  // the group may have gone while the outputs were stored
+  struct HookedProcessGroup *group = HookedProcessGroupManager_lookup(
+    finish->manager, finish->hgid);
+  struct HookedProcess *p = group == NULL ? NULL :
+    HookedProcessGroup_lookup(group, finish->pid);
+  if (p != NULL && p == finish->p) {
+    CRITICAL_SECTIONS_START(&p->mtx, event);
+
+    p->filelist = finish->filelist;
+    finish->filelist = NULL;
+    p->finished = true;
+    if (p->onchange_hooked != NULL) {
+      p->onchange_hooked(p, PROCESS_STATUS_EXIT);
+    }
+
+    CRITICAL_SECTIONS_END(&p->mtx, event);
+  }
+
+  HookedProcessFinish_free(finish);
+  return G_SOURCE_REMOVE;
+}
+
+
+void HookedProcess_finish_func (gpointer data, gpointer user_data) {
+  struct HookedProcessFinish *finish = (struct HookedProcessFinish *) data;
+  struct HookedProcessGroupManager *manager = finish->manager;
+  bool failed = false;
+
+  GVariantBuilder builder;
+  g_variant_builder_init(
+    &builder, G_VARIANT_TYPE(ResultCache_FILELIST_SIGNATURE));
+  GHashTableIter iter;
+  struct HookedProcessOutput *output;
+  g_hash_table_iter_init(&iter, finish->outputs);
+  while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &output)) {
+    struct MappedFile m;
+    GError *error = NULL;
+    struct CacheEntry *entry = NULL;
+    if (MappedFile_init_from_fd(&m, output->fd, &error) == 0) {
+      entry = Cache_index_buf(&manager->cache, m.content, m.length, &error);
+      MappedFile_destroy(&m);
+    }
+    should (entry != NULL) otherwise {
+      g_log(DFCC_SPAWN_NAME, G_LOG_LEVEL_WARNING,
+            "Cannot store output `%s`: %s", output->path, error->message);
+      g_error_free(error);
+      failed = true;
+      continue;
+    }
+    g_variant_builder_add(&builder, "{st}", output->path, entry->hash);
+    CacheEntry_unref(entry);
+  }
+  finish->filelist = g_variant_ref_sink(g_variant_builder_end(&builder));
+  // temporary files are not needed any more
+  g_hash_table_destroy(finish->outputs);
+  finish->outputs = NULL;
+
+  if (!failed && finish->inputs != NULL) {
+    ResultCache_store(
+      &manager->results, finish->result_key, finish->inputs,
+      finish->filelist);
+  }
+
+  g_main_context_invoke(NULL, HookedProcess__finished, finish);
+}
+
+
+/**
+ * @memberof HookedProcess
+ * @private
+ * @brief Hands outputs of the finished job to
+ *        HookedProcessGroupManager.finishers.
+ *
+ * Must be called with HookedProcess.mtx held.
+ *
+ * @param p a HookedProcess
+ */
+static void HookedProcess__finish (struct HookedProcess *p) {
+  struct HookedProcessFinish *finish = g_new(struct HookedProcessFinish, 1);
+  finish->p = p;
+  finish->manager = p->group->manager;
+  finish->hgid = p->group->hgid;
+  finish->pid = p->pid;
+  // children left behind get a table of their own
+  finish->outputs = p->outputs;
+  p->outputs = g_hash_table_new_full(
+    g_str_hash, g_str_equal, NULL, HookedProcessOutput_free);
+  finish->result_key = p->error == NULL ? p->result_key : 0;
+  // let unpinned memfds go
+  g_ptr_array_set_size(p->pins, 0);
+  finish->inputs = NULL;
+  finish->filelist = NULL;
+
+  if (finish->result_key != 0) {
+    GVariantBuilder builder;
+    g_variant_builder_init(
+      &builder, G_VARIANT_TYPE(ResultCache_FILELIST_SIGNATURE));
+    GList *paths = g_list_sort(
+      g_hash_table_get_keys(p->inputs), (GCompareFunc) strcmp);
+    for (GList *l = paths; l != NULL; l = l->next) {
+      FileHash *hash = g_hash_table_lookup(p->inputs, l->data);
+      g_variant_builder_add(&builder, "{st}", l->data, *hash);
+    }
+    g_list_free(paths);
+    finish->inputs = g_variant_ref_sink(g_variant_builder_end(&builder));
+  }
+
+  g_thread_pool_push(finish->manager->finishers, finish, NULL);
+}
+
+
 /**
  * @memberof HookedProcess
  * @brief Callback when a compiler process changes its status.
@@ -26,12 +200,14 @@ static void HookedProcess_onchange (void *p_, int status) {
   switch (status) {
     case PROCESS_STATUS_EXIT:
       p->group->manager->n_available++;
+      HookedProcess__finish(p);
+      // dispatched by HookedProcess__finished once outputs are stored
+      mask_event = true;
       break;
     case HOOKEDPROCESS_FILE_MISSING:
       break;
       // todo
     case HOOKEDPROCESS_OUTPUT: {
-      mask_event = true;
       char *path = g_strdup(p->path);
       GError *error = NULL;
       struct HookedProcessOutput *output = HookedProcessOutput_new(path, p->mode, &error);
@@ -39,6 +215,7 @@ static void HookedProcess_onchange (void *p_, int status) {
         g_log(DFCC_SPAWN_NAME, G_LOG_LEVEL_WARNING, "Cannot create output file `%s`", path);
         g_error_free(error);
         g_free(path);
+        mask_event = true;
         break;
       }
       g_hash_table_insert(p->outputs, output->path, output);
@@ -91,9 +268,92 @@ int HookedProcessOutput_init (
 }
 
 
+/**
+ * @memberof HookedProcess
+ * @private
+ * @brief Records a path read by the job as an input of the job.
+ *
+ * Must be called with HookedProcess.mtx held.
+ *
+ * @param p a HookedProcess
+ * @param path the path read
+ * @param[out] realpath path to the cache file or memfd of a remote file, or
+ *                      NULL for a local file [transfer-full][optional]
+ * @return the hash of the file, or 0 if it does not exist
+ */
+static FileHash HookedProcess__note_input (
+    struct HookedProcess *p, const char *path, char **realpath) {
+  FileHash hash = HookedProcessGroup_resolve(
+    p->group, path, realpath, realpath != NULL ? p->pins : NULL);
+  if (!g_hash_table_contains(p->inputs, path)) {
+    g_hash_table_insert(
+      p->inputs, g_strdup(path), g_memdup(&hash, sizeof(hash)));
+  }
+  return hash;
+}
+
+
+char *HookedProcess_resolve_path (
+    struct HookedProcess *p, const char *path, bool write) {
+  char *realpath = NULL;
+
+  CRITICAL_SECTIONS_START(&p->mtx, event);
+
+  struct HookedProcessOutput *output = g_hash_table_lookup(p->outputs, path);
+  if (output == NULL && write) {
+    p->path = path;
+    p->mode = 0644;
+    Process_onchange((struct Process *) p, HOOKEDPROCESS_OUTPUT);
+    output = g_hash_table_lookup(p->outputs, path);
+  }
+  if (output != NULL) {
+    // the job reads its own output
+    realpath = g_strdup(output->tmp_path);
+  } else if (!write) {
+    HookedProcess__note_input(p, path, &realpath);
+  }
+
+  CRITICAL_SECTIONS_END(&p->mtx, event);
+
+  return realpath;
+}
+
+
+void HookedProcess_note_exec (
+    struct HookedProcess *p, const char *file, bool search) {
+  CRITICAL_SECTIONS_START(&p->mtx, event);
+
+  if (!search || strchr(file, '/') != NULL) {
+    HookedProcess__note_input(p, file, NULL);
+  } else if (p->search_path != NULL) {
+    // directories before the program matter, should it appear there later
+    gchar **dirs = g_strsplit(p->search_path, ":", 0);
+    for (int i = 0; dirs[i] != NULL; i++) {
+      char *path = g_build_filename(
+        dirs[i][0] == '\0' ? "." : dirs[i], file, NULL);
+      FileHash hash = HookedProcess__note_input(p, path, NULL);
+      g_free(path);
+      // 0 for missing, 1 for directories
+      break_if(hash > 1);
+    }
+    g_strfreev(dirs);
+  }
+
+  CRITICAL_SECTIONS_END(&p->mtx, event);
+}
+
+
 void HookedProcess_destroy (struct HookedProcess *p) {
   Process_destroy((struct Process *) p);
   g_hash_table_destroy(p->outputs);
+  g_hash_table_destroy(p->inputs);
+  if (p->pins != NULL) {
+    g_ptr_array_free(p->pins, TRUE);
+  }
+  if (p->filelist != NULL) {
+    g_variant_unref(p->filelist);
+  }
+  g_free(p->search_path);
 }
 
 
@@ -135,12 +395,26 @@ int HookedProcess_init (
   p->onchange_hooked = onchange;
   p->outputs = g_hash_table_new_full(
     g_str_hash, g_str_equal, NULL, HookedProcessOutput_free);
+  p->inputs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  p->pins = g_ptr_array_new_with_free_func(
+    (GDestroyNotify) CacheMemfd_unref);
+  p->result_key = 0;
+  p->filelist = NULL;
+  p->finished = false;
+  p->search_path = g_strdup(
+    envp != NULL ? g_environ_getenv(envp, "PATH") : g_getenv("PATH"));
 
   int ret = Process_init(
-    (struct Process *) p, argv, envp_hooked, group->manager->selfpath,
+    (struct Process *) p, argv, envp_hooked, group->manager->selfpath, -1,
     HookedProcess_onchange, userdata, error);
   g_strfreev(envp_hooked);
-  return_if_fail(ret == 0) ret;
+  should (ret == 0) otherwise {
+    g_hash_table_destroy(p->outputs);
+    g_hash_table_destroy(p->inputs);
+    g_ptr_array_free(p->pins, TRUE);
+    g_free(p->search_path);
+    return ret;
+  }
 
   return ret;
 }
@@ -158,3 +432,23 @@ struct HookedProcess *HookedProcess_new (
   }
   return p;
 }
+
+
+struct HookedProcess *HookedProcess_new_finished (
+    GVariant *filelist, struct HookedProcessGroup *group) {
+  // above the maximum PID of Linux
+  static atomic_int next_id = 1 << 30;
+
+  struct HookedProcess *p = g_new0(struct HookedProcess, 1);
+  mtx_init(&p->mtx, mtx_plain);
+  p->pid = atomic_fetch_add(&next_id, 1);
+  p->stdin = -1;
+  p->stopped = true;
+  p->finished = true;
+  p->group = group;
+  p->outputs = g_hash_table_new_full(
+    g_str_hash, g_str_equal, NULL, HookedProcessOutput_free);
+  p->inputs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  p->filelist = g_variant_ref_sink(filelist);
+  return p;
+}
@@ -1,11 +1,14 @@
 #ifndef DFCC_SPAWN_HOOKED_SUBPROCESS_H
 #define DFCC_SPAWN_HOOKED_SUBPROCESS_H
 
+#include <stdbool.h>
+
 #include <glib.h>
 
 #include "file/cache.h"
 #include "file/hash.h"
 #include "file/remoteindex.h"
+#include "file/resultcache.h"
 #include "hookedprocessgroup.h"
 #include "process.h"
 
@@ -74,9 +77,61 @@ struct HookedProcess {
   GHashTable *outputs;
   const char *path;
   int mode;
+
+  /// Files read by the job and their hashes, 0 if missing.
+  /// [element-type filename FileHash]
+  GHashTable *inputs;
+  /// Memfds of Cache handed out to the job, kept open until it exits.
+  /// [element-type CacheMemfd][nullable]
+  GPtrArray *pins;
+  /// Key of the job in ResultCache, 0 if the result is not to be cached.
+  FileHash result_key;
+  /// Outputs and their hashes once the job has finished.
+  /// [ResultCache_FILELIST_SIGNATURE][nullable]
+  GVariant *filelist;
+  /// Whether outputs have been stored and HookedProcess.filelist is set.
+  bool finished;
+  /// `PATH` of the job, to find programs it runs. [nullable]
+  char *search_path;
 };
 
 
+/**
+ * @memberof HookedProcess
+ * @brief Stores outputs of a finished job into Cache, and records the job in
+ *        ResultCache, as a GThreadPool function.
+ *
+ * The job is notified in the main context.
+ *
+ * @param data outputs of the job
+ * @param user_data unused
+ */
+void HookedProcess_finish_func (gpointer data, gpointer user_data);
+
+
+/**
+ * @memberof HookedProcess
+ * @brief Resolves a path accessed by the job through hookfs, and records it as
+ *        an input or output of the job.
+ *
+ * @param p a HookedProcess
+ * @param path the path accessed
+ * @param write whether the file is opened for writing
+ * @return the path to be accessed instead, or NULL to access `path` itself
+ *         [transfer-full]
+ */
+char *HookedProcess_resolve_path (
+  struct HookedProcess *p, const char *path, bool write);
+/**
+ * @memberof HookedProcess
+ * @brief Records a program run by the job as an input of the job.
+ *
+ * @param p a HookedProcess
+ * @param file path to the program, or its name if `search` is set
+ * @param search whether to search `file` in the `PATH` of the job
+ */
+void HookedProcess_note_exec (
+  struct HookedProcess *p, const char *file, bool search);
 /**
  * @memberof HookedProcess
  * @brief Frees associated resources of a HookedProcess.
@@ -132,6 +187,20 @@ int HookedProcess_init (
 struct HookedProcess *HookedProcess_new (
   gchar **argv, gchar **envp, ProcessOnchangeCallback onchange, void *userdata,
   struct HookedProcessGroup *group, GError **error);
+/**
+ * @memberof HookedProcess
+ * @brief Create a new HookedProcess which has already finished with outputs
+ *        `filelist`, without running anything.
+ *
+ * Such a HookedProcess gets an ID out of the range of process IDs.
+ *
+ * @param filelist outputs as @ref ResultCache_FILELIST_SIGNATURE, consumed if
+ *                 floating
+ * @param group a HookedProcessGroup
+ * @return a HookedProcess [transfer-full]
+ */
+struct HookedProcess *HookedProcess_new_finished (
+  GVariant *filelist, struct HookedProcessGroup *group);
 
 
 END_C_DECLS
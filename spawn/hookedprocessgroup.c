@@ -1,4 +1,6 @@
 #include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
 
 #include <libsoup/soup.h>
 #include <glib.h>
@@ -6,7 +8,11 @@
 #include "common/macro.h"
 #include "common/atomiccount.h"
 #include "file/cache.h"
+#include "file/hashdb.h"
+#include "file/resultcache.h"
 #include "log.h"
+#include "hookedprocess.h"
+#include "process.h"
 #include "hookedprocessgroup.h"
 
 
@@ -54,6 +60,20 @@ bool HookedProcessGroup_reserve (struct HookedProcessGroup *group) {
 }
 
 
+/**
+ * @memberof HookedProcessGroup
+ * @private
+ * @brief Get the current hash of a path, as a ResultCacheResolver.
+ *
+ * Remote paths not yet in the file index are looked up locally instead, and
+ * usually resolve to 0, as if missing.
+ */
+static FileHash HookedProcessGroup__input_hash (
+    struct HookedProcessGroup *group, const char *path) {
+  return HookedProcessGroup_resolve(group, path, NULL, NULL);
+}
+
+
 struct HookedProcess *HookedProcessGroup_new_job (
     struct HookedProcessGroup *group, gchar **argv, gchar **envp,
     ProcessOnchangeCallback onchange, void *userdata, GError **error) {
@@ -70,6 +90,91 @@ struct HookedProcess *HookedProcessGroup_new_job (
 }
 
 
+FileHash HookedProcessGroup_job_key (
+    struct HookedProcessGroup *group, char * const argv[], char * const envp[],
+    const char *working_directory) {
+  // the same executable Process_init would run
+  char *compiler = strchr(argv[0], '/') != NULL ? g_strdup(argv[0]) :
+    Process_search_executable(argv[0], group->manager->selfpath, NULL);
+  FileHash key = ResultCache_key(argv, envp, working_directory, compiler);
+  g_free(compiler);
+  return key;
+}
+
+
+struct HookedProcess *HookedProcessGroup_new_cached_job (
+    struct HookedProcessGroup *group, FileHash key) {
+  return_if(key == 0) NULL;
+
+  GVariant *filelist = ResultCache_lookup(
+    &group->manager->results, key,
+    (ResultCacheResolver) HookedProcessGroup__input_hash, group);
+  return_if(filelist == NULL) NULL;
+
+  // outputs may have been evicted from the cache
+  GVariantIter iter;
+  const char *path;
+  FileHash hash;
+  for (g_variant_iter_init(&iter, filelist);
+       g_variant_iter_next(&iter, "{&st}", &path, &hash);) {
+    struct CacheEntry *entry = Cache_get(&group->manager->cache, hash, NULL);
+    should (entry != NULL) otherwise {
+      g_variant_unref(filelist);
+      return NULL;
+    }
+    CacheEntry_unref(entry);
+  }
+
+  struct HookedProcess *p = HookedProcess_new_finished(filelist, group);
+  g_log(DFCC_SPAWN_NAME, G_LOG_LEVEL_DEBUG,
+        "Job %" G_PID_FORMAT " of group %x served from result cache",
+        p->pid, group->hgid);
+  g_rw_lock_writer_lock(&group->rwlock);
+  g_hash_table_insert(group->table, &p->pid, p);
+  g_rw_lock_writer_unlock(&group->rwlock);
+  return p;
+}
+
+
+FileHash HookedProcessGroup_resolve (
+    struct HookedProcessGroup *group, const char *path, char **realpath,
+    GPtrArray *pins) {
+  struct FileTag *tag = RemoteFileIndex_get(&group->file_index, path);
+  if (tag != NULL) {
+    if (realpath != NULL) {
+      *realpath = NULL;
+      struct Cache *cache = &group->manager->cache;
+      struct CacheEntry *entry = Cache_get(cache, tag->hash, NULL);
+      if (entry != NULL) {
+        GError *error = NULL;
+        struct CacheMemfd *memfd = NULL;
+        *realpath = pins == NULL ?
+          Cache_file_path(cache, entry, &error) :
+          Cache_hot_path(cache, entry, &memfd, &error);
+        if (memfd != NULL) {
+          g_ptr_array_add(pins, memfd);
+        }
+        should (*realpath != NULL) otherwise {
+          g_log(DFCC_SPAWN_NAME, G_LOG_LEVEL_WARNING,
+                "Cannot get cache file of '%s': %s", path, error->message);
+          g_error_free(error);
+        }
+        CacheEntry_unref(entry);
+      }
+    }
+    return tag->hash;
+  }
+
+  if (realpath != NULL) {
+    *realpath = NULL;
+  }
+  return_if_not(g_file_test(path, G_FILE_TEST_EXISTS)) 0;
+  // directories are only tested for existence
+  return g_file_test(path, G_FILE_TEST_IS_DIR) ?
+    1 : HashDB_hash_file(group->manager->hashdb, path, NULL);
+}
+
+
 void HookedProcessGroup_destroy (struct HookedProcessGroup *group) {
   g_rw_lock_writer_lock(&group->rwlock);
   g_hash_table_destroy(group->table);
@@ -134,13 +239,25 @@ static struct HookedProcess *HookedProcessGroupManager_resolve (
   struct HookedProcessGroup *group = HookedProcessGroupManager_lookup(
     manager, hgid);
   return_if_fail(group != NULL) NULL;
-  return HookedProcessGroup_lookup(group, pid);
+  struct HookedProcess *p = HookedProcessGroup_lookup(group, pid);
+  return_if(p != NULL) p;
+  // children of a job, such as `cc1`, are in the process group of the job
+  GPid pgid = getpgid(pid);
+  return_if_fail(pgid > 0 && pgid != pid) NULL;
+  return HookedProcessGroup_lookup(group, pgid);
 }
 
 
 void HookedProcessGroupManager_destroy (
     struct HookedProcessGroupManager *manager) {
+  // let pending outputs reach the cache
+  g_thread_pool_free(manager->finishers, FALSE, TRUE);
   HookFsServer_destroy((struct HookFsServer *) manager);
+  if (manager->hashdb != NULL) {
+    HashDB_destroy(manager->hashdb);
+    g_free(manager->hashdb);
+  }
+  ResultCache_destroy(&manager->results);
   Cache_destroy(&manager->cache);
   g_rw_lock_writer_lock(&manager->rwlock);
   g_hash_table_destroy(manager->table);
@@ -162,6 +279,34 @@ int HookedProcessGroupManager_init (
     HookFsServer_destroy((struct HookFsServer *) manager);
     return 1;
   }
+  char *results_dir = g_build_filename(
+    cache_dir, DFCC_RESULT_CACHE_DIRNAME, NULL);
+  int results_ret = ResultCache_init(&manager->results, results_dir);
+  g_free(results_dir);
+  should (results_ret == 0) otherwise {
+    g_set_error(error, DFCC_SPAWN_ERROR, 0, "Cannot create result cache");
+    Cache_destroy(&manager->cache);
+    HookFsServer_destroy((struct HookFsServer *) manager);
+    return 1;
+  }
+
+  char *hashdb_path = g_build_filename(cache_dir, DFCC_HASHDB_FILENAME, NULL);
+  manager->hashdb = g_new(struct HashDB, 1);
+  GError *hashdb_error = NULL;
+  should (HashDB_init(
+      manager->hashdb, hashdb_path, HashDB_DEFAULT_SLOTS,
+      &hashdb_error) == 0) otherwise {
+    g_log(DFCC_SPAWN_NAME, G_LOG_LEVEL_WARNING,
+          "Cannot open hash database '%s': %s",
+          hashdb_path, hashdb_error->message);
+    g_error_free(hashdb_error);
+    g_free(manager->hashdb);
+    manager->hashdb = NULL;
+  }
+  g_free(hashdb_path);
+
+  manager->finishers = g_thread_pool_new(
+    HookedProcess_finish_func, NULL, max(jobs, 1), FALSE, NULL);
 
   manager->table = g_hash_table_new_full(
     g_int_hash, g_int_equal, NULL, HookedProcessGroup_free);
@@ -1,14 +1,21 @@
 #ifndef DFCC_SPAWN_HOOKED_SUBPROCESS_GROUP_H
 #define DFCC_SPAWN_HOOKED_SUBPROCESS_GROUP_H
 
-#include <stdatomic.h>
+#ifdef __cplusplus
+# include <atomic>
+using std::atomic_int;
+#else
+# include <stdatomic.h>
+#endif
 #include <stdbool.h>
 #include <stdint.h>
 #include <threads.h>
 
 #include <glib.h>
 
+#include "file/hashdb.h"
 #include "file/remoteindex.h"
+#include "file/resultcache.h"
 #include "_hookedprocessgroupid.h"
 #include "hookedprocess.h"
 #include "hookfsserver.h"
@@ -76,6 +83,52 @@ bool HookedProcessGroup_reserve (struct HookedProcessGroup *group);
 struct HookedProcess *HookedProcessGroup_new_job (
   struct HookedProcessGroup *group, gchar **argv, gchar **envp,
   ProcessOnchangeCallback onchange, void *userdata, GError **error);
+/**
+ * @memberof HookedProcessGroup
+ * @brief Calculates the key of a job in ResultCache, with `argv[0]` resolved
+ *        as HookedProcessGroup_new_job would.
+ *
+ * @param group a HookedProcessGroup
+ * @param argv compiler's argument vector [array zero-terminated=1]
+ * @param envp compiler's environment [array zero-terminated=1]
+ * @param working_directory compiler's working directory
+ * @return the key, or 0 if the job is not to be cached
+ */
+FileHash HookedProcessGroup_job_key (
+  struct HookedProcessGroup *group, char * const argv[], char * const envp[],
+  const char *working_directory);
+/**
+ * @memberof HookedProcessGroup
+ * @brief Creates a finished Job from ResultCache if a previous job with `key`
+ *        read the same files, and inserts the Job into `group`.
+ *
+ * Remote inputs are resolved against the file index of `group`, which is
+ * filled as the compiler fetches files or by `--prescan`. Without the latter,
+ * a job of a new session misses unless its inputs were already fetched.
+ *
+ * @param group a HookedProcessGroup
+ * @param key the key of the job in ResultCache, or 0
+ * @return Job, or NULL if not cached [transfer-none]
+ */
+struct HookedProcess *HookedProcessGroup_new_cached_job (
+  struct HookedProcessGroup *group, FileHash key);
+/**
+ * @memberof HookedProcessGroup
+ * @brief Resolves a path accessed by a job.
+ *
+ * Files of the remote client take precedence over local files.
+ *
+ * @param group a HookedProcessGroup
+ * @param path the path accessed
+ * @param[out] realpath path to the cache file of a remote file, or NULL for a
+ *                      local file [transfer-full][optional]
+ * @param pins if not `NULL`, `realpath` may be a memfd of Cache, which is
+ *             appended to `pins` to be kept open [element-type CacheMemfd]
+ * @return the hash of the file, or 0 if it does not exist
+ */
+FileHash HookedProcessGroup_resolve (
+  struct HookedProcessGroup *group, const char *path, char **realpath,
+  GPtrArray *pins);
 /**
  * @memberof HookedProcessGroup
  * @brief Frees associated resources of a HookedProcessGroup.
@@ -132,6 +185,13 @@ struct HookedProcessGroupManager {
 
   /// Source file cache.
   struct Cache cache;
+  /// Outputs of finished jobs, stored in HookedProcessGroupManager.cache.
+  struct ResultCache results;
+  /// Hashes of local files. [nullable]
+  struct HashDB *hashdb;
+  /// Workers storing outputs of finished jobs into
+  /// HookedProcessGroupManager.cache.
+  GThreadPool *finishers;
   cnd_t cond;
   mtx_t cond_mtx;
 
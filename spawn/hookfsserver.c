@@ -1,4 +1,6 @@
+#include <fcntl.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -9,6 +11,7 @@
 #include <gio/gunixsocketaddress.h>
 
 #include "common/macro.h"
+#include "common/morestring.h"
 #include "common/simplestring.h"
 #include "common/wrapper/file.h"
 #include "hookfs/limit.h"
@@ -46,6 +49,99 @@ struct HookFsServerConnection {
 };
 
 
+/**
+ * @memberof HookFsServerConnection
+ * @brief Replies a path to a hooked function which accesses a path.
+ *
+ * @param conn a HookFsServerConnection
+ * @param path the path to be accessed instead, or NULL to access the
+ *             original one
+ */
+static void HookFsServerConnection_reply_path (
+    struct HookFsServerConnection *conn, const char *path) {
+  GOutputStream *ostream =
+    g_io_stream_get_output_stream(G_IO_STREAM(conn->connection));
+  uint8_t type = MESSAGE_STRING;
+  uint64_t len = path == NULL ? 0 : strlen(path) + 1;
+  GError *error = NULL;
+  should (g_output_stream_write_all(
+      ostream, &type, sizeof(type), NULL, NULL, &error) &&
+    g_output_stream_write_all(
+      ostream, &len, sizeof(len), NULL, NULL, &error) &&
+    (len == 0 || g_output_stream_write_all(
+      ostream, path, len, NULL, NULL, &error))) otherwise {
+    g_log(DFCC_SPAWN_NAME, G_LOG_LEVEL_WARNING,
+          "Error when replying message: %s", error->message);
+    g_error_free(error);
+  }
+}
+
+
+/**
+ * @memberof HookFsServerConnection
+ * @brief Handles a call of hooked function.
+ *
+ * Functions which access a path wait for a reply, see `HOOK_PATH` in hookfs.
+ * Functions which run a program do not, and the program is recorded as an
+ * input of the job.
+ *
+ * @param conn a HookFsServerConnection
+ * @param func_name name of the hooked function
+ */
+static void HookFsServerConnection_handle (
+    struct HookFsServerConnection *conn, const char *func_name) {
+  static const char *path_funcs[] = {
+    "access", "stat", "lstat", "opendir", "open", "open64",
+    "fopen", "fopen64", "freopen", "freopen64",
+  };
+
+  static const char *exec_funcs[] = {
+    "execve", "execvp", "posix_spawn", "posix_spawnp",
+  };
+
+  // programs run by the job are inputs as well, such as `cc1` and `as`
+  for (unsigned int i = 0; i < G_N_ELEMENTS(exec_funcs); i++) {
+    continue_if(strcmp(func_name, exec_funcs[i]) != 0);
+    if (conn->p != NULL && conn->tokens->len > 1) {
+      const char *file = g_variant_get_string(conn->tokens->pdata[1], NULL);
+      // the `p` variants search `PATH`
+      bool search = func_name[strlen(func_name) - 1] == 'p';
+      HookedProcess_note_exec(conn->p, file, search);
+    }
+    return;
+  }
+
+  bool reply = false;
+  for (unsigned int i = 0; i < G_N_ELEMENTS(path_funcs); i++) {
+    if (strcmp(func_name, path_funcs[i]) == 0) {
+      reply = true;
+      break;
+    }
+  }
+  return_if_not(reply);
+
+  char *realpath = NULL;
+  if (conn->p != NULL && conn->tokens->len > 1) {
+    const char *path = g_variant_get_string(conn->tokens->pdata[1], NULL);
+    bool write = false;
+    if (conn->tokens->len > 2 &&
+        g_variant_is_of_type(conn->tokens->pdata[2], G_VARIANT_TYPE_STRING)) {
+      const char *mode = g_variant_get_string(conn->tokens->pdata[2], NULL);
+      if (strcmp(func_name, "open") == 0 ||
+          strcmp(func_name, "open64") == 0) {
+        write = (atoi(mode) & O_ACCMODE) != O_RDONLY;
+      } else if (strscmp(func_name, "fopen") == 0 ||
+                 strscmp(func_name, "freopen") == 0) {
+        write = strpbrk(mode, "wa+") != NULL;
+      }
+    }
+    realpath = HookedProcess_resolve_path(conn->p, path, write);
+  }
+  HookFsServerConnection_reply_path(conn, realpath);
+  g_free(realpath);
+}
+
+
 static void HookFsServerConnection_message_receive_cb (
     GObject *source_object, GAsyncResult *res, gpointer user_data) {
   GInputStream *istream = G_INPUT_STREAM(source_object);
@@ -102,7 +198,9 @@ static void HookFsServerConnection_message_receive_cb (
                       "Get HookFs connection from %x:%d", hgid, pid);
               }
             } else {
+              HookFsServerConnection_handle(conn, func_name);
             }
+            g_ptr_array_set_size(conn->tokens, 0);
           }
           goto read_type;
         case MESSAGE_ARRAY:
@@ -1,5 +1,7 @@
+#include <signal.h>
 #include <stdbool.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <glib.h>
 
@@ -40,6 +42,11 @@ static void Process_child_watch_cb (GPid pid, gint status, gpointer user_data) {
 }
 
 
+int Process_signal (struct Process *p, int sig) {
+  return kill(-p->pid, sig);
+}
+
+
 void Process_destroy (struct Process *p) {
   if (!p->stopped) {
     g_log(DFCC_SPAWN_NAME, G_LOG_LEVEL_WARNING,
@@ -71,15 +78,33 @@ void Process_destroy (struct Process *p) {
 /**
  * @memberof Process
  * @private
- * @brief Search for a executable in the `PATH` environment variable, with
- *        `selfpath` avoided.
+ * @brief Redirect stderr of the child.
  *
- * @param file name of the executable
- * @param selfpath path to be avoided when searching in `PATH`
- * @param[out] error a return location for a GError [optional]
- * @return the full path to the executable, or NULL
+ * @param user_data file descriptor to be stderr, or -1 to keep it
  */
-static char *Process__search_executable (
+static void Process__child_redirect (gpointer user_data) {
+  int stderr_fd = GPOINTER_TO_INT(user_data);
+  if (stderr_fd >= 0) {
+    dup2(stderr_fd, STDERR_FILENO);
+  }
+}
+
+
+/**
+ * @memberof Process
+ * @private
+ * @brief Put the child in its own process group, so that it can be signaled
+ *        together with its descendants.
+ *
+ * @param user_data as in Process__child_redirect()
+ */
+static void Process__child_setup (gpointer user_data) {
+  setpgid(0, 0);
+  Process__child_redirect(user_data);
+}
+
+
+char *Process_search_executable (
     const char *file, const char *selfpath, GError **error) {
   bool would_loop = false;
   char *ret = NULL;
@@ -130,7 +155,8 @@ static char *Process__search_executable (
 
 int Process_init (
     struct Process *p, gchar **argv, gchar **envp, const char *selfpath,
-    ProcessOnchangeCallback onchange, void *userdata, GError **error) {
+    int stderr_fd, ProcessOnchangeCallback onchange, void *userdata,
+    GError **error) {
   if (p != NULL) {
     return_if_fail(
       mtx_init_e(&p->mtx, mtx_plain, error) == thrd_success
@@ -141,7 +167,7 @@ int Process_init (
   if (selfpath != NULL && strchr(argv[0], '/') == NULL) {
     free_argv = true;
     argv = g_memdup(argv, (g_strv_length(argv) + 1) * sizeof(gchar *));
-    argv[0] = Process__search_executable(argv[0], selfpath, error);
+    argv[0] = Process_search_executable(argv[0], selfpath, error);
     should (argv[0] != NULL) otherwise {
       g_free(argv);
       if (p != NULL) {
@@ -162,7 +188,8 @@ int Process_init (
       should (g_spawn_sync(
           NULL, argv, envp_protected,
           search_path | G_SPAWN_LEAVE_DESCRIPTORS_OPEN,
-          NULL, NULL, NULL, NULL, &exit_status, error)) otherwise {
+          Process__child_redirect, GINT_TO_POINTER(stderr_fd),
+          NULL, NULL, &exit_status, error)) otherwise {
         exit_status = 255;
         break;
       }
@@ -178,7 +205,8 @@ int Process_init (
           NULL, argv, envp_protected,
           search_path | G_SPAWN_DO_NOT_REAP_CHILD |
             G_SPAWN_LEAVE_DESCRIPTORS_OPEN,
-          NULL, NULL, &p->pid, &p->stdin, NULL, NULL, error) // temp
+          Process__child_setup, GINT_TO_POINTER(stderr_fd), &p->pid,
+          &p->stdin, NULL, NULL, error) // temp
       ) otherwise {
         mtx_destroy(&p->mtx);
         exit_status = 255;
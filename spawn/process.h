@@ -63,6 +63,29 @@ inline void Process_onchange (struct Process *p, int status) {
   }
 }
 
+/**
+ * @memberof Process
+ * @brief Search for a executable in the `PATH` environment variable, with
+ *        `selfpath` avoided.
+ *
+ * @param file name of the executable
+ * @param selfpath path to be avoided when searching in `PATH`
+ * @param[out] error a return location for a GError [optional]
+ * @return the full path to the executable, or NULL [transfer-full]
+ */
+char *Process_search_executable (
+  const char *file, const char *selfpath, GError **error);
+/**
+ * @memberof Process
+ * @brief Send a signal to an asynchronous child and all its descendants.
+ *
+ * The caller should make sure the child has not stopped.
+ *
+ * @param p a Process
+ * @param sig the signal
+ * @return 0 if success, otherwize nonzero
+ */
+int Process_signal (struct Process *p, int sig);
 /**
  * @memberof Process
  * @brief Frees associated resources of a Process.
@@ -98,6 +121,8 @@ void Process_destroy (struct Process *p);
  *             [array zero-terminated=1][optional]
  * @param selfpath path to be avoided when searching `argv[0]` in `PATH`
  *                 [optional]
+ * @param stderr_fd file descriptor to be the child's stderr, or -1 to inherit
+ *                  parent's
  * @param onchange Callback when process exits [optional]
  * @param userdata User data [optional]
  * @param[out] error a return location for a GError [optional]
@@ -106,7 +131,8 @@ void Process_destroy (struct Process *p);
  */
 int Process_init (
   struct Process *p, gchar **argv, gchar **envp, const char *selfpath,
-  ProcessOnchangeCallback onchange, void *userdata, GError **error);
+  int stderr_fd, ProcessOnchangeCallback onchange, void *userdata,
+  GError **error);
 
 
 END_C_DECLS
@@ -2,6 +2,7 @@
 #include <gtest/gtest.h>
 
 #include "common/hexstring.h"
+#include "common/wrapper/zstd.h"
 
 
 TEST(Common, hexstring) {
@@ -13,3 +14,28 @@ TEST(Common, hexstring) {
   buf2hex(dst, (void *) src, sizeof(src));
   EXPECT_STREQ(dst, "11223345");
 }
+
+
+TEST(Common, zstd) {
+  char src[8192];
+  for (size_t i = 0; i < sizeof(src); i++) {
+    src[i] = "dfcc"[i % 4];
+  }
+
+  GByteArray *compressed = zstd_compress_e(src, sizeof(src), 1, NULL);
+  ASSERT_NE(compressed, nullptr);
+  EXPECT_LT(compressed->len, sizeof(src));
+
+  GByteArray *decompressed = zstd_decompress_e(
+    compressed->data, compressed->len, 0, NULL);
+  ASSERT_NE(decompressed, nullptr);
+  ASSERT_EQ(decompressed->len, sizeof(src));
+  EXPECT_EQ(memcmp(decompressed->data, src, sizeof(src)), 0);
+  g_byte_array_unref(decompressed);
+
+  EXPECT_EQ(zstd_decompress_e(
+    compressed->data, compressed->len, sizeof(src) / 2, NULL), nullptr);
+  EXPECT_EQ(zstd_decompress_e(
+    compressed->data, compressed->len / 2, 0, NULL), nullptr);
+  g_byte_array_unref(compressed);
+}
@@ -1,7 +1,10 @@
 #include <cstdio>
 #include <fstream>
+#include <iterator>
 #include <memory>
 #include <filesystem>
+#include <string>
+#include <vector>
 
 #include <gtest/gtest.h>
 
@@ -36,6 +39,49 @@ TEST(FileHash, buf) {
   EXPECT_EQ(hash, hash_);
 }
 
+TEST(FileHash, algorithm) {
+  defer(FileHash_algorithm = FileHash_XXH64);
+  EXPECT_NE(FileHash_set_algorithm("none"), 0);
+
+  for (int i = 0; i < FileHash_N_ALGORITHMS; i++) {
+    ASSERT_EQ(FileHash_set_algorithm(FileHash_algorithm_names[i]), 0);
+    FileHash hash = FileHash_from_buf(testdata, strlen(testdata));
+
+    struct FileHashState *state = FileHashState_new();
+    size_t half = strlen(testdata) / 2;
+    FileHashState_update(state, testdata, half);
+    FileHashState_update(state, testdata + half, strlen(testdata) - half);
+    EXPECT_EQ(FileHashState_digest(state), hash);
+    FileHashState_free(state);
+  }
+}
+
+// run with --gtest_also_run_disabled_tests
+TEST(FileHash, DISABLED_bench) {
+  defer(FileHash_algorithm = FileHash_XXH64);
+  const size_t sizes[] = {256, 4 << 10, 64 << 10, 1 << 20, 16 << 20};
+  std::string buf(sizes[G_N_ELEMENTS(sizes) - 1], '\0');
+  for (size_t i = 0; i < buf.size(); i++) {
+    buf[i] = testdata[i % strlen(testdata)] ^ (i >> 8);
+  }
+
+  for (int i = 0; i < FileHash_N_ALGORITHMS; i++) {
+    FileHash_algorithm = (enum FileHashAlgorithm) i;
+    for (size_t size : sizes) {
+      // hash about 1 GiB in total
+      size_t rounds = ((size_t) 1 << 30) / size;
+      volatile FileHash sink = 0;
+      gint64 start = g_get_monotonic_time();
+      for (size_t j = 0; j < rounds; j++) {
+        sink = sink ^ FileHash_from_buf(buf.data(), size);
+      }
+      gint64 elapsed = g_get_monotonic_time() - start + 1;
+      printf("%-6s %10zu B %10.1f MiB/s\n", FileHash_algorithm_names[i], size,
+             (double) size * rounds / elapsed * 1e6 / (1 << 20));
+    }
+  }
+}
+
 
 #include "file/localindex.h"
 #include "file/entry.h"
@@ -83,3 +129,411 @@ TEST(Cache, cache) {
   EXPECT_EQ(entry, entry_);
   CacheEntry_unref(entry);
 }
+
+TEST(Cache, writer) {
+  const char cache_dir[] = "data/cache";
+
+  struct Cache cache;
+  ASSERT_EQ(Cache_init(&cache, cache_dir, false), 0);
+  defer(std::filesystem::remove_all(cache_dir));
+  defer(Cache_destroy(&cache));
+
+  GError *error = NULL;
+  struct CacheWriter writer;
+  ASSERT_EQ(CacheWriter_init(&writer, &cache, &error), 0) << error->message;
+  defer(CacheWriter_destroy(&writer));
+  size_t half = strlen(testdata) / 2;
+  ASSERT_EQ(CacheWriter_write(&writer, testdata, half, &error), 0);
+  ASSERT_EQ(CacheWriter_write(
+    &writer, testdata + half, strlen(testdata) - half, &error), 0);
+  EXPECT_EQ(writer.size, strlen(testdata));
+
+  // the temporary file may have no name
+  std::string tmppath = writer.tmppath != NULL ? writer.tmppath : "";
+  struct CacheEntry *entry = CacheWriter_commit(&writer, &error);
+  ASSERT_NE(entry, nullptr) << (error ? error->message : "");
+  EXPECT_EQ(entry->__anon.__anon.hash, testdata_hash);
+  EXPECT_STREQ(entry->__anon.__anon.path, "9/9/4/99434ED1D2F22B2A");
+  EXPECT_TRUE(tmppath.empty() || !std::filesystem::exists(tmppath));
+
+  std::ifstream fs(std::string(cache_dir) + "/9/9/4/99434ED1D2F22B2A");
+  std::string content(
+    (std::istreambuf_iterator<char>(fs)), std::istreambuf_iterator<char>());
+  EXPECT_EQ(content, testdata);
+}
+
+TEST(Cache, scrub) {
+  const char cache_dir[] = "data/cache";
+
+  struct Cache cache;
+  ASSERT_EQ(Cache_init(&cache, cache_dir, false), 0);
+  defer(std::filesystem::remove_all(cache_dir));
+  defer(Cache_destroy(&cache));
+
+  GError *error = NULL;
+  struct CacheEntry *entry = Cache_index_buf(&cache, testdata, strlen(testdata), &error);
+  ASSERT_NE(entry, nullptr) << (error ? error->message : "");
+  CacheEntry_ref(entry);
+  defer(CacheEntry_unref(entry));
+
+  // fresh entries are left alone
+  EXPECT_EQ(Cache_scrub(&cache, 1 << 20), 0);
+
+  // corrupt the file in place
+  std::string path = std::string(cache_dir) + "/9/9/4/99434ED1D2F22B2A";
+  {
+    std::fstream fs(path, std::ios::in | std::ios::out | std::ios::binary);
+    fs.put('X');
+  }
+  entry->scrubbed = 0;
+  EXPECT_EQ(Cache_scrub(&cache, 1 << 20), strlen(testdata));
+  EXPECT_TRUE(entry->invalid);
+  EXPECT_FALSE(std::filesystem::exists(path));
+  EXPECT_EQ(Cache_try_get(&cache, testdata_hash), nullptr);
+}
+
+TEST(Cache, journal) {
+  const char cache_dir[] = "data/cache";
+  defer(std::filesystem::remove_all(cache_dir));
+
+  {
+    struct Cache cache;
+    ASSERT_EQ(Cache_init(&cache, cache_dir, false), 0);
+    defer(Cache_destroy(&cache));
+    GError *error = NULL;
+    ASSERT_EQ(Cache_open_journal(&cache, &error), 0) << error->message;
+    ASSERT_NE(Cache_index_buf(&cache, testdata, strlen(testdata), &error), nullptr);
+  }
+
+  // a torn record is discarded
+  std::string path = std::string(cache_dir) + "/.journal";
+  {
+    std::ofstream fs(path, std::ios::app | std::ios::binary);
+    fs.write("torn", 4);
+  }
+
+  struct Cache cache;
+  ASSERT_EQ(Cache_init(&cache, cache_dir, false), 0);
+  defer(Cache_destroy(&cache));
+  GError *error = NULL;
+  ASSERT_EQ(Cache_open_journal(&cache, &error), 0) << error->message;
+  EXPECT_EQ(cache.journal->n_records, 1u);
+  struct CacheEntry *entry = Cache_try_get(&cache, testdata_hash);
+  ASSERT_NE(entry, nullptr);
+  EXPECT_STREQ(entry->__anon.__anon.path, "9/9/4/99434ED1D2F22B2A");
+  CacheEntry_unref(entry);
+
+  // nothing to compact yet
+  EXPECT_EQ(Cache_compact_journal(&cache, &error), 0);
+  EXPECT_EQ(cache.journal->n_records, 1u);
+}
+
+TEST(Cache, evict) {
+  const char cache_dir[] = "data/cache";
+
+  struct Cache cache;
+  ASSERT_EQ(Cache_init(&cache, cache_dir, false), 0);
+  defer(std::filesystem::remove_all(cache_dir));
+  defer(Cache_destroy(&cache));
+
+  // distinct blobs of the same size
+  const unsigned int n_blobs = 20;
+  const size_t size = strlen(testdata) + 2;
+  struct CacheEntry *entries[n_blobs];
+  GError *error = NULL;
+  gint now = g_get_monotonic_time() / G_TIME_SPAN_SECOND;
+  for (unsigned int i = 0; i < n_blobs; i++) {
+    char suffix[3];
+    snprintf(suffix, sizeof(suffix), "%02u", i);
+    std::string blob = std::string(testdata) + suffix;
+    entries[i] = Cache_index_buf(&cache, blob.data(), blob.size(), &error);
+    ASSERT_NE(entries[i], nullptr) << (error ? error->message : "");
+    // long unused
+    entries[i]->accessed = now - Cache_EVICT_MIN_AGE;
+  }
+  defer(for (unsigned int i = 0; i < n_blobs; i++) {
+    CacheEntry_unref(entries[i]);
+  });
+  EXPECT_EQ(cache.n_files, n_blobs);
+  EXPECT_EQ(cache.total_size, n_blobs * size);
+
+  // under quota
+  EXPECT_EQ(Cache_evict(&cache, n_blobs * size, n_blobs), 0u);
+
+  // popular entries, and entries in use, stay
+  for (int i = 0; i < 8; i++) {
+    CountMinSketch_add(&cache.sketch, entries[0]->__anon.__anon.hash);
+  }
+  entries[1]->accessed = now;
+  EXPECT_EQ(Cache_evict(&cache, 0, 10), 11u);
+  EXPECT_EQ(cache.n_files, 9u);
+  EXPECT_EQ(cache.total_size, 9 * size);
+  EXPECT_FALSE(entries[0]->invalid);
+  EXPECT_FALSE(entries[1]->invalid);
+  unsigned int n_evicted = 0;
+  for (unsigned int i = 0; i < n_blobs; i++) {
+    n_evicted += entries[i]->invalid;
+  }
+  EXPECT_EQ(n_evicted, 11u);
+}
+
+
+TEST(CachePack, pack) {
+  const char pack_dir[] = "data/pack";
+  defer(std::filesystem::remove_all(pack_dir));
+  FileHash other_hash = FileHash_from_buf(testdata, 10);
+
+  {
+    struct CachePack pack;
+    GError *error = NULL;
+    ASSERT_EQ(CachePack_init(&pack, pack_dir, &error), 0) << error->message;
+    defer(CachePack_destroy(&pack));
+    ASSERT_EQ(CachePack_put(&pack, testdata_hash, testdata, strlen(testdata), &error), 0);
+    ASSERT_EQ(CachePack_put(&pack, other_hash, testdata, 10, &error), 0);
+
+    GBytes *bytes = CachePack_get(&pack, testdata_hash, &error);
+    ASSERT_NE(bytes, nullptr);
+    gsize size;
+    const char *data = (const char *) g_bytes_get_data(bytes, &size);
+    EXPECT_EQ(std::string(data, size), testdata);
+    g_bytes_unref(bytes);
+
+    EXPECT_TRUE(CachePack_remove(&pack, other_hash));
+    EXPECT_FALSE(CachePack_lookup(&pack, other_hash, nullptr));
+  }
+
+  // removals survive reopening
+  struct CachePack pack;
+  GError *error = NULL;
+  ASSERT_EQ(CachePack_init(&pack, pack_dir, &error), 0) << error->message;
+  defer(CachePack_destroy(&pack));
+  size_t size;
+  EXPECT_TRUE(CachePack_lookup(&pack, testdata_hash, &size));
+  EXPECT_EQ(size, strlen(testdata));
+  EXPECT_FALSE(CachePack_lookup(&pack, other_hash, nullptr));
+  // the only segment is still active
+  EXPECT_EQ(CachePack_compact(&pack, &error), 0);
+}
+
+
+TEST(CachePack, compact) {
+  const char pack_dir[] = "data/pack";
+  defer(std::filesystem::remove_all(pack_dir));
+  const size_t blob_size = 4 << 20;
+  const unsigned n_sealed = CachePack_SEGMENT_SIZE / blob_size;
+  const unsigned n_removed = n_sealed - 3;
+  std::vector<std::string> blobs;
+  std::vector<FileHash> hashes;
+  for (unsigned i = 0; i <= n_sealed; i++) {
+    blobs.emplace_back(blob_size, (char) ('a' + i));
+    hashes.push_back(FileHash_from_buf(blobs[i].data(), blob_size));
+  }
+
+  {
+    struct CachePack pack;
+    GError *error = NULL;
+    ASSERT_EQ(CachePack_init(&pack, pack_dir, &error), 0) << error->message;
+    defer(CachePack_destroy(&pack));
+    // the last blob starts a new segment, sealing the first one
+    for (unsigned i = 0; i <= n_sealed; i++) {
+      ASSERT_EQ(CachePack_put(
+        &pack, hashes[i], blobs[i].data(), blob_size, &error), 0);
+    }
+    for (unsigned i = 0; i < n_removed; i++) {
+      EXPECT_TRUE(CachePack_remove(&pack, hashes[i]));
+    }
+    EXPECT_GT(CachePack_compact(&pack, &error), 0);
+    // nothing left to compact
+    EXPECT_EQ(CachePack_compact(&pack, &error), 0);
+  }
+
+  // both copies and removals survive reopening
+  struct CachePack pack;
+  GError *error = NULL;
+  ASSERT_EQ(CachePack_init(&pack, pack_dir, &error), 0) << error->message;
+  defer(CachePack_destroy(&pack));
+  for (unsigned i = 0; i < n_removed; i++) {
+    EXPECT_FALSE(CachePack_lookup(&pack, hashes[i], nullptr));
+  }
+  for (unsigned i = n_removed; i <= n_sealed; i++) {
+    GBytes *bytes = CachePack_get(&pack, hashes[i], &error);
+    ASSERT_NE(bytes, nullptr);
+    gsize size;
+    const char *data = (const char *) g_bytes_get_data(bytes, &size);
+    EXPECT_EQ(std::string(data, size), blobs[i]);
+    g_bytes_unref(bytes);
+  }
+}
+
+
+
+#include "file/sketch.h"
+
+TEST(CountMinSketch, sketch) {
+  struct CountMinSketch sketch;
+  ASSERT_EQ(CountMinSketch_init(&sketch, 1000), 0);
+  defer(CountMinSketch_destroy(&sketch));
+  EXPECT_EQ(sketch.width, 1024u);
+
+  for (int i = 0; i < 5; i++) {
+    CountMinSketch_add(&sketch, testdata_hash);
+  }
+  CountMinSketch_add(&sketch, testdata_hash + 1);
+  EXPECT_EQ(CountMinSketch_estimate(&sketch, testdata_hash), 5u);
+  EXPECT_EQ(CountMinSketch_estimate(&sketch, testdata_hash + 1), 1u);
+  EXPECT_EQ(CountMinSketch_estimate(&sketch, testdata_hash + 2), 0u);
+
+  for (int i = 0; i < 100; i++) {
+    CountMinSketch_add(&sketch, testdata_hash);
+  }
+  EXPECT_EQ(CountMinSketch_estimate(&sketch, testdata_hash),
+            (unsigned) CountMinSketch_MAX);
+
+  // popularity fades
+  for (unsigned int i = 0; i < 10 * sketch.width; i++) {
+    CountMinSketch_add(&sketch, (FileHash) i << 32);
+  }
+  EXPECT_LT(CountMinSketch_estimate(&sketch, testdata_hash),
+            (unsigned) CountMinSketch_MAX);
+}
+
+
+#include "file/hashdb.h"
+
+TEST(HashDB, hashdb) {
+  const char db_path[] = "data/hashdb";
+  const char path[] = "data/sample-hashdb";
+
+  struct HashDB db;
+  GError *error = NULL;
+  ASSERT_EQ(HashDB_init(&db, db_path, 100, &error), 0) << error->message;
+  defer(remove(db_path));
+  EXPECT_EQ(db.n_slots, 128u);
+
+  struct HashDBKey key = {1, 2, 3, 4, 5};
+  EXPECT_EQ(HashDB_lookup(&db, &key), 0ull);
+  HashDB_store(&db, &key, testdata_hash);
+  EXPECT_EQ(HashDB_lookup(&db, &key), testdata_hash);
+  HashDB_destroy(&db);
+
+  // persistent across mappings
+  ASSERT_EQ(HashDB_init(&db, db_path, 1, &error), 0) << error->message;
+  defer(HashDB_destroy(&db));
+  EXPECT_EQ(db.n_slots, 128u);
+  EXPECT_EQ(HashDB_lookup(&db, &key), testdata_hash);
+  key.mtime_ns++;
+  EXPECT_EQ(HashDB_lookup(&db, &key), 0ull);
+
+  std::ofstream ofs(path);
+  ofs << testdata;
+  ofs.close();
+  defer(remove(path));
+
+  EXPECT_EQ(HashDB_hash_file(&db, path, &error), testdata_hash);
+  EXPECT_EQ(HashDB_hash_file(nullptr, path, &error), testdata_hash);
+}
+
+
+TEST(HashDB, recreate_while_mapped) {
+  const char db_path[] = "data/hashdb-recreate";
+
+  struct HashDB db;
+  GError *error = NULL;
+  ASSERT_EQ(HashDB_init(&db, db_path, 16, &error), 0) << error->message;
+  defer(remove(db_path));
+  defer(HashDB_destroy(&db));
+  struct HashDBKey key = {1, 2, 3, 4, 5};
+  HashDB_store(&db, &key, testdata_hash);
+
+  // as seen by a client with another layout
+  FILE *f = fopen(db_path, "r+");
+  ASSERT_NE(f, nullptr);
+  fputs("BROKEN!!", f);
+  fclose(f);
+
+  struct HashDB db2;
+  ASSERT_EQ(HashDB_init(&db2, db_path, 16, &error), 0) << error->message;
+  defer(HashDB_destroy(&db2));
+  EXPECT_EQ(HashDB_lookup(&db2, &key), 0ull);
+  // the old mapping is still backed by the old file
+  EXPECT_EQ(HashDB_lookup(&db, &key), testdata_hash);
+}
+
+
+#include "file/resultcache.h"
+
+static FileHash resolve_from_table (void *table, const char *path) {
+  gpointer hash = g_hash_table_lookup((GHashTable *) table, path);
+  return hash == NULL ? 0 : *(FileHash *) hash;
+}
+
+TEST(ResultCache, resultcache) {
+  const char results_dir[] = "data/results";
+  const char compiler[] = "data/cc";
+  const char *argv[] = {"cc", "-c", "a.c", NULL};
+  const char *envp[] = {"PATH=/bin", "LANG=C", NULL};
+  const char *envp_other[] = {"PATH=/usr/bin", "LANG=C", NULL};
+  const char *envp_lang[] = {"PATH=/bin", "LANG=en_US.UTF-8", NULL};
+  std::ofstream ofs(compiler);
+  ofs << testdata;
+  ofs.close();
+  defer(remove(compiler));
+
+  FileHash key = ResultCache_key(
+    (char * const *) argv, (char * const *) envp, "/src", compiler);
+  EXPECT_NE(key, 0);
+  EXPECT_NE(key, ResultCache_key(
+    (char * const *) argv, (char * const *) envp, "/src2", compiler));
+  // only relevant variables count
+  EXPECT_EQ(key, ResultCache_key(
+    (char * const *) argv, (char * const *) envp_other, "/src", compiler));
+  EXPECT_NE(key, ResultCache_key(
+    (char * const *) argv, (char * const *) envp_lang, "/src", compiler));
+  // an upgraded compiler is another job
+  {
+    std::ofstream fs(compiler, std::ios::app);
+    fs << testdata;
+  }
+  FileHash key_upgraded = ResultCache_key(
+    (char * const *) argv, (char * const *) envp, "/src", compiler);
+  EXPECT_NE(key, key_upgraded);
+  key = key_upgraded;
+  // an unknown compiler is not cached
+  EXPECT_EQ(ResultCache_key(
+    (char * const *) argv, (char * const *) envp, "/src", "data/nocc"), 0);
+
+  struct ResultCache cache;
+  ASSERT_EQ(ResultCache_init(&cache, results_dir), 0);
+  defer(std::filesystem::remove_all(results_dir));
+
+  FileHash header_hash = 42;
+  FileHash header_hash_new = 43;
+  GHashTable *files = g_hash_table_new(g_str_hash, g_str_equal);
+  defer(g_hash_table_destroy(files));
+  g_hash_table_insert(files, (gpointer) "/src/a.h", &header_hash);
+  EXPECT_EQ(ResultCache_lookup(&cache, key, resolve_from_table, files), nullptr);
+
+  ResultCache_store(
+    &cache, key,
+    g_variant_new_parsed("{'/src/a.h': uint64 42, '/src/b.h': uint64 0}"),
+    g_variant_new_parsed("{'a.o': uint64 %t}", testdata_hash));
+  ResultCache_destroy(&cache);
+
+  // persistent across instances
+  ASSERT_EQ(ResultCache_init(&cache, results_dir), 0);
+  defer(ResultCache_destroy(&cache));
+  GVariant *outputs = ResultCache_lookup(
+    &cache, key, resolve_from_table, files);
+  ASSERT_NE(outputs, nullptr);
+  FileHash object_hash = 0;
+  EXPECT_TRUE(g_variant_lookup(outputs, "a.o", "t", &object_hash));
+  EXPECT_EQ(object_hash, testdata_hash);
+  g_variant_unref(outputs);
+
+  // a changed header, or a header appearing, is a miss
+  g_hash_table_insert(files, (gpointer) "/src/a.h", &header_hash_new);
+  EXPECT_EQ(ResultCache_lookup(&cache, key, resolve_from_table, files), nullptr);
+  g_hash_table_insert(files, (gpointer) "/src/a.h", &header_hash);
+  g_hash_table_insert(files, (gpointer) "/src/b.h", &header_hash);
+  EXPECT_EQ(ResultCache_lookup(&cache, key, resolve_from_table, files), nullptr);
+}
@@ -0,0 +1,116 @@
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#define DEFER_1(x, y) x##y
+#define DEFER_2(x, y) DEFER_1(x, y)
+#define DEFER_3(x)    DEFER_2(x, __COUNTER__)
+#define defer(code)   std::shared_ptr<void> DEFER_3(_defer_)(nullptr, [&](...){code;})
+
+
+#include "common/macro.h"
+#include "file/cache.h"
+#include "file/entry.h"
+#include "spawn/hookedprocessgroup.h"
+
+TEST(HookedProcessGroup, resolve_packed) {
+  const char cache_dir[] = "data/cache";
+  const char data[] = "#define PACKED 1\n";
+  const char path[] = "/nonexistent/packed.h";
+
+  struct HookedProcessGroupManager manager = {};
+  ASSERT_EQ(Cache_init(&manager.cache, cache_dir, false), 0);
+  defer(std::filesystem::remove_all(cache_dir));
+  defer(Cache_destroy(&manager.cache));
+  GError *error = NULL;
+  ASSERT_EQ(Cache_open_pack(&manager.cache, 1 << 10, &error), 0) << error->message;
+
+  struct CacheEntry *entry = Cache_index_buf(&manager.cache, data, strlen(data), &error);
+  ASSERT_NE(entry, nullptr) << (error ? error->message : "");
+  EXPECT_TRUE(entry->packed);
+  FileHash hash = entry->__anon.__anon.hash;
+  CacheEntry_unref(entry);
+
+  struct HookedProcessGroup group;
+  ASSERT_EQ(HookedProcessGroup_init(&group, 1, &manager), 0);
+  defer(HookedProcessGroup_destroy(&group));
+  struct FileTag *tag = g_new(struct FileTag, 1);
+  FileTag_init_with_hash(tag, g_strdup(path), hash);
+  RemoteFileIndex_add(&group.file_index, tag, false);
+
+  // the compiler gets a real file with the content
+  char *realpath;
+  EXPECT_EQ(HookedProcessGroup_resolve(&group, path, &realpath, NULL), hash);
+  ASSERT_NE(realpath, nullptr);
+  defer(g_free(realpath));
+  std::ifstream file(realpath);
+  std::string content(
+    (std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  EXPECT_EQ(content, data);
+
+  // and the blob is no longer packed
+  entry = Cache_get(&manager.cache, hash, &error);
+  ASSERT_NE(entry, nullptr);
+  EXPECT_FALSE(entry->packed);
+  CacheEntry_unref(entry);
+}
+
+TEST(HookedProcessGroup, resolve_hot) {
+  const char cache_dir[] = "data/cache";
+  const char data[] = "#define HOT 1\n";
+  const char path[] = "/nonexistent/hot.h";
+
+  struct HookedProcessGroupManager manager = {};
+  ASSERT_EQ(Cache_init(&manager.cache, cache_dir, false), 0);
+  defer(std::filesystem::remove_all(cache_dir));
+  defer(Cache_destroy(&manager.cache));
+  manager.cache.hot_budget = 1 << 20;
+
+  GError *error = NULL;
+  struct CacheEntry *entry = Cache_index_buf(&manager.cache, data, strlen(data), &error);
+  ASSERT_NE(entry, nullptr) << (error ? error->message : "");
+  FileHash hash = entry->__anon.__anon.hash;
+  CacheEntry_unref(entry);
+  for (int i = 0; i < Cache_HOT_MIN_FREQUENCY; i++) {
+    CacheEntry_unref(Cache_try_get(&manager.cache, hash));
+  }
+
+  struct HookedProcessGroup group;
+  ASSERT_EQ(HookedProcessGroup_init(&group, 1, &manager), 0);
+  defer(HookedProcessGroup_destroy(&group));
+  struct FileTag *tag = g_new(struct FileTag, 1);
+  FileTag_init_with_hash(tag, g_strdup(path), hash);
+  RemoteFileIndex_add(&group.file_index, tag, false);
+
+  GPtrArray *pins = g_ptr_array_new_with_free_func((GDestroyNotify) CacheMemfd_unref);
+  defer(g_ptr_array_free(pins, TRUE));
+  for (int i = 0; i < 2; i++) {
+    // the first time pins the content, the second time finds it pinned
+    char *realpath;
+    EXPECT_EQ(HookedProcessGroup_resolve(&group, path, &realpath, pins), hash);
+    ASSERT_NE(realpath, nullptr);
+    EXPECT_TRUE(g_str_has_prefix(realpath, "/proc/"));
+    std::ifstream file(realpath);
+    g_free(realpath);
+    std::string content(
+      (std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(content, data);
+  }
+  EXPECT_EQ(pins->len, 2u);
+  EXPECT_EQ(manager.cache.hot_misses, 1u);
+  EXPECT_EQ(manager.cache.hot_hits, 1u);
+  EXPECT_EQ(manager.cache.hot_size, strlen(data));
+
+  // no longer fits, but stays open for the job
+  manager.cache.hot_budget = 1;
+  EXPECT_EQ(Cache_rebalance_hot(&manager.cache), 1u);
+  EXPECT_EQ(manager.cache.hot_size, 0u);
+  struct CacheMemfd *memfd = (struct CacheMemfd *) g_ptr_array_index(pins, 0);
+  EXPECT_EQ(fcntl(memfd->fd, F_GETFD), FD_CLOEXEC);
+}
@@ -13,5 +13,21 @@
 
 #define HOOKFS_SOCKET_PATH "/hookfs/" DFCC_NAME
 
+#define DFCC_AGENT_SOCKET_FILENAME "agent.sock"
+
+#define DFCC_HASHDB_FILENAME "hashdb"
+
+#define DFCC_SERVER_LOAD_FILENAME "servers"
+
+#define DFCC_JOB_TIMES_FILENAME "jobtimes"
+
+#define DFCC_LOCAL_SLOT_FILENAME "local"
+
+#define DFCC_RESULT_CACHE_DIRNAME "results"
+
+#define DFCC_CACHE_JOURNAL_FILENAME ".journal"
+
+#define DFCC_CACHE_PACK_DIRNAME ".pack"
+
 
 #endif /* DFCC_VERSION_H */